@@ -106,6 +106,15 @@ std::map<AsmOpCode, std::string> asmOpCodeToString {
     {AsmOpCode::popb   ,"popb"},
     {AsmOpCode::cmpb   ,"cmpb"},
 
+
+    {AsmOpCode::movsd     ,"movsd"},
+    {AsmOpCode::addsd     ,"addsd"},
+    {AsmOpCode::subsd     ,"subsd"},
+    {AsmOpCode::mulsd     ,"mulsd"},
+    {AsmOpCode::divsd     ,"divsd"},
+    {AsmOpCode::cvtsi2sdl ,"cvtsi2sdl"},
+    {AsmOpCode::cvttsd2si ,"cvttsd2si"},
+
     //伪指令
     {AsmOpCode::declVar   ,"declVar"},
     {AsmOpCode::reload   ,"reload"},
@@ -119,6 +128,7 @@ std::map<OprandKind, std::string> oprandKindToString {
     {OprandKind::bb         ,    "bb"},
     {OprandKind::function   ,    "function"},
     {OprandKind::stringConst,    "stringConst"},
+    {OprandKind::doubleConst,    "doubleConst"},
 
     {OprandKind::regist     ,    "regist"},
     {OprandKind::memory     ,    "memory"},
@@ -252,6 +262,31 @@ std::vector<std::shared_ptr<Oprand>> Register::callerProtected64 {
 
 };
 
+//可供分配给临时变量的xmm寄存器，避开用于传参的xmm0-xmm7
+std::vector<std::shared_ptr<Oprand>> Register::registersXmm {
+        Register::xmm8(),
+        Register::xmm9(),
+        Register::xmm10(),
+        Register::xmm11(),
+        Register::xmm12(),
+        Register::xmm13(),
+        Register::xmm14(),
+        Register::xmm15(),
+
+};
+
+std::vector<std::shared_ptr<Oprand>> Register::paramRegistersXmm {
+        Register::xmm0(),
+        Register::xmm1(),
+        Register::xmm2(),
+        Register::xmm3(),
+        Register::xmm4(),
+        Register::xmm5(),
+        Register::xmm6(),
+        Register::xmm7(),
+
+};
+
 
 std::string compileToAsm(AstNode& node, bool verbose){
 
@@ -25,6 +25,8 @@
 #include <mutex>
 #include <optional>
 #include <climits>
+#include <cstring>
+#include <cstdio>
 
 /**
  * 指令的编码
@@ -134,6 +136,15 @@ enum class AsmOpCode{
     popb,
     cmpb,
 
+    //双精度浮点数指令（SSE）
+    movsd=200,
+    addsd,
+    subsd,
+    mulsd,
+    divsd,
+    cvtsi2sdl,  //把32位整数转换成双精度浮点数
+    cvttsd2si,  //把双精度浮点数截断成32位整数
+
     //伪指令
     declVar,   //变量声明
     reload,    //重新装载被溢出到内存的变量到寄存器
@@ -149,6 +160,7 @@ enum class OprandKind{
     bb,             //跳转指令指向的基本块
     function,       //函数调用
     stringConst,    //字符串常量
+    doubleConst,    //双精度浮点数常量，存放在常量区
 
     //抽象度较低的操作数
     regist,       //物理寄存器
@@ -205,6 +217,10 @@ public:
         else if (this->kind == OprandKind::varIndex){
                 return "var" + value2String();
         }
+        else if (this->kind == OprandKind::doubleConst){
+                //采用rip相对寻址访问常量区
+                return "LCPI_" + value2String() + "(%rip)";
+        }
         else{
             return ::toString(this->kind) + "(" + value2String() + ")";
         }
@@ -298,7 +314,9 @@ public:
 class FunctionOprand: public Oprand{
 public:
     std::vector<std::shared_ptr<Oprand>> args;
+    std::vector<bool> decimalArgs;  //每个参数是否通过xmm寄存器传递
     std::shared_ptr<Type> returnType;
+    bool isTailCall {false};        //尾调用，Lower的时候可能变成jmp
     FunctionOprand(const std::string& funtionName, std::vector<std::shared_ptr<Oprand>>& args, std::shared_ptr<Type> returnType):
         Oprand(OprandKind::function, funtionName), args(args), returnType(returnType) {
     }
@@ -369,11 +387,35 @@ public:
     //字符串常量
     std::vector<std::string> stringConsts;
 
+    //双精度浮点数常量
+    std::vector<double> doubleConsts;
+
+    //每个函数中值为浮点数的变量（包括参数、本地变量和临时变量）
+    std::map<std::string, std::set<uint32_t>> decimalVars;
+
+    //返回值为浮点数的函数
+    std::set<std::string> decimalFunctions;
+
     /**
      * 输出代表该模块的asm文件的字符串。
      */
     std::string toString(){
-        std::string str = "    .section	__TEXT,__text,regular,pure_instructions\n";  //伪指令：一个文本的section
+        std::string str;
+        //浮点数常量放在8字节对齐的常量区
+        if (!this->doubleConsts.empty()){
+            str += "    .section	__TEXT,__literal8,8byte_literals\n";
+            str += "    .p2align	3\n";
+            for (uint32_t i = 0; i < this->doubleConsts.size(); i++){
+                uint64_t bits;
+                std::memcpy(&bits, &this->doubleConsts[i], sizeof(bits));
+                char buf[32];
+                std::snprintf(buf, sizeof(buf), "0x%016llx", static_cast<unsigned long long>(bits));
+                str += "LCPI_" + std::to_string(i) + ":\n";
+                str += "    .quad	" + std::string(buf) + "\t\t## double " + ValueToString(this->doubleConsts[i]) + "\n";
+            }
+            str += "\n";
+        }
+        str += "    .section	__TEXT,__text,regular,pure_instructions\n";  //伪指令：一个文本的section
         for (auto& item: this->fun2Code){
             auto funName = "_" + item.first;
             str += ("\n    .global " + funName + "\n");  //添加伪指令
@@ -402,6 +444,9 @@ struct TempStates{
     //下一个临时变量的下标
     uint32_t nextTempVarIndex {0};
 
+    //值为浮点数的变量的下标，Lower时分配xmm寄存器或8字节的栈空间
+    std::set<uint32_t> decimalVars;
+
 
     //每个表达式节点对应的临时变量的索引
     // tempVarMap:Map<Expression, number> = new Map();
@@ -425,12 +470,16 @@ public:
     //用来存放返回值的位置
     std::shared_ptr<Oprand> returnSlot;
 
+    //用来存放浮点数返回值的位置，Lower成xmm0
+    std::shared_ptr<Oprand> decimalReturnSlot;
+
     //一些状态变量
     std::shared_ptr<TempStates> s;
 
     AsmGenerator() {
         this->asmModule = std::make_shared<AsmModule>();
         this->returnSlot = std::make_shared<Oprand>(OprandKind::returnSlot, -1);
+        this->decimalReturnSlot = std::make_shared<Oprand>(OprandKind::returnSlot, -1, "decimal");
         this->s = std::make_shared<TempStates>();
     }
 
@@ -448,9 +497,12 @@ public:
         return std::any_cast<std::shared_ptr<Oprand>>(val);
     }
 
-    std::shared_ptr<Oprand> allocateTempVar() {
+    std::shared_ptr<Oprand> allocateTempVar(bool decimal = false) {
         uint32_t varIndex = this->s->nextTempVarIndex++;
         auto oprand = std::make_shared<Oprand>(OprandKind::varIndex, varIndex);
+        if (decimal) {
+            this->s->decimalVars.insert(varIndex);
+        }
         //这里要添加一个变量声明
         auto inst = std::make_shared<Inst_1>(AsmOpCode::declVar,oprand);
         this->getCurrentBB()->insts.push_back(inst);
@@ -467,6 +519,67 @@ public:
         }
     }
 
+    /**
+     * 操作数的值是否是双精度浮点数。
+     * @param oprand
+     */
+    bool isDecimal(std::shared_ptr<Oprand>& oprand) {
+        if (oprand == nullptr) {
+            return false;
+        }
+        if (oprand->kind == OprandKind::doubleConst) {
+            return true;
+        }
+        if (oprand->kind == OprandKind::varIndex && isType<uint32_t>(oprand->value)) {
+            return this->s->decimalVars.count(std::any_cast<uint32_t>(oprand->value)) > 0;
+        }
+        return false;
+    }
+
+    /**
+     * 把一个浮点数加入常量区，返回对应的操作数。
+     * @param value
+     */
+    std::shared_ptr<Oprand> addDoubleConst(double value) {
+        auto& consts = this->asmModule->doubleConsts;
+        uint32_t index = consts.size();
+        for (uint32_t i = 0; i < consts.size(); i++) {
+            if (std::memcmp(&consts[i], &value, sizeof(double)) == 0) {
+                index = i;
+                break;
+            }
+        }
+        if (index == consts.size()) {
+            consts.push_back(value);
+        }
+        return std::make_shared<Oprand>(OprandKind::doubleConst, index);
+    }
+
+    /**
+     * 把操作数转换成一个存放在xmm寄存器里的浮点数临时变量。
+     * 整数立即数在编译期转换成常量；整型变量用cvtsi2sdl转换。
+     * @param oprand
+     */
+    std::shared_ptr<Oprand> toDecimalTemp(std::shared_ptr<Oprand>& oprand) {
+        if (this->isTempVar(oprand) && this->isDecimal(oprand)) {
+            return oprand;
+        }
+
+        auto& insts = this->getCurrentBB()->insts;
+        auto dest = this->allocateTempVar(true);
+        if (this->isDecimal(oprand)) {
+            insts.push_back(std::make_shared<Inst_2>(AsmOpCode::movsd, oprand, dest));
+        }
+        else if (oprand->kind == OprandKind::immediate && isType<int32_t>(oprand->value)) {
+            auto constOprand = this->addDoubleConst(std::any_cast<int32_t>(oprand->value));
+            insts.push_back(std::make_shared<Inst_2>(AsmOpCode::movsd, constOprand, dest));
+        }
+        else {
+            insts.push_back(std::make_shared<Inst_2>(AsmOpCode::cvtsi2sdl, oprand, dest));
+        }
+        return dest;
+    }
+
     /**
      * 如果操作数不同，则生成mov指令；否则，可以减少一次拷贝。
      * @param src
@@ -474,7 +587,8 @@ public:
      */
     void movIfNotSame(std::shared_ptr<Oprand>& src, std::shared_ptr<Oprand>& dest) {
         if (!src->isSame<uint32_t>(dest)){
-            auto inst = std::make_shared<Inst_2>(AsmOpCode::movl, src, dest);
+            auto op = this->isDecimal(src) ? AsmOpCode::movsd : AsmOpCode::movl;
+            auto inst = std::make_shared<Inst_2>(op, src, dest);
             this->getCurrentBB()->insts.push_back(inst);
         }
     }
@@ -506,6 +620,7 @@ public:
         this->asmModule->numParams.insert({this->s->functionSym->name, this->s->functionSym->getNumParams()});
         this->asmModule->numVars.insert({this->s->functionSym->name, this->s->functionSym->vars.size()});
         this->asmModule->numTotalVars.insert({this->s->functionSym->name, this->s->nextTempVarIndex});
+        this->asmModule->decimalVars.insert({this->s->functionSym->name, this->s->decimalVars});
 
 
         //重新设置状态变量
@@ -562,6 +677,15 @@ public:
             auto varIndex = this->s->functionSym->getVarIndex(variableDecl.sym->name);
             auto left = std::make_shared<Oprand>(OprandKind::varIndex, varIndex);
 
+            //声明为decimal，或者用浮点数初始化的变量，是浮点数变量
+            if (variableDecl.sym->theType == SysTypes::Decimal() || this->isDecimal(right)) {
+                //movsd不能在两个内存地址之间拷贝，所以要经过xmm寄存器中转
+                if (right != nullptr) {
+                    right = this->toDecimalTemp(right);
+                }
+                this->s->decimalVars.insert(varIndex);
+            }
+
             //插入一条抽象指令，代表这里声明了一个变量
             this->getCurrentBB()->insts.push_back(std::make_shared<Inst_1>(AsmOpCode::declVar, left));
 
@@ -587,6 +711,10 @@ public:
         return std::make_shared<Oprand>(OprandKind::immediate, integerLiteral.value);
     }
 
+    std::any visitDecimalLiteral(DecimalLiteral& decimalLiteral, std::string prefix) override {
+        return this->addDoubleConst(decimalLiteral.value);
+    }
+
     std::any visitReturnStatement(ReturnStatement& returnStatement, std::string prefix) override {
         if (returnStatement.exp != nullptr){
             auto ret = this->visit(*returnStatement.exp);
@@ -596,11 +724,39 @@ public:
                 return std::any();
             }
             //把返回值赋给相应的寄存器
-            this->movIfNotSame(op, this->returnSlot);
+            //浮点数通过xmm0返回
+            auto& funName = this->s->functionSym->name;
+            if (this->isDecimal(op) || this->asmModule->decimalFunctions.count(funName) > 0) {
+                this->asmModule->decimalFunctions.insert(funName);
+                if (!this->isDecimal(op)) {
+                    op = this->toDecimalTemp(op);
+                }
+                this->movIfNotSame(op, this->decimalReturnSlot);
+            }
+            else {
+                this->movIfNotSame(op, this->returnSlot);
+            }
         }
         return std::any();
     }
 
+    std::any visitBenchStatement(BenchStatement& stmt, std::string prefix) override {
+        //还没有生成循环的能力，bench语句只能在Interpretor和ClosureEngine中执行
+        dbg("Error: bench statement is not supported by the x86-64 backend");
+        return std::any();
+    }
+
+    //条件跳转和循环还没有lower成基本块之间的跳转，if和for语句只能在解释器、闭包引擎和字节码虚拟机中执行
+    std::any visitIfStatement(IfStatement& stmt, std::string prefix) override {
+        dbg("Error: if statement is not supported by the x86-64 backend");
+        return std::any();
+    }
+
+    std::any visitForStatement(ForStatement& stmt, std::string prefix) override {
+        dbg("Error: for statement is not supported by the x86-64 backend");
+        return std::any();
+    }
+
     std::any visitFunctionDecl(FunctionDecl& functionDecl, std::string prefix) override {
         //保存原来的状态信息
         auto s = this->s;
@@ -614,6 +770,17 @@ public:
         //先设置成叶子变量。如果遇到函数调用，则设置为false。
         this->asmModule->isLeafFunction.insert({this->s->functionSym->name, true});
 
+        //声明为decimal的参数，通过xmm寄存器传入
+        auto functionType = std::dynamic_pointer_cast<FunctionType>(this->s->functionSym->theType);
+        for (uint32_t i = 0; i < functionType->paramTypes.size(); i++) {
+            if (functionType->paramTypes[i] == SysTypes::Decimal()) {
+                this->s->decimalVars.insert(i);
+            }
+        }
+        if (functionType->returnType == SysTypes::Decimal()) {
+            this->asmModule->decimalFunctions.insert(this->s->functionSym->name);
+        }
+
         //创建新的基本块
         this->newBlock();
 
@@ -623,6 +790,7 @@ public:
         this->asmModule->numParams.insert({this->s->functionSym->name, this->s->functionSym->getNumParams()});
         this->asmModule->numVars.insert({this->s->functionSym->name, this->s->functionSym->vars.size()});
         this->asmModule->numTotalVars.insert({this->s->functionSym->name, this->s->nextTempVarIndex});
+        this->asmModule->decimalVars.insert({this->s->functionSym->name, this->s->decimalVars});
 
         //恢复原来的状态信息
         this->s = s;
@@ -651,13 +819,46 @@ public:
         auto functionSym = functionCall.sym;
         auto functionType = std::dynamic_pointer_cast<FunctionType>(functionSym->theType);
 
+        //确定每个参数用通用寄存器还是xmm寄存器传递。
+        //自定义函数以参数的声明类型为准；内置函数则按照实参的类型。
+        std::vector<bool> decimalArgs;
+        bool isBuiltIn = built_ins.count(functionCall.name) > 0;
+        for (uint32_t i = 0; i < args.size(); i++) {
+            bool decimalParam = i < functionType->paramTypes.size() && functionType->paramTypes[i] == SysTypes::Decimal();
+            bool decimal = decimalParam || (isBuiltIn && this->isDecimal(args[i]));
+            if (decimal && !this->isDecimal(args[i])) {
+                args[i] = this->toDecimalTemp(args[i]);
+            }
+            else if (!decimal && this->isDecimal(args[i])) {
+                //参数不是浮点数类型，截断成整数
+                auto intArg = this->allocateTempVar();
+                insts.push_back(std::make_shared<Inst_2>(AsmOpCode::cvttsd2si, args[i], intArg));
+                args[i] = intArg;
+            }
+            decimalArgs.push_back(decimal);
+        }
+
         dbg("--------- inst.size " + std::to_string(insts.size()));
         std::shared_ptr<Oprand> op = std::make_shared<FunctionOprand>(functionCall.name, args, functionType->returnType);
+        std::dynamic_pointer_cast<FunctionOprand>(op)->decimalArgs = decimalArgs;
+
+        //尾调用：被调用者的返回值要原样作为当前函数的返回值，所以两者都用xmm0返回，或者都用eax返回
+        if (functionCall.isTailCall) {
+            bool callerDecimal = this->asmModule->decimalFunctions.count(this->s->functionSym->name) > 0;
+            bool calleeDecimal = this->asmModule->decimalFunctions.count(functionCall.name) > 0 ||
+                functionType->returnType == SysTypes::Decimal();
+            std::dynamic_pointer_cast<FunctionOprand>(op)->isTailCall = callerDecimal == calleeDecimal;
+        }
         insts.push_back(std::make_shared<Inst_1>(AsmOpCode::callq, op));
 
         //把结果放到一个新的临时变量里
         std::shared_ptr<Oprand> dest;
-        if(functionType->returnType != SysTypes::Void()) { //函数有返回值时
+        if (this->asmModule->decimalFunctions.count(functionCall.name) > 0 ||
+            functionType->returnType == SysTypes::Decimal()) { //返回值是浮点数时，从xmm0中取
+            dest = this->allocateTempVar(true);
+            insts.push_back(std::make_shared<Inst_2>(AsmOpCode::movsd, this->decimalReturnSlot, dest));
+        }
+        else if(functionType->returnType != SysTypes::Void()) { //函数有返回值时
             dest = this->allocateTempVar();
             insts.push_back(std::make_shared<Inst_2>(AsmOpCode::movl, this->returnSlot, dest));
         }
@@ -694,6 +895,27 @@ public:
         }
 
 
+        //有一个操作数是浮点数的算术运算，使用SSE指令
+        if ((bi.op == Op::Plus || bi.op == Op::Minus || bi.op == Op::Multiply || bi.op == Op::Divide) &&
+            (this->isDecimal(left) || this->isDecimal(right))) {
+            auto dest = this->toDecimalTemp(left);
+            if (right->kind == OprandKind::immediate && isType<int32_t>(right->value)) {
+                right = this->addDoubleConst(std::any_cast<int32_t>(right->value));
+            }
+            else if (!this->isDecimal(right)) {
+                right = this->toDecimalTemp(right);
+            }
+
+            AsmOpCode op = AsmOpCode::addsd;
+            if (bi.op == Op::Minus) op = AsmOpCode::subsd;
+            else if (bi.op == Op::Multiply) op = AsmOpCode::mulsd;
+            else if (bi.op == Op::Divide) op = AsmOpCode::divsd;
+            this->getCurrentBB()->insts.push_back(std::make_shared<Inst_2>(op, right, dest));
+
+            this->s->inExpression = false;
+            return dest;
+        }
+
         //计算出一个目标操作数
         auto dest = left;
         if (bi.op == Op::Plus || bi.op == Op::Minus || bi.op == Op::Multiply || bi.op == Op::Divide) {
@@ -952,6 +1174,96 @@ public:
     static std::vector<std::shared_ptr<Oprand>> calleeProtected64;
     static std::vector<std::shared_ptr<Oprand>> callerProtected64;
 
+    //128位的xmm寄存器，用于浮点数运算
+    //xmm0-xmm7用于传参，xmm0同时用于返回值；所有xmm寄存器都由caller保护
+    static std::shared_ptr<Oprand> xmm0() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm0", 128);
+        return oprand;
+    }
+
+    static std::shared_ptr<Oprand> xmm1() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm1", 128);
+        return oprand;
+    }
+
+    static std::shared_ptr<Oprand> xmm2() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm2", 128);
+        return oprand;
+    }
+
+    static std::shared_ptr<Oprand> xmm3() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm3", 128);
+        return oprand;
+    }
+
+    static std::shared_ptr<Oprand> xmm4() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm4", 128);
+        return oprand;
+    }
+
+    static std::shared_ptr<Oprand> xmm5() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm5", 128);
+        return oprand;
+    }
+
+    static std::shared_ptr<Oprand> xmm6() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm6", 128);
+        return oprand;
+    }
+
+    static std::shared_ptr<Oprand> xmm7() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm7", 128);
+        return oprand;
+    }
+
+    static std::shared_ptr<Oprand> xmm8() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm8", 128);
+        return oprand;
+    }
+
+    static std::shared_ptr<Oprand> xmm9() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm9", 128);
+        return oprand;
+    }
+
+    static std::shared_ptr<Oprand> xmm10() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm10", 128);
+        return oprand;
+    }
+
+    static std::shared_ptr<Oprand> xmm11() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm11", 128);
+        return oprand;
+    }
+
+    static std::shared_ptr<Oprand> xmm12() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm12", 128);
+        return oprand;
+    }
+
+    static std::shared_ptr<Oprand> xmm13() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm13", 128);
+        return oprand;
+    }
+
+    static std::shared_ptr<Oprand> xmm14() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm14", 128);
+        return oprand;
+    }
+
+    static std::shared_ptr<Oprand> xmm15() {
+        static std::shared_ptr<Oprand> oprand = std::make_shared<Register>("xmm15", 128);
+        return oprand;
+    }
+
+    //可供分配给浮点数临时变量的xmm寄存器
+    static std::vector<std::shared_ptr<Oprand>> registersXmm;
+    static std::vector<std::shared_ptr<Oprand>> paramRegistersXmm;
+
+    static bool isXmm(const std::shared_ptr<Oprand>& oprand) {
+        return oprand->kind == OprandKind::regist && oprand->name.compare(0, 3, "xmm") == 0;
+    }
+
     std::string toString() override {
         return "%"+ std::any_cast<std::string>(this->value);
     }
@@ -995,6 +1307,18 @@ public:
     //临时变量的数量
     uint32_t numTempVars = 0;
 
+    //当前函数中值为浮点数的变量
+    std::set<uint32_t> decimalVars;
+
+    //参数和本地变量相对于rbp的偏移量，key是varIndex
+    std::map<uint32_t, int32_t> varOffsets;
+
+    //通过寄存器传入的参数，在序曲里要保存到栈桢中。key是varIndex，value是传参的寄存器
+    std::map<uint32_t, std::shared_ptr<Oprand>> paramRegs;
+
+    //参数和本地变量在栈桢里占据的字节数
+    uint32_t frameBytes = 0;
+
     //To Delete 保存已经被Lower的Oprand，用于提高效率
     std::map<uint32_t, std::shared_ptr<Oprand>> lowedVars;
 
@@ -1062,7 +1386,17 @@ public:
         this->addPrologue(bbs[0]->insts);
 
         //添加尾声
-        this->addEpilogue(bbs.back()->insts);
+        //以尾调用结束的基本块，在jmp之前恢复栈桢，由被调用的函数返回到当前函数的调用者
+        for (auto& bb: bbs){
+            if (isTailJump(bb)){
+                std::vector<std::shared_ptr<Inst>> epilogue;
+                this->restoreFrame(epilogue);
+                bb->insts.insert(bb->insts.end() - 1, epilogue.begin(), epilogue.end());
+            }
+        }
+        if (!isTailJump(bbs.back())){
+            this->addEpilogue(bbs.back()->insts);
+        }
 
         //基本块的标签和跳转指令。
         auto newBBs = this->lowerBBLabelAndJumps(bbs, funIndex);
@@ -1081,19 +1415,75 @@ public:
         this->rspOffset = 0;
         this->lowedVars.clear();
         this->allocatedRegisters.clear();
+        this->decimalVars = this->asmModule->decimalVars[funName];
+
+        //确定参数和本地变量在栈桢中的位置
+        this->layoutFrame();
 
         //是否可以使用RedZone
         //需要是叶子函数，并且对栈外空间的使用量小于128个字节，也就是32个整数
         this->canUseRedZone = false;
         bool isLeafFunction = this->asmModule->isLeafFunction[funName];
         if (isLeafFunction){
-            uint32_t paramsToSave = (this->numParams > 6) ? 6: this->numParams;
-            uint32_t bytes = paramsToSave * 4 + this->numLocalVars * 4 + Register::calleeProtected32.size() * 8;
+            uint32_t bytes = this->frameBytes + Register::calleeProtected32.size() * 8;
             this->canUseRedZone = bytes < 128u;
         }
         return;
     }
 
+    /**
+     * 在栈桢里分配一个槽位，返回分配后总共占用的字节数。
+     * 整数占4个字节；浮点数占8个字节，并且要8字节对齐。
+     */
+    static uint32_t allocateSlot(uint32_t bytes, bool decimal) {
+        return decimal ? (bytes + 7) / 8 * 8 + 8 : bytes + 4;
+    }
+
+    void layoutFrame() {
+        this->varOffsets.clear();
+        this->paramRegs.clear();
+
+        uint32_t bytes = 0;
+        uint32_t numGPParams = 0;      //用通用寄存器传递的参数
+        uint32_t numXmmParams = 0;     //用xmm寄存器传递的参数
+        uint32_t numStackParams = 0;   //通过Caller的栈桢传递的参数
+        for (uint32_t varIndex = 0; varIndex < this->numParams + this->numLocalVars; varIndex++){
+            bool decimal = this->decimalVars.count(varIndex) > 0;
+            if (varIndex < this->numParams){
+                std::shared_ptr<Oprand> reg;
+                if (decimal && numXmmParams < Register::paramRegistersXmm.size()){
+                    reg = Register::paramRegistersXmm[numXmmParams++];
+                }
+                else if (!decimal && numGPParams < Register::paramRegisters32.size()){
+                    reg = Register::paramRegisters32[numGPParams++];
+                }
+
+                if (reg == nullptr){
+                    //从Caller的栈里访问参数
+                    //+16是因为有一个callq压入的返回地址，一个pushq rbp又加了8个字节
+                    this->varOffsets[varIndex] = numStackParams++ * 8 + 16;
+                    continue;
+                }
+                this->paramRegs.insert({varIndex, reg});
+            }
+
+            bytes = allocateSlot(bytes, decimal);
+            this->varOffsets[varIndex] = -static_cast<int32_t>(bytes);
+        }
+        this->frameBytes = bytes;
+    }
+
+    /**
+     * 调用函数前保存Caller负责保护的寄存器所需的字节数
+     */
+    uint32_t callerProtectedBytes() {
+        uint32_t bytes = this->frameBytes;
+        for (auto& reg: this->usedCallerProtectedRegs){
+            bytes = allocateSlot(bytes, Register::isXmm(reg));
+        }
+        return bytes - this->frameBytes;
+    }
+
     void lowerParams(){
         for (uint32_t i = 0; i< this->numParams; i++){
             if (i < 6u){
@@ -1112,30 +1502,13 @@ public:
 
 
     void lowerVars() {
-        uint32_t paramsToSave = this->numParams > 6 ? 6: this->numParams;
-
-        //处理参数
         for (uint32_t varIndex = 0; varIndex < this->numTotalVars; varIndex++){
             std::shared_ptr<Oprand> newOprand;
-            if (varIndex < this->numParams){
-                if (varIndex < 6){
-                    //从自己的栈桢里访问。在程序的序曲里，就把这些变量拷贝到栈里了。
-                    int32_t offset = -(varIndex + 1) * 4;
-                    auto oprand = Register::rbp();
-                    newOprand = std::make_shared<MemAddress>(oprand, offset);
-                }
-                else{
-                    //从Caller的栈里访问参数
-                    int32_t offset = (varIndex - 6) * 8 + 16;  //+16是因为有一个callq压入的返回地址，一个pushq rbp又加了8个字节
-                    auto oprand = Register::rbp();
-                    newOprand = std::make_shared<MemAddress>(oprand, offset);
-                }
-            }
-            //本地变量，在栈桢里。
-            else if (varIndex < this->numParams + this->numLocalVars) {
-                int32_t offset = -(varIndex - this->numParams + paramsToSave + 1) * 4;
+            //参数和本地变量，在栈桢里。
+            //通过寄存器传入的参数，在程序的序曲里就拷贝到栈里了；其他参数从Caller的栈里访问。
+            if (varIndex < this->numParams + this->numLocalVars){
                 auto oprand = Register::rbp();
-                newOprand = std::make_shared<MemAddress>(oprand, offset);
+                newOprand = std::make_shared<MemAddress>(oprand, this->varOffsets[varIndex]);
             }
             //临时变量，分配寄存器
             else{
@@ -1148,6 +1521,19 @@ public:
     }
 
     std::shared_ptr<Oprand> allocateRegister(uint32_t varIndex) {
+        //浮点数变量分配xmm寄存器，xmm寄存器都由Caller保护
+        if (this->decimalVars.count(varIndex) > 0){
+            for (auto& reg: Register::registersXmm){
+                if (this->allocatedRegisters.find(reg->name) == this->allocatedRegisters.end()){
+                    this->allocatedRegisters.insert({reg->name, varIndex});
+                    this->usedCallerProtectedRegs.push_back(reg);
+                    return reg;
+                }
+            }
+            dbg("Error: Unable to allocate a xmm Register, the generated asm is not reliable");
+            return nullptr;
+        }
+
         for (auto& reg: Register::registers32){
             auto it = this->allocatedRegisters.find(reg->name);
             if (it == this->allocatedRegisters.end()){
@@ -1201,7 +1587,7 @@ public:
                 inst_2->oprand1 = this->lowerOprand(inst_2->oprand1);
                 inst_2->oprand2 = this->lowerOprand(inst_2->oprand2);
                 // 对mov再做一次优化
-                if (!(inst_2->op == AsmOpCode::movl && inst_2->oprand1 == inst_2->oprand2)) {
+                if (!((inst_2->op == AsmOpCode::movl || inst_2->op == AsmOpCode::movsd) && inst_2->oprand1 == inst_2->oprand2)) {
                     newInsts.push_back(inst_2);
                 }
             }
@@ -1212,6 +1598,10 @@ public:
                 //处理函数调用
                 //函数调用前后，要设置参数；
                 if (inst_1->op == AsmOpCode::callq) {
+                    //尾调用变成了jmp，当前函数到此结束，后面的指令不会再执行
+                    if (this->lowerTailCall(inst_1, newInsts)) {
+                        return;
+                    }
                     this->lowerFunctionCall(inst_1, newInsts);
                 }
                 else {
@@ -1225,25 +1615,100 @@ public:
         }
     }
 
+    /**
+     * 确定每个参数用哪个寄存器传递
+     * 整数参数依次使用6个通用寄存器，浮点数参数依次使用xmm0-xmm7，其余的参数放在栈里
+     * @param argRegs 每个参数对应的寄存器，放在栈里的参数为nullptr
+     * @param stackArgs 放在栈里的参数的下标
+     */
+    static void assignArgRegs(FunctionOprand& functionOprand, std::vector<std::shared_ptr<Oprand>>& argRegs, std::vector<uint32_t>& stackArgs) {
+        uint32_t numArgs = functionOprand.args.size();
+        argRegs.assign(numArgs, nullptr);
+        uint32_t numGPArgs = 0;
+        uint32_t numXmmArgs = 0;
+        for (uint32_t j = 0; j < numArgs; j++) {
+            bool decimal = j < functionOprand.decimalArgs.size() && functionOprand.decimalArgs[j];
+            if (decimal && numXmmArgs < Register::paramRegistersXmm.size()) {
+                argRegs[j] = Register::paramRegistersXmm[numXmmArgs++];
+            }
+            else if (!decimal && numGPArgs < Register::paramRegisters32.size()) {
+                argRegs[j] = Register::paramRegisters32[numGPArgs++];
+            }
+            else {
+                stackArgs.push_back(j);
+            }
+        }
+    }
+
+    /**
+     * 把尾调用lower成jmp。
+     * 只有所有参数都能通过寄存器传递时才可以，否则被调用者会到当前函数的调用者的栈桢里读参数，那里的空间不一定够。
+     * 尾声在addPrologue确定了栈桢大小之后再插入到jmp前面。
+     * @return 是否lower成了jmp
+     */
+    bool lowerTailCall(std::shared_ptr<Inst_1>& inst_1, std::vector<std::shared_ptr<Inst>>& newInsts) {
+        auto functionOprand = std::dynamic_pointer_cast<FunctionOprand>(inst_1->oprand);
+        if (functionOprand == nullptr || !functionOprand->isTailCall) {
+            return false;
+        }
+
+        std::vector<std::shared_ptr<Oprand>> argRegs;
+        std::vector<uint32_t> stackArgs;
+        assignArgRegs(*functionOprand, argRegs, stackArgs);
+        if (!stackArgs.empty()) {
+            return false;
+        }
+
+        //把参数设置到寄存器。当前函数不会再继续执行，不需要保护Caller负责保护的寄存器
+        auto& args = functionOprand->args;
+        for (uint32_t j = 0; j < args.size(); j++) {
+            auto regSrc = this->lowerOprand(args[j]);
+            auto regDest = argRegs[j];
+            if (regDest != regSrc)
+                newInsts.push_back(std::make_shared<Inst_2>(Register::isXmm(regDest) ? AsmOpCode::movsd : AsmOpCode::movl, regSrc, regDest));
+        }
+
+        newInsts.push_back(std::make_shared<Inst_1>(AsmOpCode::jmp, inst_1->oprand));
+        return true;
+    }
+
+    //基本块是否以尾调用的jmp结束
+    static bool isTailJump(std::shared_ptr<BasicBlock>& bb) {
+        if (bb->insts.empty() || bb->insts.back()->op != AsmOpCode::jmp) {
+            return false;
+        }
+        auto inst_1 = std::dynamic_pointer_cast<Inst_1>(bb->insts.back());
+        return inst_1 != nullptr && inst_1->oprand->kind == OprandKind::function;
+    }
+
     void lowerFunctionCall(std::shared_ptr<Inst_1>& inst_1, std::vector<std::shared_ptr<Inst>>& newInsts) {
         auto functionOprand = std::dynamic_pointer_cast<FunctionOprand>(inst_1->oprand);
         auto& args = functionOprand->args;
-        //需要在栈桢里为传参保留的空间
         uint32_t numArgs = args.size();
-        if (numArgs > 6 && numArgs - 6 > this->numArgsOnStack) {
-            this->numArgsOnStack = numArgs - 6;
+
+        std::vector<std::shared_ptr<Oprand>> argRegs;
+        std::vector<uint32_t> stackArgs;
+        assignArgRegs(*functionOprand, argRegs, stackArgs);
+
+        //需要在栈桢里为传参保留的空间
+        if (stackArgs.size() > this->numArgsOnStack) {
+            this->numArgsOnStack = stackArgs.size();
         }
+
         //保存Caller负责保护的寄存器
-        uint32_t paramsToSave = this->numParams > 6 ? 6 : this->numParams;
-        int32_t offset = -(paramsToSave + this->numLocalVars + 1) * 4;
+        uint32_t bytes = this->frameBytes;
+        std::vector<int32_t> offsets;
         std::vector<uint32_t> spilledTempVars;
         std::vector<std::shared_ptr<Oprand>> spilledRegs;
         for (uint32_t i = 0; i < this->usedCallerProtectedRegs.size(); i++) {
             auto reg = this->usedCallerProtectedRegs[i];
+            bool isXmm = Register::isXmm(reg);
+            bytes = allocateSlot(bytes, isXmm);
             auto rbp = Register::rbp();
-            std::shared_ptr<Oprand> op = std::make_shared<MemAddress>(rbp, offset - i * 4);
-            newInsts.push_back(std::make_shared<Inst_2>(AsmOpCode::movl, reg, op));
+            std::shared_ptr<Oprand> op = std::make_shared<MemAddress>(rbp, -static_cast<int32_t>(bytes));
+            newInsts.push_back(std::make_shared<Inst_2>(isXmm ? AsmOpCode::movsd : AsmOpCode::movl, reg, op));
             auto varIndex = this->allocatedRegisters[reg->name];
+            offsets.push_back(-static_cast<int32_t>(bytes));
             spilledRegs.push_back(reg);
             spilledTempVars.push_back(varIndex);
         }
@@ -1252,25 +1717,28 @@ public:
             this->freeRegister(reg);
         }
 
-        //把前6个参数设置到寄存器
-        for (uint32_t j = 0; j < numArgs && j < 6; j++) {
+        //把参数设置到寄存器
+        for (uint32_t j = 0; j < numArgs; j++) {
+            if (argRegs[j] == nullptr)
+                continue;
             auto regSrc = this->lowerOprand(args[j]);
-            auto regDest = Register::paramRegisters32[j];
+            auto regDest = argRegs[j];
             if (regDest != regSrc)
-                newInsts.push_back(std::make_shared<Inst_2>(AsmOpCode::movl, regSrc, regDest));
-        }
-
-        //超过6个之后的参数是放在栈桢里的，并要移动栈顶指针
-        if (args.size() > 6) {
-            //参数是倒着排的。
-            //栈顶是参数7，再往上，依次是参数8、参数9...
-            //在Callee中，会到Caller的栈桢中去读取参数值
-            for (uint32_t j = 6; j < numArgs; j++) {
-                int32_t offset = (j - 6) * 8;
-                auto rsp = Register::rsp();
-                std::shared_ptr<Oprand> op = std::make_shared<MemAddress>(rsp, offset);
-                newInsts.push_back(std::make_shared<Inst_2>(AsmOpCode::movl, functionOprand->args[j], op));
-            }
+                newInsts.push_back(std::make_shared<Inst_2>(Register::isXmm(regDest) ? AsmOpCode::movsd : AsmOpCode::movl, regSrc, regDest));
+        }
+
+        //寄存器放不下的参数是放在栈桢里的，并要移动栈顶指针
+        //参数是倒着排的。
+        //栈顶是第一个放不下的参数，再往上，依次是下一个参数...
+        //在Callee中，会到Caller的栈桢中去读取参数值
+        for (uint32_t k = 0; k < stackArgs.size(); k++) {
+            uint32_t j = stackArgs[k];
+            int32_t offset = k * 8;
+            auto rsp = Register::rsp();
+            std::shared_ptr<Oprand> op = std::make_shared<MemAddress>(rsp, offset);
+            bool decimal = j < functionOprand->decimalArgs.size() && functionOprand->decimalArgs[j];
+            auto src = this->lowerOprand(args[j]);
+            newInsts.push_back(std::make_shared<Inst_2>(decimal ? AsmOpCode::movsd : AsmOpCode::movl, src, op));
         }
 
         //调用函数，修改操作数为functionName
@@ -1282,8 +1750,8 @@ public:
             uint32_t varIndex = spilledTempVars[i];
             auto reg = this->allocateRegister(varIndex);
             auto rbp = Register::rbp();
-            std::shared_ptr<Oprand> op = std::make_shared<MemAddress>(rbp, offset - i * 4);
-            newInsts.push_back(std::make_shared<Inst_2>(AsmOpCode::movl, op, reg));
+            std::shared_ptr<Oprand> op = std::make_shared<MemAddress>(rbp, offsets[i]);
+            newInsts.push_back(std::make_shared<Inst_2>(Register::isXmm(reg) ? AsmOpCode::movsd : AsmOpCode::movl, op, reg));
             this->lowedVars.insert({varIndex, reg});
         }
 
@@ -1297,19 +1765,17 @@ public:
         //把原来的栈顶保存到rbp,成为现在的栈底
         auto rsp = Register::rsp();
         newInsts.push_back(std::make_shared<Inst_2>(AsmOpCode::movq, rsp, rbp));
-        //把前6个参数存到栈桢里
-        int32_t paramsToSave = this->numParams > 6 ? 6 : this->numParams;
-        for (int32_t i = 0; i < paramsToSave; i++) {
-            int32_t offset = -(i + 1) * 4;
-            auto src = Register::paramRegisters32[i];
-            std::shared_ptr<Oprand> dst = std::make_shared<MemAddress>(rbp, offset);
-            newInsts.push_back(std::make_shared<Inst_2>(AsmOpCode::movl, src, dst));
+        //把通过寄存器传入的参数存到栈桢里
+        for (auto& item: this->paramRegs) {
+            auto src = item.second;
+            std::shared_ptr<Oprand> dst = std::make_shared<MemAddress>(rbp, this->varOffsets[item.first]);
+            newInsts.push_back(std::make_shared<Inst_2>(Register::isXmm(src) ? AsmOpCode::movsd : AsmOpCode::movl, src, dst));
         }
 
         //计算栈顶指针需要移动多少位置
         //要保证栈桢16字节对齐
         if (!this->canUseRedZone) {
-            this->rspOffset = paramsToSave * 4 + this->numLocalVars * 4 + this->usedCallerProtectedRegs.size() * 4 + this->numArgsOnStack * 8 + 16;
+            this->rspOffset = this->frameBytes + this->callerProtectedBytes() + this->numArgsOnStack * 8 + 16;
             //当前占用的栈空间，还要加上Callee保护的寄存器占据的空间
             auto rem = (this->rspOffset + this->usedCalleeProtectedRegs.size() * 8) % 16;
             // console.log("this->rspOffset="+this->rspOffset);
@@ -1338,6 +1804,13 @@ public:
     }
 
     void addEpilogue(std::vector<std::shared_ptr<Inst>>& newInsts) {
+        this->restoreFrame(newInsts);
+        //返回
+        newInsts.push_back(std::make_shared<Inst_0>(AsmOpCode::retq));
+    }
+
+    //恢复Callee负责保护的寄存器、栈顶指针和rbp，回到进入函数时的状态
+    void restoreFrame(std::vector<std::shared_ptr<Inst>>& newInsts) {
         //恢复Callee负责保护的寄存器
         this->restoreCalleeProtectedRegs(newInsts);
         //缩小栈桢
@@ -1349,8 +1822,6 @@ public:
         //恢复rbp的值
         auto rbp = Register::rbp();
         newInsts.push_back(std::make_shared<Inst_1>(AsmOpCode::popq, rbp));
-        //返回
-        newInsts.push_back(std::make_shared<Inst_0>(AsmOpCode::retq));
     }
 
     std::vector<std::shared_ptr<BasicBlock>> lowerBBLabelAndJumps(std::vector<std::shared_ptr<BasicBlock>>& bbs, int32_t funIndex) {
@@ -1406,7 +1877,8 @@ public:
             return iter->second;
         }
         else if (oprand->kind == OprandKind::returnSlot) {
-            newOprand = Register::eax();
+            //浮点数的返回值放在xmm0里
+            newOprand = oprand->name == "decimal" ? Register::xmm0() : Register::eax();
         }
         return newOprand;
     }
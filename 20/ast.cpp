@@ -66,6 +66,34 @@ std::any AstVisitor::visitReturnStatement(ReturnStatement& stmt, std::string add
     return std::any();
 }
 
+std::any AstVisitor::visitBenchStatement(BenchStatement& stmt, std::string additional) {
+    this->visit(*stmt.name, additional);
+    this->visit(*stmt.iterations, additional);
+    return this->visit(*stmt.body, additional);
+}
+
+std::any AstVisitor::visitIfStatement(IfStatement& stmt, std::string additional) {
+    this->visit(*stmt.condition, additional);
+    this->visit(*stmt.stmt, additional);
+    if (stmt.elseStmt != nullptr){
+        return this->visit(*stmt.elseStmt, additional);
+    }
+    return std::any();
+}
+
+std::any AstVisitor::visitForStatement(ForStatement& stmt, std::string additional) {
+    if (stmt.init != nullptr){
+        this->visit(*stmt.init, additional);
+    }
+    if (stmt.condition != nullptr){
+        this->visit(*stmt.condition, additional);
+    }
+    if (stmt.increment != nullptr){
+        this->visit(*stmt.increment, additional);
+    }
+    return this->visit(*stmt.stmt, additional);
+}
+
 std::any AstVisitor::visitBinary(Binary& exp, std::string additional) {
     this->visit(*exp.exp1, additional);
     this->visit(*exp.exp2, additional);
@@ -81,3 +109,12 @@ std::any AstVisitor::visitIntegerLiteral(IntegerLiteral& node, std::string addit
     return node.value;
 }
 
+std::any AstVisitor::visitDecimalLiteral(DecimalLiteral& node, std::string additional) {
+    return node.value;
+}
+
+
+
+std::any AstVisitor::visitStringLiteral(StringLiteral& node, std::string additional) {
+    return node.value;
+}
\ No newline at end of file
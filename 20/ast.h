@@ -21,6 +21,8 @@ class ErrorStmt;
 class ErrorExp;
 class Variable;
 class IntegerLiteral;
+class DecimalLiteral;
+class StringLiteral;
 class ParameterList;
 class VariableDecl;
 class VariableStatement;
@@ -31,6 +33,9 @@ class Prog;
 class CallSignature;
 class FunctionDecl;
 class ReturnStatement;
+class BenchStatement;
+class IfStatement;
+class ForStatement;
 class Binary;
 class Unary;
 
@@ -56,6 +61,11 @@ public:
     virtual std::any visitFunctionDecl(FunctionDecl& functionDecl, std::string additional = "");
     virtual std::any visitReturnStatement(ReturnStatement& stmt, std::string additional = "");
 
+    virtual std::any visitBenchStatement(BenchStatement& stmt, std::string additional = "");
+
+    virtual std::any visitIfStatement(IfStatement& stmt, std::string additional = "");
+    virtual std::any visitForStatement(ForStatement& stmt, std::string additional = "");
+
     virtual std::any visitBlock(Block& block, std::string additional = "");
     virtual std::any visitProg(Prog& prog, std::string additional = "");
 
@@ -67,6 +77,8 @@ public:
         return std::any();
     }
     virtual std::any visitIntegerLiteral(IntegerLiteral& node, std::string additional = "");
+    virtual std::any visitDecimalLiteral(DecimalLiteral& node, std::string additional = "");
+    virtual std::any visitStringLiteral(StringLiteral& node, std::string additional = "");
 
     virtual std::any visitErrorStmt(ErrorStmt& node, std::string additional = "") {
         return std::any();
@@ -116,6 +128,42 @@ public:
     }
 };
 
+//
+// 类型反馈
+// 解释器执行Binary节点时，记录观察到的操作数类型。
+// 同样的情况连续出现若干次之后，节点把自己特化成对应的快速路径，并带上一个守卫；
+// 守卫失败就退回通用路径重新收集，退回次数太多的节点停留在通用状态。
+//
+enum class Specialization: uint8_t{
+    Uninitialized,      //还在收集类型
+    IntInt,             //两个整数
+    DecimalDecimal,     //两个浮点数
+    ConcatStrStr,       //两个字符串拼接
+    Monomorphic,        //其他固定的一组类型，按缓存的标签直接取运算函数
+    Generic,            //类型不稳定，总是走通用路径
+};
+
+struct TypeFeedback{
+    Specialization state {Specialization::Uninitialized};
+    ValueTag tag1 {ValueTag::Undefined};    //观察到的左操作数类型
+    ValueTag tag2 {ValueTag::Undefined};    //观察到的右操作数类型
+    uint8_t hits {0};       //同样的类型连续出现的次数
+    uint8_t deopts {0};     //守卫失败的次数
+};
+
+//
+// 调用描述符
+// 语义分析之后由CallLinker为每个被调用的函数生成一次，同一个函数的所有调用点共享。
+// 解释器调用时不需要再比较函数名称，也不需要对CallSignature、ParameterList做类型转换。
+//
+struct CallDescriptor{
+    BuiltinId builtin {BuiltinId::None};
+    FunctionSymbol* callee {nullptr};
+    AstNode* body {nullptr};            //函数体
+    std::vector<int32_t> paramSlots;    //每个参数在栈桢中的槽位
+    uint32_t numSlots {0};              //栈桢的大小，也就是本地变量（包括参数）的数量
+};
+
 class Expression: public AstNode{
 public:
     Expression(Position beginPos, Position endPos, bool isErrorNode):
@@ -170,6 +218,32 @@ public:
     }
 };
 
+class DecimalLiteral: public Expression{
+public:
+    double value;
+    DecimalLiteral(Position beginPos, double value, bool isErrorNode = false):
+        Expression(beginPos, beginPos, isErrorNode), value(value){
+        this->theType = SysTypes::Decimal();
+        this->constValue = value;
+    }
+    std::any accept(AstVisitor& visitor, std::string additional) override {
+        return visitor.visitDecimalLiteral(*this, additional);
+    }
+};
+
+class StringLiteral: public Expression{
+public:
+    std::string value;
+    StringLiteral(Position beginPos, const std::string& value, bool isErrorNode = false):
+        Expression(beginPos, beginPos, isErrorNode), value(value){
+        this->theType = SysTypes::String();
+        this->constValue = value;
+    }
+    std::any accept(AstVisitor& visitor, std::string additional) override {
+        return visitor.visitStringLiteral(*this, additional);
+    }
+};
+
 /**
  * 函数调用
  */
@@ -179,6 +253,10 @@ public:
     std::vector<std::shared_ptr<AstNode>> arguments;
     // decl: FunctionDecl|null=null;  //指向函数的声明
     std::shared_ptr<FunctionSymbol> sym;
+
+    std::shared_ptr<CallDescriptor> callDesc;   //由CallLinker设置
+    bool isTailCall {false};    //是否是尾调用，也就是return f(...)，由TailCallAnalyzer设置
+
     FunctionCall(Position beginPos, Position endPos, const std::string name,
         std::vector<std::shared_ptr<AstNode>>& paramValues,
         bool isErrorNode = false): Expression(beginPos, beginPos, isErrorNode),
@@ -321,13 +399,73 @@ public:
     }
 };
 
+/**
+ * 基准测试语句
+ * bench(name, iterations) { ... }
+ * 把代码块执行iterations次，报告每次迭代耗时的最小值、中位数和p99。
+ */
+class BenchStatement: public Statement{
+public:
+    std::shared_ptr<AstNode> name;          //名称，报告里用
+    std::shared_ptr<AstNode> iterations;    //迭代次数
+    std::shared_ptr<AstNode> body;          //被测量的代码块
+    BenchStatement(Position beginPos, Position endPos, std::shared_ptr<AstNode>& name, std::shared_ptr<AstNode>& iterations,
+        std::shared_ptr<AstNode>& body, bool isErrorNode = false):
+        Statement(beginPos, endPos, isErrorNode), name(name), iterations(iterations), body(body){
+    }
+    std::any accept(AstVisitor& visitor, std::string additional) override {
+        return visitor.visitBenchStatement(*this, additional);
+    }
+};
+
+/**
+ * If语句
+ * if (condition) stmt [else elseStmt]
+ */
+class IfStatement: public Statement{
+public:
+    std::shared_ptr<AstNode> condition;
+    std::shared_ptr<AstNode> stmt;
+    std::shared_ptr<AstNode> elseStmt;      //没有else部分时为nullptr
+    IfStatement(Position beginPos, Position endPos, std::shared_ptr<AstNode>& condition, std::shared_ptr<AstNode>& stmt,
+        std::shared_ptr<AstNode>& elseStmt, bool isErrorNode = false):
+        Statement(beginPos, endPos, isErrorNode), condition(condition), stmt(stmt), elseStmt(elseStmt){
+    }
+    std::any accept(AstVisitor& visitor, std::string additional) override {
+        return visitor.visitIfStatement(*this, additional);
+    }
+};
+
+/**
+ * For语句
+ * for (init; condition; increment) stmt
+ * init可以是变量声明（VariableDecl）或者表达式，三个部分都可以省略，省略的部分为nullptr。
+ * init中声明的变量属于for语句自己的作用域。
+ */
+class ForStatement: public Statement{
+public:
+    std::shared_ptr<AstNode> init;
+    std::shared_ptr<AstNode> condition;
+    std::shared_ptr<AstNode> increment;
+    std::shared_ptr<AstNode> stmt;
+    std::shared_ptr<Scope> scope;
+    ForStatement(Position beginPos, Position endPos, std::shared_ptr<AstNode>& init, std::shared_ptr<AstNode>& condition,
+        std::shared_ptr<AstNode>& increment, std::shared_ptr<AstNode>& stmt, bool isErrorNode = false):
+        Statement(beginPos, endPos, isErrorNode), init(init), condition(condition), increment(increment), stmt(stmt){
+    }
+    std::any accept(AstVisitor& visitor, std::string additional) override {
+        return visitor.visitForStatement(*this, additional);
+    }
+};
+
 class Binary: public Expression{
 public:
     Op op;      //运算符
     std::shared_ptr<AstNode> exp1; //左边的表达式
     std::shared_ptr<AstNode> exp2; //右边的表达式
+    TypeFeedback feedback; //类型反馈
     Binary(Op op, std::shared_ptr<AstNode> exp1, std::shared_ptr<AstNode> exp2,
-        bool isErrorNode = false): Expression(beginPos, endPos, isErrorNode),
+        bool isErrorNode = false): Expression(exp1 ? exp1->beginPos : Position(), exp2 ? exp2->endPos : Position(), isErrorNode),
         op(op), exp1(exp1), exp2(exp2) {
     }
     std::any accept(AstVisitor& visitor, std::string additional) override {
@@ -437,6 +575,18 @@ public:
             (exp.isErrorNode? " **E** " : ""));
         return std::any();
     }
+    std::any visitDecimalLiteral(DecimalLiteral& exp, std::string prefix) override {
+        ss << Print(prefix+ ValueToString(exp.value) +
+            (exp.theType == nullptr? "" : "("+exp.theType->name+")") +
+            (exp.isErrorNode? " **E** " : ""));
+        return std::any();
+    }
+    std::any visitStringLiteral(StringLiteral& exp, std::string prefix) override {
+        ss << Print(prefix+ exp.value +
+            (exp.theType == nullptr? "" : "("+exp.theType->name+")") +
+            (exp.isErrorNode? " **E** " : ""));
+        return std::any();
+    }
     std::any visitErrorStmt(ErrorStmt& node, std::string prefix) override {
         ss << Print(prefix+"Error Statement **E**");
         return std::any();
@@ -473,6 +623,38 @@ public:
         return std::any();
     }
 
+    std::any visitBenchStatement(BenchStatement& stmt, std::string prefix) override {
+        ss << Print(prefix+"BenchStatement" + (stmt.isErrorNode? " **E** " : ""));
+        this->visit(*stmt.name, prefix+"    ");
+        this->visit(*stmt.iterations, prefix+"    ");
+        return this->visit(*stmt.body, prefix+"    ");
+    }
+
+    std::any visitIfStatement(IfStatement& stmt, std::string prefix) override {
+        ss << Print(prefix+"IfStatement" + (stmt.isErrorNode? " **E** " : ""));
+        this->visit(*stmt.condition, prefix+"    ");
+        this->visit(*stmt.stmt, prefix+"    ");
+        if (stmt.elseStmt != nullptr){
+            ss << Print(prefix+"else");
+            this->visit(*stmt.elseStmt, prefix+"    ");
+        }
+        return std::any();
+    }
+
+    std::any visitForStatement(ForStatement& stmt, std::string prefix) override {
+        ss << Print(prefix+"ForStatement" + (stmt.isErrorNode? " **E** " : ""));
+        if (stmt.init != nullptr){
+            this->visit(*stmt.init, prefix+"    ");
+        }
+        if (stmt.condition != nullptr){
+            this->visit(*stmt.condition, prefix+"    ");
+        }
+        if (stmt.increment != nullptr){
+            this->visit(*stmt.increment, prefix+"    ");
+        }
+        return this->visit(*stmt.stmt, prefix+"    ");
+    }
+
     std::any visitBinary(Binary& exp, std::string prefix) override {
         ss << Print(prefix+"Binary:"+ ::toString(exp.op)+ (exp.theType == nullptr? "" : "("+exp.theType->name+")") + (exp.isErrorNode? " **E** " : ""));
 
@@ -523,6 +705,21 @@ public:
         return std::any();
     }
 
+    std::any visitForStatement(ForStatement& stmt, std::string prefix) override {
+        Print(prefix + "Scope of for statement");
+        //显示本级Scope
+        if(stmt.scope != nullptr){
+            this->dumpScope(stmt.scope, prefix);
+        }
+        else{
+            Print(prefix + "{null}");
+        }
+
+        //继续遍历
+        AstVisitor::visitForStatement(stmt, prefix+"    ");
+        return std::any();
+    }
+
     void dumpScope(std::shared_ptr<Scope>& scope, std::string prefix) {
         if (scope->name2sym.size()>0){
             //遍历该作用域的符号。
@@ -0,0 +1,87 @@
+//
+// 二元运算分派的微基准测试
+// 比较三种方式下每次运算的平均耗时（纳秒）：
+// 1.原来的三层嵌套std::map + std::function，操作数是std::any；
+// 2.VM的稠密跳转表，操作数是Value，以及VM中iadd指令的特化处理函数；
+// 3.解释器的稠密跳转表，操作数是Value。
+//
+#include "interpretor.h"
+#include "vm.h"
+
+#include <chrono>
+#include <functional>
+#include <typeindex>
+
+static const uint32_t NumIterations = 10000000;
+
+template<typename F>
+static void Run(const std::string& name, F&& body) {
+    auto start = std::chrono::steady_clock::now();
+    int64_t checksum = body();
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    printf("%-40s %8.2f ns/op  (checksum %lld)\n", name.c_str(), ns / NumIterations, static_cast<long long>(checksum));
+}
+
+int main() {
+    //1.原来的实现：每次运算要做三次树查找，再通过std::function间接调用
+    using AnyFunction = std::function<std::any(const std::any&, const std::any&)>;
+    std::map<Op, std::map<std::type_index, std::map<std::type_index, AnyFunction>>> nestedMap;
+    nestedMap[Op::Plus][std::type_index(typeid(int32_t))][std::type_index(typeid(int32_t))] = PlusIntInt<int32_t, int32_t>;
+    nestedMap[Op::Plus][std::type_index(typeid(double))][std::type_index(typeid(double))] = PlusIntInt<double, double>;
+
+    Run("nested std::map + std::function", [&]() {
+        std::any acc = 0;
+        std::any one = 1;
+        for (uint32_t i = 0; i < NumIterations; i++) {
+            auto& func = nestedMap[Op::Plus][std::type_index(acc.type())][std::type_index(one.type())];
+            acc = func(acc, one);
+        }
+        return static_cast<int64_t>(std::any_cast<int32_t>(acc));
+    });
+
+    //2.VM：按[操作码][标签][标签]查表，操作数是16字节的Value
+    Run("VM flat table (Value)", [&]() {
+        Value acc = 0;
+        Value one = 1;
+        for (uint32_t i = 0; i < NumIterations; i++) {
+            auto func = VM::GetBinaryFunction(OpCode::iadd, acc, one);
+            acc = func.value()(acc, one);
+        }
+        return static_cast<int64_t>(acc.i);
+    });
+
+    //VM执行iadd指令时的路径：两个整数直接在操作数栈上原地相加
+    Run("VM iconst_1 + iadd handler (Value stack)", [&]() {
+        Value stack[2] = {Value(0)};
+        Value* sp = stack + 1;
+        for (uint32_t i = 0; i < NumIterations; i++) {
+            *sp++ = Value(1);
+            VM::ExecuteBinary<OpCode::iadd>(sp);
+        }
+        return static_cast<int64_t>(stack[0].i);
+    });
+
+    //3.解释器：按[运算符][标签][标签]查表，操作数是16字节的Value
+    Run("Interpretor flat table (Value)", [&]() {
+        Value acc = 0;
+        Value one = 1;
+        for (uint32_t i = 0; i < NumIterations; i++) {
+            auto func = Interpretor::GetBinaryFunction(Op::Plus, acc, one);
+            acc = func.value()(acc, one);
+        }
+        return static_cast<int64_t>(acc.i);
+    });
+
+    Run("Interpretor flat table (Value, double)", [&]() {
+        Value acc = 0.0;
+        Value one = 1.0;
+        for (uint32_t i = 0; i < NumIterations; i++) {
+            auto func = Interpretor::GetBinaryFunction(Op::Plus, acc, one);
+            acc = func.value()(acc, one);
+        }
+        return static_cast<int64_t>(acc.d);
+    });
+
+    return 0;
+}
@@ -0,0 +1,107 @@
+//
+// 几种执行引擎的基准测试
+// 同一个程序分别用树遍历解释器（Interpretor）、闭包编译执行（ClosureEngine）、栈式虚拟机（VM）
+// 和寄存器虚拟机（VM::useRegisterTier）执行，
+// 比较每次执行的平均耗时（微秒）。编译/生成字节码的时间不计算在内。
+//
+// 目前语言里还没有循环语句，所以生成一个很长的直线程序：
+//   function f(a, b){ let s = a * 2 - a / 2 + b; return s - a; }
+//   let x1 = f(1, 1); let x2 = f(x1, 1); ...
+//
+#include "interpretor.h"
+#include "closure.h"
+#include "vm.h"
+#include "semantic.h"
+#include "parser.h"
+
+#include <chrono>
+
+static const uint32_t NumStatements = 500;
+static const uint32_t NumRuns = 2000;
+
+static std::string MakeProgram() {
+    std::string program =
+R"(
+function f(a : number, b : number):number{
+    let s : number = a * 2 - a / 2 + b;
+    return s - a;
+}
+let x0 : number = 1;
+)";
+    for (uint32_t i = 1; i <= NumStatements; i++) {
+        program += "let x" + std::to_string(i) + " : number = f(x" + std::to_string(i - 1) + ", " + std::to_string(i % 7 + 1) + ");\n";
+    }
+    return program;
+}
+
+template<typename F>
+static void Run(const std::string& name, F&& body) {
+    //先预热一次
+    body();
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < NumRuns; i++) {
+        body();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double us = std::chrono::duration<double, std::micro>(end - start).count();
+    printf("%-30s %10.2f us/run\n", name.c_str(), us / NumRuns);
+}
+
+int main() {
+    std::string program = MakeProgram();
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto prog = std::dynamic_pointer_cast<Prog>(ast);
+
+    //1.树遍历解释器，先不使用类型反馈，再使用类型反馈把节点特化
+    Interpretor genericInterpretor;
+    genericInterpretor.useTypeFeedback = false;
+    Run("Interpretor (no type feedback)", [&]() {
+        genericInterpretor.returning = false;
+        genericInterpretor.visit(*ast, "");
+    });
+
+    Interpretor interpretor;
+    Run("Interpretor (type feedback)", [&]() {
+        //顶层的Return语句会留下returning标记，每次执行前清掉
+        interpretor.returning = false;
+        interpretor.visit(*ast, "");
+    });
+
+    //2.闭包编译：只编译一次
+    ClosureEngine engine;
+    engine.compile(*prog);
+    Run("ClosureEngine (closures)", [&]() {
+        engine.execute();
+    });
+
+    //3.栈式虚拟机：只生成一次字节码
+    auto generator = BCGenerator();
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+    VM vm;
+    Run("VM (stack bytecode)", [&]() {
+        vm.execute(*bc);
+    });
+
+    //4.寄存器虚拟机：第一次执行时把字节码翻译成寄存器指令，之后直接执行
+    VM registerVM;
+    registerVM.useRegisterTier = true;
+    Run("VM (register tier)", [&]() {
+        registerVM.execute(*bc);
+    });
+
+    //三者的结果应该一样
+    printf("check: interpretor=%s closure=%s\n",
+        interpretor.currentFrame->slots[NumStatements].toString().c_str(),
+        engine.ctx.slots[NumStatements].toString().c_str());
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+//
+// 超级指令的基准测试
+// 1.分派次数：corpus/下的每个程序分别生成不带超级指令和带超级指令的字节码，用OpCodeProfile统计执行时分派的次数。
+// 2.执行时间：语料里的程序都会调用println，不适合反复执行计时，所以另外生成一个没有输出的长程序：
+//     function f(a, b){ let s = a * 2 - a / 2 + b; return s - a; }
+//     let x1 = f(x0, 1); let x2 = f(x1, 2); ...
+//   比较两种字节码每次执行的平均耗时。
+//
+#include "vm.h"
+#include "semantic.h"
+#include "parser.h"
+#include "common.h"
+
+#include <chrono>
+
+static const uint32_t NumStatements = 500;
+static const uint32_t NumRuns = 5000;
+
+static const char* CorpusFiles[] = {"arithmetic.ts", "calls.ts", "decimal.ts", "loops.ts", "strings.ts"};
+
+static std::string MakeProgram() {
+    std::string program =
+R"(
+function f(a : number, b : number):number{
+    let s : number = a * 2 - a / 2 + b;
+    return s - a;
+}
+let x0 : number = 1;
+)";
+    for (uint32_t i = 1; i <= NumStatements; i++) {
+        program += "let x" + std::to_string(i) + " : number = f(x" + std::to_string(i - 1) + ", " + std::to_string(i % 7 + 1) + ");\n";
+    }
+    return program;
+}
+
+static std::shared_ptr<BCModule> Compile(const std::string& program, bool useSuperInstructions) {
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto generator = BCGenerator();
+    generator.useSuperInstructions = useSuperInstructions;
+    return std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+}
+
+//执行一次，返回分派的次数
+static uint64_t CountDispatches(const BCModule& bc) {
+    OpCodeProfile profile;
+    VM vm;
+    vm.opCodeProfile = &profile;
+    vm.execute(bc);
+    return profile.numInsts;
+}
+
+static double NanosPerRun(const BCModule& bc) {
+    VM vm;
+    //先预热一次
+    vm.execute(bc);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < NumRuns; i++) {
+        vm.execute(bc);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / NumRuns;
+}
+
+int main() {
+    std::vector<std::string> lines;
+    char tmp[256] = {0};
+
+    //1.语料的分派次数
+    uint64_t totalBase = 0;
+    uint64_t totalFused = 0;
+    for (auto name: CorpusFiles) {
+        std::string program = ReadFile(std::string(CORPUS_DIR) + "/" + name);
+        uint64_t base = CountDispatches(*Compile(program, false));
+        uint64_t fused = CountDispatches(*Compile(program, true));
+        totalBase += base;
+        totalFused += fused;
+        snprintf(tmp, sizeof(tmp), "%-16s dispatches: %8llu -> %8llu (%5.1f%% fewer)", name,
+            static_cast<unsigned long long>(base), static_cast<unsigned long long>(fused), 100.0 - 100.0 * fused / base);
+        lines.push_back(tmp);
+    }
+    snprintf(tmp, sizeof(tmp), "%-16s dispatches: %8llu -> %8llu (%5.1f%% fewer)", "corpus total",
+        static_cast<unsigned long long>(totalBase), static_cast<unsigned long long>(totalFused), 100.0 - 100.0 * totalFused / totalBase);
+    lines.push_back(tmp);
+
+    //2.没有输出的长程序，比较分派次数和执行时间
+    std::string program = MakeProgram();
+    auto base = Compile(program, false);
+    auto fused = Compile(program, true);
+    uint64_t baseDispatches = CountDispatches(*base);
+    uint64_t fusedDispatches = CountDispatches(*fused);
+    double baseNanos = NanosPerRun(*base);
+    double fusedNanos = NanosPerRun(*fused);
+    snprintf(tmp, sizeof(tmp), "%-16s dispatches: %8llu -> %8llu (%5.1f%% fewer), %8.0f -> %8.0f ns/run", "calls bench",
+        static_cast<unsigned long long>(baseDispatches), static_cast<unsigned long long>(fusedDispatches),
+        100.0 - 100.0 * fusedDispatches / baseDispatches, baseNanos, fusedNanos);
+    lines.push_back(tmp);
+
+    //语料程序的输出在前面，结果放在最后
+    printf("superinstructions (%s):\n", VM_COMPUTED_GOTO ? "computed goto" : "switch");
+    for (auto& line: lines) {
+        printf("%s\n", line.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+//
+// 虚拟机条件跳转的基准测试
+// 同一个循环写成两种形式：
+//   for (let i = 0; i < N; i = i + 1) { if (i < H) s = s + 1; }
+//   for (let i = 0; (i < N) != 0; i = i + 1) { if ((i < H) != 0) s = s + 1; }
+// 第一种直接生成if_icmp*，比较之后就跳转；
+// 第二种先把比较的结果算成1或0（if_icmp* + iconst + igoto + iconst），再用ifne/ifeq判断一次，
+// 相当于没有合并比较和跳转时的代码。两者的差别就是每次迭代多执行的指令的开销。
+//
+#include "vm.h"
+#include "semantic.h"
+#include "parser.h"
+
+#include <chrono>
+
+static const uint32_t NumRuns = 200;
+static const uint32_t NumIterations = 10000;
+
+static std::string MakeProgram(bool fused) {
+    std::string n = std::to_string(NumIterations);
+    std::string h = std::to_string(NumIterations / 2);
+    std::string loopCondition = fused ? "i < " + n : "(i < " + n + ") != 0";
+    std::string ifCondition = fused ? "i < " + h : "(i < " + h + ") != 0";
+    return "let s : number = 0;\n"
+           "for (let i : number = 0; " + loopCondition + "; i = i + 1) {\n"
+           "    if (" + ifCondition + ") s = s + 1;\n"
+           "}\n";
+}
+
+static std::shared_ptr<BCModule> Compile(const std::string& program) {
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto generator = BCGenerator();
+    return std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+}
+
+//执行NumRuns次，返回平均每次迭代的耗时
+static double NanosPerIteration(const BCModule& bc) {
+    VM vm;
+
+    //先预热一次
+    vm.execute(bc);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < NumRuns; i++) {
+        vm.execute(bc);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / NumRuns / NumIterations;
+}
+
+static void Run(bool fused) {
+    auto bc = Compile(MakeProgram(fused));
+    double ns = NanosPerIteration(*bc);
+    printf("VM branches, %-13s main %3zu bytes: %6.2f ns/iteration\n",
+        fused ? "fused," : "materialized,", bc->_main->byteCode.size(), ns);
+}
+
+int main() {
+    Run(true);
+    Run(false);
+    return 0;
+}
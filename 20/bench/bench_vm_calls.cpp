@@ -0,0 +1,104 @@
+//
+// 虚拟机函数调用的基准测试
+// 生成N个语句的主程序，每个语句调用一次很小的函数：
+//   function id(a){ return a; }
+//   let x1 = id(x0); let x2 = id(x1); ...
+// 每次调用和返回都要切换当前执行的字节码。主程序越长，如果切换时拷贝字节码，
+// 每次调用的耗时就会随着N线性增长；不拷贝的话，每次调用的耗时应该与N无关。
+//
+// 另外生成一棵调用树，模拟fib那样的递归（不用分支，每一层的调用次数是确定的）：
+//   function t0(a){ return a; }
+//   function t1(a){ return t0(a) + t0(a + 1); }  ...
+//   let x = tD(1);
+// 一共有 2^(D+1)-1 次调用，调用深度是D+1，主要测调用和返回的开销。
+//
+#include "vm.h"
+#include "semantic.h"
+#include "parser.h"
+
+#include <chrono>
+
+static const uint32_t NumRuns = 200;
+static const uint32_t TreeDepth = 12;
+
+static std::string MakeProgram(uint32_t numStatements) {
+    std::string program =
+R"(
+function id(a : number):number{
+    return a;
+}
+let x0 : number = 1;
+)";
+    for (uint32_t i = 1; i <= numStatements; i++) {
+        program += "let x" + std::to_string(i) + " : number = id(x" + std::to_string(i - 1) + ");\n";
+    }
+    return program;
+}
+
+static std::string MakeTreeProgram(uint32_t depth) {
+    std::string program =
+R"(
+function t0(a : number):number{
+    return a;
+}
+)";
+    for (uint32_t i = 1; i <= depth; i++) {
+        std::string callee = "t" + std::to_string(i - 1);
+        program += "function t" + std::to_string(i) + "(a : number):number{\n";
+        program += "    return " + callee + "(a) + " + callee + "(a + 1);\n";
+        program += "}\n";
+    }
+    program += "let x : number = t" + std::to_string(depth) + "(1);\n";
+    return program;
+}
+
+static std::shared_ptr<BCModule> Compile(const std::string& program) {
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto generator = BCGenerator();
+    return std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+}
+
+//执行NumRuns次，返回平均每次执行的耗时
+static double NanosPerRun(const BCModule& bc) {
+    VM vm;
+
+    //先预热一次
+    vm.execute(bc);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < NumRuns; i++) {
+        vm.execute(bc);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / NumRuns;
+}
+
+static void Run(uint32_t numStatements) {
+    auto bc = Compile(MakeProgram(numStatements));
+    double ns = NanosPerRun(*bc);
+    printf("VM calls, %5u statements, main %6zu bytes: %8.1f ns/call\n",
+        numStatements, bc->_main->byteCode.size(), ns / numStatements);
+}
+
+static void RunTree(uint32_t depth) {
+    auto bc = Compile(MakeTreeProgram(depth));
+    double ns = NanosPerRun(*bc);
+    uint32_t numCalls = (1u << (depth + 1)) - 1;
+    printf("VM call tree, depth %2u, %6u calls:            %8.1f ns/call\n", depth, numCalls, ns / numCalls);
+}
+
+int main() {
+    for (uint32_t n: {100, 1000, 4000}) {
+        Run(n);
+    }
+    RunTree(TreeDepth);
+    return 0;
+}
@@ -0,0 +1,95 @@
+//
+// 虚拟机指令分派的基准测试
+// 生成一个只有算术运算、没有函数调用的长程序：
+//   let x0 = 1; let x1 = 2; let x2 = x1 - x1 + x0 * 1 + 1; let x3 = x2 - x2 + x1 * 1 + 1; ...
+// 变量不超过255个，本地变量的下标只需要一个字节，不用wide前缀。
+// 每条指令的处理代码都很短，耗时主要在指令分派上，适合比较switch和computed goto两种分派方式。
+// 同一个程序也用寄存器虚拟机（见regvm.h）执行一遍，比较的是执行整个程序的时间，以及需要分派的指令条数。
+//
+#include "vm.h"
+#include "regvm.h"
+#include "semantic.h"
+#include "parser.h"
+
+#include <chrono>
+
+static const uint32_t NumStatements = 250;
+static const uint32_t NumRuns = 5000;
+
+static std::string MakeProgram() {
+    std::string program =
+R"(
+let x0 : number = 1;
+let x1 : number = 2;
+)";
+    for (uint32_t i = 2; i < NumStatements; i++) {
+        auto x1 = "x" + std::to_string(i - 1);
+        auto x2 = "x" + std::to_string(i - 2);
+        program += "let x" + std::to_string(i) + " : number = " + x1 + " - " + x1 + " + " + x2 + " * 1 + 1;\n";
+    }
+    return program;
+}
+
+int main() {
+    std::string program = MakeProgram();
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto generator = BCGenerator();
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+
+    //统计指令条数，用来计算每条指令的平均耗时
+    auto& code = bc->_main->byteCode;
+    uint32_t numInsts = 0;
+    for (uint32_t i = 0; i < code.size(); i++) {
+        numInsts++;
+        switch (code[i]) {
+            case OpCode::bipush:
+            case OpCode::ldc:
+            case OpCode::sldc:
+            case OpCode::iload:
+            case OpCode::istore:
+                i += 1;
+                break;
+            case OpCode::sipush:
+            case OpCode::ldc2_w:
+            case OpCode::invokestatic:
+            case OpCode::invoketail:
+                i += 2;
+                break;
+            default:
+                break;
+        }
+    }
+
+    //先预热一次，然后计算每次执行的平均耗时（纳秒）
+    auto run = [&](VM& vm) {
+        vm.execute(*bc);
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < NumRuns; i++) {
+            vm.execute(*bc);
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count() / NumRuns;
+    };
+
+    VM vm;
+    double ns = run(vm);
+    printf("VM dispatch (%s), %u instructions: %6.2f ns/instruction, %8.0f ns/run\n",
+        VM_COMPUTED_GOTO ? "computed goto" : "switch", numInsts, ns / numInsts, ns);
+
+    VM registerVM;
+    registerVM.useRegisterTier = true;
+    ns = run(registerVM);
+    if (registerVM.registerVM != nullptr && registerVM.registerVM->module != nullptr) {
+        printf("VM register tier, %u instructions: %6.2f ns/instruction, %8.0f ns/run\n",
+            registerVM.registerVM->module->numRegInsts, ns / registerVM.registerVM->module->numRegInsts, ns);
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+//
+// 栈顶缓存的基准测试（见vmcache.cpp）
+// 同一份字节码分别用普通的主循环和栈顶缓存的主循环执行，比较执行整个程序的时间：
+//   expressions：只有算术运算的长程序，与bench_vm_dispatch相同，每条语句都是一个比较深的表达式
+//   loop：循环里计算一个表达式，有iinc和条件跳转
+//   calls：递归的fib，每次调用和返回都要把缓存写回内存，栈顶缓存的收益最小
+//
+#include "vm.h"
+#include "semantic.h"
+#include "parser.h"
+
+#include <chrono>
+
+static const uint32_t NumRuns = 2000;
+
+static std::string ExpressionsProgram() {
+    std::string program = "let x0 : number = 1;\nlet x1 : number = 2;\n";
+    //变量不超过255个，本地变量的下标只需要一个字节，不用wide前缀
+    for (uint32_t i = 2; i < 250; i++) {
+        auto x1 = "x" + std::to_string(i - 1);
+        auto x2 = "x" + std::to_string(i - 2);
+        program += "let x" + std::to_string(i) + " : number = " + x1 + " - " + x1 + " + " + x2 + " * 1 + 1;\n";
+    }
+    return program;
+}
+
+static std::string LoopProgram() {
+    return "let s : number = 0;\n"
+           "for (let i : number = 0; i < 1000; i++) {\n"
+           "    s = s + i * 3 - (i / 2 + 1) * 2;\n"
+           "}\n";
+}
+
+static std::string CallsProgram() {
+    return "function fib(n : number):number{\n"
+           "    if (n < 2) return n;\n"
+           "    return fib(n - 1) + fib(n - 2);\n"
+           "}\n"
+           "let r : number = fib(12);\n";
+}
+
+static std::shared_ptr<BCModule> Compile(const std::string& program) {
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto generator = BCGenerator();
+    return std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+}
+
+//执行NumRuns次，返回平均每次的耗时
+static double MicrosPerRun(const BCModule& bc, bool useStackCache) {
+    VM vm;
+    vm.useStackCache = useStackCache;
+
+    //先预热一次
+    if (vm.execute(bc) != 0) {
+        printf("execution failed\n");
+        return 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < NumRuns; i++) {
+        vm.execute(bc);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count() / NumRuns;
+}
+
+static void Run(const char* name, const std::string& program) {
+    auto bc = Compile(program);
+    double plain = MicrosPerRun(*bc, false);
+    double cached = MicrosPerRun(*bc, true);
+    printf("VM stack cache, %-12s plain: %8.2f us/run, cached: %8.2f us/run, speedup: %.2fx\n",
+        name, plain, cached, plain / cached);
+}
+
+int main() {
+    Run("expressions,", ExpressionsProgram());
+    Run("loop,", LoopProgram());
+    Run("calls,", CallsProgram());
+    return 0;
+}
@@ -0,0 +1,367 @@
+#include "closure.h"
+
+#include <optional>
+
+//
+// 两个整数的快速路径
+// 整数运算是最常见的情况，直接在闭包里内联计算，不需要查跳转表。
+//
+static std::optional<Value> IntIntOp(Op op, int32_t l, int32_t r) {
+    switch (op) {
+        case Op::Plus:
+            return Value(l + r);
+        case Op::Minus:
+            return Value(l - r);
+        case Op::Multiply:
+            return Value(l * r);
+        case Op::G:
+            return Value(l > r);
+        case Op::GE:
+            return Value(l >= r);
+        case Op::L:
+            return Value(l < r);
+        case Op::LE:
+            return Value(l <= r);
+        case Op::EQ:
+            return Value(l == r);
+        case Op::NE:
+            return Value(l != r);
+        default:
+            //除法和取模仍然走跳转表，以保持与Interpretor相同的语义
+            return std::nullopt;
+    }
+}
+
+template<Op op>
+static Closure MakeIntIntBinary(Closure exp1, Closure exp2) {
+    return [exp1, exp2](ClosureContext& ctx) {
+        Value v1 = exp1(ctx);
+        Value v2 = exp2(ctx);
+        if (v1.tag == ValueTag::Integer && v2.tag == ValueTag::Integer) {
+            return IntIntOp(op, v1.i, v2.i).value();
+        }
+
+        auto func = Interpretor::GetBinaryFunction(op, v1, v2);
+        if (!func) {
+            dbg("Unsupported binary operation: " + toString(op));
+            return Value();
+        }
+        return func.value()(v1, v2);
+    };
+}
+
+static Closure MakeBinary(Op op, Closure exp1, Closure exp2) {
+    switch (op) {
+        case Op::Plus:
+            return MakeIntIntBinary<Op::Plus>(exp1, exp2);
+        case Op::Minus:
+            return MakeIntIntBinary<Op::Minus>(exp1, exp2);
+        case Op::Multiply:
+            return MakeIntIntBinary<Op::Multiply>(exp1, exp2);
+        case Op::G:
+            return MakeIntIntBinary<Op::G>(exp1, exp2);
+        case Op::GE:
+            return MakeIntIntBinary<Op::GE>(exp1, exp2);
+        case Op::L:
+            return MakeIntIntBinary<Op::L>(exp1, exp2);
+        case Op::LE:
+            return MakeIntIntBinary<Op::LE>(exp1, exp2);
+        case Op::EQ:
+            return MakeIntIntBinary<Op::EQ>(exp1, exp2);
+        case Op::NE:
+            return MakeIntIntBinary<Op::NE>(exp1, exp2);
+        default:
+            break;
+    }
+
+    //其他运算符，按运行时的标签查跳转表
+    return [op, exp1, exp2](ClosureContext& ctx) {
+        Value v1 = exp1(ctx);
+        Value v2 = exp2(ctx);
+        auto func = Interpretor::GetBinaryFunction(op, v1, v2);
+        if (!func) {
+            dbg("Unsupported binary operation: " + toString(op));
+            return Value();
+        }
+        return func.value()(v1, v2);
+    };
+}
+
+std::any ClosureCompiler::visitBinary(Binary& bi, std::string prefix) {
+    //赋值运算：左边必须是一个变量。复合赋值 a += b 编译成 a = a + b
+    if (IsAssignOp(bi.op)) {
+        auto variable = std::dynamic_pointer_cast<Variable>(bi.exp1);
+        if (variable == nullptr || variable->sym == nullptr || variable->sym->kind != SymKind::Variable) {
+            dbg("Error: the left side of an assignment must be a variable");
+            return this->constant(Value());
+        }
+
+        uint32_t index = std::static_pointer_cast<VarSymbol>(variable->sym)->index;
+        auto exp2 = this->compile(*bi.exp2);
+        if (bi.op != Op::Assign) {
+            exp2 = MakeBinary(CompoundAssignOp(bi.op), this->compile(*bi.exp1), exp2);
+        }
+        return Closure([index, exp2](ClosureContext& ctx) {
+            Value v = exp2(ctx);
+            ctx.slots[ctx.base + index] = v;
+            return v;
+        });
+    }
+
+    if (bi.op < Op::Plus || bi.op > Op::LE) {
+        dbg("Unsupported binary, Op: " + toString(bi.op));
+        return this->constant(Value());
+    }
+
+    //两边都是字面量：类型在编译时就确定了，直接绑定运算函数
+    auto lit1 = this->literalValue(*bi.exp1);
+    auto lit2 = this->literalValue(*bi.exp2);
+    if (lit1 && lit2) {
+        auto func = Interpretor::GetBinaryFunction(bi.op, lit1.value(), lit2.value());
+        if (!func) {
+            dbg("Unsupported binary operation: " + toString(bi.op));
+            return this->constant(Value());
+        }
+        auto f = func.value();
+        Value v1 = lit1.value();
+        Value v2 = lit2.value();
+        return Closure([f, v1, v2](ClosureContext& ctx) {
+            return f(v1, v2);
+        });
+    }
+
+    return MakeBinary(bi.op, this->compile(*bi.exp1), this->compile(*bi.exp2));
+}
+
+std::any ClosureCompiler::visitUnary(Unary& exp, std::string prefix) {
+    //++、--：操作数必须是变量。前缀表达式的值是加减之后的值，后缀表达式的值是原来的值
+    if (exp.op == Op::Inc || exp.op == Op::Dec) {
+        auto variable = std::dynamic_pointer_cast<Variable>(exp.exp);
+        if (variable == nullptr || variable->sym == nullptr || variable->sym->kind != SymKind::Variable) {
+            dbg("Error: the operand of ++ or -- must be a variable");
+            return this->constant(Value());
+        }
+
+        uint32_t index = std::static_pointer_cast<VarSymbol>(variable->sym)->index;
+        auto update = MakeBinary(exp.op == Op::Inc ? Op::Plus : Op::Minus, this->compile(*exp.exp), this->constant(Value(1)));
+        bool isPrefix = exp.isPrefix;
+        return Closure([index, update, isPrefix](ClosureContext& ctx) {
+            Value oldValue = ctx.slots[ctx.base + index];
+            Value newValue = update(ctx);
+            ctx.slots[ctx.base + index] = newValue;
+            return isPrefix ? newValue : oldValue;
+        });
+    }
+
+    switch (exp.op) {
+        case Op::Plus:
+            return this->compile(*exp.exp);
+        case Op::Minus:
+        {
+            //负的字面量在编译时就算出来
+            auto lit = this->literalValue(*exp.exp);
+            auto func = lit ? Interpretor::GetBinaryFunction(Op::Minus, Value(0), lit.value()) : std::nullopt;
+            if (func) {
+                return this->constant(func.value()(Value(0), lit.value()));
+            }
+            return MakeBinary(Op::Minus, this->constant(Value(0)), this->compile(*exp.exp));
+        }
+        default:
+            dbg("Unsupported unary, Op: " + toString(exp.op));
+            return this->constant(Value());
+    }
+}
+
+std::optional<Value> ClosureCompiler::literalValue(AstNode& node) {
+    if (auto n = dynamic_cast<IntegerLiteral*>(&node)) {
+        return Value(n->value);
+    } else if (auto n = dynamic_cast<DecimalLiteral*>(&node)) {
+        return Value(n->value);
+    } else if (auto n = dynamic_cast<StringLiteral*>(&node)) {
+        return Value(StringPool::intern(n->value));
+    }
+    return std::nullopt;
+}
+
+std::any ClosureCompiler::visitFunctionCall(FunctionCall& functionCall, std::string prefix) {
+    auto desc = functionCall.callDesc;
+    if (desc == nullptr) {
+        dbg("Runtime error, cannot find declaration of " + functionCall.name +".");
+        return this->constant(Value());
+    }
+
+    //内置函数和注册的原生函数在链接调用点时就确定下来：实参计算到一个连续的数组里，再通过生成的适配代码调用
+    if (desc->builtin != BuiltinId::None) {
+        auto native = NativeFunctions()[static_cast<size_t>(desc->builtin)];
+        std::vector<Closure> args;
+        for (uint32_t i = 0; i < native.numParams && i < functionCall.arguments.size(); i++) {
+            args.push_back(this->compile(*functionCall.arguments[i]));
+        }
+        return Closure([native, args](ClosureContext& ctx) {
+            Value values[MaxNativeParams];
+            for (size_t i = 0; i < args.size(); i++) {
+                values[i] = args[i](ctx);
+            }
+            Value ret;
+            if (!native.call(values, ret)) {
+                dbg("Runtime error, argument type mismatch when calling " + native.name + ".");
+            }
+            return ret;
+        });
+    }
+
+    //被调用的函数，以及每个实参要写入的槽位，都在编译时确定
+    auto fun = this->getFunction(desc->callee);
+    std::vector<std::pair<uint32_t, Closure>> args;
+    for (uint32_t i = 0; i < desc->paramSlots.size() && i < functionCall.arguments.size(); i++) {
+        args.push_back({desc->paramSlots[i], this->compile(*functionCall.arguments[i])});
+    }
+
+    //尾调用：复用当前栈桢，由调用者所在的RunFunction()接着执行被调用的函数
+    if (functionCall.isTailCall) {
+        return Closure([fun, args](ClosureContext& ctx) {
+            //1.计算参数。参数可能引用当前栈桢中的变量，所以要先全部算完
+            size_t first = ctx.tailArgs.size();
+            for (auto& arg: args) {
+                Value v = arg.second(ctx);
+                ctx.tailArgs.push_back(v);
+            }
+
+            //2.复用当前栈桢
+            ctx.top = ctx.base + fun->numSlots;
+            if (ctx.slots.size() < ctx.top) {
+                ctx.slots.resize(ctx.top);
+            }
+            for (uint32_t i = ctx.base; i < ctx.top; i++) {
+                ctx.slots[i] = Value();
+            }
+            for (size_t i = 0; i < args.size(); i++) {
+                ctx.slots[ctx.base + args[i].first] = ctx.tailArgs[first + i];
+            }
+            ctx.tailArgs.resize(first);
+
+            ctx.tailCall = fun.get();
+            return Value();
+        });
+    }
+
+    return Closure([fun, args](ClosureContext& ctx) {
+        //栈向低地址增长
+        char marker = 0;
+        if (ctx.depth >= ClosureContext::MaxCallDepth ||
+            static_cast<size_t>(ctx.stackBase - &marker) > ClosureContext::MaxStackBytes) {
+            dbg("Error: stack overflow when calling " + fun->name);
+            ctx.aborted = true;
+            ctx.returning = true;
+            return Value();
+        }
+
+        //1.在slots的顶部分配新栈桢。先移动top，这样计算参数时如果有嵌套调用，会分配在更上面
+        uint32_t oldBase = ctx.base;
+        uint32_t oldTop = ctx.top;
+        uint32_t newBase = ctx.top;
+        ctx.top = newBase + fun->numSlots;
+        if (ctx.slots.size() < ctx.top) {
+            ctx.slots.resize(ctx.top);
+        }
+        for (uint32_t i = newBase; i < ctx.top; i++) {
+            ctx.slots[i] = Value();
+        }
+
+        //2.计算参数值，保存到新栈桢中。slots可能会扩容，所以只用下标访问
+        for (auto& arg: args) {
+            Value v = arg.second(ctx);
+            ctx.slots[newBase + arg.first] = v;
+        }
+
+        //3.执行函数
+        ctx.retVal = Value();
+        ctx.base = newBase;
+        ctx.depth++;
+        RunFunction(*fun, ctx);
+        ctx.depth--;
+        ctx.returning = ctx.aborted;
+
+        //4.恢复调用者的栈桢
+        ctx.base = oldBase;
+        ctx.top = oldTop;
+
+        Value ret = ctx.retVal;
+        ctx.retVal = Value();
+        return ret;
+    });
+}
+
+std::any ClosureCompiler::visitBenchStatement(BenchStatement& stmt, std::string prefix) {
+    auto name = this->compile(*stmt.name);
+    auto iterations = this->compile(*stmt.iterations);
+    auto body = this->compile(*stmt.body);
+
+    return Closure([name, iterations, body](ClosureContext& ctx) {
+        Value n = name(ctx);
+        Value count = iterations(ctx);
+        if (count.tag != ValueTag::Integer || count.i < 0) {
+            dbg("Error: the iterations of bench statement must be a non-negative integer");
+            return Value();
+        }
+
+        //每次迭代单独计时
+        std::vector<double> samples;
+        samples.reserve(count.i);
+        for (int32_t i = 0; i < count.i; i++) {
+            double start = TickNanos();
+            body(ctx);
+            samples.push_back(TickNanos() - start);
+            if (ctx.returning) {
+                break;
+            }
+        }
+
+        Print(BenchReport(n.toString(), samples));
+        return Value();
+    });
+}
+
+std::any ClosureCompiler::visitIfStatement(IfStatement& stmt, std::string prefix) {
+    auto condition = this->compile(*stmt.condition);
+    auto then = this->compile(*stmt.stmt);
+    if (stmt.elseStmt == nullptr) {
+        return Closure([condition, then](ClosureContext& ctx) {
+            if (condition(ctx).isTruthy()) {
+                then(ctx);
+            }
+            return Value();
+        });
+    }
+
+    auto otherwise = this->compile(*stmt.elseStmt);
+    return Closure([condition, then, otherwise](ClosureContext& ctx) {
+        if (condition(ctx).isTruthy()) {
+            then(ctx);
+        }
+        else {
+            otherwise(ctx);
+        }
+        return Value();
+    });
+}
+
+std::any ClosureCompiler::visitForStatement(ForStatement& stmt, std::string prefix) {
+    //省略的部分编译成空的闭包，省略了条件时一直循环，直到执行了返回语句
+    auto init = stmt.init != nullptr ? this->compile(*stmt.init) : this->constant(Value());
+    auto condition = stmt.condition != nullptr ? this->compile(*stmt.condition) : this->constant(Value(true));
+    auto increment = stmt.increment != nullptr ? this->compile(*stmt.increment) : this->constant(Value());
+    auto body = this->compile(*stmt.stmt);
+
+    return Closure([init, condition, increment, body](ClosureContext& ctx) {
+        init(ctx);
+        while (condition(ctx).isTruthy()) {
+            body(ctx);
+            if (ctx.returning) {
+                break;
+            }
+            increment(ctx);
+        }
+        return Value();
+    });
+}
@@ -0,0 +1,322 @@
+#ifndef __CLOSURE_H_
+#define __CLOSURE_H_
+
+#include "scanner.h"
+#include "types.h"
+#include "symbol.h"
+#include "common.h"
+#include "ast.h"
+#include "value.h"
+#include "interpretor.h"
+#include "timing.h"
+
+#include "dbg.h"
+
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <any>
+#include <stdint.h>
+#include <functional>
+#include <optional>
+
+//
+// 闭包编译执行模式
+// 把语义分析之后的AST一次性编译成一棵C++闭包树，每个闭包只处理一种节点，
+// 变量的槽位、内置函数、被调用的函数等都在编译时绑定好。
+// 运行时直接调用闭包，不再经过accept()的虚函数分派和std::any装箱，也不再比较内置函数的名称。
+// 语义与Interpretor保持一致。
+//
+
+struct CompiledFunction;
+
+//
+// 运行时的上下文
+// 所有栈桢的本地变量都连续存放在slots里，当前栈桢从base开始。
+//
+struct ClosureContext{
+    //调用的最大深度，与VM::MaxCallDepth相同。尾调用复用栈桢，不计入深度
+    static constexpr uint32_t MaxCallDepth = 4096;
+
+    //每层调用都要经过几个闭包，占用的C++栈跟编译选项有关（不优化时大约2KB），
+    //所以同时限制使用的C++栈的大小，留出足够的余量（线程的栈通常是8MB）
+    static constexpr size_t MaxStackBytes = 4 * 1024 * 1024;
+
+    std::vector<Value> slots;
+
+    //当前栈桢在slots中的起始位置
+    uint32_t base {0};
+
+    //下一个栈桢的起始位置
+    uint32_t top {0};
+
+    //函数的返回值
+    Value retVal;
+
+    //当前是否执行了一个Return语句，正在从函数中返回
+    bool returning {false};
+
+    //当前函数以尾调用返回：栈桢已经交给这个函数，返回之后接着执行它的函数体，见RunFunction()
+    CompiledFunction* tailCall {nullptr};
+
+    //尾调用的实参先计算到这里，因为实参可能引用当前栈桢中的变量
+    std::vector<Value> tailArgs;
+
+    //当前调用的深度
+    uint32_t depth {0};
+
+    //开始执行时C++栈的位置，用来计算已经使用的栈的大小
+    const char* stackBase {nullptr};
+
+    //发生了运行时错误（比如栈溢出），正在中止执行。中止时returning也一直是true，所有语句都不再执行
+    bool aborted {false};
+};
+
+using Closure = std::function<Value(ClosureContext&)>;
+
+//
+// 编译后的函数
+//
+struct CompiledFunction{
+    std::string name;
+
+    //参数的数量。参数占据栈桢中最前面的几个槽位
+    uint32_t numParams {0};
+
+    //栈桢中槽位的数量，也就是本地变量（包括参数）的数量
+    uint32_t numSlots {0};
+
+    //函数体
+    Closure body;
+};
+
+/**
+ * 执行一个函数的函数体。
+ * 如果函数以尾调用返回，被调用的函数已经复用了当前栈桢，在这里接着执行，C++栈不会增长。
+ * 与Interpretor::callFunction的做法相同。
+ */
+inline void RunFunction(const CompiledFunction& fun, ClosureContext& ctx) {
+    fun.body(ctx);
+    while (ctx.tailCall != nullptr && !ctx.aborted) {
+        auto next = ctx.tailCall;
+        ctx.tailCall = nullptr;
+        ctx.returning = false;
+        next->body(ctx);
+    }
+    ctx.tailCall = nullptr;
+}
+
+class ClosureCompiler: public AstVisitor{
+public:
+    //每个函数符号对应的编译结果。
+    //调用点在编译时就持有被调用函数的CompiledFunction，函数体可以在之后才编译，这样支持递归和先调用后声明。
+    std::map<FunctionSymbol*, std::shared_ptr<CompiledFunction>> functions;
+
+    std::shared_ptr<CompiledFunction> getFunction(FunctionSymbol* sym) {
+        auto it = this->functions.find(sym);
+        if (it != this->functions.end()) {
+            return it->second;
+        }
+
+        auto fun = std::make_shared<CompiledFunction>();
+        fun->name = sym->name;
+        fun->numParams = sym->getNumParams();
+        fun->numSlots = sym->vars.size();
+        this->functions.insert({sym, fun});
+        return fun;
+    }
+
+    /**
+     * 把一个AST节点编译成闭包
+     */
+    Closure compile(AstNode& node) {
+        auto r = this->visit(node);
+        if (!r.has_value() || !isType<Closure>(r)) {
+            return [](ClosureContext& ctx) { return Value(); };
+        }
+        return std::any_cast<Closure>(r);
+    }
+
+    /**
+     * 编译整个程序，返回代表main函数的CompiledFunction
+     */
+    std::shared_ptr<CompiledFunction> compileProg(Prog& prog) {
+        if (prog.sym == nullptr) {
+            dbg("Error: prog.sym is nullptr, run semantic analysis first");
+            return nullptr;
+        }
+        auto main = this->getFunction(prog.sym.get());
+        main->body = this->compile(prog);
+        return main;
+    }
+
+    std::any visitProg(Prog& prog, std::string prefix) override {
+        return this->visitBlock(prog, prefix);
+    }
+
+    std::any visitBlock(Block& block, std::string prefix) override {
+        std::vector<Closure> stmts;
+        for (auto& x: block.stmts) {
+            //函数声明在编译时处理，运行时不需要执行
+            if (std::dynamic_pointer_cast<FunctionDecl>(x) != nullptr) {
+                this->visit(*x);
+                continue;
+            }
+            stmts.push_back(this->compile(*x));
+        }
+
+        return Closure([stmts](ClosureContext& ctx) {
+            for (auto& stmt: stmts) {
+                stmt(ctx);
+                //执行了返回语句，就不再执行后面的语句
+                if (ctx.returning) {
+                    break;
+                }
+            }
+            return Value();
+        });
+    }
+
+    std::any visitFunctionDecl(FunctionDecl& functionDecl, std::string prefix) override {
+        if (functionDecl.sym == nullptr) {
+            dbg("Error: functionDecl.sym is nullptr: " + functionDecl.name);
+            return std::any();
+        }
+        auto fun = this->getFunction(functionDecl.sym.get());
+        fun->body = this->compile(*functionDecl.body);
+        return std::any();
+    }
+
+    std::any visitVariableStatement(VariableStatement& variableStmt, std::string prefix) override {
+        return this->visit(*variableStmt.variableDecl);
+    }
+
+    std::any visitExpressionStatement(ExpressionStatement& stmt, std::string prefix) override {
+        return this->visit(*stmt.exp);
+    }
+
+    std::any visitVariableDecl(VariableDecl& variableDecl, std::string prefix) override {
+        if (variableDecl.init == nullptr || variableDecl.sym == nullptr) {
+            return std::any();
+        }
+
+        auto init = this->compile(*variableDecl.init);
+        uint32_t index = variableDecl.sym->index;
+        return Closure([init, index](ClosureContext& ctx) {
+            Value v = init(ctx);
+            ctx.slots[ctx.base + index] = v;
+            return Value();
+        });
+    }
+
+    std::any visitVariable(Variable& v, std::string prefix) override {
+        if (v.sym == nullptr || v.sym->kind != SymKind::Variable) {
+            dbg("Error: can't find VariableValue: " + v.name);
+            return std::any();
+        }
+
+        uint32_t index = std::static_pointer_cast<VarSymbol>(v.sym)->index;
+        return Closure([index](ClosureContext& ctx) {
+            return ctx.slots[ctx.base + index];
+        });
+    }
+
+    std::any visitIntegerLiteral(IntegerLiteral& node, std::string prefix) override {
+        return this->constant(Value(node.value));
+    }
+
+    std::any visitDecimalLiteral(DecimalLiteral& node, std::string prefix) override {
+        return this->constant(Value(node.value));
+    }
+
+    std::any visitStringLiteral(StringLiteral& node, std::string prefix) override {
+        return this->constant(Value(node.value));
+    }
+
+    Closure constant(Value value) {
+        return [value](ClosureContext& ctx) { return value; };
+    }
+
+    std::any visitReturnStatement(ReturnStatement& returnStatement, std::string prefix) override {
+        if (returnStatement.exp == nullptr) {
+            return Closure([](ClosureContext& ctx) {
+                ctx.returning = true;
+                return Value();
+            });
+        }
+
+        auto exp = this->compile(*returnStatement.exp);
+        return Closure([exp](ClosureContext& ctx) {
+            ctx.retVal = exp(ctx);
+            ctx.returning = true;
+            return Value();
+        });
+    }
+
+    std::any visitFunctionCall(FunctionCall& functionCall, std::string prefix) override;
+
+    std::any visitBinary(Binary& bi, std::string prefix) override;
+
+    std::any visitUnary(Unary& exp, std::string prefix) override;
+
+    std::any visitBenchStatement(BenchStatement& stmt, std::string prefix) override;
+
+    std::any visitIfStatement(IfStatement& stmt, std::string prefix) override;
+
+    std::any visitForStatement(ForStatement& stmt, std::string prefix) override;
+
+    //如果节点是字面量，返回它的值
+    std::optional<Value> literalValue(AstNode& node);
+};
+
+//
+// 闭包执行引擎
+//
+class ClosureEngine{
+public:
+    ClosureCompiler compiler;
+    ClosureContext ctx;
+
+    //编译结果，可以反复执行
+    std::shared_ptr<CompiledFunction> main;
+
+    /**
+     * 编译程序。需要先做完语义分析。
+     */
+    bool compile(Prog& prog) {
+        this->main = this->compiler.compileProg(prog);
+        return this->main != nullptr;
+    }
+
+    /**
+     * 执行编译好的程序
+     */
+    void execute() {
+        if (this->main == nullptr) {
+            dbg("Error: nothing to execute, compile first");
+            return;
+        }
+
+        this->ctx.slots.assign(this->main->numSlots, Value());
+        this->ctx.base = 0;
+        this->ctx.top = this->main->numSlots;
+        this->ctx.returning = false;
+        this->ctx.tailCall = nullptr;
+        this->ctx.tailArgs.clear();
+        this->ctx.depth = 0;
+        this->ctx.aborted = false;
+        char marker = 0;
+        this->ctx.stackBase = &marker;
+        RunFunction(*this->main, this->ctx);
+        this->ctx.returning = false;
+    }
+
+    void run(Prog& prog) {
+        if (this->compile(prog)) {
+            this->execute();
+        }
+    }
+};
+
+#endif
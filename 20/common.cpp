@@ -9,6 +9,9 @@
 #include <functional>
 #include <typeindex>
 #include <typeinfo>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 
 std::string Print(const std::string& str, Color color) {
     static std::map<Color, std::string> colors {
@@ -52,8 +55,10 @@ any_visitor {
     to_any_visitor<int32_t>([](int32_t x){ Print(std::to_string(x)); }),
     to_any_visitor<uint32_t>([](uint32_t x){ Print(std::to_string(x)); }),
     to_any_visitor<float>([](float x){ Print(std::to_string(x)); }),
-    to_any_visitor<double>([](double x){ Print(std::to_string(x)); }),
+    to_any_visitor<double>([](double x){ Print(ValueToString(x)); }),
+    to_any_visitor<bool>([](bool x){ Print(x ? "true" : "false"); }),
     to_any_visitor<char const*>([](char const *s){ Print(s); }),
+    to_any_visitor<std::string>([](const std::string& s){ Print(s); }),
     // ... add more handlers for your types ...
 };
 
@@ -66,6 +71,20 @@ void PrintAny(const std::any& a) {
     }
 }
 
+ValueTag TagOf(const std::any& a) {
+    const auto& type = a.type();
+    if (type == typeid(int32_t)) {
+        return ValueTag::Integer;
+    } else if (type == typeid(double)) {
+        return ValueTag::Decimal;
+    } else if (type == typeid(std::string)) {
+        return ValueTag::String;
+    } else if (type == typeid(bool)) {
+        return ValueTag::Boolean;
+    }
+    return ValueTag::Undefined;
+}
+
 std::string PrintHex(const std::vector<uint8_t>& byteCode, Color color) {
     std::string str("[");
     bool start = true;
@@ -84,3 +103,33 @@ std::string PrintHex(const std::vector<uint8_t>& byteCode, Color color) {
 
     return Print(str, color);
 }
+
+
+std::string BenchReport(const std::string& name, std::vector<double>& samples) {
+    if (samples.empty()) {
+        return "bench " + name + ": no iterations";
+    }
+
+    std::sort(samples.begin(), samples.end());
+    //p99用最近秩法：第ceil(0.99 * N)个样本
+    size_t n = samples.size();
+    size_t p99 = (n * 99 + 99) / 100;
+    p99 = p99 == 0 ? 0 : p99 - 1;
+
+    char tmp[256] = {0};
+    snprintf(tmp, sizeof(tmp), "min=%.0fns median=%.0fns p99=%.0fns (%zu iterations)",
+        samples[0], samples[n / 2], samples[p99], n);
+    return "bench " + name + ": " + tmp;
+}
+
+std::string ReadFile(const std::string& filename) {
+    std::ifstream ifile(filename.c_str());
+    if (!ifile.is_open()) {
+        dbg("Open file: [" + filename + "] failed.");
+        return "";
+    }
+
+    std::ostringstream buf;
+    buf << ifile.rdbuf();
+    return buf.str();
+}
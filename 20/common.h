@@ -5,6 +5,9 @@
 #include <type_traits>
 #include <any>
 #include <vector>
+#include <array>
+#include <charconv>
+#include <cmath>
 
 #include <iostream>
 #include <sstream>
@@ -18,6 +21,45 @@ enum class Color {
 
 };
 
+//
+// 运行时值的类型标签
+// 二元运算按照左右两个操作数的标签对，到一个小的跳转表里去找处理函数，
+// 这样联合类型（比如 number|string）的值也不需要逐级去查std::type_index。
+//
+enum class ValueTag: uint8_t {
+    Undefined = 0,
+    Integer,
+    Decimal,
+    Boolean,
+    String,
+    Function,
+
+    Count,  //标签的数量，不是一个真正的标签
+};
+
+constexpr size_t NumValueTags = static_cast<size_t>(ValueTag::Count);
+
+//以标签对为下标的跳转表
+template<typename F>
+using TagTable = std::array<std::array<F, NumValueTags>, NumValueTags>;
+
+template<typename T>
+constexpr ValueTag TagOf() {
+    if constexpr (std::is_same_v<T, int32_t>) {
+        return ValueTag::Integer;
+    } else if constexpr (std::is_same_v<T, double>) {
+        return ValueTag::Decimal;
+    } else if constexpr (std::is_same_v<T, bool>) {
+        return ValueTag::Boolean;
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        return ValueTag::String;
+    } else {
+        return ValueTag::Undefined;
+    }
+}
+
+ValueTag TagOf(const std::any& a);
+
 template<typename T>
 bool isType(const std::any& a) {
     return typeid(T) == a.type();
@@ -28,101 +70,142 @@ bool CheckType(const std::any& val, T t) {
     return isType<T>(val) && std::any_cast<T>(val) == t;
 }
 
-template<typename T1, typename T2>
-std::any PlusIntInt(const std::any& l, const std::any& r) {
-    T1 v1 = std::any_cast<T1>(l);
-    T2 v2 = std::any_cast<T2>(r);
-    std::any ret = v1 + v2;
+//
+// 从运行时值中取出C++类型的值。
+// 下面的二元运算模板通过它同时支持std::any（VM）和Value（解释器，见value.h）。
+//
+template<typename T>
+T Unbox(const std::any& v) {
+    return std::any_cast<T>(v);
+}
+
+template<typename T1, typename T2, typename V = std::any>
+V PlusIntInt(const V& l, const V& r) {
+    T1 v1 = Unbox<T1>(l);
+    T2 v2 = Unbox<T2>(r);
+    V ret = v1 + v2;
 
     return ret;
 }
 
-template<typename T1, typename T2>
-std::any MinusIntInt(const std::any& l, const std::any& r) {
-    T1 v1 = std::any_cast<T1>(l);
-    T2 v2 = std::any_cast<T2>(r);
-    std::any ret = v1 - v2;
+template<typename T1, typename T2, typename V = std::any>
+V MinusIntInt(const V& l, const V& r) {
+    T1 v1 = Unbox<T1>(l);
+    T2 v2 = Unbox<T2>(r);
+    V ret = v1 - v2;
 
     return ret;
 }
 
-template<typename T1, typename T2>
-std::any MultiplyIntInt(const std::any& l, const std::any& r) {
-    T1 v1 = std::any_cast<T1>(l);
-    T2 v2 = std::any_cast<T2>(r);
-    std::any ret = v1 * v2;
+template<typename T1, typename T2, typename V = std::any>
+V MultiplyIntInt(const V& l, const V& r) {
+    T1 v1 = Unbox<T1>(l);
+    T2 v2 = Unbox<T2>(r);
+    V ret = v1 * v2;
 
     return ret;
 }
 
-template<typename T1, typename T2>
-std::any DivideIntInt(const std::any& l, const std::any& r) {
-    T1 v1 = std::any_cast<T1>(l);
-    T2 v2 = std::any_cast<T2>(r);
-    std::any ret = v1 / v2;
+template<typename T1, typename T2, typename V = std::any>
+V DivideIntInt(const V& l, const V& r) {
+    T1 v1 = Unbox<T1>(l);
+    T2 v2 = Unbox<T2>(r);
+    V ret = v1 / v2;
 
     return ret;
 }
 
-template<typename T1, typename T2>
-std::any ModulusIntInt(const std::any& l, const std::any& r) {
-    T1 v1 = std::any_cast<T1>(l);;
-    T2 v2 = std::any_cast<T2>(r);
-    std::any ret = v1 % v2;
+template<typename T1, typename T2, typename V = std::any>
+V ModulusIntInt(const V& l, const V& r) {
+    T1 v1 = Unbox<T1>(l);
+    T2 v2 = Unbox<T2>(r);
+    V ret = v1 % v2;
 
     return ret;
 }
 
-template<typename T1, typename T2>
-std::any GreatIntInt(const std::any& l, const std::any& r) {
-    T1 v1 = std::any_cast<T1>(l);;
-    T2 v2 = std::any_cast<T2>(r);
-    std::any ret = v1 > v2;
+template<typename T1, typename T2, typename V = std::any>
+V GreatIntInt(const V& l, const V& r) {
+    T1 v1 = Unbox<T1>(l);
+    T2 v2 = Unbox<T2>(r);
+    V ret = v1 > v2;
 
     return ret;
 }
 
-template<typename T1, typename T2>
-std::any GEIntInt(const std::any& l, const std::any& r) {
-    T1 v1 = std::any_cast<T1>(l);;
-    T2 v2 = std::any_cast<T2>(r);
-    std::any ret = v1 >= v2;
+template<typename T1, typename T2, typename V = std::any>
+V GEIntInt(const V& l, const V& r) {
+    T1 v1 = Unbox<T1>(l);
+    T2 v2 = Unbox<T2>(r);
+    V ret = v1 >= v2;
 
     return ret;
 }
 
-template<typename T1, typename T2>
-std::any LessIntInt(const std::any& l, const std::any& r) {
-    T1 v1 = std::any_cast<T1>(l);;
-    T2 v2 = std::any_cast<T2>(r);
-    std::any ret = v1 < v2;
+template<typename T1, typename T2, typename V = std::any>
+V LessIntInt(const V& l, const V& r) {
+    T1 v1 = Unbox<T1>(l);
+    T2 v2 = Unbox<T2>(r);
+    V ret = v1 < v2;
 
     return ret;
 }
 
-template<typename T1, typename T2>
-std::any LEIntInt(const std::any& l, const std::any& r) {
-    T1 v1 = std::any_cast<T1>(l);;
-    T2 v2 = std::any_cast<T2>(r);
-    std::any ret = v1 <= v2;
+template<typename T1, typename T2, typename V = std::any>
+V LEIntInt(const V& l, const V& r) {
+    T1 v1 = Unbox<T1>(l);
+    T2 v2 = Unbox<T2>(r);
+    V ret = v1 <= v2;
 
     return ret;
 }
 
-template<typename T1, typename T2>
-std::any EQIntInt(const std::any& l, const std::any& r) {
-    T1 v1 = std::any_cast<T1>(l);
-    T2 v2 = std::any_cast<T2>(r);
-    std::any ret = v1 == v2;
+template<typename T1, typename T2, typename V = std::any>
+V EQIntInt(const V& l, const V& r) {
+    T1 v1 = Unbox<T1>(l);
+    T2 v2 = Unbox<T2>(r);
+    V ret = v1 == v2;
 
     return ret;
 }
 
-template<typename T1, typename T2>
-std::any NEIntInt(const std::any& l, const std::any& r) {
-    T1 v1 = std::any_cast<T1>(l);
-    T2 v2 = std::any_cast<T2>(r);
-    std::any ret = v1 != v2;
+template<typename T1, typename T2, typename V = std::any>
+V NEIntInt(const V& l, const V& r) {
+    T1 v1 = Unbox<T1>(l);
+    T2 v2 = Unbox<T2>(r);
+    V ret = v1 != v2;
+
+    return ret;
+}
+
+template<typename T>
+std::string ValueToString(const T& v) {
+    if constexpr (std::is_same_v<T, std::string>) {
+        return v;
+    } else if constexpr (std::is_same_v<T, bool>) {
+        return v ? "true" : "false";
+    } else if constexpr (std::is_same_v<T, double>) {
+        //跟TypeScript一样，输出能准确读回这个数的最短形式：50.24而不是50.240000，0.1+0.2是0.30000000000000004
+        if (std::isnan(v)) {
+            return "NaN";
+        }
+        if (std::isinf(v)) {
+            return v > 0 ? "Infinity" : "-Infinity";
+        }
+        char buf[32];
+        auto result = std::to_chars(buf, buf + sizeof(buf), v);
+        return std::string(buf, result.ptr);
+    } else {
+        return std::to_string(v);
+    }
+}
+
+//字符串连接，另一边可以是其他类型的值
+template<typename T1, typename T2, typename V = std::any>
+V ConcatStrStr(const V& l, const V& r) {
+    T1 v1 = Unbox<T1>(l);
+    T2 v2 = Unbox<T2>(r);
+    V ret = ValueToString(v1) + ValueToString(v2);
 
     return ret;
 }
@@ -151,4 +234,14 @@ std::string PrintSeq(const T& seq, Color color = Color::Red) {
 }
 
 void PrintAny(const std::any& a);
+
+/**
+ * 汇总bench语句每次迭代的耗时（纳秒），格式化为一行报告：
+ *   bench <name>: min=...ns median=...ns p99=...ns (N iterations)
+ * samples会被排序。
+ */
+std::string BenchReport(const std::string& name, std::vector<double>& samples);
+
+//读取整个文件，失败时返回空字符串
+std::string ReadFile(const std::string& filename);
 #endif
\ No newline at end of file
@@ -0,0 +1,41 @@
+//整数运算：多项式求值、平均数、线性插值
+function square(x : number):number{
+    return x * x;
+}
+
+function poly(x : number):number{
+    let a : number = 3 * x * x;
+    let b : number = 2 * x;
+    return a + b + 1;
+}
+
+function average(a : number, b : number, c : number):number{
+    let sum : number = a + b + c;
+    return sum / 3;
+}
+
+function lerp(a : number, b : number, t : number):number{
+    let d : number = b - a;
+    return a + d * t / 100;
+}
+
+function distance2(x1 : number, y1 : number, x2 : number, y2 : number):number{
+    let dx : number = x2 - x1;
+    let dy : number = y2 - y1;
+    return dx * dx + dy * dy;
+}
+
+let p1 : number = poly(1);
+let p2 : number = poly(p1);
+let p3 : number = poly(p2 - p1);
+let avg : number = average(p1, p2, p3);
+let s1 : number = square(avg - p1) + square(avg - p2) + square(avg - p3);
+let l1 : number = lerp(p1, p2, 25);
+let l2 : number = lerp(l1, p3, 50);
+let l3 : number = lerp(l2, avg, 75);
+let d1 : number = distance2(p1, p2, l1, l2);
+let d2 : number = distance2(l1, l2, l3, avg);
+let d3 : number = distance2(d1 / 100, d2 / 100, 3, 4);
+println(s1);
+println(l3);
+println(d1 + d2 + d3);
@@ -0,0 +1,30 @@
+//函数调用：多层调用和尾调用
+function inc(x : number):number{
+    return x + 1;
+}
+
+function twice(x : number):number{
+    let y : number = inc(x);
+    return inc(y);
+}
+
+function mix(a : number, b : number):number{
+    let s : number = a * 2 - a / 2 + b;
+    return s - a;
+}
+
+function chain(a : number, b : number):number{
+    let c : number = mix(a, b);
+    let d : number = mix(c, a);
+    return mix(d, c);
+}
+
+let x0 : number = 1;
+let x1 : number = chain(x0, 1);
+let x2 : number = chain(x1, 2);
+let x3 : number = chain(x2, 3);
+let x4 : number = chain(x3, 4);
+let x5 : number = twice(x4);
+let x6 : number = twice(x5) + twice(x4);
+let x7 : number = mix(x6, x5) + mix(x5, x4);
+println(x7);
@@ -0,0 +1,25 @@
+//浮点数运算：面积、体积和温度换算
+function circleArea(r : number):number{
+    let area = 3.14 * r * r;
+    return area;
+}
+
+function sphereVolume(r : number):number{
+    let v = 4.0 / 3.0 * 3.14 * r * r * r;
+    return v;
+}
+
+function celsius(f : number):number{
+    let c = (f - 32.0) * 5.0 / 9.0;
+    return c;
+}
+
+let a1 = circleArea(1.5);
+let a2 = circleArea(2.5);
+let v1 = sphereVolume(1.5);
+let v2 = sphereVolume(a1 / 10.0);
+let t1 = celsius(98.6);
+let t2 = celsius(212.0);
+println(a1 + a2);
+println(v1 + v2);
+println(t1 + t2);
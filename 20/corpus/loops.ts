@@ -0,0 +1,62 @@
+//循环：累加、嵌套循环、带条件的循环和迭代
+function sumTo(n : number):number{
+    let s : number = 0;
+    for (let i : number = 0; i < n; i++) {
+        s = s + i;
+    }
+    return s;
+}
+
+function sumSquares(n : number):number{
+    let s : number = 0;
+    for (let i : number = 1; i <= n; i++) {
+        s = s + i * i;
+    }
+    return s;
+}
+
+function grid(w : number, h : number):number{
+    let cells : number = 0;
+    for (let y : number = 0; y < h; y++) {
+        for (let x : number = 0; x < w; x++) {
+            cells = cells + x * y;
+        }
+    }
+    return cells;
+}
+
+function countDivisible(n : number, d : number):number{
+    let c : number = 0;
+    for (let i : number = 1; i <= n; i++) {
+        if (i / d * d == i) {
+            c++;
+        }
+    }
+    return c;
+}
+
+function fib(n : number):number{
+    let a : number = 0;
+    let b : number = 1;
+    for (let i : number = 0; i < n; i++) {
+        let t : number = a + b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+function series(n : number):decimal{
+    let x : decimal = 0.0;
+    for (let i : number = 1; i <= n; i++) {
+        x = x + 1.0 / i;
+    }
+    return x;
+}
+
+println(sumTo(1000));
+println(sumSquares(500));
+println(grid(30, 30));
+println(countDivisible(600, 7));
+println(fib(40));
+println(series(200));
@@ -0,0 +1,18 @@
+//字符串连接
+function label(name : string, n : number):string{
+    let s : string = name + ": " + n;
+    return s;
+}
+
+function pair(a : number, b : number):string{
+    let s : string = "(" + a + ", " + b + ")";
+    return s;
+}
+
+let w : number = 3;
+let h : number = 4;
+let area : number = w * h;
+println(label("width", w));
+println(label("height", h));
+println(label("area", area));
+println(pair(w, h) + " -> " + integer_to_string(area));
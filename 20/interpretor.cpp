@@ -1,61 +1,69 @@
 #include "interpretor.h"
 
+template<typename T1, typename T2>
+constexpr void SetBinaryOpFunc(Interpretor::BinaryOpTable& table, Op op, Interpretor::BinaryFunction func) {
+    table[Interpretor::BinaryOpIndex(op)][static_cast<size_t>(TagOf<T1>())][static_cast<size_t>(TagOf<T2>())] = func;
+}
 
-std::map<Op,
-        std::map<std::type_index,
-            std::map<std::type_index,
-                Interpretor::BinaryFunction>>> Interpretor::binaryOp = {
+//算术运算和比较运算。整数与浮点数混合运算时，整数会按C++的规则提升为double
+template<typename T1, typename T2>
+constexpr void SetNumberOpFuncs(Interpretor::BinaryOpTable& table) {
+    SetBinaryOpFunc<T1, T2>(table, Op::Plus, PlusIntInt<T1, T2, Value>); //'+'
+    SetBinaryOpFunc<T1, T2>(table, Op::Minus, MinusIntInt<T1, T2, Value>); //'-'
+    SetBinaryOpFunc<T1, T2>(table, Op::Multiply, MultiplyIntInt<T1, T2, Value>); //'*'
+    SetBinaryOpFunc<T1, T2>(table, Op::Divide, DivideIntInt<T1, T2, Value>); //'/'
 
-    //{Op::Plus, { std::type_index(typeid(int32_t)), {std::type_index(typeid(int32_t)), PlusIntInt} } };
+    SetBinaryOpFunc<T1, T2>(table, Op::G, GreatIntInt<T1, T2, Value>); //'>'
+    SetBinaryOpFunc<T1, T2>(table, Op::GE, GEIntInt<T1, T2, Value>); //'>='
+    SetBinaryOpFunc<T1, T2>(table, Op::L, LessIntInt<T1, T2, Value>); //'<'
+    SetBinaryOpFunc<T1, T2>(table, Op::LE, LEIntInt<T1, T2, Value>); //'<='
+    SetBinaryOpFunc<T1, T2>(table, Op::EQ, EQIntInt<T1, T2, Value>); //'=='
+    SetBinaryOpFunc<T1, T2>(table, Op::NE, NEIntInt<T1, T2, Value>); //'!='
+}
 
-};
+constexpr Interpretor::BinaryOpTable MakeBinaryOpTable() {
+    Interpretor::BinaryOpTable table {};
 
-std::once_flag Interpretor::flag;
+    SetNumberOpFuncs<int32_t, int32_t>(table);
+    SetBinaryOpFunc<int32_t, int32_t>(table, Op::Modulus, ModulusIntInt<int32_t, int32_t, Value>); //'%'
 
-template<typename T1, typename T2>
-inline void InsertBinaryOpFunc(Op op, const Interpretor::BinaryFunction& func) {
-    //Interpretor::binaryOp.insert(op, {});
-    auto& inner = Interpretor::binaryOp[op];
-    auto& innerLeft = inner[std::type_index(typeid(int32_t))];
-    innerLeft[std::type_index(typeid(int32_t))] = func;
-}
+    //浮点数，以及整数与浮点数混合的运算
+    SetNumberOpFuncs<double, double>(table);
+    SetNumberOpFuncs<double, int32_t>(table);
+    SetNumberOpFuncs<int32_t, double>(table);
 
-void Interpretor::InitBinaryFunction() {
-    InsertBinaryOpFunc<int32_t, int32_t>(Op::Plus, PlusIntInt<int32_t, int32_t>); //'+'
-    InsertBinaryOpFunc<int32_t, int32_t>(Op::Minus, MinusIntInt<int32_t, int32_t>); //'-'
-    InsertBinaryOpFunc<int32_t, int32_t>(Op::Multiply, MultiplyIntInt<int32_t, int32_t>); //'*'
-    InsertBinaryOpFunc<int32_t, int32_t>(Op::Divide, DivideIntInt<int32_t, int32_t>); //'/'
-    InsertBinaryOpFunc<int32_t, int32_t>(Op::Modulus, ModulusIntInt<int32_t, int32_t>); //'%'
-
-    InsertBinaryOpFunc<int32_t, int32_t>(Op::G, GreatIntInt<int32_t, int32_t>); //'>'
-    InsertBinaryOpFunc<int32_t, int32_t>(Op::GE, GEIntInt<int32_t, int32_t>); //'>='
-    InsertBinaryOpFunc<int32_t, int32_t>(Op::L, LessIntInt<int32_t, int32_t>); //'<'
-    InsertBinaryOpFunc<int32_t, int32_t>(Op::LE, LEIntInt<int32_t, int32_t>); //'<='
-    InsertBinaryOpFunc<int32_t, int32_t>(Op::EQ, EQIntInt<int32_t, int32_t>); //'=='
-    InsertBinaryOpFunc<int32_t, int32_t>(Op::NE, NEIntInt<int32_t, int32_t>); //'!='
+    //字符串，以及字符串与其他类型混合的运算
+    SetBinaryOpFunc<std::string, std::string>(table, Op::Plus, ConcatStrStr<std::string, std::string, Value>); //'+'
+    SetBinaryOpFunc<std::string, int32_t>(table, Op::Plus, ConcatStrStr<std::string, int32_t, Value>); //'+'
+    SetBinaryOpFunc<int32_t, std::string>(table, Op::Plus, ConcatStrStr<int32_t, std::string, Value>); //'+'
+    SetBinaryOpFunc<std::string, double>(table, Op::Plus, ConcatStrStr<std::string, double, Value>); //'+'
+    SetBinaryOpFunc<double, std::string>(table, Op::Plus, ConcatStrStr<double, std::string, Value>); //'+'
+    SetBinaryOpFunc<std::string, bool>(table, Op::Plus, ConcatStrStr<std::string, bool, Value>); //'+'
+    SetBinaryOpFunc<bool, std::string>(table, Op::Plus, ConcatStrStr<bool, std::string, Value>); //'+'
+    SetBinaryOpFunc<std::string, std::string>(table, Op::EQ, EQIntInt<std::string, std::string, Value>); //'=='
+    SetBinaryOpFunc<std::string, std::string>(table, Op::NE, NEIntInt<std::string, std::string, Value>); //'!='
+
+    SetBinaryOpFunc<bool, bool>(table, Op::EQ, EQIntInt<bool, bool, Value>); //'=='
+    SetBinaryOpFunc<bool, bool>(table, Op::NE, NEIntInt<bool, bool, Value>); //'!='
+
+    return table;
 }
 
-std::optional<Interpretor::BinaryFunction> Interpretor::GetBinaryFunction(Op op, const std::any& l, const std::any& r) {
-    auto type1 = std::type_index(l.type());
-    auto type2 = std::type_index(r.type());
+//跳转表在编译期生成，运行时不需要初始化
+static constexpr Interpretor::BinaryOpTable binaryOpTable = MakeBinaryOpTable();
+const Interpretor::BinaryOpTable Interpretor::binaryOp = binaryOpTable;
 
-    auto it = Interpretor::binaryOp.find(op);
-    if (it == Interpretor::binaryOp.end()) {
+std::optional<Interpretor::BinaryFunction> Interpretor::GetBinaryFunction(Op op, const Value& l, const Value& r) {
+    if (op < Op::Plus || op > Op::LE) {
         dbg("Unsupported binary, Op: " + toString(op));
         return std::nullopt;
     }
 
-    auto itLeft = it->second.find(type1);
-    if (itLeft == it->second.end()) {
-        dbg("Unsupported binary, leftType: " + std::string(l.type().name()));
-        return std::nullopt;
-    }
-
-    auto itRight = itLeft->second.find(type2);
-    if (itRight == itLeft->second.end()) {
-        dbg("Unsupported binary, rightType: " + std::string(r.type().name()));
+    auto func = Interpretor::binaryOp[BinaryOpIndex(op)][static_cast<size_t>(l.tag)][static_cast<size_t>(r.tag)];
+    if (func == nullptr) {
+        dbg("Unsupported binary, leftTag: " + std::to_string(static_cast<int>(l.tag)) + ", rightTag: " + std::to_string(static_cast<int>(r.tag)));
         return std::nullopt;
     }
 
-    return itRight->second;
-}
\ No newline at end of file
+    return func;
+}
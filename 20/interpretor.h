@@ -8,6 +8,9 @@
 #include "symbol.h"
 #include "common.h"
 #include "ast.h"
+#include "value.h"
+#include "native.h"
+#include "timing.h"
 
 #include "dbg.h"
 
@@ -30,88 +33,148 @@
 // 每个函数对应一级栈桢.
 //
 struct StackFrame{
-    //存储变量的值
-    std::map<std::string, std::shared_ptr<Symbol>> symMap;
-    std::map<std::string, std::any> values;
+    //存储变量的值，以VarSymbol::index为下标
+    std::vector<Value> slots;
 
     //返回值，当调用函数的时候，返回值放在这里
-    std::any retVal;
+    Value retVal;
+
+    StackFrame(uint32_t numSlots = 0): slots(numSlots) {}
 };
 
 //
-// 用于封装Return语句的返回结果，并结束后续语句的执行。
+// 解释器
+// 表达式的计算结果不通过std::any返回，而是放在result里；
+// Return语句也不再返回一个包装对象，而是设置returning标志，让Block等停止执行。
 //
-struct ReturnValue{
-    std::any value;
-    ReturnValue(std::any value): value(value){
-    }
-};
-
 class Interpretor: public AstVisitor{
 public:
-    //调用栈
-    std::vector<std::shared_ptr<StackFrame>> callStack;
+    //调用栈。函数返回之后栈桢不会被释放，而是留给下一次调用复用，
+    //callStack[0, depth)是正在使用的栈桢。
+    std::vector<std::unique_ptr<StackFrame>> callStack;
+    uint32_t depth {0};
 
     //当前栈桢
-    std::shared_ptr<StackFrame> currentFrame;
+    StackFrame* currentFrame {nullptr};
+
+    //尾调用：被调用的函数复用当前栈桢，在当前函数返回之后由callFunction接着执行
+    const CallDescriptor* tailCall {nullptr};
+
+    //计算尾调用参数时的临时存储。嵌套的尾调用按后进先出的方式使用
+    std::vector<Value> tailArgs;
+
+    //最近一次计算的表达式的值
+    Value result;
+
+    //当前是否执行了一个Return语句，正在从函数中返回
+    bool returning {false};
 
-    using BinaryFunction = std::function<std::any(const std::any&, const std::any&)>;
-    static std::map<Op,
-                    std::map<std::type_index,
-                        std::map<std::type_index,
-                            BinaryFunction>>> binaryOp;
-    static void InitBinaryFunction();
-    static std::optional<BinaryFunction> GetBinaryFunction(Op op, const std::any& l, const std::any& r);
+    //是否根据类型反馈把Binary节点特化
+    bool useTypeFeedback {true};
 
-    static std::once_flag flag;
+    //同样的类型连续出现多少次之后特化
+    static constexpr uint8_t SpecializeThreshold = 8;
+
+    //守卫失败多少次之后，节点停留在通用状态
+    static constexpr uint8_t MaxDeopts = 4;
+
+    using BinaryFunction = Value (*)(const Value&, const Value&);
+
+    //二元运算的跳转表，下标是[运算符][左操作数标签][右操作数标签]。
+    //Op::Plus到Op::LE在枚举中是连续的，所以运算符这一维是稠密的。
+    static constexpr size_t NumBinaryOps = static_cast<size_t>(Op::LE) - static_cast<size_t>(Op::Plus) + 1;
+    using BinaryOpTable = std::array<TagTable<BinaryFunction>, NumBinaryOps>;
+    static const BinaryOpTable binaryOp;   //在编译期生成，见interpretor.cpp
+
+    static constexpr size_t BinaryOpIndex(Op op) {
+        return static_cast<size_t>(op) - static_cast<size_t>(Op::Plus);
+    }
+
+    static std::optional<BinaryFunction> GetBinaryFunction(Op op, const Value& l, const Value& r);
 
     Interpretor() {
         //创建顶层的栈桢
-        this->currentFrame = std::make_shared<StackFrame>();
-        this->callStack.push_back(this->currentFrame);
-        std::call_once(flag, [](){
-            dbg("InitBinaryFunction: called once");
-            InitBinaryFunction();
-        });
+        this->currentFrame = this->pushFrame(0);
     }
 
-    void pushFrame(std::shared_ptr<StackFrame>& frame){
-        this->callStack.push_back(frame);
-        this->currentFrame = frame;
+    /**
+     * 从调用栈中取出下一个栈桢，并把槽位清空。
+     * 不会切换当前栈桢，因为参数还需要在调用者的栈桢中计算。
+     */
+    StackFrame* pushFrame(uint32_t numSlots){
+        if (this->depth == this->callStack.size()){
+            this->callStack.push_back(std::make_unique<StackFrame>());
+        }
+        auto frame = this->callStack[this->depth++].get();
+        frame->slots.assign(numSlots, Value());
+        frame->retVal = Value();
+        return frame;
     }
 
     void popFrame(){
-        if (this->callStack.size() > 1){
-            // auto frame = this->callStack[this->callStack.size() - 2];
-            this->callStack.pop_back();
-            this->currentFrame = this->callStack.back();
+        if (this->depth > 1){
+            this->depth--;
         }
     }
 
-    std::any getVariableValue(std::shared_ptr<Symbol>& sym) {
-        auto it = this->currentFrame->values.find(sym->name);
-        if (it == this->currentFrame->values.end()) {
+    /**
+     * 计算一个表达式，返回它的值
+     */
+    Value evaluate(AstNode& node) {
+        this->result = Value();
+        this->visit(node);
+        return this->result;
+    }
+
+    /**
+     * 获取变量在当前栈桢中的槽位。
+     * 下标在语义分析阶段已经确定，这里不需要按名称查找。
+     */
+    Value* getVariableSlot(const std::shared_ptr<Symbol>& sym) {
+        if (sym == nullptr || sym->kind != SymKind::Variable) {
+            dbg("Error: expect a VarSymbol");
+            return nullptr;
+        }
+
+        auto index = std::static_pointer_cast<VarSymbol>(sym)->index;
+        auto& slots = this->currentFrame->slots;
+        if (index < 0 || static_cast<uint32_t>(index) >= slots.size()) {
             dbg("Error: can't find VariableValue: " + sym->name);
-            return std::any();
+            return nullptr;
         }
-        return it->second;
+        return &slots[index];
     }
 
-    void setVariableValue(const std::shared_ptr<Symbol>& sym, std::any value) {
-        this->currentFrame->values.insert({sym->name, value});
+    Value getVariableValue(std::shared_ptr<Symbol>& sym) {
+        auto slot = this->getVariableSlot(sym);
+        return slot != nullptr ? *slot : Value();
+    }
+
+    void setVariableValue(const std::shared_ptr<Symbol>& sym, const Value& value) {
+        auto slot = this->getVariableSlot(sym);
+        if (slot != nullptr) {
+            *slot = value;
+        }
+    }
+
+    std::any visitProg(Prog& prog, std::string prefix) override {
+        //按照main函数的本地变量数量，为顶层栈桢分配槽位
+        if (prog.sym != nullptr) {
+            this->currentFrame->slots.resize(prog.sym->vars.size());
+        }
+        return AstVisitor::visitProg(prog, prefix);
     }
 
     std::any visitBlock(Block& block, std::string prefix) override {
-        std::any retVal;
-        for (auto x: block.stmts){
-            retVal = this->visit(*x);
+        for (auto& x: block.stmts){
+            this->visit(*x);
             //如果当前执行了一个返回语句，那么就直接返回，不再执行后面的语句。
             //如果存在上一级Block，也是中断执行，直接返回。
-            if (retVal.has_value() && isType<ReturnValue>(retVal)) {
-                return retVal;
+            if (this->returning) {
+                break;
             }
         }
-        return retVal;
+        return std::any();
     }
 
     //函数声明不做任何事情。
@@ -120,25 +183,69 @@ public:
     }
 
     std::any visitReturnStatement(ReturnStatement& returnStatement, std::string prefix) override {
-        std::any retVal;
+        //返回值放在被调用者自己的栈桢里，由调用者在弹出栈桢之前取走
         if (returnStatement.exp != nullptr){
-            retVal = this->visit(*returnStatement.exp);
-            this->setReturnValue(retVal);
+            this->currentFrame->retVal = this->evaluate(*returnStatement.exp);
+        }
+        this->returning = true;  //这里是传递一个信号，让Block和for循环等停止执行。
+        return std::any();
+    }
+
+    std::any visitBenchStatement(BenchStatement& stmt, std::string prefix) override {
+        Value name = this->evaluate(*stmt.name);
+        Value iterations = this->evaluate(*stmt.iterations);
+        if (iterations.tag != ValueTag::Integer || iterations.i < 0) {
+            dbg("Error: the iterations of bench statement must be a non-negative integer");
+            return std::any();
+        }
+
+        //每次迭代单独计时
+        std::vector<double> samples;
+        samples.reserve(iterations.i);
+        for (int32_t i = 0; i < iterations.i; i++) {
+            double start = TickNanos();
+            this->visit(*stmt.body);
+            samples.push_back(TickNanos() - start);
+            if (this->returning) {
+                break;
+            }
         }
-        return ReturnValue(retVal);  //这里是传递一个信号，让Block和for循环等停止执行。
+
+        Print(BenchReport(name.toString(), samples));
+        return std::any();
     }
 
-    //把返回值设置到上一级栈桢中（也就是调用者的栈桢）
-    void setReturnValue(std::any retVal){
-        auto frame = this->callStack[this->callStack.size() - 2];
-        frame->retVal = retVal;
+    std::any visitIfStatement(IfStatement& stmt, std::string prefix) override {
+        if (this->evaluate(*stmt.condition).isTruthy()) {
+            this->visit(*stmt.stmt);
+        }
+        else if (stmt.elseStmt != nullptr) {
+            this->visit(*stmt.elseStmt);
+        }
+        return std::any();
+    }
+
+    std::any visitForStatement(ForStatement& stmt, std::string prefix) override {
+        if (stmt.init != nullptr) {
+            this->visit(*stmt.init);
+        }
+        //省略了条件时一直循环，直到执行了返回语句
+        while (stmt.condition == nullptr || this->evaluate(*stmt.condition).isTruthy()) {
+            this->visit(*stmt.stmt);
+            if (this->returning) {
+                break;
+            }
+            if (stmt.increment != nullptr) {
+                this->visit(*stmt.increment);
+            }
+        }
+        return std::any();
     }
 
     std::any visitVariableDecl(VariableDecl& variableDecl, std::string prefix) override {
         if(variableDecl.init != nullptr){
-            auto v = this->visit(*variableDecl.init);
+            auto v = this->evaluate(*variableDecl.init);
             this->setVariableValue(variableDecl.sym, v);
-            return v;
         }
         return std::any();
     }
@@ -148,112 +255,324 @@ public:
             return v.sym;
         }
         else{
-            return this->getVariableValue(v.sym);
+            this->result = this->getVariableValue(v.sym);
+            return std::any();
         }
     }
 
+    std::any visitIntegerLiteral(IntegerLiteral& node, std::string prefix) override {
+        this->result = Value(node.value);
+        return std::any();
+    }
+
+    std::any visitDecimalLiteral(DecimalLiteral& node, std::string prefix) override {
+        this->result = Value(node.value);
+        return std::any();
+    }
+
+    std::any visitStringLiteral(StringLiteral& node, std::string prefix) override {
+        this->result = Value(StringPool::intern(node.value));
+        return std::any();
+    }
+
     std::any visitFunctionCall(FunctionCall& functionCall, std::string prefix) override {
         // console.log("running funciton:" + functionCall.name);
-        if (functionCall.name == "println"){ //内置函数
-            return this->println(functionCall.arguments);
-        }
-        else if (functionCall.name == "tick"){
-            return this->tick();
-        }
-        else if (functionCall.name == "integer_to_string"){
-            return this->integer_to_string(functionCall.arguments);
-        }
-
-        if(functionCall.sym != nullptr){
-            //清空返回值
-            this->currentFrame->retVal = std::any();
-
-            //1.创建新栈桢
-            auto frame = std::make_shared<StackFrame>();
-            //2.计算参数值，并保存到新创建的栈桢
-            auto functionDecl = functionCall.sym->decl;
-            auto callSignature = std::dynamic_pointer_cast<CallSignature>(functionDecl->callSignature);
-            if (callSignature != nullptr && callSignature->paramList != nullptr){
-                auto paramList = std::dynamic_pointer_cast<ParameterList>(callSignature->paramList);
-                auto params = paramList->params;
-                for (uint32_t i = 0; i< params.size(); i++){
-                    auto variableDecl = std::dynamic_pointer_cast<VariableDecl>(params[i]);
-                    auto val = this->visit(*functionCall.arguments[i]);
-                    frame->values.insert({variableDecl->sym->name, val});  //设置到新的frame里。
-                }
+        //调用点在语义分析之后已经链接好了
+        auto desc = functionCall.callDesc.get();
+        if (desc == nullptr){
+            dbg("Runtime error, cannot find declaration of " + functionCall.name +".");
+            this->result = Value();
+            return std::any();
+        }
+
+        if (desc->builtin != BuiltinId::None){  //内置函数和注册的原生函数
+            this->result = this->callNative(desc->builtin, functionCall.arguments);
+        }
+        else if (functionCall.isTailCall){
+            this->prepareTailCall(*desc, functionCall.arguments);
+        }
+        else{
+            this->callFunction(*desc, functionCall.arguments);
+        }
+        return std::any();
+    }
+
+    /**
+     * 调用一个注册的原生函数（见native.h），实参按顺序计算之后放在一个连续的数组里
+     */
+    Value callNative(BuiltinId id, const std::vector<std::shared_ptr<AstNode>>& arguments) {
+        auto& native = NativeFunctions()[static_cast<size_t>(id)];
+        Value args[MaxNativeParams];
+        for (uint32_t i = 0; i < native.numParams && i < arguments.size(); i++) {
+            args[i] = this->evaluate(*arguments[i]);
+        }
+        Value ret;
+        if (!native.call(args, ret)) {
+            dbg("Runtime error, argument type mismatch when calling " + native.name + ".");
+        }
+        return ret;
+    }
+
+    /**
+     * 调用一个用户定义的函数，返回值放在result里
+     */
+    void callFunction(const CallDescriptor& desc, const std::vector<std::shared_ptr<AstNode>>& arguments) {
+        if (desc.body == nullptr){
+            dbg("Runtime error, cannot find body of " + desc.callee->name +".");
+            this->result = Value();
+            return;
+        }
+
+        //1.取出一个栈桢，槽位数量就是函数的本地变量数量（包括参数）
+        auto caller = this->currentFrame;
+        auto frame = this->pushFrame(desc.numSlots);
+
+        //2.计算参数值，并保存到新的栈桢。参数在调用者的栈桢中计算，嵌套的调用会使用更上面的栈桢
+        for (uint32_t i = 0; i < desc.paramSlots.size() && i < arguments.size(); i++){
+            frame->slots[desc.paramSlots[i]] = this->evaluate(*arguments[i]);  //设置到新的frame里。
+        }
+
+        //3.切换到新栈桢，执行函数。
+        //如果函数以尾调用返回，被调用的函数已经复用了这个栈桢，在这里接着执行，调用栈和C++栈都不会增长
+        this->currentFrame = frame;
+        auto body = desc.body;
+        while (true){
+            this->visit(*body);
+            this->returning = false;
+            if (this->tailCall == nullptr){
+                break;
             }
+            body = this->tailCall->body;
+            this->tailCall = nullptr;
+        }
 
-            //3.把新栈桢入栈
-            this->pushFrame(frame);
+        //4.函数的返回值
+        this->result = frame->retVal;
 
-            //4.执行函数
-            this->visit(*functionDecl->body);
+        //5.弹出栈桢，回到调用者
+        this->popFrame();
+        this->currentFrame = caller;
+    }
 
-            //5.弹出当前的栈桢
-            this->popFrame();
+    /**
+     * 准备尾调用：在当前栈桢中计算参数，然后把当前栈桢改成被调用函数的栈桢。
+     * 接下来的Return语句会结束当前函数，由callFunction执行被调用的函数。
+     */
+    void prepareTailCall(const CallDescriptor& desc, const std::vector<std::shared_ptr<AstNode>>& arguments) {
+        if (desc.body == nullptr){
+            dbg("Runtime error, cannot find body of " + desc.callee->name +".");
+            this->result = Value();
+            return;
+        }
 
-            //5.函数的返回值
-            return this->currentFrame->retVal;
+        //1.计算参数。参数可能引用当前栈桢中的变量，所以要先全部算完
+        auto base = this->tailArgs.size();
+        for (uint32_t i = 0; i < desc.paramSlots.size() && i < arguments.size(); i++){
+            this->tailArgs.push_back(this->evaluate(*arguments[i]));
         }
-        else{
-            dbg("Runtime error, cannot find declaration of " + functionCall.name +".");
-            return std::any();
+
+        //2.复用当前栈桢
+        auto frame = this->currentFrame;
+        frame->slots.assign(desc.numSlots, Value());
+        for (uint32_t i = 0; i + base < this->tailArgs.size(); i++){
+            frame->slots[desc.paramSlots[i]] = this->tailArgs[base + i];
         }
+        this->tailArgs.resize(base);
+
+        this->tailCall = &desc;
+        this->result = Value();
     }
 
     std::any visitBinary(Binary& bi, std::string prefix) override {
         // console.log("visitBinary:" + bi.op);
-        std::any ret;
-        auto v1 = this->visit(*bi.exp1);
-        auto v2 = this->visit(*bi.exp2);
+        //赋值运算：左边必须是一个变量。复合赋值 a += b 相当于 a = a + b
+        if (IsAssignOp(bi.op)) {
+            auto variable = std::dynamic_pointer_cast<Variable>(bi.exp1);
+            if (variable == nullptr || variable->sym == nullptr) {
+                dbg("Error: the left side of an assignment must be a variable");
+                this->result = Value();
+                return std::any();
+            }
+            auto value = this->evaluate(*bi.exp2);
+            if (bi.op != Op::Assign) {
+                value = this->binaryValue(CompoundAssignOp(bi.op), this->getVariableValue(variable->sym), value);
+            }
+            this->setVariableValue(variable->sym, value);
+            this->result = value;
+            return std::any();
+        }
+
+        auto v1 = this->evaluate(*bi.exp1);
+        auto v2 = this->evaluate(*bi.exp2);
+
+        //先走特化过的快速路径
+        if (this->runSpecializedBinary(bi, v1, v2)) {
+            return std::any();
+        }
 
         auto func = Interpretor::GetBinaryFunction(bi.op, v1, v2);
         if (!func) {
             dbg("Unsupported binary operation: " + toString(bi.op));
-            return ret;
+            this->result = Value();
+            return std::any();
         }
 
+        this->result = func.value()(v1, v2);
+        this->recordBinaryFeedback(bi.feedback, bi.op, v1, v2);
+        return std::any();
+    }
+
+    //按运算符和操作数的标签查跳转表计算，不支持时返回undefined
+    Value binaryValue(Op op, const Value& v1, const Value& v2) {
+        auto func = Interpretor::GetBinaryFunction(op, v1, v2);
+        if (!func) {
+            dbg("Unsupported binary operation: " + toString(op));
+            return Value();
+        }
         return func.value()(v1, v2);
     }
 
-    std::any println(std::vector<std::shared_ptr<AstNode>> args) {
-        if(args.size() >0){
-            auto retVal = this->visit(*args[0]);
-            if (retVal.has_value()) {
-                dbg("call println");
-                PrintAny(retVal);
+    /**
+     * 一元运算：正负号，以及++、--。
+     * ++、--的操作数必须是变量，前缀表达式的值是加减之后的值，后缀表达式的值是原来的值。
+     */
+    std::any visitUnary(Unary& exp, std::string prefix) override {
+        if (exp.op == Op::Inc || exp.op == Op::Dec) {
+            auto variable = std::dynamic_pointer_cast<Variable>(exp.exp);
+            if (variable == nullptr || variable->sym == nullptr) {
+                dbg("Error: the operand of ++ or -- must be a variable");
+                this->result = Value();
+                return std::any();
             }
-        }
-        else{
-            Print("println: None");
+            auto oldValue = this->getVariableValue(variable->sym);
+            auto newValue = this->binaryValue(exp.op == Op::Inc ? Op::Plus : Op::Minus, oldValue, Value(1));
+            this->setVariableValue(variable->sym, newValue);
+            this->result = exp.isPrefix ? newValue : oldValue;
+            return std::any();
         }
 
+        auto v = this->evaluate(*exp.exp);
+        switch (exp.op) {
+            case Op::Plus:
+                this->result = v;
+                break;
+            case Op::Minus:
+                this->result = this->binaryValue(Op::Minus, Value(0), v);
+                break;
+            default:
+                dbg("Unsupported unary operation: " + toString(exp.op));
+                this->result = Value();
+                break;
+        }
         return std::any();
     }
 
-    uint32_t tick() {
-        return 0;
+    /**
+     * 按节点的特化状态计算二元运算。
+     * 守卫失败，或者节点还没有特化，返回false，由调用者走通用路径。
+     */
+    bool runSpecializedBinary(Binary& bi, const Value& v1, const Value& v2) {
+        auto& feedback = bi.feedback;
+        switch (feedback.state) {
+            case Specialization::IntInt:
+                if (v1.tag == ValueTag::Integer && v2.tag == ValueTag::Integer) {
+                    this->result = ArithBinary<int32_t>(bi.op, v1.i, v2.i);
+                    return true;
+                }
+                break;
+            case Specialization::DecimalDecimal:
+                if (v1.tag == ValueTag::Decimal && v2.tag == ValueTag::Decimal) {
+                    this->result = ArithBinary<double>(bi.op, v1.d, v2.d);
+                    return true;
+                }
+                break;
+            case Specialization::ConcatStrStr:
+                if (v1.tag == ValueTag::String && v2.tag == ValueTag::String) {
+                    this->result = Value(*v1.s + *v2.s);
+                    return true;
+                }
+                break;
+            case Specialization::Monomorphic:
+                if (v1.tag == feedback.tag1 && v2.tag == feedback.tag2) {
+                    this->result = Interpretor::binaryOp[BinaryOpIndex(bi.op)][static_cast<size_t>(v1.tag)][static_cast<size_t>(v2.tag)](v1, v2);
+                    return true;
+                }
+                break;
+            default:
+                return false;
+        }
+
+        this->deoptimize(feedback);
+        return false;
     }
 
-    std::string integer_to_string(std::vector<std::shared_ptr<AstNode>> args){
-        if(args.size() > 0){
-            auto retVal = this->visit(*args[0]);
-            if (retVal.has_value()) {
-                if (isType<int32_t>(retVal)) {
-                    auto i = std::any_cast<int32_t>(retVal);
-                    return std::to_string(i);
-                } else {
-                    dbg("integer_to_string not support other type");
-                    return "";
+    //整数或浮点数的算术运算和比较运算，用于特化后的快速路径
+    template<typename T>
+    static Value ArithBinary(Op op, T l, T r) {
+        switch (op) {
+            case Op::Plus:
+                return Value(l + r);
+            case Op::Minus:
+                return Value(l - r);
+            case Op::Multiply:
+                return Value(l * r);
+            case Op::Divide:
+                return Value(l / r);
+            case Op::G:
+                return Value(l > r);
+            case Op::GE:
+                return Value(l >= r);
+            case Op::L:
+                return Value(l < r);
+            case Op::LE:
+                return Value(l <= r);
+            case Op::EQ:
+                return Value(l == r);
+            case Op::NE:
+                return Value(l != r);
+            default:
+                if constexpr (std::is_integral_v<T>) {
+                    if (op == Op::Modulus) {
+                        return Value(l % r);
+                    }
                 }
+                return Value();
+        }
+    }
+
+    /**
+     * 记录二元运算观察到的操作数类型，同样的类型连续出现足够多次之后就特化。
+     */
+    void recordBinaryFeedback(TypeFeedback& feedback, Op op, const Value& v1, const Value& v2) {
+        if (!this->useTypeFeedback || feedback.state != Specialization::Uninitialized) {
+            return;
+        }
+
+        if (feedback.tag1 != v1.tag || feedback.tag2 != v2.tag) {
+            feedback.tag1 = v1.tag;
+            feedback.tag2 = v2.tag;
+            feedback.hits = 0;
+        }
+
+        if (++feedback.hits >= SpecializeThreshold) {
+            if (v1.tag == ValueTag::Integer && v2.tag == ValueTag::Integer) {
+                feedback.state = Specialization::IntInt;
+            } else if (v1.tag == ValueTag::Decimal && v2.tag == ValueTag::Decimal) {
+                feedback.state = Specialization::DecimalDecimal;
+            } else if (v1.tag == ValueTag::String && v2.tag == ValueTag::String && op == Op::Plus) {
+                feedback.state = Specialization::ConcatStrStr;
             } else {
-                dbg("integer_to_string exp1 no has value");
-                return "";
+                feedback.state = Specialization::Monomorphic;
             }
         }
+    }
 
-        dbg("integer_to_string param 0");
-        return "";
+    /**
+     * 守卫失败，退回到通用路径重新收集类型。退回太多次的节点不再特化。
+     */
+    void deoptimize(TypeFeedback& feedback) {
+        feedback.hits = 0;
+        feedback.state = ++feedback.deopts >= MaxDeopts ? Specialization::Generic : Specialization::Uninitialized;
     }
 };
 
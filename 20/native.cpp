@@ -0,0 +1,51 @@
+#include "native.h"
+#include "timing.h"
+
+std::vector<NativeFunction>& NativeFunctions() {
+    //系统内置函数的符号在symbol.cpp里定义，这里按编号给出它们的实现
+    static std::vector<NativeFunction> natives = {
+        NativeFunction(),   //BuiltinId::None
+        MakeNativeFunction("println", [](const Value& v) {
+            //没有值的表达式（如void函数的返回值）不打印
+            if (!v.isUndefined()) {
+                Print(v.toString());
+            }
+        }),
+        MakeNativeFunction("tick", []() {
+            return TickNanos();
+        }),
+        MakeNativeFunction("cycles", []() {
+            return CycleCount();
+        }),
+        MakeNativeFunction("integer_to_string", [](int32_t v) {
+            return std::to_string(v);
+        }),
+    };
+    return natives;
+}
+
+BuiltinId AddNativeFunction(NativeFunction native, std::shared_ptr<Type> functionType) {
+    auto& natives = NativeFunctions();
+    if (built_ins.count(native.name) > 0) {
+        dbg("Error: native function " + native.name + " already exists");
+        return BuiltinId::None;
+    }
+    if (natives.size() != built_ins_by_id.size() || natives.size() > UINT8_MAX) {
+        dbg("Error: can not register native function " + native.name);
+        return BuiltinId::None;
+    }
+
+    //参数也要有变量符号，和用户定义的函数一样
+    auto type = std::dynamic_pointer_cast<FunctionType>(functionType);
+    std::vector<std::shared_ptr<Symbol>> vars;
+    for (size_t i = 0; i < type->paramTypes.size(); i++) {
+        vars.push_back(std::make_shared<VarSymbol>("p" + std::to_string(i), type->paramTypes[i]));
+    }
+    auto sym = std::make_shared<FunctionSymbol>(native.name, functionType, vars);
+
+    auto id = static_cast<BuiltinId>(natives.size());
+    built_ins.insert({native.name, sym});
+    built_ins_by_id.push_back(sym);
+    natives.push_back(std::move(native));
+    return id;
+}
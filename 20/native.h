@@ -0,0 +1,185 @@
+#ifndef __NATIVE_H_
+#define __NATIVE_H_
+
+#include "value.h"
+#include "symbol.h"
+#include "types.h"
+
+#include "dbg.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <stdint.h>
+
+//
+// 原生函数接口
+// 用RegisterNative()注册一个C++函数或lambda，模板根据它的签名生成：
+//   1.FunctionType和FunctionSymbol，加入built_ins，语义分析时就能找到这个函数；
+//   2.一个编号（BuiltinId），字节码用invokenative调用它；
+//   3.一个NativeFunction：把实参从Value拆箱成C++类型，调用之后再把返回值装箱。
+// 解释器、闭包引擎、栈式虚拟机和寄存器虚拟机都通过NativeFunction调用，不经过std::any。
+//
+// 参数和返回值支持的C++类型：int32_t、double、bool、std::string（参数可以是const std::string&），
+// 以及Value（不拆箱，对应any类型）。返回值还可以是void。
+//
+// 编号按注册的顺序分配，会写进字节码文件，所以读字节码文件的进程要按相同的顺序注册。
+// 注册要在语义分析之前完成，不能在静态初始化期间进行。汇编后端还不支持调用注册的函数。
+//
+
+//原生函数最多的参数个数。调用时实参放在栈上的数组里
+constexpr uint32_t MaxNativeParams = 8;
+
+struct NativeFunction{
+    std::string name;
+    uint32_t numParams {0};
+    bool returnsValue {false};
+
+    //callable是注册时保存的函数对象，args是连续的numParams个实参。
+    //实参的类型不对时返回false，没有返回值时result为Undefined
+    bool (*invoke)(const void* callable, const Value* args, Value& result) {nullptr};
+    std::shared_ptr<void> callable;
+
+    bool call(const Value* args, Value& result) const {
+        return this->invoke(this->callable.get(), args, result);
+    }
+};
+
+//所有原生函数，下标是BuiltinId，与built_ins_by_id一一对应。BuiltinId::None的位置为空
+std::vector<NativeFunction>& NativeFunctions();
+
+//按C++类型对应的语言类型
+template<typename T>
+std::shared_ptr<Type> NativeType() {
+    if constexpr (std::is_void_v<T>) {
+        return SysTypes::Void();
+    } else if constexpr (std::is_same_v<T, int32_t>) {
+        return SysTypes::Integer();
+    } else if constexpr (std::is_same_v<T, double>) {
+        return SysTypes::Decimal();
+    } else if constexpr (std::is_same_v<T, bool>) {
+        return SysTypes::Boolean();
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        return SysTypes::String();
+    } else {
+        static_assert(std::is_same_v<T, Value>, "unsupported native type");
+        return SysTypes::Any();
+    }
+}
+
+//实参的标签是否与参数的C++类型相符。浮点数参数也接受整数
+template<typename T>
+bool NativeArgMatches(const Value& v) {
+    if constexpr (std::is_same_v<T, double>) {
+        return v.tag == ValueTag::Decimal || v.tag == ValueTag::Integer;
+    } else if constexpr (std::is_same_v<T, Value>) {
+        return true;
+    } else {
+        return v.tag == TagOf<T>();
+    }
+}
+
+//拆箱。字符串直接引用字符串池里的对象，不做拷贝
+template<typename T>
+decltype(auto) NativeArg(const Value& v) {
+    if constexpr (std::is_same_v<T, double>) {
+        return v.tag == ValueTag::Integer ? static_cast<double>(v.i) : v.d;
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        return static_cast<const std::string&>(*v.s);
+    } else if constexpr (std::is_same_v<T, Value>) {
+        return static_cast<const Value&>(v);
+    } else {
+        return ValueAs<T>(v);
+    }
+}
+
+//从函数对象的类型推导出签名，得到对应的函数指针类型
+template<typename F>
+struct NativeSignature: NativeSignature<decltype(&F::operator())> {
+};
+
+template<typename R, typename... Args>
+struct NativeSignature<R (*)(Args...)> {
+    using Pointer = R (*)(Args...);
+};
+
+template<typename R, typename... Args>
+struct NativeSignature<R (Args...)>: NativeSignature<R (*)(Args...)> {
+};
+
+template<typename C, typename R, typename... Args>
+struct NativeSignature<R (C::*)(Args...) const>: NativeSignature<R (*)(Args...)> {
+};
+
+template<typename C, typename R, typename... Args>
+struct NativeSignature<R (C::*)(Args...)>: NativeSignature<R (*)(Args...)> {
+};
+
+//为一个函数对象类型F生成拆箱、调用、装箱的代码
+template<typename F, typename R, typename... Args>
+struct NativeAdapter{
+    template<size_t... I>
+    static bool Call(const F& f, const Value* args, Value& result, std::index_sequence<I...>) {
+        if (!(NativeArgMatches<std::decay_t<Args>>(args[I]) && ...)) {
+            return false;
+        }
+        //实参全部拆箱之后才写result，所以result可以是实参所在的槽位
+        if constexpr (std::is_void_v<R>) {
+            f(NativeArg<std::decay_t<Args>>(args[I])...);
+            result = Value();
+        } else {
+            result = Value(f(NativeArg<std::decay_t<Args>>(args[I])...));
+        }
+        return true;
+    }
+
+    static bool Invoke(const void* callable, const Value* args, Value& result) {
+        return Call(*static_cast<const F*>(callable), args, result, std::index_sequence_for<Args...>{});
+    }
+};
+
+template<typename F, typename R, typename... Args>
+NativeFunction MakeNativeFunction(const std::string& name, F f, R (*)(Args...)) {
+    static_assert(sizeof...(Args) <= MaxNativeParams, "too many native params");
+    NativeFunction native;
+    native.name = name;
+    native.numParams = sizeof...(Args);
+    native.returnsValue = !std::is_void_v<R>;
+    native.invoke = &NativeAdapter<F, R, Args...>::Invoke;
+    native.callable = std::make_shared<F>(std::move(f));
+    return native;
+}
+
+template<typename F>
+NativeFunction MakeNativeFunction(const std::string& name, F f) {
+    using Pointer = typename NativeSignature<std::decay_t<F>>::Pointer;
+    return MakeNativeFunction(name, std::decay_t<F>(std::move(f)), static_cast<Pointer>(nullptr));
+}
+
+template<typename R, typename... Args>
+std::shared_ptr<Type> MakeNativeFunctionType(R (*)(Args...)) {
+    return std::make_shared<FunctionType>(NativeType<std::decay_t<R>>(),
+        std::vector<std::shared_ptr<Type>>{NativeType<std::decay_t<Args>>()...});
+}
+
+/**
+ * 加入一个原生函数：生成FunctionSymbol，加入built_ins和built_ins_by_id。
+ * @return 分配的编号。名称已经存在，或者编号用完了（invokenative的操作数只有1个字节）时返回BuiltinId::None
+ */
+BuiltinId AddNativeFunction(NativeFunction native, std::shared_ptr<Type> functionType);
+
+/**
+ * 注册一个C++函数或lambda，比如：
+ *   RegisterNative("hash", [](const std::string& s) { return static_cast<int32_t>(std::hash<std::string>()(s)); });
+ * @return 分配的编号，失败时返回BuiltinId::None
+ */
+template<typename F>
+BuiltinId RegisterNative(const std::string& name, F f) {
+    using Pointer = typename NativeSignature<std::decay_t<F>>::Pointer;
+    auto functionType = MakeNativeFunctionType(static_cast<Pointer>(nullptr));
+    return AddNativeFunction(MakeNativeFunction(name, std::move(f)), functionType);
+}
+
+#endif
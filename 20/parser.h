@@ -18,6 +18,7 @@
 #include <memory>
 #include <any>
 #include <stdint.h>
+#include <algorithm>
 
 class Parser{
     static std::map<Op, int32_t> opPrec;
@@ -79,6 +80,9 @@ public:
         else if (isType<KeywordKind>(code) && std::any_cast<KeywordKind>(code) == KeywordKind::For){
             return this->parseForStatement();
         }
+        else if (isType<KeywordKind>(code) && std::any_cast<KeywordKind>(code) == KeywordKind::Bench){
+            return this->parseBenchStatement();
+        }
         else if (isType<Seperator>(code) && std::any_cast<Seperator>(code) == Seperator::OpenBrace){  //'{'
             return this->parseBlock();
         }
@@ -92,6 +96,8 @@ public:
         else{
             this->addError("Can not recognize a statement starting with: " + this->scanner.peek().text, this->scanner.getLastPos());
             auto beginPos = this->scanner.getNextPos();
+            //先跳过这个无法识别的Token，否则遇到关键字或分隔符时skip()不会前进，导致死循环
+            this->scanner.next();
             this->skip();
             return std::make_shared<ErrorStmt>(beginPos,this->scanner.getLastPos());
         }
@@ -124,7 +130,7 @@ public:
         if (t.kind == TokenKind::Identifier){
             auto varName = t.text;
 
-            std::string varType = "any";
+            std::shared_ptr<Type> varType = SysTypes::Any();
             std::shared_ptr<AstNode> init;
             auto isErrorNode = false;
 
@@ -133,9 +139,8 @@ public:
             if (CheckType<Seperator>(t1.code, Seperator::Colon)){  //':'
                 this->scanner.next();
                 t1 = this->scanner.peek();
-                if (t1.kind == TokenKind::Identifier){
-                    this->scanner.next();
-                    varType = t1.text;
+                if (this->isTypeName(t1)){
+                    varType = this->parseUnionType();
                 }
                 else{
                     this->addError("Error parsing type annotation in VariableDecl", this->scanner.getLastPos());
@@ -151,8 +156,7 @@ public:
                 this->scanner.next();
                 init = this->parseExpression();
             }
-            auto type = this->parseType(varType);
-            return std::make_shared<VariableDecl>(beginPos, this->scanner.getLastPos(), varName, type, init, isErrorNode);
+            return std::make_shared<VariableDecl>(beginPos, this->scanner.getLastPos(), varName, varType, init, isErrorNode);
         }
         else{
             this->addError("Expecting variable name in VariableDecl, while we meet " + t.text, this->scanner.getLastPos());
@@ -224,11 +228,10 @@ public:
             this->scanner.next();
 
             //解析typeAnnotation
-            std::string theType = "any";
+            std::shared_ptr<Type> type = SysTypes::Any();
             if (CheckType<Seperator>(this->scanner.peek().code, Seperator::Colon)){  //':'
-                theType = this->parseTypeAnnotation();
+                type = this->parseTypeAnnotation();
             }
-            auto type = this->parseType(theType);
             return std::make_shared<CallSignature>(beginPos,this->scanner.getLastPos(),paramList, type);
         }
         else{
@@ -238,25 +241,70 @@ public:
         }
     }
 
-    std::string parseTypeAnnotation() {
-        std::string theType = "any";
-
+    std::shared_ptr<Type> parseTypeAnnotation() {
         //跳过:
         this->scanner.next();
 
         auto t = this->scanner.peek();
-        if (t.kind == TokenKind::Identifier){
-            this->scanner.next();
-            theType = t.text;
+        if (this->isTypeName(t)){
+            return this->parseUnionType();
         }
         else{
             this->addError("Expecting a type name in type annotation", this->scanner.getLastPos());
         }
 
-        return theType;
+        return SysTypes::Any();
+    }
+
+    /**
+     * 解析类型，可以是联合类型
+     * unionType : primaryType ('|' primaryType)* ;
+     */
+    std::shared_ptr<Type> parseUnionType() {
+        std::vector<std::shared_ptr<Type>> types;
+        auto t = this->scanner.next();
+        types.push_back(this->parseType(t.text));
+
+        while (CheckType<Op>(this->scanner.peek().code, Op::BitOr)){  //'|'
+            this->scanner.next();  //跳过'|'
+            t = this->scanner.peek();
+            if (!this->isTypeName(t)){
+                this->addError("Expecting a type name after '|' in type annotation", this->scanner.getLastPos());
+                break;
+            }
+            this->scanner.next();
+            auto type = this->parseType(t.text);
+            auto equal = [&](const std::shared_ptr<Type>& t1) {
+                return *t1 == *type;
+            };
+            if (std::find_if(types.begin(), types.end(), equal) == types.end()){
+                types.push_back(type);
+            }
+        }
+
+        if (types.size() == 1){
+            return types[0];
+        }
+        return std::make_shared<UnionType>(types);
     }
 
 
+    /**
+     * 类型名称可以是标识符，也可以是string、boolean这样的关键字
+     */
+    bool isTypeName(const Token& t) {
+        if (t.kind == TokenKind::Identifier){
+            return true;
+        }
+
+        static const std::set<KeywordKind> typeKeywords = {
+            KeywordKind::Number, KeywordKind::String, KeywordKind::Boolean,
+            KeywordKind::Any, KeywordKind::Void, KeywordKind::Undefined, KeywordKind::Null,
+        };
+        return t.kind == TokenKind::Keyword && isType<KeywordKind>(t.code) &&
+               typeKeywords.find(std::any_cast<KeywordKind>(t.code)) != typeKeywords.end();
+    }
+
     std::shared_ptr<AstNode> parseParameterList() {
         std::vector<std::shared_ptr<AstNode>> params;
         auto beginPos = this->scanner.getNextPos();
@@ -267,12 +315,11 @@ public:
             if (t.kind == TokenKind::Identifier){
                 this->scanner.next();
                 auto t1 = this->scanner.peek();
-                std::string theType = "any";
+                std::shared_ptr<Type> type = SysTypes::Any();
                 if (isType<Seperator>(t1.code) && std::any_cast<Seperator>(t1.code)== Seperator::Colon){  //':'
-                    theType = this->parseTypeAnnotation();
+                    type = this->parseTypeAnnotation();
                 }
                 std::shared_ptr<AstNode> init;
-                auto type = this->parseType(theType);
                 params.push_back(std::make_shared<VariableDecl>(beginPos, this->scanner.getLastPos(), t.text, type, init));
 
                 //处理','
@@ -341,6 +388,70 @@ public:
         return std::make_shared<ReturnStatement>(beginPos, this->scanner.getLastPos(), exp);
     }
 
+    /**
+     * 解析基准测试语句
+     * benchStatement: 'bench' '(' expression ',' expression ')' block ;
+     */
+    std::shared_ptr<AstNode> parseBenchStatement() {
+        auto beginPos = this->scanner.getNextPos();
+        auto isErrorNode = false;
+        std::shared_ptr<AstNode> name;
+        std::shared_ptr<AstNode> iterations;
+        std::shared_ptr<AstNode> body;
+
+        //跳过'bench'
+        this->scanner.next();
+
+        auto t = this->scanner.peek();
+        if (CheckType<Seperator>(t.code, Seperator::OpenParen)){  //'('
+            this->scanner.next();
+            name = this->parseExpression();
+
+            t = this->scanner.peek();
+            if (CheckType<Op>(t.code, Op::Comma)){  //','
+                this->scanner.next();
+                iterations = this->parseExpression();
+            }
+            else{
+                this->addError("Expecting ',' after the name of bench statement, while we got a " + t.text, this->scanner.getLastPos());
+                isErrorNode = true;
+            }
+
+            t = this->scanner.peek();
+            if (CheckType<Seperator>(t.code, Seperator::CloseParen)){  //')'
+                this->scanner.next();
+            }
+            else{
+                this->addError("Expecting ')' in bench statement, while we got a " + t.text, this->scanner.getLastPos());
+                isErrorNode = true;
+            }
+        }
+        else{
+            this->addError("Expecting '(' after 'bench', while we got a " + t.text, this->scanner.getLastPos());
+            isErrorNode = true;
+        }
+
+        t = this->scanner.peek();
+        if (CheckType<Seperator>(t.code, Seperator::OpenBrace)){  //'{'
+            body = this->parseBlock();
+        }
+        else{
+            this->addError("Expecting '{' in bench statement, while we got a " + t.text, this->scanner.getLastPos());
+            this->skip();
+            std::vector<std::shared_ptr<AstNode>> stmts;
+            body = std::make_shared<Block>(beginPos, this->scanner.getLastPos(), stmts, true);
+            isErrorNode = true;
+        }
+
+        if (name == nullptr){
+            name = std::make_shared<ErrorExp>(beginPos, this->scanner.getLastPos());
+        }
+        if (iterations == nullptr){
+            iterations = std::make_shared<ErrorExp>(beginPos, this->scanner.getLastPos());
+        }
+        return std::make_shared<BenchStatement>(beginPos, this->scanner.getLastPos(), name, iterations, body, isErrorNode);
+    }
+
     std::shared_ptr<AstNode> parseBlock() {
         auto beginPos = this->scanner.getNextPos();
         auto t = this->scanner.peek();
@@ -363,12 +474,125 @@ public:
         return this->parseAssignment();
     }
 
+    /**
+     * 解析If语句
+     * ifStatement : 'if' '(' expression ')' statement ('else' statement)? ;
+     */
     std::shared_ptr<AstNode> parseIfStatement() {
-        return nullptr;
+        auto beginPos = this->scanner.getNextPos();
+        auto isErrorNode = false;
+        std::shared_ptr<AstNode> condition;
+        std::shared_ptr<AstNode> stmt;
+        std::shared_ptr<AstNode> elseStmt;
+
+        //跳过'if'
+        this->scanner.next();
+
+        auto t = this->scanner.peek();
+        if (CheckType<Seperator>(t.code, Seperator::OpenParen)){  //'('
+            this->scanner.next();
+            condition = this->parseExpression();
+
+            t = this->scanner.peek();
+            if (CheckType<Seperator>(t.code, Seperator::CloseParen)){  //')'
+                this->scanner.next();
+            }
+            else{
+                this->addError("Expecting ')' after if condition, while we got a " + t.text, this->scanner.getLastPos());
+                this->skip();
+                isErrorNode = true;
+            }
+        }
+        else{
+            this->addError("Expecting '(' after 'if', while we got a " + t.text, this->scanner.getLastPos());
+            this->skip();
+            isErrorNode = true;
+        }
+
+        //if后面的语句
+        stmt = this->parseStatement();
+
+        //可选的else部分
+        t = this->scanner.peek();
+        if (CheckType<KeywordKind>(t.code, KeywordKind::Else)){
+            this->scanner.next();
+            elseStmt = this->parseStatement();
+        }
+
+        if (condition == nullptr){
+            condition = std::make_shared<ErrorExp>(beginPos, this->scanner.getLastPos());
+        }
+        return std::make_shared<IfStatement>(beginPos, this->scanner.getLastPos(), condition, stmt, elseStmt, isErrorNode);
     }
 
+    /**
+     * 解析For语句
+     * forStatement : 'for' '(' (('let' variableDecl) | expression)? ';' expression? ';' expression? ')' statement ;
+     */
     std::shared_ptr<AstNode> parseForStatement() {
-        return nullptr;
+        auto beginPos = this->scanner.getNextPos();
+        auto isErrorNode = false;
+        std::shared_ptr<AstNode> init;
+        std::shared_ptr<AstNode> condition;
+        std::shared_ptr<AstNode> increment;
+
+        //跳过'for'
+        this->scanner.next();
+
+        auto t = this->scanner.peek();
+        if (CheckType<Seperator>(t.code, Seperator::OpenParen)){  //'('
+            this->scanner.next();
+
+            //初始化部分
+            t = this->scanner.peek();
+            if (CheckType<KeywordKind>(t.code, KeywordKind::Let)){
+                this->scanner.next();
+                init = this->parseVariableDecl();
+            }
+            else if (!CheckType<Seperator>(t.code, Seperator::SemiColon)){
+                init = this->parseExpression();
+            }
+
+            //条件和递增部分，前面各有一个';'
+            for (auto part: {&condition, &increment}){
+                t = this->scanner.peek();
+                if (CheckType<Seperator>(t.code, Seperator::SemiColon)){  //';'
+                    this->scanner.next();
+                }
+                else{
+                    this->addError("Expecting ';' in for statement, while we got a " + t.text, this->scanner.getLastPos());
+                    this->skip();
+                    isErrorNode = true;
+                    break;
+                }
+
+                t = this->scanner.peek();
+                auto end = part == &condition ? Seperator::SemiColon : Seperator::CloseParen;
+                if (!CheckType<Seperator>(t.code, end)){
+                    *part = this->parseExpression();
+                }
+            }
+
+            t = this->scanner.peek();
+            if (CheckType<Seperator>(t.code, Seperator::CloseParen)){  //')'
+                this->scanner.next();
+            }
+            else{
+                this->addError("Expecting ')' in for statement, while we got a " + t.text, this->scanner.getLastPos());
+                this->skip();
+                isErrorNode = true;
+            }
+        }
+        else{
+            this->addError("Expecting '(' after 'for', while we got a " + t.text, this->scanner.getLastPos());
+            this->skip();
+            isErrorNode = true;
+        }
+
+        //循环体
+        auto stmt = this->parseStatement();
+
+        return std::make_shared<ForStatement>(beginPos, this->scanner.getLastPos(), init, condition, increment, stmt, isErrorNode);
     }
 
     std::shared_ptr<AstNode> parseExpressionStatement() {
@@ -468,9 +692,9 @@ public:
             auto exp = this->parsePrimary();
             auto t1 = this->scanner.peek();
             if (t1.kind == TokenKind::Operator &&
-                (isType<Op>(t.code) && (std::any_cast<Op>(t.code) == Op::Inc || std::any_cast<Op>(t.code) == Op::Dec))){
+                (isType<Op>(t1.code) && (std::any_cast<Op>(t1.code) == Op::Inc || std::any_cast<Op>(t1.code) == Op::Dec))){
                 this->scanner.next(); //跳过运算符
-                return std::make_shared<Unary>(beginPos, this->scanner.getLastPos(), std::any_cast<Op>(t.code), exp, false);
+                return std::make_shared<Unary>(beginPos, this->scanner.getLastPos(), std::any_cast<Op>(t1.code), exp, false);
             }
             else{
                 return exp;
@@ -501,15 +725,11 @@ public:
         }
         else if (t.kind == TokenKind::DecimalLiteral){
             this->scanner.next();
-            //return std::make_shared<DecimalLiteral>(beginPos,parseFloat(t.text));
-            dbg("IntegerLiteral is not support!");
-            return nullptr;
+            return std::make_shared<DecimalLiteral>(beginPos, std::stod(t.text));
         }
         else if (t.kind == TokenKind::StringLiteral){
             this->scanner.next();
-            //return std::make_shared<StringLiteral>(beginPos,t.text);
-            dbg("StringLiteral is not support!");
-            return nullptr;
+            return std::make_shared<StringLiteral>(beginPos, t.text);
         }
         else if (isType<Seperator>(t.code) && std::any_cast<Seperator>(t.code) == Seperator::OpenParen){  //'('
             this->scanner.next();
@@ -576,6 +796,8 @@ public:
         static std::map<std::string, std::shared_ptr<Type>> str2Type = {
             {"any", SysTypes::Any()},
             {"number", SysTypes::Number()},
+            {"integer", SysTypes::Integer()},
+            {"decimal", SysTypes::Decimal()},
             {"boolean", SysTypes::Boolean()},
             {"string", SysTypes::String()},
             {"undefined", SysTypes::Undefined()},
@@ -0,0 +1,185 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <sstream>
+#include <math.h>
+
+//
+// 找出程序中所有的函数声明，记录函数体与函数的对应关系
+//
+class FunctionCollector: public AstVisitor{
+public:
+    std::unordered_map<AstNode*, FunctionProfile>& functions;
+
+    FunctionCollector(std::unordered_map<AstNode*, FunctionProfile>& functions): functions(functions) {
+    }
+
+    std::any visitFunctionDecl(FunctionDecl& functionDecl, std::string prefix) override {
+        auto& function = this->functions[functionDecl.body.get()];
+        function.name = functionDecl.name;
+        function.pos = functionDecl.beginPos;
+        return AstVisitor::visitFunctionDecl(functionDecl, prefix);
+    }
+};
+
+static std::string NodeKind(AstNode& node) {
+    if (dynamic_cast<Prog*>(&node) != nullptr) {
+        return "Prog";
+    } else if (dynamic_cast<Block*>(&node) != nullptr) {
+        return "Block";
+    } else if (dynamic_cast<FunctionDecl*>(&node) != nullptr) {
+        return "FunctionDecl";
+    } else if (dynamic_cast<VariableStatement*>(&node) != nullptr) {
+        return "VariableStatement";
+    } else if (dynamic_cast<VariableDecl*>(&node) != nullptr) {
+        return "VariableDecl";
+    } else if (dynamic_cast<ExpressionStatement*>(&node) != nullptr) {
+        return "ExpressionStatement";
+    } else if (dynamic_cast<ReturnStatement*>(&node) != nullptr) {
+        return "ReturnStatement";
+    } else if (dynamic_cast<BenchStatement*>(&node) != nullptr) {
+        return "BenchStatement";
+    } else if (dynamic_cast<IfStatement*>(&node) != nullptr) {
+        return "IfStatement";
+    } else if (dynamic_cast<ForStatement*>(&node) != nullptr) {
+        return "ForStatement";
+    } else if (dynamic_cast<FunctionCall*>(&node) != nullptr) {
+        return "FunctionCall";
+    } else if (dynamic_cast<Binary*>(&node) != nullptr) {
+        return "Binary";
+    } else if (dynamic_cast<Unary*>(&node) != nullptr) {
+        return "Unary";
+    } else if (dynamic_cast<Variable*>(&node) != nullptr) {
+        return "Variable";
+    } else if (dynamic_cast<IntegerLiteral*>(&node) != nullptr ||
+               dynamic_cast<DecimalLiteral*>(&node) != nullptr ||
+               dynamic_cast<StringLiteral*>(&node) != nullptr) {
+        return "Literal";
+    }
+    return "AstNode";
+}
+
+void ProfilingInterpretor::profile(Prog& prog) {
+    FunctionCollector collector(this->functions);
+    collector.visit(prog);
+
+    //顶层代码算作main函数
+    auto& main = this->functions[&prog];
+    main.name = "main";
+    main.pos = prog.beginPos;
+
+    this->stackKey.clear();
+    this->childNanos.clear();
+    this->activeFunctions.clear();
+    this->returning = false;
+    this->visit(prog);
+    this->returning = false;
+}
+
+std::any ProfilingInterpretor::visit(AstNode& node, std::string prefix) {
+    //进入一个函数体，把函数压入调用栈。
+    //尾调用会先结束当前的函数体，再执行被调用者的函数体，所以调用栈里不会出现被复用了栈桢的函数
+    FunctionProfile* function = nullptr;
+    std::string callerKey;
+    auto it = this->functions.find(&node);
+    if (it != this->functions.end()) {
+        function = &it->second;
+        function->calls++;
+        callerKey = this->stackKey;
+        this->stackKey = callerKey.empty() ? function->name : callerKey + ";" + function->name;
+        this->activeFunctions.push_back(function);
+    }
+
+    this->childNanos.push_back(0);
+    double start = TickNanos();
+    auto ret = Interpretor::visit(node, prefix);
+    double total = TickNanos() - start;
+    double self = total - this->childNanos.back();
+    this->childNanos.pop_back();
+    if (!this->childNanos.empty()) {
+        this->childNanos.back() += total;
+    }
+
+    auto& profile = this->nodes[&node];
+    if (profile.count == 0) {
+        profile.pos = node.beginPos;
+        profile.kind = NodeKind(node);
+    }
+    profile.count++;
+    profile.totalNanos += total;
+    profile.selfNanos += self;
+
+    this->folded[this->stackKey] += self;
+    if (!this->activeFunctions.empty()) {
+        this->activeFunctions.back()->selfNanos += self;
+    }
+
+    if (function != nullptr) {
+        function->totalNanos += total;
+        this->activeFunctions.pop_back();
+        this->stackKey = callerKey;
+    }
+    return ret;
+}
+
+std::string ProfilingInterpretor::foldedStacks() const {
+    std::stringstream ss;
+    for (auto& x: this->folded) {
+        auto nanos = llround(x.second);
+        if (x.first.empty() || nanos <= 0) {
+            continue;
+        }
+        ss << x.first << " " << nanos << "\n";
+    }
+    return ss.str();
+}
+
+std::string ProfilingInterpretor::annotatedSource(const std::string& source) const {
+    //按行汇总：执行次数取这一行上执行最多的节点，耗时取这一行上所有节点的自身耗时之和
+    std::map<uint32_t, std::pair<uint64_t, double>> lines;
+    for (auto& x: this->nodes) {
+        auto& line = lines[x.second.pos.line];
+        line.first = std::max(line.first, x.second.count);
+        line.second += x.second.selfNanos;
+    }
+
+    std::stringstream ss;
+    char tmp[64] = {0};
+    snprintf(tmp, sizeof(tmp), "%10s %14s | ", "count", "self(ns)");
+    ss << tmp << "source\n";
+
+    std::istringstream in(source);
+    std::string text;
+    uint32_t lineNo = 1;
+    while (std::getline(in, text)) {
+        auto it = lines.find(lineNo);
+        if (it != lines.end()) {
+            snprintf(tmp, sizeof(tmp), "%10llu %14.0f | ", static_cast<unsigned long long>(it->second.first), it->second.second);
+        } else {
+            snprintf(tmp, sizeof(tmp), "%10s %14s | ", "", "");
+        }
+        ss << tmp << text << "\n";
+        lineNo++;
+    }
+    return ss.str();
+}
+
+std::string ProfilingInterpretor::functionSummary() const {
+    std::vector<const FunctionProfile*> sorted;
+    for (auto& x: this->functions) {
+        sorted.push_back(&x.second);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const FunctionProfile* a, const FunctionProfile* b) {
+        return a->selfNanos > b->selfNanos;
+    });
+
+    std::stringstream ss;
+    char tmp[256] = {0};
+    for (auto function: sorted) {
+        snprintf(tmp, sizeof(tmp), "%-20s ln:%-5u calls=%-8llu total=%.0fns self=%.0fns\n",
+            function->name.c_str(), function->pos.line, static_cast<unsigned long long>(function->calls),
+            function->totalNanos, function->selfNanos);
+        ss << tmp;
+    }
+    return ss.str();
+}
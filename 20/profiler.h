@@ -0,0 +1,93 @@
+#ifndef __PROFILER_H_
+#define __PROFILER_H_
+
+#include "ast.h"
+#include "error.h"
+#include "interpretor.h"
+#include "timing.h"
+
+#include "dbg.h"
+
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <any>
+#include <stdint.h>
+
+//
+// 解释器的剖析模式
+// ProfilingInterpretor是Interpretor的子类，重写了visit()，对每个AST节点计数和计时，
+// 并按照函数调用栈累计时间。Interpretor本身没有任何改动，不剖析的时候没有额外开销。
+// 结果可以输出成两种格式：
+//   foldedStacks()     folded stack格式，每行是"main;f;g 纳秒数"，可以直接交给flamegraph.pl等工具
+//   annotatedSource()  带注解的源代码，每一行前面是执行次数和自身耗时
+//
+
+//一个AST节点的统计数据
+struct NodeProfile{
+    Position pos;           //节点在源代码中的位置
+    std::string kind;       //节点的种类，比如Binary、FunctionCall
+    uint64_t count {0};     //执行次数
+    double totalNanos {0};  //总耗时，包括子节点
+    double selfNanos {0};   //自身耗时，不包括子节点
+};
+
+//一个函数的统计数据。顶层代码算作main函数
+struct FunctionProfile{
+    std::string name;
+    Position pos;           //FunctionDecl在源代码中的位置
+    uint64_t calls {0};     //调用次数
+    double totalNanos {0};  //总耗时，包括它调用的其他函数
+    double selfNanos {0};   //自身耗时
+};
+
+class ProfilingInterpretor: public Interpretor{
+public:
+    //每个节点的统计数据
+    std::unordered_map<AstNode*, NodeProfile> nodes;
+
+    //每个函数的统计数据，key是函数体
+    std::unordered_map<AstNode*, FunctionProfile> functions;
+
+    //每个调用栈上的自身耗时，key是"main;f;g"
+    std::map<std::string, double> folded;
+
+    /**
+     * 剖析一个程序的执行。需要先做完语义分析。
+     * 可以多次调用，统计数据会累加。
+     */
+    void profile(Prog& prog);
+
+    /**
+     * 每个AST节点都经过这里，在调用Interpretor的实现前后计时
+     */
+    std::any visit(AstNode& node, std::string prefix = "") override;
+
+    //folded stack格式的输出
+    std::string foldedStacks() const;
+
+    //带注解的源代码，source是被剖析的程序的源代码
+    std::string annotatedSource(const std::string& source) const;
+
+    //按自身耗时从大到小排列的函数统计
+    std::string functionSummary() const;
+
+    void clear() {
+        this->nodes.clear();
+        this->functions.clear();
+        this->folded.clear();
+    }
+
+private:
+    //当前调用栈，用';'连接的函数名称
+    std::string stackKey;
+
+    //正在执行的节点，它们的子节点耗时之和。用于计算自身耗时
+    std::vector<double> childNanos;
+
+    //正在执行的函数
+    std::vector<FunctionProfile*> activeFunctions;
+};
+
+#endif
@@ -0,0 +1,659 @@
+#include "regvm.h"
+
+#include <algorithm>
+#include <optional>
+#include <sstream>
+
+std::string toString(RegOp op) {
+    switch (op) {
+        case RegOp::Move:
+            return "move";
+        case RegOp::IAdd:
+            return "iadd";
+        case RegOp::SAdd:
+            return "sadd";
+        case RegOp::ISub:
+            return "isub";
+        case RegOp::IMul:
+            return "imul";
+        case RegOp::IDiv:
+            return "idiv";
+        case RegOp::DAdd:
+            return "dadd";
+        case RegOp::DSub:
+            return "dsub";
+        case RegOp::DMul:
+            return "dmul";
+        case RegOp::DDiv:
+            return "ddiv";
+        case RegOp::Call:
+            return "call";
+        case RegOp::TailCall:
+            return "tailcall";
+        case RegOp::CallNative:
+            return "callnative";
+        case RegOp::Return:
+            return "return";
+        case RegOp::ReturnVoid:
+            return "vreturn";
+    }
+    return "unknown";
+}
+
+//指令的a是不是目标槽位
+static bool WritesA(const RegInst& inst) {
+    switch (inst.op) {
+        case RegOp::Move:
+        case RegOp::IAdd:
+        case RegOp::SAdd:
+        case RegOp::ISub:
+        case RegOp::IMul:
+        case RegOp::IDiv:
+        case RegOp::DAdd:
+        case RegOp::DSub:
+        case RegOp::DMul:
+        case RegOp::DDiv:
+            return true;
+        case RegOp::Call:
+        case RegOp::CallNative:
+            return inst.a != RegInst::NoReg;
+        default:
+            return false;
+    }
+}
+
+RegFunction* RegisterTranslator::getFunction(RegModule& m, const std::shared_ptr<FunctionSymbol>& sym) {
+    auto& fun = m.functions[sym.get()];
+    if (fun == nullptr) {
+        fun = std::make_unique<RegFunction>();
+        fun->sym = sym;
+        this->pending.push_back(fun.get());
+    }
+    return fun.get();
+}
+
+std::shared_ptr<RegModule> RegisterTranslator::translate(const BCModule& bcModule) {
+    if (bcModule._main == nullptr) {
+        dbg("Can not find main function.");
+        return nullptr;
+    }
+
+    auto m = std::make_shared<RegModule>();
+    m->source = &bcModule;
+    this->pending.clear();
+    m->main = this->getFunction(*m, bcModule._main);
+
+    //从入口函数开始，翻译所有可以调用到的函数
+    while (!this->pending.empty()) {
+        auto fun = this->pending.back();
+        this->pending.pop_back();
+        if (!this->translateFunction(bcModule, *m, *fun)) {
+            this->pending.clear();
+            return nullptr;
+        }
+        m->numStackInsts += fun->numStackInsts;
+        m->numRegInsts += fun->code.size();
+    }
+    return m;
+}
+
+bool RegisterTranslator::translateFunction(const BCModule& bcModule, RegModule& m, RegFunction& fun) {
+    auto& sym = *fun.sym;
+
+    //超级指令先还原成组成它的指令再翻译。numStackInsts统计的是原来的字节码的指令数
+    for (uint32_t i = 0; i < sym.byteCode.size() && InstructionLength(sym.byteCode, i) != 0; i += InstructionLength(sym.byteCode, i)) {
+        fun.numStackInsts++;
+    }
+    auto bc = ExpandSuperInstructions(sym.byteCode);
+    fun.numParams = sym.getNumParams();
+    fun.numLocals = sym.vars.size();
+
+    //模拟的操作数栈，保存每个操作数所在的位置（RK编码）
+    std::vector<uint16_t> stack;
+    size_t maxDepth = 0;
+
+    //深度为depth的操作数对应的临时变量
+    auto temp = [&](size_t depth) {
+        return static_cast<uint16_t>(fun.numLocals + depth);
+    };
+
+    auto emit = [&](RegOp op, uint16_t a, uint16_t b, uint16_t c) {
+        fun.code.push_back(RegInst{op, a, b, c});
+    };
+
+    auto pushConst = [&](const Value& v) {
+        fun.constants.push_back(v);
+        stack.push_back(static_cast<uint16_t>(RegInst::ConstBit | (fun.constants.size() - 1)));
+    };
+
+    //把栈里第depth个操作数放到它对应的临时变量里
+    auto materialize = [&](size_t depth) {
+        if (stack[depth] != temp(depth)) {
+            emit(RegOp::Move, temp(depth), stack[depth], 0);
+            stack[depth] = temp(depth);
+        }
+    };
+
+    auto error = [&](const std::string& msg, uint32_t codeIndex) {
+        dbg("Register tier: " + msg + " in " + sym.name + " at: " + std::to_string(codeIndex));
+        return false;
+    };
+
+    uint32_t i = 0;
+    while (i < bc.size()) {
+        uint8_t opCode = bc[i];
+        uint32_t length = InstructionLength(bc, i);
+        if (length == 0 || i + length > bc.size()) {
+            return error("bad op code " + toString(static_cast<OpCode>(opCode)), i);
+        }
+
+        //iload、istore的本地变量下标
+        int32_t load = -1;
+        int32_t store = -1;
+        //二元运算
+        std::optional<RegOp> binary;
+
+        switch (opCode) {
+            case OpCode::iconst_0:
+            case OpCode::iconst_1:
+            case OpCode::iconst_2:
+            case OpCode::iconst_3:
+            case OpCode::iconst_4:
+            case OpCode::iconst_5:
+                pushConst(Value(static_cast<int32_t>(opCode - OpCode::iconst_0)));
+                break;
+            case OpCode::dconst_0:
+                pushConst(Value(0.0));
+                break;
+            case OpCode::dconst_1:
+                pushConst(Value(1.0));
+                break;
+            case OpCode::bconst_0:
+            case OpCode::bconst_1:
+                pushConst(Value(opCode == OpCode::bconst_1));
+                break;
+            case OpCode::bipush:
+                pushConst(Value(static_cast<int32_t>(static_cast<int8_t>(bc[i + 1]))));
+                break;
+            case OpCode::sipush:
+                pushConst(Value(static_cast<int32_t>((static_cast<int8_t>(bc[i + 1]) << 8) | bc[i + 2])));
+                break;
+            case OpCode::ldc:
+            case OpCode::sldc:
+            case OpCode::ldc2_w:
+            {
+                uint32_t index = opCode == OpCode::ldc2_w ? (bc[i + 1] << 8 | bc[i + 2]) : bc[i + 1];
+                if (index >= bcModule.consts.size()) {
+                    return error("const index out of range", i);
+                }
+                pushConst(VM::ToValue(bcModule.consts[index]));
+                break;
+            }
+
+            case OpCode::iload:
+                load = bc[i + 1];
+                break;
+            case OpCode::iload_0:
+            case OpCode::iload_1:
+            case OpCode::iload_2:
+            case OpCode::iload_3:
+                load = opCode - OpCode::iload_0;
+                break;
+
+            case OpCode::istore:
+                store = bc[i + 1];
+                break;
+            case OpCode::istore_0:
+            case OpCode::istore_1:
+            case OpCode::istore_2:
+            case OpCode::istore_3:
+                store = opCode - OpCode::istore_0;
+                break;
+
+            case OpCode::iadd:
+                binary = RegOp::IAdd;
+                break;
+            case OpCode::sadd:
+                binary = RegOp::SAdd;
+                break;
+            case OpCode::isub:
+                binary = RegOp::ISub;
+                break;
+            case OpCode::imul:
+                binary = RegOp::IMul;
+                break;
+            case OpCode::idiv:
+                binary = RegOp::IDiv;
+                break;
+            case OpCode::dadd:
+                binary = RegOp::DAdd;
+                break;
+            case OpCode::dsub:
+                binary = RegOp::DSub;
+                break;
+            case OpCode::dmul:
+                binary = RegOp::DMul;
+                break;
+            case OpCode::ddiv:
+                binary = RegOp::DDiv;
+                break;
+
+            case OpCode::ireturn:
+                if (stack.empty()) {
+                    return error("ireturn with empty stack", i);
+                }
+                emit(RegOp::Return, 0, stack.back(), 0);
+                stack.pop_back();
+                break;
+            case OpCode::vreturn:
+                emit(RegOp::ReturnVoid, 0, 0, 0);
+                break;
+
+            case OpCode::invokestatic:
+            case OpCode::invoketail:
+            {
+                uint32_t index = bc[i + 1] << 8 | bc[i + 2];
+                if (index >= bcModule.consts.size() || !isType<std::shared_ptr<FunctionSymbol>>(bcModule.consts[index])) {
+                    return error("invoke expect FunctionSymbol", i);
+                }
+                auto callee = std::any_cast<std::shared_ptr<FunctionSymbol>>(bcModule.consts[index]);
+
+                //实参放到连续的临时变量里，调用时复制到被调用者的栈桢
+                uint32_t numParams = callee->getNumParams();
+                if (stack.size() < numParams) {
+                    return error("not enough arguments for " + callee->name, i);
+                }
+                size_t first = stack.size() - numParams;
+                for (size_t d = first; d < stack.size(); d++) {
+                    materialize(d);
+                }
+                stack.resize(first);
+
+                auto target = this->getFunction(m, callee);
+                auto iter = std::find(fun.callees.begin(), fun.callees.end(), target);
+                uint16_t calleeIndex = static_cast<uint16_t>(iter - fun.callees.begin());
+                if (iter == fun.callees.end()) {
+                    fun.callees.push_back(target);
+                }
+
+                if (opCode == OpCode::invoketail) {
+                    emit(RegOp::TailCall, RegInst::NoReg, temp(first), calleeIndex);
+                    stack.clear();
+                }
+                else if (ReturnsValue(*callee)) {
+                    emit(RegOp::Call, temp(first), temp(first), calleeIndex);
+                    stack.push_back(temp(first));
+                }
+                else {
+                    emit(RegOp::Call, RegInst::NoReg, temp(first), calleeIndex);
+                }
+                break;
+            }
+
+            //原生函数（包括内置函数）：实参放到连续的临时变量里，与调用用户定义的函数一样
+            case OpCode::invokenative:
+            {
+                if (bc[i + 1] >= NativeFunctions().size() || bc[i + 1] == 0) {
+                    return error("unknown built-in function " + std::to_string(bc[i + 1]), i);
+                }
+                auto& native = NativeFunctions()[bc[i + 1]];
+                if (stack.size() < native.numParams) {
+                    return error("not enough arguments for " + native.name, i);
+                }
+                size_t first = stack.size() - native.numParams;
+                for (size_t d = first; d < stack.size(); d++) {
+                    materialize(d);
+                }
+                stack.resize(first);
+                if (native.returnsValue) {
+                    emit(RegOp::CallNative, temp(first), temp(first), bc[i + 1]);
+                    stack.push_back(temp(first));
+                }
+                else {
+                    emit(RegOp::CallNative, RegInst::NoReg, temp(first), bc[i + 1]);
+                }
+                break;
+            }
+
+            //值不再使用，不生成指令
+            case OpCode::pop:
+                stack.pop_back();
+                break;
+
+            //本地变量原地加上一个常量。与栈式虚拟机相同，负的增量用isub
+            case OpCode::iinc:
+            case OpCode::iinc_w:
+            {
+                bool wide = opCode == OpCode::iinc_w;
+                uint32_t index = wide ? (bc[i + 1] << 8 | bc[i + 2]) : bc[i + 1];
+                int32_t delta = wide ? static_cast<int16_t>(bc[i + 3] << 8 | bc[i + 4]) : static_cast<int8_t>(bc[i + 2]);
+                if (index >= fun.numLocals) {
+                    return error("local index out of range", i);
+                }
+                uint16_t local = static_cast<uint16_t>(index);
+
+                //栈里还有iload留下的、对这个本地变量的引用，先把旧值复制到临时变量里
+                for (size_t d = 0; d < stack.size(); d++) {
+                    if (stack[d] == local) {
+                        materialize(d);
+                    }
+                }
+                fun.constants.push_back(Value(delta >= 0 ? delta : -delta));
+                uint16_t k = static_cast<uint16_t>(RegInst::ConstBit | (fun.constants.size() - 1));
+                emit(delta >= 0 ? RegOp::IAdd : RegOp::ISub, local, local, k);
+                break;
+            }
+
+            default:
+                //跳转指令等，还不支持
+                return error("unsupported op code " + toString(static_cast<OpCode>(opCode)), i);
+        }
+
+        if (load >= fun.numLocals || store >= fun.numLocals) {
+            return error("local index out of range", i);
+        }
+
+        //iload：不生成指令，只记下操作数在哪个本地变量里
+        if (load >= 0) {
+            stack.push_back(static_cast<uint16_t>(load));
+        }
+        //istore
+        else if (store >= 0) {
+            if (stack.empty()) {
+                return error("istore with empty stack", i);
+            }
+            uint16_t local = static_cast<uint16_t>(store);
+            uint16_t src = stack.back();
+            stack.pop_back();
+
+            //栈里还有iload留下的、对这个本地变量的引用，先把旧值复制到临时变量里
+            bool moved = false;
+            for (size_t d = 0; d < stack.size(); d++) {
+                if (stack[d] == local) {
+                    materialize(d);
+                    moved = true;
+                }
+            }
+
+            //要保存的是上一条指令的结果，直接让上一条指令写到本地变量
+            if (!moved && src == temp(stack.size()) && !fun.code.empty() && WritesA(fun.code.back()) && fun.code.back().a == src) {
+                fun.code.back().a = local;
+            }
+            else if (src != local) {
+                emit(RegOp::Move, local, src, 0);
+            }
+        }
+        //二元运算，结果放到栈顶对应的临时变量
+        else if (binary) {
+            if (stack.size() < 2) {
+                return error("binary with not enough operands", i);
+            }
+            uint16_t r = stack.back();
+            stack.pop_back();
+            uint16_t l = stack.back();
+            stack.pop_back();
+            emit(binary.value(), temp(stack.size()), l, r);
+            stack.push_back(temp(stack.size()));
+        }
+
+        maxDepth = std::max(maxDepth, stack.size());
+        if (fun.numLocals + maxDepth >= RegInst::ConstBit || fun.constants.size() >= RegInst::ConstBit - 1) {
+            return error("too many registers or constants", i);
+        }
+        i += length;
+    }
+
+    //确保函数以返回指令结束
+    if (fun.code.empty() || (fun.code.back().op != RegOp::Return && fun.code.back().op != RegOp::ReturnVoid && fun.code.back().op != RegOp::TailCall)) {
+        emit(RegOp::ReturnVoid, 0, 0, 0);
+    }
+
+    fun.numRegs = static_cast<uint16_t>(fun.numLocals + maxDepth);
+    return true;
+}
+
+std::string RegModuleDumper::dump(const RegModule& m) {
+    std::stringstream ss;
+    auto operand = [](const RegFunction& fun, uint16_t x) {
+        if (x == RegInst::NoReg) {
+            return std::string("_");
+        }
+        if (RegInst::isConst(x)) {
+            return "K(" + fun.constants[x & ~RegInst::ConstBit].toString() + ")";
+        }
+        return "r" + std::to_string(x);
+    };
+
+    for (auto& x: m.functions) {
+        auto& fun = *x.second;
+        ss << fun.sym->name << ": params=" << fun.numParams << " locals=" << fun.numLocals << " regs=" << fun.numRegs << "\n";
+        for (auto& inst: fun.code) {
+            ss << "    " << toString(inst.op);
+            switch (inst.op) {
+                case RegOp::Call:
+                case RegOp::TailCall:
+                    ss << " " << operand(fun, inst.a) << ", " << fun.callees[inst.c]->sym->name << "(r" << inst.b << "...)";
+                    break;
+                case RegOp::CallNative:
+                    ss << " " << operand(fun, inst.a) << ", " << NativeFunctions()[inst.c].name << "(r" << inst.b << "...)";
+                    break;
+                case RegOp::Return:
+                    ss << " " << operand(fun, inst.b);
+                    break;
+                case RegOp::Move:
+                    ss << " " << operand(fun, inst.a) << ", " << operand(fun, inst.b);
+                    break;
+                case RegOp::ReturnVoid:
+                    break;
+                default:
+                    ss << " " << operand(fun, inst.a) << ", " << operand(fun, inst.b) << ", " << operand(fun, inst.c);
+                    break;
+            }
+            ss << "\n";
+        }
+    }
+    return ss.str();
+}
+
+bool RegisterVM::load(const BCModule& bcModule) {
+    if (this->module != nullptr && this->module->source == &bcModule) {
+        return true;
+    }
+    if (this->rejected == &bcModule) {
+        return false;
+    }
+
+    RegisterTranslator translator;
+    this->module = translator.translate(bcModule);
+    if (this->module == nullptr) {
+        dbg("Register tier: fall back to stack bytecode");
+        this->rejected = &bcModule;
+        return false;
+    }
+    this->rejected = nullptr;
+    return true;
+}
+
+//取一个RK编码的操作数
+static inline const Value& Operand(const Value* regs, const Value* k, uint16_t x) {
+    return (x & RegInst::ConstBit) ? k[x & ~RegInst::ConstBit] : regs[x];
+}
+
+int32_t RegisterVM::run() {
+    if (this->module == nullptr || this->module->main == nullptr) {
+        dbg("Register tier: no module loaded");
+        return -1;
+    }
+
+    RegFunction* fun = this->module->main;
+    this->frames.clear();
+    this->frames.push_back(RegFrame{fun, 0, 0, RegInst::NoReg});
+    if (this->registers.size() < fun->numRegs) {
+        this->registers.resize(fun->numRegs);
+    }
+    std::fill(this->registers.begin(), this->registers.begin() + fun->numRegs, Value());
+
+    //当前函数的代码、常量和栈桢
+    const RegInst* code = fun->code.data();
+    const Value* k = fun->constants.data();
+    Value* regs = this->registers.data();
+    uint32_t pc = 0;
+
+    while (true) {
+        const RegInst& inst = code[pc++];
+        switch (inst.op) {
+            case RegOp::Move:
+                regs[inst.a] = Operand(regs, k, inst.b);
+                break;
+
+            case RegOp::IAdd:
+                if (!VM::BinaryOp<OpCode::iadd>(regs[inst.a], Operand(regs, k, inst.b), Operand(regs, k, inst.c))) {
+                    return -2;
+                }
+                break;
+            case RegOp::SAdd:
+                if (!VM::BinaryOp<OpCode::sadd>(regs[inst.a], Operand(regs, k, inst.b), Operand(regs, k, inst.c))) {
+                    return -2;
+                }
+                break;
+            case RegOp::ISub:
+                if (!VM::BinaryOp<OpCode::isub>(regs[inst.a], Operand(regs, k, inst.b), Operand(regs, k, inst.c))) {
+                    return -2;
+                }
+                break;
+            case RegOp::IMul:
+                if (!VM::BinaryOp<OpCode::imul>(regs[inst.a], Operand(regs, k, inst.b), Operand(regs, k, inst.c))) {
+                    return -2;
+                }
+                break;
+            case RegOp::IDiv:
+                if (!VM::BinaryOp<OpCode::idiv>(regs[inst.a], Operand(regs, k, inst.b), Operand(regs, k, inst.c))) {
+                    return -2;
+                }
+                break;
+            case RegOp::DAdd:
+                if (!VM::BinaryOp<OpCode::dadd>(regs[inst.a], Operand(regs, k, inst.b), Operand(regs, k, inst.c))) {
+                    return -2;
+                }
+                break;
+            case RegOp::DSub:
+                if (!VM::BinaryOp<OpCode::dsub>(regs[inst.a], Operand(regs, k, inst.b), Operand(regs, k, inst.c))) {
+                    return -2;
+                }
+                break;
+            case RegOp::DMul:
+                if (!VM::BinaryOp<OpCode::dmul>(regs[inst.a], Operand(regs, k, inst.b), Operand(regs, k, inst.c))) {
+                    return -2;
+                }
+                break;
+            case RegOp::DDiv:
+                if (!VM::BinaryOp<OpCode::ddiv>(regs[inst.a], Operand(regs, k, inst.b), Operand(regs, k, inst.c))) {
+                    return -2;
+                }
+                break;
+
+            case RegOp::CallNative:
+            {
+                const NativeFunction& native = NativeFunctions()[inst.c];
+                Value result;
+                if (!native.call(regs + inst.b, result)) {
+                    dbg("Error: callnative " + native.name + " argument type mismatch");
+                    return -2;
+                }
+                if (inst.a != RegInst::NoReg) {
+                    regs[inst.a] = result;
+                }
+                break;
+            }
+
+            case RegOp::Call:
+            {
+                //被调用者的栈桢紧接着当前栈桢
+                RegFunction* callee = fun->callees[inst.c];
+                uint32_t callerBase = this->frames.back().base;
+                uint32_t base = callerBase + fun->numRegs;
+                this->frames.back().pc = pc;
+                if (this->registers.size() < base + callee->numRegs) {
+                    this->registers.resize(std::max<size_t>(base + callee->numRegs, this->registers.size() * 2));
+                }
+
+                //扩容之后重新计算指针，然后复制实参，其他槽位清空
+                Value* args = this->registers.data() + callerBase + inst.b;
+                regs = this->registers.data() + base;
+                for (uint32_t i = 0; i < callee->numParams; i++) {
+                    regs[i] = args[i];
+                }
+                for (uint32_t i = callee->numParams; i < callee->numRegs; i++) {
+                    regs[i] = Value();
+                }
+
+                this->frames.push_back(RegFrame{callee, 0, base, inst.a});
+                fun = callee;
+                code = fun->code.data();
+                k = fun->constants.data();
+                pc = 0;
+                break;
+            }
+
+            case RegOp::TailCall:
+            {
+                //复用当前栈桢：实参移到本地变量的位置。实参的槽位总是不在目标槽位的前面，所以可以从前往后复制
+                RegFunction* callee = fun->callees[inst.c];
+                uint32_t base = this->frames.back().base;
+                if (this->registers.size() < base + callee->numRegs) {
+                    this->registers.resize(std::max<size_t>(base + callee->numRegs, this->registers.size() * 2));
+                    regs = this->registers.data() + base;
+                }
+                for (uint32_t i = 0; i < callee->numParams; i++) {
+                    regs[i] = regs[inst.b + i];
+                }
+                for (uint32_t i = callee->numParams; i < callee->numRegs; i++) {
+                    regs[i] = Value();
+                }
+
+                this->frames.back().function = callee;
+                fun = callee;
+                code = fun->code.data();
+                k = fun->constants.data();
+                pc = 0;
+                break;
+            }
+
+            case RegOp::Return:
+            case RegOp::ReturnVoid:
+            {
+                Value retValue = inst.op == RegOp::Return ? Operand(regs, k, inst.b) : Value();
+                uint16_t retReg = this->frames.back().retReg;
+                this->frames.pop_back();
+                if (this->frames.empty()) { //主程序返回，结束运行
+                    return 0;
+                }
+
+                //返回到调用者
+                auto& frame = this->frames.back();
+                fun = frame.function;
+                code = fun->code.data();
+                k = fun->constants.data();
+                regs = this->registers.data() + frame.base;
+                pc = frame.pc;
+                if (retReg != RegInst::NoReg) {
+                    regs[retReg] = retValue;
+                }
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+bool VM::executeRegister(const BCModule& bcModule, int32_t& ret) {
+    if (this->registerVM == nullptr) {
+        this->registerVM = std::make_shared<RegisterVM>();
+    }
+    if (!this->registerVM->load(bcModule)) {
+        return false;
+    }
+    ret = this->registerVM->run();
+    return true;
+}
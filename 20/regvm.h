@@ -0,0 +1,171 @@
+#ifndef __REGVM_H_
+#define __REGVM_H_
+
+#include "vm.h"
+#include "value.h"
+#include "symbol.h"
+
+#include "dbg.h"
+
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+//
+// 寄存器虚拟机
+// 模块加载时，把每个函数的栈式字节码翻译成三地址的寄存器指令，操作数直接是栈桢里的槽位。
+// 栈桢的槽位依次是：本地变量（参数在最前面），然后是临时变量。
+// 栈式字节码里深度为d的操作数，对应第 本地变量个数+d 个槽位，所以翻译时只需要模拟操作数栈的深度。
+// 与栈式虚拟机相比，iload、istore、常量入栈这些只是搬运数据的指令大都被消掉了：
+//   iload_0; iload_1; iadd; istore_2    =>    add r2, r0, r1
+//
+// 字节码文件的格式不变，寄存器指令只存在于内存里。
+//
+
+//寄存器指令的操作码
+enum class RegOp: uint8_t{
+    Move,           //a = RK(b)
+    IAdd,           //a = RK(b) + RK(c)，与iadd的语义相同，下同
+    SAdd,
+    ISub,
+    IMul,
+    IDiv,
+    DAdd,
+    DSub,
+    DMul,
+    DDiv,
+    Call,           //调用callees[c]，实参在b开始的连续槽位里，返回值写到a。a为NoReg时丢弃返回值
+    TailCall,       //尾调用callees[c]，复用当前栈桢，实参在b开始的连续槽位里
+    CallNative,     //调用原生函数NativeFunctions()[c]，实参在b开始的连续槽位里，返回值写到a。a为NoReg时丢弃返回值
+    Return,         //返回RK(b)
+    ReturnVoid,     //没有返回值的返回
+};
+
+std::string toString(RegOp op);
+
+//
+// 一条寄存器指令。操作数是16位的：
+// 最高位为0时是当前栈桢的槽位；最高位为1时，低15位是函数常量表的下标（RK编码，参考Lua）
+//
+struct RegInst{
+    RegOp op;
+    uint16_t a {0};
+    uint16_t b {0};
+    uint16_t c {0};
+
+    static constexpr uint16_t ConstBit = 0x8000;
+    static constexpr uint16_t NoReg = 0xffff;
+
+    static bool isConst(uint16_t operand) {
+        return (operand & ConstBit) != 0 && operand != NoReg;
+    }
+};
+
+//翻译后的一个函数
+struct RegFunction{
+    std::shared_ptr<FunctionSymbol> sym;
+
+    uint16_t numParams {0};
+    uint16_t numLocals {0};
+
+    //槽位总数，包括本地变量和临时变量
+    uint16_t numRegs {0};
+
+    //指令里用到的常量，用RK编码引用
+    std::vector<Value> constants;
+
+    //被调用的函数，Call、TailCall指令的c是这里的下标
+    std::vector<RegFunction*> callees;
+
+    std::vector<RegInst> code;
+
+    //原来的栈式字节码的指令数
+    uint32_t numStackInsts {0};
+};
+
+//翻译后的模块
+struct RegModule{
+    //被翻译的模块
+    const BCModule* source {nullptr};
+
+    //入口函数
+    RegFunction* main {nullptr};
+
+    //所有被翻译的函数，从入口函数可以调用到的函数都在这里
+    std::map<FunctionSymbol*, std::unique_ptr<RegFunction>> functions;
+
+    //栈式字节码和寄存器指令的总数，用来观察翻译的效果
+    uint32_t numStackInsts {0};
+    uint32_t numRegInsts {0};
+};
+
+//
+// 把栈式字节码翻译成寄存器指令
+// 翻译时对操作数栈做抽象解释：栈里记录的不是值，而是值在哪里（本地变量、常量或临时变量）。
+// iload和常量入栈不生成指令，只在栈里记下操作数；运算指令直接引用这些操作数，结果放到栈顶对应的临时变量。
+// istore如果保存的正好是上一条指令的结果，就把上一条指令的目标改成这个本地变量，省掉一次Move。
+//
+class RegisterTranslator{
+public:
+    /**
+     * 翻译一个模块。
+     * @return 有不支持的指令（比如跳转指令）时返回nullptr，这时应该使用栈式虚拟机
+     */
+    std::shared_ptr<RegModule> translate(const BCModule& bcModule);
+
+private:
+    //找到或者创建一个函数，新创建的函数放到待翻译的列表里
+    RegFunction* getFunction(RegModule& m, const std::shared_ptr<FunctionSymbol>& sym);
+
+    bool translateFunction(const BCModule& bcModule, RegModule& m, RegFunction& fun);
+
+    std::vector<RegFunction*> pending;
+};
+
+//寄存器虚拟机的一个栈桢
+struct RegFrame{
+    RegFunction* function;
+
+    //返回地址
+    uint32_t pc {0};
+
+    //本栈桢在registers中的起始位置
+    uint32_t base {0};
+
+    //调用者接收返回值的槽位，是相对于调用者的base的
+    uint16_t retReg {RegInst::NoReg};
+};
+
+//打印翻译后的寄存器指令
+class RegModuleDumper{
+public:
+    std::string dump(const RegModule& m);
+};
+
+class RegisterVM{
+public:
+    std::shared_ptr<RegModule> module;
+
+    //翻译失败的模块，不再重复翻译
+    const BCModule* rejected {nullptr};
+
+    //所有栈桢的槽位都分配在这个连续的数组里，被调用者的栈桢紧接着调用者的栈桢
+    std::vector<Value> registers;
+
+    std::vector<RegFrame> frames;
+
+    /**
+     * 加载模块，翻译成寄存器指令。同一个模块只翻译一次。
+     * @return 模块不能被翻译时返回false
+     */
+    bool load(const BCModule& bcModule);
+
+    /**
+     * 运行已经加载的模块。
+     */
+    int32_t run();
+};
+
+#endif
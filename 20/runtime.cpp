@@ -0,0 +1,21 @@
+//
+// 汇编代码的运行时
+// AsmGenerator生成的代码通过callq调用内置函数，这里提供对应的符号，
+// 链接时加上liblang_runtime.a即可。
+// 时间函数与解释器、虚拟机共用timing.h中的实现。
+//
+#include "timing.h"
+
+extern "C" {
+
+//单调时钟的纳秒数，通过xmm0返回
+double tick() {
+    return TickNanos();
+}
+
+//CPU时间戳计数器的周期数，通过xmm0返回
+double cycles() {
+    return CycleCount();
+}
+
+}
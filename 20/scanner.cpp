@@ -85,6 +85,25 @@ std::string toString(Op op) {
     return "Unknow Op!";
 }
 
+bool IsAssignOp(Op op) {
+    return op >= Op::Assign && op <= Op::BitOrAssign;
+}
+
+Op CompoundAssignOp(Op op) {
+    switch (op) {
+        case Op::PlusAssign:
+            return Op::Plus;
+        case Op::MinusAssign:
+            return Op::Minus;
+        case Op::MultiplyAssign:
+            return Op::Multiply;
+        case Op::DivideAssign:
+            return Op::Divide;
+        default:
+            return Op::Assign;
+    }
+}
+
 std::unordered_map<std::string, KeywordKind> Scanner::KeywordMap {
     {"function",    KeywordKind::Function},
     {"class",       KeywordKind::Class},
@@ -134,4 +153,6 @@ std::unordered_map<std::string, KeywordKind> Scanner::KeywordMap {
     {"symbol",      KeywordKind::Symbol},
     //值
     {"undefined",      KeywordKind::Undefined},
+    //基准测试语句
+    {"bench",       KeywordKind::Bench},
 };
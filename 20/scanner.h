@@ -125,7 +125,8 @@ enum class KeywordKind {
     Boolean,
     Any,
     Symbol,
-    Undefined
+    Undefined,
+    Bench,
 };
 
 inline std::string toString(uint32_t obj) {
@@ -135,6 +136,13 @@ inline std::string toString(uint32_t obj) {
 std::string toString(TokenKind kind);
 std::string toString(Op op);
 
+//赋值运算符（=、+=等）
+bool IsAssignOp(Op op);
+
+//复合赋值运算符对应的二元运算符，比如+=对应+。a += b 相当于 a = a + b。
+//还不支持的复合赋值运算符（%=、<<=等）和=，返回Op::Assign
+Op CompoundAssignOp(Op op);
+
 struct Token{
     TokenKind kind;
     std::string text;
@@ -226,7 +234,7 @@ public:
         }
 
         if (this->tokens.size() < 2) {
-            return Token{TokenKind::Eof, text:"EOF", Position()};
+            return Token{TokenKind::Eof, "EOF", Position()};
         }
 
         auto it = this->tokens.begin();
@@ -1,3 +1,3 @@
 #include "scope.h"
 
-uint32_t Scope::id = 0;
\ No newline at end of file
+uint32_t Scope::nextId = 0;
\ No newline at end of file
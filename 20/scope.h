@@ -8,15 +8,16 @@
 
 class Scope{
 public:
-    static uint32_t id;
+    //每个作用域有自己的编号，语义分析按编号记录作用域中已经声明的变量
+    static uint32_t nextId;
+    uint32_t id;
     //以名称为key存储符号
     std::map<std::string, std::shared_ptr<Symbol>> name2sym;
 
     //上级作用域
     std::shared_ptr<Scope> enclosingScope {nullptr}; //顶级作用域的上一级是null
 
-    Scope(std::shared_ptr<Scope> enclosingScope): enclosingScope(enclosingScope){
-        id++;
+    Scope(std::shared_ptr<Scope> enclosingScope): id(nextId++), enclosingScope(enclosingScope){
     }
 
     /**
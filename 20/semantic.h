@@ -150,6 +150,22 @@ public:
         return std::any();
    }
 
+    /**
+     * for语句也建立一级作用域，init部分声明的变量在这里面
+     * @param stmt
+     */
+    std::any visitForStatement(ForStatement& stmt, std::string prefix) override {
+        auto oldScope = this->scope;
+        this->scope = std::make_shared<Scope>(this->scope);
+        stmt.scope = this->scope;
+
+        AstVisitor::visitForStatement(stmt);
+
+        this->scope = oldScope;
+
+        return std::any();
+    }
+
 
     /**
      * 把变量声明加入符号表
@@ -166,6 +182,7 @@ public:
         currentScope->enter(variableDecl.name, sym);
 
         //把本地变量也加入函数符号中，可用于后面生成代码
+        sym->index = this->functionSym->vars.size();
         this->functionSym->vars.push_back(sym);
         return std::any();
     }
@@ -206,6 +223,28 @@ public:
         return std::any();
     }
 
+    std::any visitForStatement(ForStatement& stmt, std::string prefix) override {
+        //1.修改scope
+        auto oldScope = this->scope;
+        this->scope = stmt.scope;
+        if(this->scope == nullptr) {
+             dbg("error: stmt.scope must not be nullptr!");
+             return std::any();
+        }
+
+        //为已声明的变量设置一个存储区域
+        this->idToScope.insert({this->scope->id, this->scope});
+        this->declaredVarsMap.insert({this->scope->id, {}});
+
+        //2.遍历下级节点
+        AstVisitor::visitForStatement(stmt);
+
+        //3.重新设置scope
+        this->scope = oldScope;
+
+        return std::any();
+    }
+
     std::any visitFunctionDecl(FunctionDecl& functionDecl, std::string prefix) override {
         //1.修改scope
         auto oldScope = this->scope;
@@ -332,12 +371,93 @@ public:
     }
 };
 
+//
+// 链接调用点
+// 为每个被调用的函数生成一个CallDescriptor，记录内置函数编号，或者函数体、参数槽位和栈桢大小。
+// 这些信息在语义分析之后就不会再变，解释器执行函数调用时直接使用，不需要再按名称查找。
+//
+class CallLinker: public SemanticAstVisitor{
+public:
+    //每个函数只生成一个描述符，所有调用点共享
+    std::map<FunctionSymbol*, std::shared_ptr<CallDescriptor>> descriptors;
+
+    std::any visitFunctionCall(FunctionCall& functionCall, std::string prefix) override {
+        if (functionCall.sym != nullptr) {
+            functionCall.callDesc = this->getDescriptor(functionCall.sym);
+        }
+
+        //调用下级，主要是参数。
+        AstVisitor::visitFunctionCall(functionCall);
+
+        return std::any();
+    }
+
+    std::shared_ptr<CallDescriptor> getDescriptor(std::shared_ptr<FunctionSymbol>& sym) {
+        auto it = this->descriptors.find(sym.get());
+        if (it != this->descriptors.end()) {
+            return it->second;
+        }
+
+        auto desc = std::make_shared<CallDescriptor>();
+        desc->callee = sym.get();
+        desc->numSlots = sym->vars.size();
+
+        desc->builtin = GetBuiltinId(*sym);  //系统内置函数
+        if (desc->builtin == BuiltinId::None && sym->decl != nullptr) {
+            desc->body = sym->decl->body.get();
+            auto callSignature = std::dynamic_pointer_cast<CallSignature>(sym->decl->callSignature);
+            if (callSignature != nullptr && callSignature->paramList != nullptr) {
+                auto paramList = std::dynamic_pointer_cast<ParameterList>(callSignature->paramList);
+                for (auto& param: paramList->params) {
+                    auto variableDecl = std::dynamic_pointer_cast<VariableDecl>(param);
+                    desc->paramSlots.push_back(variableDecl->sym->index);
+                }
+            }
+        }
+
+        this->descriptors.insert({sym.get(), desc});
+        return desc;
+    }
+};
+
+//
+// 尾调用分析
+// 函数中形如return f(...)的调用，调用之后不再需要当前栈桢，可以复用当前栈桢（或者直接跳转）来执行被调用的函数。
+// 内置函数和顶层代码中的调用不算尾调用。
+//
+class TailCallAnalyzer: public SemanticAstVisitor{
+public:
+    //当前是否在一个函数里
+    bool inFunction {false};
+
+    std::any visitFunctionDecl(FunctionDecl& functionDecl, std::string prefix) override {
+        auto oldInFunction = this->inFunction;
+        this->inFunction = true;
+        AstVisitor::visitFunctionDecl(functionDecl);
+        this->inFunction = oldInFunction;
+        return std::any();
+    }
+
+    std::any visitReturnStatement(ReturnStatement& returnStatement, std::string prefix) override {
+        if (this->inFunction && returnStatement.exp != nullptr) {
+            auto functionCall = std::dynamic_pointer_cast<FunctionCall>(returnStatement.exp);
+            if (functionCall != nullptr && functionCall->sym != nullptr &&
+                built_ins.count(functionCall->name) == 0) {
+                functionCall->isTailCall = true;
+            }
+        }
+        return AstVisitor::visitReturnStatement(returnStatement);
+    }
+};
+
 class SemanticAnalyer {
 public:
     std::vector<std::shared_ptr<SemanticAstVisitor>> passes = {
         std::make_shared<Enter>(),
         std::make_shared<RefResolver>(),
         std::make_shared<Trans>(),
+        std::make_shared<CallLinker>(),
+        std::make_shared<TailCallAnalyzer>(),
     };
 
     std::vector<std::shared_ptr<CompilerError>> errors;   //语义错误
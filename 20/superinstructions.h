@@ -0,0 +1,26 @@
+#ifndef __SUPERINSTRUCTIONS_H_
+#define __SUPERINSTRUCTIONS_H_
+
+//
+// 超级指令列表，由tools/gen_superinstructions.cpp生成，不要手工修改。
+// 重新生成（在20/目录下）：
+//   cmake -S . -B build -DENABLE_TOOLS=ON && cmake --build build --target gen_superinstructions
+//   ./build/gen_superinstructions superinstructions.h superinstructions.txt corpus/*.ts
+//
+// 剖析语料：corpus/arithmetic.ts corpus/calls.ts corpus/decimal.ts corpus/loops.ts corpus/strings.ts
+// 语料执行的指令数：32261，使用这些超级指令之后的分派次数：19063
+//
+// 每一项是 X(操作码, 名称, 组成指令...)，注释是这个指令序列在语料中连续执行的次数
+// 每一轮挑选时的试算结果见superinstructions.txt
+//
+#define VM_SUPERINSTRUCTIONS(X) \
+    X(0xd0, iadd_istore_1_iinc, iadd, istore_1, iinc)  /* 1500 */ \
+    X(0xd1, iload_iload_3_imul, iload, iload_3, imul)  /* 900 */ \
+    X(0xd2, iadd_istore_2_iinc, iadd, istore_2, iinc)  /* 900 */ \
+    X(0xd3, iload_2_iload_0, iload_2, iload_0)  /* 1724 */ \
+    X(0xd4, iload_1_iload_2, iload_1, iload_2)  /* 1544 */ \
+    X(0xd5, iload_1_imul_iload_3, iload_1, imul, iload_3)  /* 600 */ \
+    X(0xd6, iload_3_iload_1_idiv, iload_3, iload_1, idiv)  /* 600 */ \
+    X(0xd7, iload_iload_0, iload, iload_0)  /* 930 */
+
+#endif
@@ -22,6 +22,14 @@ std::string SymKindtoString(SymKind kind) {
     return "";
 }
 
+std::any SymbolVisitor::visitVarSymbol(VarSymbol& sym, std::string additional) {
+    return std::any();
+}
+
+std::any SymbolVisitor::visitFunctionSymbol(FunctionSymbol& sym, std::string additional) {
+    return std::any();
+}
+
 
 std::vector<std::shared_ptr<Type>> FUN_println_parms{SysTypes::String()};
 std::shared_ptr<Type> FUN_println_type = std::make_shared<FunctionType>(SysTypes::Void(), FUN_println_parms);
@@ -34,11 +42,19 @@ std::shared_ptr<FunctionSymbol>  FUN_println = std::make_shared<FunctionSymbol>(
 
 
 ////////////////////////////
+//单调时钟的纳秒数。number是32位整数，放不下，所以返回decimal
 std::vector<std::shared_ptr<Type>> FUN_tick_parms;
-std::shared_ptr<Type> FUN_tick_type = std::make_shared<FunctionType>(SysTypes::Void(), FUN_tick_parms);
+std::shared_ptr<Type> FUN_tick_type = std::make_shared<FunctionType>(SysTypes::Decimal(), FUN_tick_parms);
 
 std::shared_ptr<FunctionSymbol>  FUN_tick = std::make_shared<FunctionSymbol>("tick", FUN_tick_type);
 
+////////////////////////////
+//CPU时间戳计数器（rdtsc）的周期数
+std::vector<std::shared_ptr<Type>> FUN_cycles_parms;
+std::shared_ptr<Type> FUN_cycles_type = std::make_shared<FunctionType>(SysTypes::Decimal(), FUN_cycles_parms);
+
+std::shared_ptr<FunctionSymbol>  FUN_cycles = std::make_shared<FunctionSymbol>("cycles", FUN_cycles_type);
+
 ////////////////////////////
 std::vector<std::shared_ptr<Type>> FUN_integer_to_string_parms{SysTypes::Integer()};
 std::shared_ptr<Type> FUN_integer_to_string_type = std::make_shared<FunctionType>(SysTypes::String(), FUN_integer_to_string_parms);
@@ -52,5 +68,23 @@ std::shared_ptr<FunctionSymbol>  FUN_integer_to_string = std::make_shared<Functi
 std::map<std::string, std::shared_ptr<FunctionSymbol>> built_ins {
     {"println", FUN_println},
     {"tick", FUN_tick},
+    {"cycles", FUN_cycles},
     {"integer_to_string", FUN_integer_to_string},
 };
+
+std::vector<std::shared_ptr<FunctionSymbol>> built_ins_by_id {
+    nullptr,
+    FUN_println,
+    FUN_tick,
+    FUN_cycles,
+    FUN_integer_to_string,
+};
+
+BuiltinId GetBuiltinId(const FunctionSymbol& sym) {
+    for (size_t i = 1; i < built_ins_by_id.size(); i++) {
+        if (built_ins_by_id[i].get() == &sym) {
+            return static_cast<BuiltinId>(i);
+        }
+    }
+    return BuiltinId::None;
+}
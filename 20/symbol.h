@@ -47,6 +47,10 @@ public:
 
 class VarSymbol: public Symbol{
 public:
+    //在所属函数的本地变量列表（FunctionSymbol::vars）中的下标，参数排在最前面。
+    //在语义分析阶段确定，解释器用它直接访问栈桢中的槽位。
+    int32_t index {-1};
+
     VarSymbol(const std::string& name, std::shared_ptr<Type>& theType):
         Symbol(name, theType, SymKind::Variable){
     }
@@ -72,7 +76,7 @@ public:
 
     std::vector<uint8_t> byteCode; //存放生成的字节码
 
-    FunctionDecl* decl; //存放AST，作为代码来运行
+    FunctionDecl* decl {nullptr}; //存放AST，作为代码来运行
 
     FunctionSymbol(const std::string& name, std::shared_ptr<Type>& theType, std::vector<std::shared_ptr<Symbol>> vars = {}):
         Symbol(name, theType, SymKind::Function), vars(vars)
@@ -146,4 +150,22 @@ public:
 
 extern std::map<std::string, std::shared_ptr<FunctionSymbol>> built_ins;
 
+//
+// 内置函数的编号
+// 字节码里的invokenative指令以编号作为操作数，编号会写进字节码文件，所以已有的编号不能改变，新的内置函数只能加在最后。
+//
+enum class BuiltinId: uint8_t{
+    None,       //不是内置函数
+    Println,
+    Tick,
+    Cycles,
+    IntegerToString,
+};
+
+//按编号排列的内置函数，下标是BuiltinId，BuiltinId::None的位置为nullptr
+extern std::vector<std::shared_ptr<FunctionSymbol>> built_ins_by_id;
+
+//内置函数的编号。只认built_ins里的符号本身，同名的用户函数返回BuiltinId::None
+BuiltinId GetBuiltinId(const FunctionSymbol& sym);
+
 #endif
\ No newline at end of file
@@ -207,4 +207,89 @@ println(fourTimes(4));
     interpretor.visit(*ast, "");
 
     auto asmStr = compileToAsm(*ast);
-}
\ No newline at end of file
+}
+TEST(ASM, Asm_Decimal)
+{
+    std::string program =
+R"(
+function circleArea(r : decimal):decimal{
+    let area = 3.14*r*r;
+    return area;
+}
+
+println(circleArea(4));
+)";
+
+    Print(program, Color::Blue);
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto asmStr = compileToAsm(*ast);
+
+    //浮点数常量放在常量区
+    EXPECT_NE(asmStr.find("__literal8"), std::string::npos);
+    EXPECT_NE(asmStr.find(".quad\t0x40091eb851eb851f"), std::string::npos);
+    //参数通过xmm0传入，返回值也放在xmm0
+    EXPECT_NE(asmStr.find("movsd\t%xmm0, -8(%rbp)"), std::string::npos);
+    EXPECT_NE(asmStr.find("mulsd"), std::string::npos);
+    EXPECT_EQ(asmStr.find("imull"), std::string::npos);
+}
+
+TEST(ASM, Asm_TailCall)
+{
+    std::string program =
+R"(
+function twice(x : number):number{
+    return x * 2;
+}
+
+function addTwice(a : number, b : number):number{
+    let sum = a + b;
+    return twice(sum);
+}
+
+function notTail(a : number):number{
+    let r = twice(a);
+    return r + 1;
+}
+
+println(addTwice(1, 2));
+println(notTail(3));
+)";
+
+    Print(program, Color::Blue);
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto asmStr = compileToAsm(*ast);
+    Print(asmStr, Color::Green);
+
+    //addTwice以jmp调用twice，jmp之前恢复栈桢
+    auto begin = asmStr.find("_addTwice:");
+    ASSERT_NE(begin, std::string::npos);
+    auto end = asmStr.find(".cfi_endproc", begin);
+    ASSERT_NE(end, std::string::npos);
+    auto addTwice = asmStr.substr(begin, end - begin);
+    auto jmp = addTwice.find("jmp\t_twice");
+    ASSERT_NE(jmp, std::string::npos);
+    EXPECT_EQ(addTwice.find("callq"), std::string::npos);
+    EXPECT_EQ(addTwice.find("retq"), std::string::npos);
+    EXPECT_LT(addTwice.find("popq\t%rbp"), jmp);
+
+    //notTail中的调用不在尾部，仍然是callq
+    EXPECT_NE(asmStr.find("callq\t_twice"), std::string::npos);
+}
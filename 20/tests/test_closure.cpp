@@ -0,0 +1,303 @@
+#include "closure.h"
+#include "interpretor.h"
+#include "semantic.h"
+#include "parser.h"
+
+#include "dbg.h"
+
+#include <gtest/gtest.h>
+
+static std::shared_ptr<AstNode> Analyze(const std::string& program) {
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+    return ast;
+}
+
+//分别用Interpretor和ClosureEngine执行同一个程序，输出应该完全一样
+static std::string RunBoth(const std::string& program) {
+    auto ast = Analyze(program);
+
+    auto interpretor = Interpretor();
+    testing::internal::CaptureStdout();
+    interpretor.visit(*ast, "");
+    auto expect = testing::internal::GetCapturedStdout();
+
+    auto prog = std::dynamic_pointer_cast<Prog>(ast);
+    ClosureEngine engine;
+    testing::internal::CaptureStdout();
+    engine.run(*prog);
+    auto output = testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(expect, output);
+    return output;
+}
+
+TEST(Closure, Closure_basic)
+{
+    std::string program = R"(
+let i = 100;
+println(i);
+println("hello " + i);
+)";
+
+    auto output = RunBoth(program);
+    EXPECT_NE(output.find("100"), std::string::npos);
+    EXPECT_NE(output.find("hello 100"), std::string::npos);
+}
+
+TEST(Closure, Closure_functionCall)
+{
+    std::string program =
+R"(
+function fourTimes(r : number):number{
+    let area : number = 4*r;
+    return area;
+}
+
+function addTwice(r : number, d : number):number{
+    let sum : number = r;
+    sum = sum + d;
+    sum = sum + d;
+    return sum;
+}
+
+println(fourTimes(4));
+let total = addTwice(fourTimes(10), addTwice(0, 1) - 1);
+println(total);
+println(integer_to_string(addTwice(1, 2)) + "!");
+)";
+
+    auto output = RunBoth(program);
+    EXPECT_NE(output.find("16"), std::string::npos);
+    EXPECT_NE(output.find("42"), std::string::npos);
+    EXPECT_NE(output.find("5!"), std::string::npos);
+}
+
+TEST(Closure, Closure_decimal)
+{
+    std::string program =
+R"(
+function circleArea(r : decimal):decimal{
+    let area : decimal = 3.14*r*r;
+    return area;
+}
+
+println(circleArea(4.0));
+println(1.5 + 2 * 0.5 / 0.4);
+println(7 / 2 + 7 % 2);
+println(3 > 2.5);
+)";
+
+    auto output = RunBoth(program);
+    EXPECT_NE(output.find("50.24"), std::string::npos);
+}
+
+TEST(Closure, Closure_rerun)
+{
+    std::string program =
+R"(
+function add(a : number, b : number):number{
+    return a + b;
+}
+
+let x = add(1, 2);
+x = add(x, x);
+println(x);
+)";
+
+    auto ast = Analyze(program);
+    auto prog = std::dynamic_pointer_cast<Prog>(ast);
+
+    //编译一次，可以执行多次
+    ClosureEngine engine;
+    ASSERT_TRUE(engine.compile(*prog));
+    for (int i = 0; i < 3; i++) {
+        testing::internal::CaptureStdout();
+        engine.execute();
+        auto output = testing::internal::GetCapturedStdout();
+        EXPECT_NE(output.find("6"), std::string::npos);
+        EXPECT_TRUE(engine.ctx.slots[0].tag == ValueTag::Integer);
+        EXPECT_EQ(engine.ctx.slots[0].i, 6);
+    }
+}
+
+TEST(Closure, Closure_bench)
+{
+    std::string program =
+R"(
+let n : number = 0;
+bench("inc", 7) {
+    n = n + 1;
+}
+let t = tick();
+println(n);
+)";
+
+    auto ast = Analyze(program);
+    auto prog = std::dynamic_pointer_cast<Prog>(ast);
+
+    ClosureEngine engine;
+    testing::internal::CaptureStdout();
+    engine.run(*prog);
+    auto output = testing::internal::GetCapturedStdout();
+
+    EXPECT_NE(output.find("bench inc: min="), std::string::npos);
+    EXPECT_NE(output.find("(7 iterations)"), std::string::npos);
+    EXPECT_EQ(engine.ctx.slots[0].i, 7);
+    EXPECT_TRUE(engine.ctx.slots[1].tag == ValueTag::Decimal);
+    EXPECT_GT(engine.ctx.slots[1].d, 0);
+}
+
+TEST(Closure, Closure_if_for)
+{
+    std::string program =
+R"(
+function fib(n : number):number{
+    if (n < 2) {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+function sign(x : number):string{
+    if (x > 0) return "+";
+    else if (x == 0) return "0";
+    return "-";
+}
+
+let total : number = 0;
+for (let i : number = 1; i <= 100; i = i + 1) {
+    total = total + i;
+}
+println(total);
+println(fib(15));
+println(sign(3) + sign(0) + sign(1 - 3));
+for (;;) {
+    if (total > 5000) {
+        total = total - 5000;
+    }
+    else {
+        println(total);
+        return;
+    }
+}
+)";
+
+    auto output = RunBoth(program);
+    EXPECT_NE(output.find("5050"), std::string::npos);
+    EXPECT_NE(output.find("610"), std::string::npos);
+    EXPECT_NE(output.find("+0-"), std::string::npos);
+    EXPECT_NE(output.find("50\n"), std::string::npos);
+}
+
+TEST(Closure, Closure_unary_compound_assign)
+{
+    std::string program =
+R"(
+let k : number = 5;
+let a = k++;
+let b = ++k;
+let c = --k;
+k -= 200;
+k += 1000;
+let d : decimal = 1.5;
+d++;
+d += 2;
+let s : string = "x";
+s += 1;
+let m : number = 3;
+m *= 4;
+m /= 2;
+println(a + b + c);
+println(k);
+println(d);
+println(s);
+println(-k);
+println(-m * 3);
+)";
+
+    auto output = RunBoth(program);
+    for (auto line: {"18\n", "806\n", "4.5\n", "x1\n", "-806\n", "-18\n"}) {
+        EXPECT_NE(output.find(line), std::string::npos);
+    }
+}
+
+TEST(Closure, Closure_tail_call)
+{
+    //尾调用复用栈桢，很深的递归也不会让C++栈溢出。包括两个函数互相尾调用，以及参数引用当前栈桢的变量
+    std::string program =
+R"(
+function count(n : number):number{
+    if (n == 0) {
+        return 0;
+    }
+    return count(n - 1);
+}
+
+function sum(n : number, acc : number):number{
+    if (n == 0) {
+        return acc;
+    }
+    return sum(n - 1, acc + n);
+}
+
+function isEven(n : number):number{
+    if (n == 0) {
+        return 1;
+    }
+    return isOdd(n - 1);
+}
+
+function isOdd(n : number):number{
+    if (n == 0) {
+        return 0;
+    }
+    return isEven(n - 1);
+}
+
+println(count(100000));
+println(sum(50000, 0));
+println(isEven(100001) + 10);
+)";
+
+    auto output = RunBoth(program);
+    EXPECT_EQ(output, "\033[1;31m0\n\033[0m\033[1;31m1250025000\n\033[0m\033[1;31m10\n\033[0m");
+}
+
+TEST(Closure, Closure_stack_overflow)
+{
+    //不是尾调用的深递归：超过最大调用深度时报错并中止执行，而不是让C++栈溢出
+    std::string program =
+R"(
+function depth(n : number):number{
+    if (n == 0) {
+        return 0;
+    }
+    return depth(n - 1) + 1;
+}
+
+println(depth(100));
+println(depth(100000));
+println("not reached");
+)";
+
+    auto ast = Analyze(program);
+    ClosureEngine engine;
+    testing::internal::CaptureStdout();
+    engine.run(*std::dynamic_pointer_cast<Prog>(ast));
+    auto output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output, "\033[1;31m100\n\033[0m");
+    EXPECT_TRUE(engine.ctx.aborted);
+    EXPECT_EQ(engine.ctx.depth, 0u);
+
+    //中止之后可以再次执行
+    testing::internal::CaptureStdout();
+    engine.execute();
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), output);
+}
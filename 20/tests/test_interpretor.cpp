@@ -8,36 +8,78 @@
 
 TEST(Interpretor, Interpretor_binary_function_plus)
 {
-    std::any v1 = 2;
-    std::any v2 = 2;
+    Value v1 = 2;
+    Value v2 = 2;
 
     Interpretor interpretor;
     auto func = Interpretor::GetBinaryFunction(Op::Plus, v1, v2);
     EXPECT_TRUE(func != std::nullopt);
 
     auto retVal = func.value()(v1, v2);
-    EXPECT_TRUE(retVal.has_value());
+    EXPECT_TRUE(retVal.tag == ValueTag::Integer);
 
-    auto val = std::any_cast<int32_t>(retVal);
+    auto val = retVal.i;
     EXPECT_TRUE(val == 4);
 }
 
 TEST(Interpretor, Interpretor_binary_function_minus)
 {
-    std::any v1 = 2;
-    std::any v2 = 2;
+    Value v1 = 2;
+    Value v2 = 2;
 
     Interpretor interpretor;
     auto func = Interpretor::GetBinaryFunction(Op::Minus, v1, v2);
     EXPECT_TRUE(func != std::nullopt);
 
     auto retVal = func.value()(v1, v2);
-    EXPECT_TRUE(retVal.has_value());
+    EXPECT_TRUE(retVal.tag == ValueTag::Integer);
 
-    auto val = std::any_cast<int32_t>(retVal);
+    auto val = retVal.i;
     EXPECT_TRUE(val == 0);
 }
 
+TEST(Interpretor, Interpretor_binary_function_concat)
+{
+    Value v1 = std::string("a");
+    Value v2 = 1;
+
+    Interpretor interpretor;
+    auto func = Interpretor::GetBinaryFunction(Op::Plus, v1, v2);
+    EXPECT_TRUE(func != std::nullopt);
+
+    auto retVal = func.value()(v1, v2);
+    EXPECT_TRUE(retVal.tag == ValueTag::String);
+    EXPECT_STREQ("a1", retVal.s->c_str());
+
+    //运行时拼接出来的字符串不进入字符串池，用完就释放
+    EXPECT_NE(retVal.s, StringPool::intern("a1"));
+    EXPECT_EQ(retVal.s->refCount, 1u);
+
+    //字符串和整数不能相减
+    EXPECT_TRUE(Interpretor::GetBinaryFunction(Op::Minus, v1, v2) == std::nullopt);
+}
+
+TEST(Interpretor, Interpretor_binary_function_decimal)
+{
+    Value v1 = 1.5;
+    Value v2 = 2;
+
+    //整数和浮点数混合运算，结果是浮点数
+    auto func = Interpretor::GetBinaryFunction(Op::Multiply, v1, v2);
+    EXPECT_TRUE(func != std::nullopt);
+    auto retVal = func.value()(v1, v2);
+    EXPECT_DOUBLE_EQ(3.0, retVal.d);
+
+    func = Interpretor::GetBinaryFunction(Op::Divide, v2, v1);
+    EXPECT_TRUE(func != std::nullopt);
+    retVal = func.value()(v2, v1);
+    EXPECT_DOUBLE_EQ(2.0 / 1.5, retVal.d);
+
+    func = Interpretor::GetBinaryFunction(Op::G, v2, v1);
+    EXPECT_TRUE(func != std::nullopt);
+    EXPECT_TRUE(func.value()(v2, v1).b);
+}
+
 TEST(Interpretor, Interpretor_basic)
 {
     std::string expect =
@@ -136,4 +178,274 @@ println(fourTimes(4));
 
     auto interpretor = Interpretor();
     interpretor.visit(*ast, "");
-}
\ No newline at end of file
+}
+TEST(Interpretor, Interpretor_slot_assignment)
+{
+    std::string program =
+R"(
+function addTwice(r : number, d : number):number{
+    let sum : number = r;
+    sum = sum + d;
+    sum = sum + d;
+    return sum;
+}
+
+let total = addTwice(40, 1);
+total = total + 0;
+println(total);
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    //变量的槽位下标在语义分析阶段确定，参数排在最前面
+    auto prog = std::dynamic_pointer_cast<Prog>(ast);
+    auto functionDecl = std::dynamic_pointer_cast<FunctionDecl>(prog->stmts[0]);
+    auto& vars = functionDecl->sym->vars;
+    ASSERT_EQ(vars.size(), 3u);
+    for (uint32_t i = 0; i < vars.size(); i++) {
+        EXPECT_EQ(std::dynamic_pointer_cast<VarSymbol>(vars[i])->index, static_cast<int32_t>(i));
+    }
+
+    auto interpretor = Interpretor();
+    testing::internal::CaptureStdout();
+    interpretor.visit(*ast, "");
+    auto output = testing::internal::GetCapturedStdout();
+
+    //赋值会更新已有变量的值
+    EXPECT_NE(output.find("42"), std::string::npos);
+    ASSERT_EQ(interpretor.currentFrame->slots.size(), 1u);
+    EXPECT_TRUE(interpretor.currentFrame->slots[0].tag == ValueTag::Integer);
+    EXPECT_EQ(interpretor.currentFrame->slots[0].i, 42);
+}
+
+TEST(Interpretor, Interpretor_type_feedback)
+{
+    std::string program =
+R"(
+function add(a : number, b : number):number{
+    return a + b;
+}
+
+function addFour(x : number):number{
+    let y : number = add(x, 1);
+    y = add(y, 1);
+    y = add(y, 1);
+    y = add(y, 1);
+    return y;
+}
+
+let r : number = addFour(0);
+r = addFour(r);
+r = addFour(r);
+println(r);
+println(add("a", "b"));
+println(add(1.5, 1));
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto prog = std::dynamic_pointer_cast<Prog>(ast);
+    auto add = std::dynamic_pointer_cast<FunctionDecl>(prog->stmts[0]);
+    auto returnStmt = std::dynamic_pointer_cast<ReturnStatement>(std::dynamic_pointer_cast<Block>(add->body)->stmts[0]);
+    auto plus = std::dynamic_pointer_cast<Binary>(returnStmt->exp);
+    ASSERT_TRUE(plus != nullptr);
+
+    auto addFour = std::dynamic_pointer_cast<FunctionDecl>(prog->stmts[1]);
+    auto varStmt = std::dynamic_pointer_cast<VariableStatement>(std::dynamic_pointer_cast<Block>(addFour->body)->stmts[0]);
+    auto call = std::dynamic_pointer_cast<FunctionCall>(std::dynamic_pointer_cast<VariableDecl>(varStmt->variableDecl)->init);
+    ASSERT_TRUE(call != nullptr);
+
+    auto interpretor = Interpretor();
+    testing::internal::CaptureStdout();
+    interpretor.visit(*ast, "");
+    auto output = testing::internal::GetCapturedStdout();
+
+    //特化不影响执行结果，守卫失败时会退回通用路径
+    EXPECT_NE(output.find("12"), std::string::npos);
+    EXPECT_NE(output.find("ab"), std::string::npos);
+    EXPECT_NE(output.find("2.5"), std::string::npos);
+
+    //add中的'+'执行8次整数加法之后被特化成IntInt，遇到字符串时守卫失败，退回去重新收集类型
+    EXPECT_EQ(plus->feedback.deopts, 1);
+    EXPECT_TRUE(plus->feedback.state == Specialization::Uninitialized);
+
+    //调用点在语义分析之后就链接到了add，所有调用add的地方共享一个描述符
+    ASSERT_TRUE(call->callDesc != nullptr);
+    EXPECT_EQ(call->callDesc->callee, add->sym.get());
+    EXPECT_EQ(call->callDesc->body, add->body.get());
+    EXPECT_EQ(call->callDesc->paramSlots, std::vector<int32_t>({0, 1}));
+    EXPECT_EQ(call->callDesc->numSlots, 2u);
+
+    //多执行几次之后，'+'反复特化又反复失败，最后停留在通用状态
+    for (int i = 0; i < Interpretor::SpecializeThreshold; i++) {
+        interpretor.returning = false;
+        testing::internal::CaptureStdout();
+        interpretor.visit(*ast, "");
+        EXPECT_EQ(output, testing::internal::GetCapturedStdout());
+    }
+    EXPECT_TRUE(plus->feedback.state == Specialization::Generic);
+
+    //关闭类型反馈，结果一样
+    auto generic = Interpretor();
+    generic.useTypeFeedback = false;
+    testing::internal::CaptureStdout();
+    generic.visit(*ast, "");
+    EXPECT_EQ(output, testing::internal::GetCapturedStdout());
+}
+
+TEST(Interpretor, Interpretor_frame_pool)
+{
+    std::string program =
+R"(
+function add(a : number, b : number):number{
+    return a + b;
+}
+
+function addThree(x : number):number{
+    return add(add(x, 1), add(1, 1));
+}
+
+let r : number = addThree(addThree(0));
+println(r);
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto interpretor = Interpretor();
+    for (int i = 0; i < 2; i++) {
+        interpretor.returning = false;
+        testing::internal::CaptureStdout();
+        interpretor.visit(*ast, "");
+        auto output = testing::internal::GetCapturedStdout();
+        EXPECT_NE(output.find("6"), std::string::npos);
+
+        //栈桢在返回之后留给下一次调用复用。新栈桢在计算参数之前就分配好了；
+        //addThree中的return add(...)是尾调用，外层的add复用addThree的栈桢。
+        //所以最深的时候是main、外层addThree、内层addThree、计算参数的add，一共只创建了4个栈桢
+        EXPECT_EQ(interpretor.depth, 1u);
+        EXPECT_EQ(interpretor.callStack.size(), 4u);
+        EXPECT_EQ(interpretor.currentFrame, interpretor.callStack[0].get());
+    }
+}
+
+TEST(Interpretor, Interpretor_tail_call)
+{
+    std::string program =
+R"(
+function third(x : number):number{
+    return x * 10;
+}
+
+function second(x : number):number{
+    let y : number = x + 1;
+    return third(y);
+}
+
+function first(x : number, s : string):string{
+    return s + second(x);
+}
+
+function entry(x : number):number{
+    return second(x * 2);
+}
+
+println(entry(2));
+println(first(1, "v"));
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    //return f(...)是尾调用；return s + f(...)不是
+    auto prog = std::dynamic_pointer_cast<Prog>(ast);
+    auto returnCall = [&prog](uint32_t index) {
+        auto functionDecl = std::dynamic_pointer_cast<FunctionDecl>(prog->stmts[index]);
+        auto& stmts = std::dynamic_pointer_cast<Block>(functionDecl->body)->stmts;
+        auto returnStmt = std::dynamic_pointer_cast<ReturnStatement>(stmts.back());
+        return returnStmt->exp;
+    };
+    EXPECT_TRUE(std::dynamic_pointer_cast<FunctionCall>(returnCall(1))->isTailCall);
+    EXPECT_TRUE(std::dynamic_pointer_cast<FunctionCall>(returnCall(3))->isTailCall);
+    EXPECT_TRUE(std::dynamic_pointer_cast<Binary>(returnCall(2)) != nullptr);
+
+    auto interpretor = Interpretor();
+    testing::internal::CaptureStdout();
+    interpretor.visit(*ast, "");
+    auto output = testing::internal::GetCapturedStdout();
+    EXPECT_NE(output.find("50"), std::string::npos);
+    EXPECT_NE(output.find("v20"), std::string::npos);
+
+    //entry->second->third都复用同一个栈桢；first中的second不是尾调用，需要一个新的栈桢
+    EXPECT_EQ(interpretor.callStack.size(), 3u);
+}
+
+TEST(Interpretor, Interpretor_tick_and_bench)
+{
+    std::string program =
+R"(
+let t0 = tick();
+let c0 = cycles();
+let n : number = 0;
+bench("inc", 5) {
+    n = n + 1;
+}
+let t1 = tick();
+let c1 = cycles();
+println(n);
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto interpretor = Interpretor();
+    testing::internal::CaptureStdout();
+    interpretor.visit(*ast, "");
+    auto output = testing::internal::GetCapturedStdout();
+
+    //代码块执行了5次，并输出一行统计
+    EXPECT_NE(output.find("bench inc: min="), std::string::npos);
+    EXPECT_NE(output.find("median="), std::string::npos);
+    EXPECT_NE(output.find("p99="), std::string::npos);
+    EXPECT_NE(output.find("(5 iterations)"), std::string::npos);
+    EXPECT_NE(output.find("5\n"), std::string::npos);
+
+    //tick()和cycles()都是单调递增的decimal
+    auto& slots = interpretor.currentFrame->slots;
+    ASSERT_TRUE(slots[0].tag == ValueTag::Decimal);
+    ASSERT_TRUE(slots[1].tag == ValueTag::Decimal);
+    EXPECT_GT(slots[3].d, slots[0].d);
+    EXPECT_GE(slots[4].d, slots[1].d);
+}
@@ -0,0 +1,210 @@
+#include "native.h"
+#include "closure.h"
+#include "interpretor.h"
+#include "vm.h"
+#include "regvm.h"
+#include "semantic.h"
+#include "parser.h"
+
+#include "dbg.h"
+
+#include <gtest/gtest.h>
+
+//native_record记下的实参
+static std::shared_ptr<std::vector<std::string>> Records = std::make_shared<std::vector<std::string>>();
+
+static int32_t NativeHash(const std::string& s) {
+    //FNV-1a
+    uint32_t h = 2166136261u;
+    for (unsigned char c: s) {
+        h = (h ^ c) * 16777619u;
+    }
+    return static_cast<int32_t>(h & 0x7fffffff);
+}
+
+//测试用的原生函数只注册一次，所有用例共用
+static void RegisterTestNatives() {
+    static bool registered = false;
+    if (registered) {
+        return;
+    }
+    registered = true;
+    EXPECT_NE(RegisterNative("native_hash", NativeHash), BuiltinId::None);
+    EXPECT_NE(RegisterNative("native_scale", [](int32_t a, double b) { return a * b; }), BuiltinId::None);
+    EXPECT_NE(RegisterNative("native_positive", [](int32_t a) { return a > 0; }), BuiltinId::None);
+    EXPECT_NE(RegisterNative("native_repeat", [](const std::string& s, int32_t n) {
+        std::string r;
+        for (int32_t i = 0; i < n; i++) {
+            r += s;
+        }
+        return r;
+    }), BuiltinId::None);
+    auto records = Records;
+    EXPECT_NE(RegisterNative("native_record", [records](const Value& v) {
+        records->push_back(v.toString());
+    }), BuiltinId::None);
+}
+
+static std::shared_ptr<AstNode> Analyze(const std::string& program) {
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+    return ast;
+}
+
+static const char* NativeProgram =
+R"(
+function twice(s : string):string{
+    return native_repeat(s, 2);
+}
+
+let h : number = native_hash("hello");
+println(h);
+println(native_scale(3, 1.5));
+println(native_positive(h));
+println(twice("ab"));
+native_record(h);
+native_record(native_repeat("c", 3));
+)";
+
+TEST(Native, native_register)
+{
+    RegisterTestNatives();
+    EXPECT_EQ(built_ins_by_id.size(), NativeFunctions().size());
+
+    //类型由C++的签名生成
+    auto sym = built_ins["native_scale"];
+    ASSERT_TRUE(sym != nullptr);
+    auto id = GetBuiltinId(*sym);
+    EXPECT_NE(id, BuiltinId::None);
+    EXPECT_EQ(NativeFunctions()[static_cast<size_t>(id)].name, "native_scale");
+    EXPECT_EQ(sym->getNumParams(), 2u);
+    auto type = std::dynamic_pointer_cast<FunctionType>(sym->theType);
+    ASSERT_TRUE(type != nullptr);
+    EXPECT_EQ(type->returnType, SysTypes::Decimal());
+    EXPECT_EQ(type->paramTypes[0], SysTypes::Integer());
+    EXPECT_EQ(type->paramTypes[1], SysTypes::Decimal());
+
+    auto& record = NativeFunctions()[static_cast<size_t>(GetBuiltinId(*built_ins["native_record"]))];
+    EXPECT_FALSE(record.returnsValue);
+    EXPECT_EQ(record.numParams, 1u);
+
+    //同名的函数不能再注册
+    EXPECT_EQ(RegisterNative("native_hash", [](int32_t a) { return a; }), BuiltinId::None);
+    EXPECT_EQ(RegisterNative("println", [](int32_t a) { return a; }), BuiltinId::None);
+    EXPECT_EQ(built_ins_by_id.size(), NativeFunctions().size());
+
+    //直接调用：实参类型不对时返回false
+    Value args[2] = {Value(3), Value(2)};
+    Value result;
+    auto& scale = NativeFunctions()[static_cast<size_t>(id)];
+    EXPECT_TRUE(scale.call(args, result));
+    EXPECT_EQ(result.tag, ValueTag::Decimal);
+    EXPECT_EQ(result.d, 6.0);
+    args[0] = Value(1.5);
+    EXPECT_FALSE(scale.call(args, result));
+}
+
+TEST(Native, native_engines)
+{
+    RegisterTestNatives();
+    Records->clear();
+    auto ast = Analyze(NativeProgram);
+
+    auto interpretor = Interpretor();
+    testing::internal::CaptureStdout();
+    interpretor.visit(*ast, "");
+    auto expect = testing::internal::GetCapturedStdout();
+    EXPECT_NE(expect.find(std::to_string(NativeHash("hello"))), std::string::npos);
+    EXPECT_NE(expect.find("4.5"), std::string::npos);
+    EXPECT_NE(expect.find("true"), std::string::npos);
+    EXPECT_NE(expect.find("abab"), std::string::npos);
+
+    auto prog = std::dynamic_pointer_cast<Prog>(ast);
+    ClosureEngine engine;
+    testing::internal::CaptureStdout();
+    engine.run(*prog);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+
+    auto generator = BCGenerator();
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+    auto disassembly = Disassemble(bc->_main->byteCode);
+    EXPECT_NE(disassembly.find("(native_hash)"), std::string::npos);
+
+    VM vm;
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(vm.execute(*bc), 0);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+
+    vm.useRegisterTier = true;
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(vm.execute(*bc), 0);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+    ASSERT_TRUE(vm.registerVM != nullptr && vm.registerVM->module != nullptr);
+    EXPECT_NE(RegModuleDumper().dump(*vm.registerVM->module).find("callnative"), std::string::npos);
+
+    //四个引擎各调用两次native_record
+    std::vector<std::string> once = {std::to_string(NativeHash("hello")), "ccc"};
+    ASSERT_EQ(Records->size(), 8u);
+    for (size_t i = 0; i < Records->size(); i++) {
+        EXPECT_EQ((*Records)[i], once[i % 2]);
+    }
+}
+
+TEST(Native, native_type_mismatch)
+{
+    RegisterTestNatives();
+    //语义分析不检查实参类型，运行时拆箱失败是运行时错误
+    auto ast = Analyze("println(native_hash(1));");
+    auto generator = BCGenerator();
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+    VM vm;
+    EXPECT_EQ(vm.execute(*bc), -2);
+}
+
+TEST(Native, native_builtins)
+{
+    //内置函数也走原生函数表：替换表里的integer_to_string，每个引擎都要用到新的实现
+    auto& slot = NativeFunctions()[static_cast<size_t>(BuiltinId::IntegerToString)];
+    auto saved = slot;
+    slot = MakeNativeFunction("integer_to_string", [](int32_t v) {
+        return "#" + std::to_string(v);
+    });
+
+    auto ast = Analyze(R"(
+println(integer_to_string(42));
+let t : number = tick() + cycles();
+println(integer_to_string(-3));
+)");
+    std::string expect = "\033[1;31m#42\n\033[0m\033[1;31m#-3\n\033[0m";
+
+    auto interpretor = Interpretor();
+    testing::internal::CaptureStdout();
+    interpretor.visit(*ast, "");
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+
+    auto prog = std::dynamic_pointer_cast<Prog>(ast);
+    ClosureEngine engine;
+    testing::internal::CaptureStdout();
+    engine.run(*prog);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+
+    auto generator = BCGenerator();
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+    VM vm;
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(vm.execute(*bc), 0);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+
+    vm.useRegisterTier = true;
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(vm.execute(*bc), 0);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+
+    slot = saved;
+}
@@ -27,6 +27,52 @@ R"(Prog
     EXPECT_STREQ(expect.c_str(), str.c_str());
 }
 
+TEST(Parser, variable_union_type)
+{
+    std::string expect =
+R"(Prog
+    VariableStatement
+        VariableDecl s(number|string)
+            hello(string)
+)";
+
+    std::string program = "let s: number|string = \"hello\";";
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    auto dumper = AstDumper();
+    dumper.visit(*ast, "");
+
+    auto str = dumper.toString();
+    EXPECT_STREQ(expect.c_str(), str.c_str());
+}
+
+TEST(Parser, variable_decimal)
+{
+    std::string expect =
+R"(Prog
+    VariableStatement
+        VariableDecl pi(decimal)
+            3.14(decimal)
+)";
+
+    std::string program = "let pi : decimal = 3.14;";
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    auto dumper = AstDumper();
+    dumper.visit(*ast, "");
+
+    auto str = dumper.toString();
+    EXPECT_STREQ(expect.c_str(), str.c_str());
+}
+
 TEST(Parser, function_call)
 {
     std::string expect =
@@ -82,6 +128,135 @@ R"(
 }
 
 
+TEST(Parser, bench)
+{
+    std::string expect =
+R"(Prog
+    BenchStatement
+        loop(string)
+        100(integer)
+            ExpressionStatement
+                Binary:Assign
+                    Variable: n, not resolved
+                    Binary:Plus
+                        Variable: n, not resolved
+                        1(integer)
+)";
+
+    std::string program =
+R"(
+bench("loop", 100) {
+    n = n + 1;
+}
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    auto dumper = AstDumper();
+    dumper.visit(*ast, "");
+
+    auto str = dumper.toString();
+    EXPECT_STREQ(expect.c_str(), str.c_str());
+}
+
+TEST(Parser, if_for)
+{
+    std::string expect =
+R"(Prog
+    ForStatement
+        VariableDecl i(number)
+            0(integer)
+        Binary:L
+            Variable: i, not resolved
+            10(integer)
+        Binary:Assign
+            Variable: i, not resolved
+            Binary:Plus
+                Variable: i, not resolved
+                1(integer)
+        IfStatement
+            Binary:EQ
+                Variable: i, not resolved
+                Variable: n, not resolved
+            ExpressionStatement
+                FunctionCall println, built-in
+                    Variable: i, not resolved
+        else
+                ExpressionStatement
+                    Binary:Assign
+                        Variable: n, not resolved
+                        Variable: i, not resolved
+    ForStatement
+        ExpressionStatement
+            FunctionCall println, built-in
+)";
+
+    std::string program =
+R"(
+for (let i : number = 0; i < 10; i = i + 1)
+    if (i == n) println(i);
+    else {
+        n = i;
+    }
+for (;;) println();
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    auto dumper = AstDumper();
+    dumper.visit(*ast, "");
+
+    auto str = dumper.toString();
+    EXPECT_STREQ(expect.c_str(), str.c_str());
+}
+
+TEST(Parser, unary_compound_assign)
+{
+    std::string expect =
+R"(Prog
+    ExpressionStatement
+        PostFix Unary:Inc
+            Variable: i, not resolved
+    ExpressionStatement
+        Binary:Assign
+            Variable: a, not resolved
+            Prefix Unary:Dec
+                Variable: i, not resolved
+    ExpressionStatement
+        Binary:PlusAssign
+            Variable: a, not resolved
+            Prefix Unary:Minus
+                Variable: i, not resolved
+)";
+
+    std::string program =
+R"(
+i++;
+a = --i;
+a += -i;
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    auto dumper = AstDumper();
+    dumper.visit(*ast, "");
+
+    auto str = dumper.toString();
+    EXPECT_STREQ(expect.c_str(), str.c_str());
+}
+
 TEST(Parser, FunctionDecl)
 {
     std::string expect =
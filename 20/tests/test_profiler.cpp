@@ -0,0 +1,78 @@
+#include "profiler.h"
+#include "semantic.h"
+#include "parser.h"
+
+#include "dbg.h"
+
+#include <gtest/gtest.h>
+
+TEST(Profiler, Profiler_counts_and_stacks)
+{
+    std::string program =
+R"(function square(x : number):number{
+    return x * x;
+}
+function sum(a : number, b : number):number{
+    let s : number = square(a) + square(b);
+    return s;
+}
+let total : number = sum(1, 2);
+total = total + sum(3, 4);
+println(total);
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto prog = std::dynamic_pointer_cast<Prog>(ast);
+    ProfilingInterpretor profiler;
+    testing::internal::CaptureStdout();
+    profiler.profile(*prog);
+    auto output = testing::internal::GetCapturedStdout();
+
+    //剖析不改变程序的语义
+    EXPECT_NE(output.find("30"), std::string::npos);
+
+    //每个函数的调用次数
+    std::map<std::string, uint64_t> calls;
+    for (auto& x: profiler.functions) {
+        calls[x.second.name] = x.second.calls;
+    }
+    EXPECT_EQ(calls["main"], 1u);
+    EXPECT_EQ(calls["sum"], 2u);
+    EXPECT_EQ(calls["square"], 4u);
+
+    //函数体里的乘法执行了4次，位置在第2行
+    bool foundMultiply = false;
+    for (auto& x: profiler.nodes) {
+        auto binary = dynamic_cast<Binary*>(x.first);
+        if (binary != nullptr && binary->op == Op::Multiply) {
+            foundMultiply = true;
+            EXPECT_EQ(x.second.count, 4u);
+            EXPECT_EQ(x.second.pos.line, 2u);
+            EXPECT_EQ(x.second.kind, "Binary");
+            EXPECT_GE(x.second.totalNanos, x.second.selfNanos);
+        }
+    }
+    EXPECT_TRUE(foundMultiply);
+
+    //folded stack：调用栈用';'连接
+    auto folded = profiler.foldedStacks();
+    EXPECT_NE(folded.find("main "), std::string::npos);
+    EXPECT_NE(folded.find("main;sum "), std::string::npos);
+    EXPECT_NE(folded.find("main;sum;square "), std::string::npos);
+
+    //带注解的源代码：第2行执行了4次
+    auto listing = profiler.annotatedSource(program);
+    EXPECT_NE(listing.find("         4"), std::string::npos);
+    EXPECT_NE(listing.find("|     return x * x;"), std::string::npos);
+
+    auto summary = profiler.functionSummary();
+    EXPECT_NE(summary.find("square"), std::string::npos);
+}
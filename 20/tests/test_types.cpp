@@ -54,3 +54,73 @@ TEST(TYPES, SysTypes_getUpperBound)
     EXPECT_TRUE(*any == *(Type::getUpperBound(any, number)));
     EXPECT_TRUE(*any == *(Type::getUpperBound(number, any)));
 }
+
+TEST(TYPES, UnionType_basic)
+{
+    auto number = SysTypes::Number();
+    auto string = SysTypes::String();
+
+    std::vector<std::shared_ptr<Type>> types{number, string};
+    auto t = std::make_shared<UnionType>(types);
+    EXPECT_TRUE(t->isUnionType());
+    EXPECT_STREQ("number|string", t->name.c_str());
+
+    const char* expect = "UnionType {name: number|string, types: [number, string, ]}";
+    auto str = t->toString();
+    EXPECT_STREQ(expect, str.c_str());
+}
+
+TEST(TYPES, UnionType_LE)
+{
+    auto any = SysTypes::Any();
+    auto number = SysTypes::Number();
+    auto string = SysTypes::String();
+    auto boolean = SysTypes::Boolean();
+
+    std::shared_ptr<Type> numStr = std::make_shared<UnionType>(std::vector<std::shared_ptr<Type>>{number, string});
+    std::shared_ptr<Type> numStrBool = std::make_shared<UnionType>(std::vector<std::shared_ptr<Type>>{number, string, boolean});
+
+    EXPECT_TRUE(number->LE(numStr));
+    EXPECT_TRUE(string->LE(numStr));
+    EXPECT_TRUE(!boolean->LE(numStr));
+
+    EXPECT_TRUE(numStr->LE(numStrBool));
+    EXPECT_TRUE(!numStrBool->LE(numStr));
+    EXPECT_TRUE(numStr->LE(any));
+    EXPECT_TRUE(!numStr->LE(number));
+}
+
+TEST(TYPES, UnionType_getUpperBound)
+{
+    auto number = SysTypes::Number();
+    auto string = SysTypes::String();
+
+    auto t = Type::getUpperBound(number, string);
+    EXPECT_TRUE(t->isUnionType());
+    EXPECT_STREQ("number|string", t->name.c_str());
+
+    std::shared_ptr<Type> numStr = std::make_shared<UnionType>(std::vector<std::shared_ptr<Type>>{number, string});
+    EXPECT_TRUE(*t == *numStr);
+    EXPECT_TRUE(*numStr == *(Type::getUpperBound(number, numStr)));
+}
+
+TEST(TYPES, UnionType_member_order)
+{
+    auto number = SysTypes::Number();
+    auto string = SysTypes::String();
+    auto boolean = SysTypes::Boolean();
+
+    //成员的书写顺序不同、有重复的成员，名称都相同，两个类型相等
+    std::shared_ptr<Type> numStr = std::make_shared<UnionType>(std::vector<std::shared_ptr<Type>>{number, string});
+    std::shared_ptr<Type> strNum = std::make_shared<UnionType>(std::vector<std::shared_ptr<Type>>{string, number});
+    std::shared_ptr<Type> strNumStr = std::make_shared<UnionType>(std::vector<std::shared_ptr<Type>>{string, number, string});
+    EXPECT_STREQ("number|string", strNum->name.c_str());
+    EXPECT_TRUE(*numStr == *strNum);
+    EXPECT_TRUE(*numStr == *strNumStr);
+    EXPECT_TRUE(*strNum == *(Type::getUpperBound(string, number)));
+
+    std::shared_ptr<Type> boolStrNum = std::make_shared<UnionType>(std::vector<std::shared_ptr<Type>>{boolean, string, number});
+    EXPECT_STREQ("boolean|number|string", boolStrNum->name.c_str());
+    EXPECT_TRUE(strNum->LE(boolStrNum));
+    EXPECT_FALSE(*strNum == *boolStrNum);
+}
@@ -0,0 +1,90 @@
+#include "value.h"
+
+#include "dbg.h"
+
+#include <gtest/gtest.h>
+
+TEST(Value, Value_basic)
+{
+    EXPECT_EQ(sizeof(Value), 16u);
+
+    Value undefined;
+    EXPECT_TRUE(undefined.isUndefined());
+    EXPECT_STREQ("undefined", undefined.toString().c_str());
+
+    Value i = 42;
+    EXPECT_TRUE(i.tag == ValueTag::Integer);
+    EXPECT_EQ(ValueAs<int32_t>(i), 42);
+    EXPECT_STREQ("42", i.toString().c_str());
+
+    Value d = 50.24;
+    EXPECT_TRUE(d.tag == ValueTag::Decimal);
+    EXPECT_STREQ("50.24", d.toString().c_str());
+
+    Value b = true;
+    EXPECT_TRUE(b.tag == ValueTag::Boolean);
+    EXPECT_STREQ("true", b.toString().c_str());
+}
+
+TEST(Value, Value_decimal_format)
+{
+    //最短的、能准确读回的形式
+    EXPECT_STREQ("1234567.5", Value(1234567.5).toString().c_str());
+    EXPECT_STREQ("3.14159265", Value(3.14159265).toString().c_str());
+    EXPECT_STREQ("0.30000000000000004", Value(0.1 + 0.2).toString().c_str());
+    EXPECT_STREQ("-0.5", Value(-0.5).toString().c_str());
+    EXPECT_STREQ("2", Value(2.0).toString().c_str());
+    EXPECT_STREQ("Infinity", Value(1.0 / 0.0).toString().c_str());
+}
+
+TEST(Value, Value_string_intern)
+{
+    //字面量和常量池里的字符串在字符串池里，相同内容是同一个对象
+    Value s1 = StringPool::intern("hello");
+    Value s2 = StringPool::intern(std::string("hel") + "lo");
+    EXPECT_TRUE(s1.tag == ValueTag::String);
+    EXPECT_EQ(s1.s, s2.s);
+    EXPECT_EQ(StringPool::intern("hello"), s1.s);
+    EXPECT_STREQ("hello", ValueAs<std::string>(s2).c_str());
+
+    //运行时生成的字符串不进入字符串池
+    Value s3 = std::string("hel") + "lo";
+    EXPECT_TRUE(s3.tag == ValueTag::String);
+    EXPECT_NE(s3.s, s1.s);
+    EXPECT_EQ(*s3.s, *s1.s);
+}
+
+TEST(Value, Value_string_refcount)
+{
+    Value s1 = std::string("abc");
+    auto obj = s1.s;
+    EXPECT_EQ(obj->refCount, 1u);
+    {
+        Value s2 = s1;
+        Value s3;
+        s3 = s2;
+        EXPECT_EQ(obj->refCount, 3u);
+        s3 = Value(1);
+        EXPECT_EQ(obj->refCount, 2u);
+        Value& alias = s2;
+        s2 = alias;
+        EXPECT_EQ(obj->refCount, 2u);
+    }
+    EXPECT_EQ(obj->refCount, 1u);
+
+    Value moved = std::move(s1);
+    EXPECT_TRUE(s1.isUndefined());
+    EXPECT_EQ(moved.s, obj);
+    EXPECT_EQ(obj->refCount, 1u);
+
+    //字符串池持有一个引用，值都释放了，池里的字符串也还在
+    auto pooled = StringPool::intern("pooled");
+    uint32_t count = pooled->refCount;
+    {
+        Value p1 = pooled;
+        Value p2 = p1;
+        EXPECT_EQ(pooled->refCount, count + 2);
+    }
+    EXPECT_EQ(pooled->refCount, count);
+    EXPECT_STREQ("pooled", pooled->c_str());
+}
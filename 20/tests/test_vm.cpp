@@ -1,5 +1,7 @@
 #include "vm.h"
+#include "regvm.h"
 #include "interpretor.h"
+#include "closure.h"
 #include "semantic.h"
 #include "parser.h"
 #include "common.h"
@@ -8,6 +10,15 @@
 
 #include <gtest/gtest.h>
 
+//println输出的各行，每行都带颜色，见Print()
+static std::string PrintedLines(std::initializer_list<std::string> lines) {
+    std::string out;
+    for (auto& line: lines) {
+        out += "\033[1;31m" + line + "\n\033[0m";
+    }
+    return out;
+}
+
 TEST(Vm, vm_VariableDecl)
 {
     std::string expect =
@@ -278,3 +289,1386 @@ println(fourTimes(4));
         Print("new vm.execute ret: " + std::to_string(ret), Color::Yellow);
     }
 }
+
+TEST(VM, vm_union_type)
+{
+    std::string program =
+R"(
+function addOne(s : number|string):number|string{
+    let r : number|string = s + 1;
+    return r;
+}
+
+println(addOne("hello"));
+println(addOne(41));
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto dumper = AstDumper();
+    dumper.visit(*ast, "");
+
+    auto generator = BCGenerator();
+    auto bcModule = generator.visit(*ast, "");
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(bcModule);
+
+    auto bcModuleDumper = BCModuleDumper();
+    bcModuleDumper.dump(*bc);
+
+    auto vm = VM();
+    testing::internal::CaptureStdout();
+    auto ret = vm.execute(*bc);
+    auto output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(ret, 0);
+    EXPECT_NE(output.find("hello1"), std::string::npos);
+    EXPECT_NE(output.find("42"), std::string::npos);
+
+    //联合类型写入字节码文件后，能够被完整地读回来
+    auto bcWrite = BCModuleWriter();
+    auto hex = bcWrite.write(*bc);
+    PrintHex(hex);
+
+    {
+        auto bcRead = BCModuleReader();
+        auto bc = bcRead.read(hex);
+        for (auto& c: bc->consts){
+            if (!isType<std::shared_ptr<FunctionSymbol>>(c)) continue;
+            auto sym = std::any_cast<std::shared_ptr<FunctionSymbol>>(c);
+            if (sym->name != "addOne") continue;
+
+            auto ft = std::dynamic_pointer_cast<FunctionType>(sym->theType);
+            ASSERT_TRUE(ft != nullptr);
+            ASSERT_EQ(ft->paramTypes.size(), 1u);
+            EXPECT_TRUE(ft->paramTypes[0]->isUnionType());
+            EXPECT_STREQ("number|string", ft->paramTypes[0]->name.c_str());
+            EXPECT_EQ(std::dynamic_pointer_cast<UnionType>(ft->paramTypes[0])->types.size(), 2u);
+        }
+
+        testing::internal::CaptureStdout();
+        auto ret = vm.execute(*bc);
+        auto output = testing::internal::GetCapturedStdout();
+        EXPECT_EQ(ret, 0);
+        EXPECT_NE(output.find("hello1"), std::string::npos);
+    }
+}
+
+TEST(VM, vm_union_type_roundtrip)
+{
+    //成员的书写顺序不同、有重复的成员：编译器生成的类型和从字节码读回来的类型要相同
+    std::string program =
+R"(
+function pick(a : string|number|string, b : boolean|number):number|string{
+    let r : number|string = a;
+    return r;
+}
+
+println(pick("a", 1));
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto generator = BCGenerator();
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+    auto hex = BCModuleWriter().write(*bc);
+    auto bcRead = BCModuleReader();
+    auto readBack = bcRead.read(hex);
+    ASSERT_TRUE(readBack != nullptr);
+
+    auto findPick = [](const BCModule& m) {
+        for (auto& c: m.consts) {
+            if (isType<std::shared_ptr<FunctionSymbol>>(c) && std::any_cast<std::shared_ptr<FunctionSymbol>>(c)->name == "pick") {
+                return std::any_cast<std::shared_ptr<FunctionSymbol>>(c);
+            }
+        }
+        return std::shared_ptr<FunctionSymbol>();
+    };
+    auto original = findPick(*bc);
+    auto read = findPick(*readBack);
+    ASSERT_TRUE(original != nullptr && read != nullptr);
+
+    auto compareUnion = [](const std::shared_ptr<Type>& t1, const std::shared_ptr<Type>& t2) {
+        auto u1 = std::dynamic_pointer_cast<UnionType>(t1);
+        auto u2 = std::dynamic_pointer_cast<UnionType>(t2);
+        ASSERT_TRUE(u1 != nullptr && u2 != nullptr);
+        EXPECT_EQ(u1->name, u2->name);
+        EXPECT_TRUE(*u1 == *u2);
+        ASSERT_EQ(u1->types.size(), u2->types.size());
+        for (size_t i = 0; i < u1->types.size(); i++) {
+            EXPECT_EQ(u1->types[i]->name, u2->types[i]->name);
+        }
+    };
+
+    auto ft1 = std::dynamic_pointer_cast<FunctionType>(original->theType);
+    auto ft2 = std::dynamic_pointer_cast<FunctionType>(read->theType);
+    ASSERT_TRUE(ft1 != nullptr && ft2 != nullptr);
+    ASSERT_EQ(ft1->paramTypes.size(), 2u);
+    ASSERT_EQ(ft2->paramTypes.size(), 2u);
+    //string|number|string 去重之后只有两个成员
+    EXPECT_STREQ("number|string", ft1->paramTypes[0]->name.c_str());
+    EXPECT_EQ(std::dynamic_pointer_cast<UnionType>(ft1->paramTypes[0])->types.size(), 2u);
+    EXPECT_STREQ("boolean|number", ft1->paramTypes[1]->name.c_str());
+    for (size_t i = 0; i < 2; i++) {
+        compareUnion(ft1->paramTypes[i], ft2->paramTypes[i]);
+    }
+    compareUnion(ft1->returnType, ft2->returnType);
+    ASSERT_EQ(original->vars.size(), read->vars.size());
+    compareUnion(original->vars[2]->theType, read->vars[2]->theType);
+}
+
+TEST(VM, vm_decimal)
+{
+    std::string program =
+R"(
+function circleArea(r : number):number{
+    let area = 3.14*r*r;
+    return area;
+}
+
+println(circleArea(4));
+println(circleArea(0.5) + 1.0);
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto generator = BCGenerator();
+    auto bcModule = generator.visit(*ast, "");
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(bcModule);
+
+    auto bcModuleDumper = BCModuleDumper();
+    bcModuleDumper.dump(*bc);
+
+    auto vm = VM();
+    testing::internal::CaptureStdout();
+    auto ret = vm.execute(*bc);
+    auto output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(ret, 0);
+    EXPECT_NE(output.find("50.24"), std::string::npos);
+    EXPECT_NE(output.find("1.785"), std::string::npos);
+
+    //浮点数常量写入字节码文件后，能够被完整地读回来
+    auto bcWrite = BCModuleWriter();
+    auto hex = bcWrite.write(*bc);
+    PrintHex(hex);
+
+    {
+        auto bcRead = BCModuleReader();
+        auto bc = bcRead.read(hex);
+        bool found = false;
+        for (auto& c: bc->consts){
+            if (isType<double>(c) && std::any_cast<double>(c) == 3.14){
+                found = true;
+            }
+        }
+        EXPECT_TRUE(found);
+
+        testing::internal::CaptureStdout();
+        auto ret = vm.execute(*bc);
+        auto output = testing::internal::GetCapturedStdout();
+        EXPECT_EQ(ret, 0);
+        EXPECT_NE(output.find("50.24"), std::string::npos);
+    }
+}
+
+TEST(VM, vm_decimal_format)
+{
+    //浮点数跟TypeScript一样，输出能准确读回的最短形式，每个引擎都一样
+    std::string program =
+R"(
+let a : decimal = 1234567.5;
+let b : decimal = 3.14159265;
+println(a);
+println(b);
+println(0.1 + 0.2);
+println(b * 2);
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto expect = PrintedLines({"1234567.5", "3.14159265", "0.30000000000000004", "6.2831853"});
+    auto interpretor = Interpretor();
+    testing::internal::CaptureStdout();
+    interpretor.visit(*ast, "");
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+
+    ClosureEngine engine;
+    testing::internal::CaptureStdout();
+    engine.run(*std::dynamic_pointer_cast<Prog>(ast));
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(BCGenerator().visit(*ast, ""));
+    for (bool useStackCache: {false, true}) {
+        VM vm;
+        vm.useStackCache = useStackCache;
+        testing::internal::CaptureStdout();
+        EXPECT_EQ(vm.execute(*bc), 0);
+        EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+    }
+}
+
+TEST(VM, vm_tail_call)
+{
+    std::string program =
+R"(
+function third(x : number):number{
+    return x * 10;
+}
+
+function second(x : number):number{
+    let y : number = x + 1;
+    return third(y);
+}
+
+function first(x : number, s : string):string{
+    return s + second(x);
+}
+
+println(second(4));
+println(first(1, "v"));
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto generator = BCGenerator();
+    auto bcModule = generator.visit(*ast, "");
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(bcModule);
+
+    auto bcModuleDumper = BCModuleDumper();
+    bcModuleDumper.dump(*bc);
+
+    //尾调用使用invoketail指令，后面不再需要ireturn
+    auto prog = std::dynamic_pointer_cast<Prog>(ast);
+    auto& second = std::dynamic_pointer_cast<FunctionDecl>(prog->stmts[1])->sym->byteCode;
+    ASSERT_GE(second.size(), 3u);
+    EXPECT_EQ(second[second.size() - 3], OpCode::invoketail);
+    auto& first = std::dynamic_pointer_cast<FunctionDecl>(prog->stmts[2])->sym->byteCode;
+    EXPECT_EQ(first.back(), OpCode::ireturn);
+
+    auto vm = VM();
+    testing::internal::CaptureStdout();
+    auto ret = vm.execute(*bc);
+    auto output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(ret, 0);
+    EXPECT_NE(output.find("50"), std::string::npos);
+    EXPECT_NE(output.find("v20"), std::string::npos);
+
+    //栈桢布局默认直接引用函数的字节码，不做拷贝（虚拟机加载模块时用的是副本，见vm_quickening）
+    auto thirdSym = std::dynamic_pointer_cast<FunctionDecl>(prog->stmts[0])->sym;
+    VMFunction function(*thirdSym);
+    EXPECT_EQ(function.code, thirdSym->byteCode.data());
+    EXPECT_EQ(function.codeLength, thirdSym->byteCode.size());
+
+    //执行结束之后，所有栈桢都已经弹出
+    EXPECT_TRUE(vm.callStack.empty());
+}
+
+TEST(VM, vm_quickening)
+{
+    std::string program =
+R"(
+function scale(x : number):number{
+    return x * 100000;
+}
+
+let s : string = "";
+for (let i : number = 0; i < 3; i++) {
+    s = s + "ab";
+}
+println(s);
+println(scale(3));
+println(scale(4));
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto expect = PrintedLines({"ababab", "300000", "400000"});
+    auto interpretor = Interpretor();
+    testing::internal::CaptureStdout();
+    interpretor.visit(*ast, "");
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+
+    //不合并超级指令，ldc、sldc、invokestatic都单独出现
+    auto generator = BCGenerator();
+    generator.useSuperInstructions = false;
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+    auto prog = std::dynamic_pointer_cast<Prog>(ast);
+    auto scaleSym = std::dynamic_pointer_cast<FunctionDecl>(prog->stmts[0])->sym;
+    auto mainCode = bc->_main->byteCode;
+    auto scaleCode = scaleSym->byteCode;
+    EXPECT_NE(Disassemble(scaleCode).find("ldc"), std::string::npos);
+    EXPECT_NE(Disassemble(mainCode).find("sldc"), std::string::npos);
+    EXPECT_NE(Disassemble(mainCode).find("invokestatic"), std::string::npos);
+
+    auto run = [](VM& vm, const BCModule& m) {
+        testing::internal::CaptureStdout();
+        EXPECT_EQ(vm.execute(m), 0);
+        return testing::internal::GetCapturedStdout();
+    };
+    //执行过的ldc、sldc、invokestatic都改写成了快速指令，操作数和其他指令不变
+    auto expectCode = [](const std::vector<uint8_t>& original, const VMFunction& function) {
+        ASSERT_NE(function.code, nullptr);
+        ASSERT_EQ(function.codeLength, original.size());
+        for (uint32_t i = 0; i < original.size(); i++) {
+            EXPECT_EQ(function.code[i], original[i]);
+        }
+    };
+    auto quickened = [](const std::vector<uint8_t>& code) {
+        auto ret = code;
+        for (uint32_t i = 0; i < ret.size(); i += InstructionLength(ret, i)) {
+            ret[i] = QuickOpCode(static_cast<OpCode>(ret[i]));
+        }
+        return ret;
+    };
+    auto findFunction = [](const VM& vm, const FunctionSymbol* sym) -> const VMFunction& {
+        for (auto& function: vm.functions) {
+            if (function.sym == sym) {
+                return function;
+            }
+        }
+        return vm.mainFunction;
+    };
+
+    //两个栈式虚拟机的主循环都改写自己的代码副本，改写之后再执行，结果不变
+    for (bool useStackCache: {false, true}) {
+        VM vm;
+        vm.useStackCache = useStackCache;
+        EXPECT_EQ(run(vm, *bc), expect);
+        EXPECT_NE(vm.mainFunction.code, bc->_main->byteCode.data());
+        expectCode(quickened(mainCode), vm.mainFunction);
+        expectCode(quickened(scaleCode), findFunction(vm, scaleSym.get()));
+        EXPECT_EQ(run(vm, *bc), expect);
+    }
+
+    //模块里的字节码不变，写到文件里的也是原来的指令
+    EXPECT_EQ(bc->_main->byteCode, mainCode);
+    EXPECT_EQ(scaleSym->byteCode, scaleCode);
+
+    //剖析的时候直接执行模块里的字节码，不改写，剖析数据记录的是原来的指令
+    OpCodeProfile profile;
+    VM profiled;
+    profiled.opCodeProfile = &profile;
+    EXPECT_EQ(run(profiled, *bc), expect);
+    EXPECT_EQ(profiled.mainFunction.code, bc->_main->byteCode.data());
+    EXPECT_EQ(profile.singles[OpCode::invokestatic], 2u);
+    EXPECT_EQ(profile.singles[OpCode::invoke_direct], 0u);
+    EXPECT_EQ(profile.singles[OpCode::ldc_int], 0u);
+
+    //快速指令不能出现在模块里
+    bc->_main->byteCode = {OpCode::ldc_int, 0, OpCode::pop, OpCode::vreturn};
+    EXPECT_FALSE(BCVerifier().verify(*bc));
+    bc->_main->byteCode = mainCode;
+}
+
+TEST(VM, vm_binary_handlers)
+{
+    //两个整数：原地计算，结果仍然是整数
+    Value stack[2] = {Value(7), Value(2)};
+    Value* sp = stack + 2;
+    EXPECT_TRUE(VM::ExecuteBinary<OpCode::idiv>(sp));
+    ASSERT_EQ(sp, stack + 1);
+    EXPECT_TRUE(stack[0].tag == ValueTag::Integer);
+    EXPECT_EQ(stack[0].i, 3);
+
+    //整数与浮点数混合：查跳转表，提升为浮点数
+    *sp++ = Value(0.5);
+    EXPECT_TRUE(VM::ExecuteBinary<OpCode::iadd>(sp));
+    EXPECT_TRUE(stack[0].tag == ValueTag::Decimal);
+    EXPECT_DOUBLE_EQ(stack[0].d, 3.5);
+
+    //dadd遇到两个整数，也按浮点数计算
+    stack[0] = Value(1);
+    stack[1] = Value(2);
+    sp = stack + 2;
+    EXPECT_TRUE(VM::ExecuteBinary<OpCode::ddiv>(sp));
+    EXPECT_TRUE(stack[0].tag == ValueTag::Decimal);
+    EXPECT_DOUBLE_EQ(stack[0].d, 0.5);
+
+    //字符串连接
+    stack[0] = Value("a");
+    stack[1] = Value(1);
+    sp = stack + 2;
+    EXPECT_TRUE(VM::ExecuteBinary<OpCode::sadd>(sp));
+    EXPECT_TRUE(stack[0].tag == ValueTag::String);
+    EXPECT_EQ(*stack[0].s, "a1");
+
+    //不支持的组合，栈不变
+    stack[0] = Value("a");
+    stack[1] = Value(1);
+    sp = stack + 2;
+    EXPECT_FALSE(VM::ExecuteBinary<OpCode::isub>(sp));
+    EXPECT_EQ(sp, stack + 2);
+}
+
+TEST(VM, vm_register_tier)
+{
+    std::string program =
+R"(
+function third(x : number):number{
+    return x * 10;
+}
+
+function second(x : number):number{
+    let y : number = x + 1;
+    return third(y);
+}
+
+function area(r : number, s : string):string{
+    let a = 3.14*r*r;
+    let b : number = r;
+    return s + a + 200;
+}
+
+let i : number = 2;
+let j : number = i * 3 + i;
+println(second(j));
+println(area(i, "a="));
+println(integer_to_string(j));
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto generator = BCGenerator();
+    auto bcModule = generator.visit(*ast, "");
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(bcModule);
+
+    auto vm = VM();
+    testing::internal::CaptureStdout();
+    auto ret = vm.execute(*bc);
+    auto expect = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(ret, 0);
+    EXPECT_NE(expect.find("90"), std::string::npos);
+    EXPECT_NE(expect.find("a=12.56200"), std::string::npos);
+
+    //寄存器虚拟机的输出与栈式虚拟机相同
+    vm.useRegisterTier = true;
+    testing::internal::CaptureStdout();
+    ret = vm.execute(*bc);
+    auto output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(ret, 0);
+    EXPECT_EQ(output, expect);
+
+    //iload、istore和常量入栈被消掉，指令数变少
+    ASSERT_TRUE(vm.registerVM != nullptr && vm.registerVM->module != nullptr);
+    auto& m = *vm.registerVM->module;
+    EXPECT_EQ(m.functions.size(), 4u);
+    EXPECT_LT(m.numRegInsts, m.numStackInsts);
+    auto dump = RegModuleDumper().dump(m);
+    Print(dump);
+    //let j = i * 3 + i：结果直接写到本地变量j，不需要move
+    EXPECT_NE(dump.find("imul r2, r0, K(3)"), std::string::npos);
+    EXPECT_NE(dump.find("iadd r1, r2, r0"), std::string::npos);
+    EXPECT_NE(dump.find("tailcall _, third(r2...)"), std::string::npos);
+
+    //同一个模块只翻译一次
+    auto translated = vm.registerVM->module;
+    testing::internal::CaptureStdout();
+    vm.execute(*bc);
+    testing::internal::GetCapturedStdout();
+    EXPECT_EQ(vm.registerVM->module, translated);
+
+    //从字节码文件读回来的模块，也可以翻译成寄存器指令
+    auto bcWrite = BCModuleWriter();
+    auto hex = bcWrite.write(*bc);
+    {
+        auto bcRead = BCModuleReader();
+        auto bc = bcRead.read(hex);
+        testing::internal::CaptureStdout();
+        auto ret = vm.execute(*bc);
+        auto output = testing::internal::GetCapturedStdout();
+        EXPECT_EQ(ret, 0);
+        EXPECT_EQ(output, expect);
+        EXPECT_NE(vm.registerVM->module, translated);
+    }
+
+    //有不支持的指令时，回退到栈式虚拟机
+    {
+        BCModule bc;
+        std::shared_ptr<Type> funcType = std::make_shared<FunctionType>(SysTypes::Integer(), std::vector<std::shared_ptr<Type>>());
+        bc._main = std::make_shared<FunctionSymbol>("main", funcType);
+        bc._main->byteCode = {OpCode::iconst_0, OpCode::ifeq, 0, 4, OpCode::vreturn};
+        RegisterTranslator translator;
+        EXPECT_TRUE(translator.translate(bc) == nullptr);
+        EXPECT_EQ(vm.execute(bc), 0);
+        EXPECT_EQ(vm.registerVM->rejected, &bc);
+    }
+}
+
+TEST(VM, vm_superinstructions)
+{
+    std::string program =
+R"(
+function mix(a : number, b : number):number{
+    let s : number = a * 2 - a / 2 + b;
+    return s - a;
+}
+
+function area(r : number):number{
+    let area = 3.14 * r * r;
+    return area;
+}
+
+function sum(n : number):number{
+    let s : number = 0;
+    for (let i : number = 0; i < n; i++) {
+        s = s + i;
+    }
+    return s;
+}
+
+let x0 : number = 1;
+let x1 : number = mix(x0, 1);
+let x2 : number = mix(x1, 2);
+println(mix(x2, 3));
+println(area(1.5));
+println(sum(100));
+)";
+
+    auto compile = [&](bool useSuperInstructions) {
+        CharStream charStream(program);
+        Scanner scanner(charStream);
+        auto parser = Parser(scanner);
+        auto ast = parser.parseProg();
+        SemanticAnalyer semanticAnalyer;
+        semanticAnalyer.execute(*ast);
+        auto generator = BCGenerator();
+        generator.useSuperInstructions = useSuperInstructions;
+        return std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+    };
+    auto base = compile(false);
+    auto fused = compile(true);
+
+    //超级指令还原之后，与不使用超级指令时生成的字节码相同
+    for (size_t i = 0; i < base->consts.size(); i++) {
+        if (!isType<std::shared_ptr<FunctionSymbol>>(base->consts[i])) continue;
+        auto& baseCode = std::any_cast<std::shared_ptr<FunctionSymbol>>(base->consts[i])->byteCode;
+        auto& fusedCode = std::any_cast<std::shared_ptr<FunctionSymbol>>(fused->consts[i])->byteCode;
+        EXPECT_LE(fusedCode.size(), baseCode.size());
+        EXPECT_EQ(ExpandSuperInstructions(fusedCode), baseCode);
+    }
+
+    //输出相同，分派次数更少
+    auto run = [](const BCModule& bc, OpCodeProfile* profile, bool useRegisterTier, bool useStackCache) {
+        VM vm;
+        vm.opCodeProfile = profile;
+        vm.useRegisterTier = useRegisterTier;
+        vm.useStackCache = useStackCache;
+        testing::internal::CaptureStdout();
+        EXPECT_EQ(vm.execute(bc), 0);
+        return testing::internal::GetCapturedStdout();
+    };
+    OpCodeProfile baseProfile;
+    OpCodeProfile fusedProfile;
+    auto expect = run(*base, &baseProfile, false, false);
+    EXPECT_NE(expect.find("7.0649999999999995"), std::string::npos);
+    EXPECT_NE(expect.find("4950"), std::string::npos);
+    EXPECT_EQ(run(*fused, &fusedProfile, false, false), expect);
+    if (!SuperInstructions().empty()) {
+        EXPECT_LT(fusedProfile.numInsts, baseProfile.numInsts);
+    }
+    Print(baseProfile.report(5));
+
+    //循环体里的iinc也可以被合并
+    for (auto& superInst: SuperInstructions()) {
+        auto& components = superInst.components;
+        if (std::find(components.begin(), components.end(), OpCode::iinc) != components.end()) {
+            EXPECT_LT(fusedProfile.singles[OpCode::iinc], baseProfile.singles[OpCode::iinc]);
+            break;
+        }
+    }
+
+    //寄存器虚拟机和栈顶缓存也能执行带超级指令的字节码
+    EXPECT_EQ(run(*fused, nullptr, true, false), expect);
+    EXPECT_EQ(run(*fused, nullptr, false, true), expect);
+
+    //剖析数据：3次mix、1次area、1次sum是invokestatic，3次println是invokenative；mix里的 a * 2 是 iload_0 iconst_2 imul，每次调用执行一次
+    EXPECT_EQ(baseProfile.singles[OpCode::invokestatic], 5u);
+    EXPECT_EQ(baseProfile.singles[OpCode::invokenative], 3u);
+    EXPECT_EQ(baseProfile.pairs[OpCode::iload_0 << 8 | OpCode::iconst_2], 6u);
+    EXPECT_EQ(baseProfile.triples[OpCode::iload_0 << 16 | OpCode::iconst_2 << 8 | OpCode::imul], 3u);
+}
+
+TEST(VM, vm_superinstructions_jump_targets)
+{
+    if (SuperInstructions().empty()) {
+        return;
+    }
+
+    //用第一条超级指令的组成指令拼出一段代码，操作数都填0：
+    //  igoto END; <组成指令...>; END: vreturn
+    auto& superInst = SuperInstructions()[0];
+    std::vector<uint8_t> sequence;
+    std::vector<uint32_t> starts;
+    for (auto component: superInst.components) {
+        starts.push_back(3 + sequence.size());
+        sequence.push_back(component);
+        sequence.resize(sequence.size() + OpCodeLength(component) - 1, 0);
+    }
+    uint32_t end = 3 + sequence.size();
+    std::vector<uint8_t> code {OpCode::igoto, static_cast<uint8_t>(end >> 8), static_cast<uint8_t>(end)};
+    code.insert(code.end(), sequence.begin(), sequence.end());
+    code.push_back(OpCode::vreturn);
+
+    //合并成一条超级指令，跳转目标指向新的位置
+    auto fused = FuseSuperInstructions(code);
+    ASSERT_EQ(fused[3], superInst.op);
+    uint32_t newEnd = 3 + OpCodeLength(superInst.op);
+    EXPECT_EQ(static_cast<uint32_t>(fused[1] << 8 | fused[2]), newEnd);
+    ASSERT_EQ(fused.size(), newEnd + 1);
+    EXPECT_EQ(fused[newEnd], OpCode::vreturn);
+    EXPECT_EQ(ExpandSuperInstructions(fused), code);
+
+    //跳转目标在序列中间时，不能合并
+    code[1] = static_cast<uint8_t>(starts[1] >> 8);
+    code[2] = static_cast<uint8_t>(starts[1]);
+    auto notFused = FuseSuperInstructions(code);
+    EXPECT_NE(notFused[3], superInst.op);
+    EXPECT_EQ(static_cast<uint32_t>(notFused[1] << 8 | notFused[2]), starts[1]);
+}
+
+TEST(VM, vm_contiguous_stack)
+{
+    auto compile = [](const std::string& program) {
+        CharStream charStream(program);
+        Scanner scanner(charStream);
+        auto parser = Parser(scanner);
+        auto ast = parser.parseProg();
+        SemanticAnalyer semanticAnalyer;
+        semanticAnalyer.execute(*ast);
+        auto generator = BCGenerator();
+        return std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+    };
+
+    //调用树：实参原地变成被调用者的本地变量，返回值放回调用者的操作数栈
+    auto tree = compile(
+R"(
+function t0(a : number, b : number):number{
+    let c : number = a * 10;
+    return c + b;
+}
+function t1(a : number, b : number):number{
+    return t0(a, b) + t0(b, a);
+}
+function t2(a : number):number{
+    return t1(a, a + 1) - t1(a + 2, a);
+}
+println(t2(1) * 100 + t2(2));
+)");
+    //操作数栈的最大深度：t1里两次调用的返回值都在栈上，而t0(b, a)的两个实参还没有弹出
+    std::shared_ptr<FunctionSymbol> t1;
+    for (auto& c: tree->consts) {
+        if (isType<std::shared_ptr<FunctionSymbol>>(c) && std::any_cast<std::shared_ptr<FunctionSymbol>>(c)->name == "t1") {
+            t1 = std::any_cast<std::shared_ptr<FunctionSymbol>>(c);
+        }
+    }
+    ASSERT_NE(t1, nullptr);
+    EXPECT_EQ(t1->opStackSize, 3u);
+
+    auto vm = VM();
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(vm.execute(*tree), 0);
+    auto output = testing::internal::GetCapturedStdout();
+    //t1(a, b) = 11 * (a + b)，t2(a) = 11 * (2a + 1) - 11 * (2a + 2) = -11
+    EXPECT_NE(output.find("-1111"), std::string::npos);
+    EXPECT_TRUE(vm.callStack.empty());
+
+    //无穷递归：调用栈达到最大深度时报错，而不是越界
+    auto recursion = compile(
+R"(
+function f(a : number):number{
+    return f(a + 1) + 1;
+}
+println(f(1));
+)");
+    EXPECT_EQ(vm.execute(*recursion), -2);
+    EXPECT_EQ(vm.callStack.size(), VM::MaxCallDepth);
+
+    //同一个VM可以继续执行别的模块
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(vm.execute(*tree), 0);
+    EXPECT_NE(testing::internal::GetCapturedStdout().find("-1111"), std::string::npos);
+}
+
+TEST(VM, vm_verifier)
+{
+    //操作码的元数据在编译期生成
+    static_assert(OpCodeLength(OpCode::iadd) == 1, "iadd has no operand");
+    static_assert(OpCodeLength(OpCode::invokestatic) == 3, "invokestatic has a 2-byte const index");
+    static_assert(IsJumpOpCode(OpCode::igoto) && !IsJumpOpCode(OpCode::invoketail), "jump flag");
+    static_assert(OpCodeInfos[OpCode::ireturn].flow == FlowKind::Return, "ireturn returns");
+    EXPECT_EQ(OpCodeLength(0xff), 0u);
+    for (auto& superInst: SuperInstructions()) {
+        //超级指令的长度是各组成指令的操作数之和加1
+        uint32_t length = 1;
+        for (auto component: superInst.components) {
+            length += OpCodeLength(component) - 1;
+        }
+        EXPECT_EQ(OpCodeLength(superInst.op), length);
+        EXPECT_TRUE(OpCodeInfos[superInst.op].isSuper);
+    }
+
+    //手工构造一个函数：一个参数，一个本地变量，常量池里有一个整数和一个字符串
+    std::shared_ptr<Type> numberType = SysTypes::Number();
+    std::shared_ptr<Type> funType = std::make_shared<FunctionType>(SysTypes::Number(), std::vector<std::shared_ptr<Type>>{numberType});
+    std::vector<std::shared_ptr<Symbol>> vars {std::make_shared<VarSymbol>("a", numberType), std::make_shared<VarSymbol>("b", numberType)};
+    auto sym = std::make_shared<FunctionSymbol>("f", funType, vars);
+    BCModule m;
+    uint8_t intIndex = m.consts.size();
+    m.consts.push_back(static_cast<int32_t>(100));
+    uint8_t stringIndex = m.consts.size();
+    m.consts.push_back(std::string("s"));
+    uint8_t funIndex = m.consts.size();
+    m.consts.push_back(sym);
+
+    auto verify = [&](const std::vector<uint8_t>& code, uint32_t& maxStackDepth) {
+        sym->byteCode = code;
+        BCVerifier verifier;
+        return verifier.verifyFunction(*sym, m.consts, maxStackDepth);
+    };
+
+    //a + 100 + f(a)，最大深度是2：a + 100的结果，加上a或者调用的返回值
+    uint32_t depth = 0;
+    EXPECT_TRUE(verify({OpCode::iload_0, OpCode::ldc, intIndex, OpCode::iadd,
+                        OpCode::iload_0, OpCode::invokestatic, 0, funIndex, OpCode::iadd, OpCode::ireturn}, depth));
+    EXPECT_EQ(depth, 2u);
+    EXPECT_NE(Disassemble(sym->byteCode).find("invokestatic " + std::to_string(funIndex)), std::string::npos);
+
+    //分支汇合的地方深度相同：if (a == 0) b = 1; else b = 2; return b;
+    EXPECT_TRUE(verify({OpCode::iload_0, OpCode::ifne, 0, 9, OpCode::iconst_1, OpCode::istore_1, OpCode::igoto, 0, 11,
+                        OpCode::iconst_2, OpCode::istore_1, OpCode::iload_1, OpCode::ireturn}, depth));
+    EXPECT_EQ(depth, 1u);
+
+    //常量的类型不对
+    EXPECT_FALSE(verify({OpCode::ldc, stringIndex, OpCode::ireturn}, depth));
+    EXPECT_FALSE(verify({OpCode::sldc, intIndex, OpCode::ireturn}, depth));
+    //调用的不是函数
+    EXPECT_FALSE(verify({OpCode::iload_0, OpCode::invokestatic, 0, intIndex, OpCode::ireturn}, depth));
+    //本地变量越界
+    EXPECT_FALSE(verify({OpCode::iload_2, OpCode::ireturn}, depth));
+    EXPECT_FALSE(verify({OpCode::iconst_0, OpCode::istore, 5, OpCode::vreturn}, depth));
+    //操作数越过代码的末尾
+    EXPECT_FALSE(verify({OpCode::iconst_0, OpCode::bipush}, depth));
+    //不认识的操作码
+    EXPECT_FALSE(verify({0xff, OpCode::vreturn}, depth));
+    //操作数栈弹空
+    EXPECT_FALSE(verify({OpCode::iconst_1, OpCode::iadd, OpCode::ireturn}, depth));
+    //跳到一条指令的中间
+    EXPECT_FALSE(verify({OpCode::igoto, 0, 4, OpCode::bipush, 1, OpCode::vreturn}, depth));
+    //执行到代码的末尾之外
+    EXPECT_FALSE(verify({OpCode::iconst_1, OpCode::istore_1}, depth));
+    //汇合的地方深度不同
+    EXPECT_FALSE(verify({OpCode::iload_0, OpCode::ifne, 0, 5, OpCode::iconst_1, OpCode::vreturn}, depth));
+
+    //没有通过校验的模块，虚拟机拒绝执行
+    sym->byteCode = {OpCode::iconst_1, OpCode::iadd, OpCode::ireturn};
+    m._main = sym;
+    VM vm;
+    EXPECT_EQ(vm.execute(m), -1);
+}
+
+TEST(VM, vm_invokenative)
+{
+    std::string program =
+R"(
+function label(n : number):string{
+    return "n=" + integer_to_string(n);
+}
+
+let t : number = tick();
+println(label(42));
+)";
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+    auto generator = BCGenerator();
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+
+    //内置函数的编号是固定的，不随built_ins的遍历顺序变化
+    EXPECT_EQ(GetBuiltinId(*built_ins["println"]), BuiltinId::Println);
+    EXPECT_EQ(GetBuiltinId(*built_ins["integer_to_string"]), BuiltinId::IntegerToString);
+    EXPECT_EQ(built_ins_by_id.size(), NativeFunctions().size());
+
+    //内置函数不在常量池里，调用点直接用编号
+    for (auto& c: bc->consts) {
+        auto sym = std::any_cast<std::shared_ptr<FunctionSymbol>>(&c);
+        EXPECT_TRUE(sym == nullptr || GetBuiltinId(**sym) == BuiltinId::None);
+    }
+    auto disassembly = Disassemble(bc->_main->byteCode);
+    EXPECT_NE(disassembly.find("invokenative 2 (tick)"), std::string::npos);
+    EXPECT_NE(disassembly.find("invokenative 1 (println)"), std::string::npos);
+
+    //栈式虚拟机、寄存器虚拟机，以及写到文件再读回来，结果都相同
+    auto run = [](const BCModule& m, bool useRegisterTier) {
+        VM vm;
+        vm.useRegisterTier = useRegisterTier;
+        testing::internal::CaptureStdout();
+        EXPECT_EQ(vm.execute(m), 0);
+        return testing::internal::GetCapturedStdout();
+    };
+    auto expect = run(*bc, false);
+    EXPECT_NE(expect.find("n=42"), std::string::npos);
+    EXPECT_EQ(run(*bc, true), expect);
+    auto hex = BCModuleWriter().write(*bc);
+    auto loaded = BCModuleReader().read(hex);
+    ASSERT_NE(loaded, nullptr);
+    EXPECT_EQ(run(*loaded, false), expect);
+
+    //不存在的编号，以及用invokestatic调用内置函数，都通不过校验
+    auto sym = bc->_main;
+    auto original = sym->byteCode;
+    sym->byteCode = {OpCode::invokenative, 0, OpCode::vreturn};
+    EXPECT_FALSE(BCVerifier().verify(*bc));
+    sym->byteCode = {OpCode::invokenative, 99, OpCode::vreturn};
+    EXPECT_FALSE(BCVerifier().verify(*bc));
+    bc->consts.push_back(built_ins["tick"]);
+    uint8_t index = static_cast<uint8_t>(bc->consts.size() - 1);
+    sym->byteCode = {OpCode::invokestatic, 0, index, OpCode::vreturn};
+    EXPECT_FALSE(BCVerifier().verify(*bc));
+    bc->consts.pop_back();
+    sym->byteCode = original;
+    EXPECT_TRUE(BCVerifier().verify(*bc));
+}
+
+TEST(VM, vm_branches)
+{
+    std::string program =
+R"(
+function fib(n : number):number{
+    if (n < 2) {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+function sign(x : number):string{
+    if (x > 0) return "+";
+    else if (x == 0) return "0";
+    return "-";
+}
+
+function count(n : number){
+    let c : number = 0;
+    for (let i : number = 0; i < n; i = i + 1)
+        for (let j : number = 0; j < n; j = j + 1)
+            if (i != j) c = c + 1;
+    println(c);
+}
+
+let total : number = 0;
+for (let i : number = 1; i <= 100; i = i + 1) {
+    total = total + i;
+}
+println(total);
+println(fib(15));
+println(sign(3) + sign(0) + sign(1 - 3));
+count(4);
+let d = 0.5;
+if (d) println("truthy");
+if (d < 1) println(d);
+
+function compare(x : number){
+    let b = x < 4;
+    println(b);
+    if (b) println("stored");
+    println(x >= 5);
+}
+compare(3);
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto interpretor = Interpretor();
+    testing::internal::CaptureStdout();
+    interpretor.visit(*ast, "");
+    auto expect = testing::internal::GetCapturedStdout();
+    for (auto line: {"5050", "610", "+0-", "12", "truthy", "0.5"}) {
+        EXPECT_NE(expect.find(line), std::string::npos);
+    }
+    //比较的结果作为值保存下来再打印，是布尔值
+    EXPECT_NE(expect.find(PrintedLines({"true", "stored", "false"})), std::string::npos);
+
+    auto generator = BCGenerator();
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+    EXPECT_TRUE(BCVerifier().verify(*bc));
+
+    //比较直接生成比较并跳转的指令，不再先算出1或0；与0比较时用if*
+    auto prog = std::dynamic_pointer_cast<Prog>(ast);
+    auto fib = Disassemble(std::dynamic_pointer_cast<FunctionDecl>(prog->stmts[0])->sym->byteCode);
+    Print(fib);
+    EXPECT_NE(fib.find("if_icmpge"), std::string::npos);
+    EXPECT_EQ(fib.find("igoto"), std::string::npos);
+    auto sign = Disassemble(std::dynamic_pointer_cast<FunctionDecl>(prog->stmts[1])->sym->byteCode);
+    EXPECT_NE(sign.find("ifle"), std::string::npos);
+    EXPECT_NE(sign.find("ifne"), std::string::npos);
+    //循环的条件放在循环体后面，每次迭代只有一条跳转指令
+    auto main = Disassemble(bc->_main->byteCode);
+    Print(main);
+    EXPECT_NE(main.find("if_icmple"), std::string::npos);
+    EXPECT_EQ(main.find("igoto"), main.rfind("igoto"));
+
+    //没有返回值的函数以循环结束，补上了vreturn
+    auto& count = std::dynamic_pointer_cast<FunctionDecl>(prog->stmts[2])->sym->byteCode;
+    EXPECT_EQ(count.back(), OpCode::vreturn);
+
+    //比较的结果作为值使用时，压入布尔值
+    auto compare = Disassemble(std::dynamic_pointer_cast<FunctionDecl>(prog->stmts[12])->sym->byteCode);
+    EXPECT_NE(compare.find("bconst_1"), std::string::npos);
+    EXPECT_NE(compare.find("bconst_0"), std::string::npos);
+
+    //栈式虚拟机、寄存器虚拟机（回退到栈式虚拟机），以及写到文件再读回来，结果都与解释器相同
+    auto run = [](const BCModule& m, bool useRegisterTier) {
+        VM vm;
+        vm.useRegisterTier = useRegisterTier;
+        testing::internal::CaptureStdout();
+        EXPECT_EQ(vm.execute(m), 0);
+        return testing::internal::GetCapturedStdout();
+    };
+    EXPECT_EQ(run(*bc, false), expect);
+    EXPECT_EQ(run(*bc, true), expect);
+    auto hex = BCModuleWriter().write(*bc);
+    auto loaded = BCModuleReader().read(hex);
+    ASSERT_NE(loaded, nullptr);
+    EXPECT_EQ(run(*loaded, false), expect);
+
+    //跳转目标不在指令的开头，通不过校验
+    auto original = bc->_main->byteCode;
+    bc->_main->byteCode = {OpCode::iconst_0, OpCode::ifeq, 0, 2, OpCode::vreturn};
+    EXPECT_FALSE(BCVerifier().verify(*bc));
+    bc->_main->byteCode = original;
+}
+
+TEST(VM, vm_iinc)
+{
+    std::string program =
+R"(
+function count(n : number):number{
+    let c : number = 0;
+    for (let i : number = 0; i < n; i++) {
+        c += 3;
+    }
+    return c;
+}
+
+let k : number = 5;
+let a = k++;
+let b = ++k;
+let c = --k;
+k -= 200;
+k += 1000;
+let d : decimal = 1.5;
+d++;
+d += 2;
+let s : string = "x";
+s += 1;
+println(a + b + c);
+println(k);
+println(d);
+println(s);
+println(-k);
+println(count(10));
+println(k++);
+println(--k);
+let e = k--;
+let f : number = ++k;
+println(e + f);
+println(count(k++ - 800));
+println(k);
+println(d++);
+println(--d);
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto interpretor = Interpretor();
+    testing::internal::CaptureStdout();
+    interpretor.visit(*ast, "");
+    auto expect = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(expect, PrintedLines({"18", "806", "4.5", "x1", "-806", "30", "806", "806", "1612", "18", "807", "4.5", "4.5"}));
+
+    auto generator = BCGenerator();
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+    EXPECT_TRUE(BCVerifier().verify(*bc));
+
+    //循环变量的i++和c += 3都是一条iinc，不再是iload、iconst、iadd、istore四条指令
+    auto prog = std::dynamic_pointer_cast<Prog>(ast);
+    auto count = Disassemble(std::dynamic_pointer_cast<FunctionDecl>(prog->stmts[0])->sym->byteCode);
+    Print(count);
+    EXPECT_NE(count.find("iinc 1 3"), std::string::npos);
+    EXPECT_NE(count.find("iinc 2 1"), std::string::npos);
+    EXPECT_EQ(count.find("iadd"), std::string::npos);
+    EXPECT_EQ(count.find("istore_2"), count.rfind("istore_2"));
+
+    //增量超出一个字节时用iinc_w；字符串的+=不能用iinc
+    auto main = Disassemble(bc->_main->byteCode);
+    Print(main);
+    EXPECT_NE(main.find("iinc_w 0 -200"), std::string::npos);
+    EXPECT_NE(main.find("iinc_w 0 1000"), std::string::npos);
+    EXPECT_NE(main.find("iadd"), std::string::npos);
+
+    auto run = [](const BCModule& m, bool useRegisterTier, bool useStackCache) {
+        VM vm;
+        vm.useRegisterTier = useRegisterTier;
+        vm.useStackCache = useStackCache;
+        testing::internal::CaptureStdout();
+        EXPECT_EQ(vm.execute(m), 0);
+        return testing::internal::GetCapturedStdout();
+    };
+    EXPECT_EQ(run(*bc, false, false), expect);
+    EXPECT_EQ(run(*bc, true, false), expect);
+    EXPECT_EQ(run(*bc, false, true), expect);
+    auto hex = BCModuleWriter().write(*bc);
+    auto loaded = BCModuleReader().read(hex);
+    ASSERT_NE(loaded, nullptr);
+    EXPECT_EQ(run(*loaded, false, false), expect);
+
+    //iinc的局部变量下标越界，通不过校验
+    auto original = bc->_main->byteCode;
+    bc->_main->byteCode = {OpCode::iinc, 200, 1, OpCode::vreturn};
+    EXPECT_FALSE(BCVerifier().verify(*bc));
+    bc->_main->byteCode = {OpCode::iinc_w, 0, 200, 0, 1, OpCode::vreturn};
+    EXPECT_FALSE(BCVerifier().verify(*bc));
+    bc->_main->byteCode = original;
+}
+
+TEST(VM, vm_stack_cache)
+{
+    std::string program =
+R"(
+function mix(a : number, b : number):number{
+    let s : number = a * 2 - a / 2 + b;
+    return s - a;
+}
+
+function fib(n : number):number{
+    if (n < 2) {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+function sum(n : number, acc : number):number{
+    if (n == 0) return acc;
+    return sum(n - 1, acc + n);
+}
+
+let total : number = 0;
+for (let i : number = 0; i < 20; i++) {
+    total += 1 + mix(i, 2) * (i - fib(5));
+}
+println(total);
+println(1 + fib(12));
+println(sum(100, 0));
+let d : decimal = 0.5;
+if (d < 1) println(3.14 * d * d - d / 2);
+let s : string = "a" + (2 + 3);
+s += "b";
+println(s);
+println(-total);
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto interpretor = Interpretor();
+    testing::internal::CaptureStdout();
+    interpretor.visit(*ast, "");
+    auto expect = testing::internal::GetCapturedStdout();
+    for (auto line: {"985\n", "145\n", "5050\n", "a5b\n", "-985\n"}) {
+        EXPECT_NE(expect.find(line), std::string::npos);
+    }
+
+    //使用和不使用超级指令的字节码，栈顶缓存的结果都与解释器相同
+    for (bool useSuperInstructions: {false, true}) {
+        auto generator = BCGenerator();
+        generator.useSuperInstructions = useSuperInstructions;
+        auto bc = std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+
+        VM vm;
+        vm.useStackCache = true;
+        testing::internal::CaptureStdout();
+        EXPECT_EQ(vm.execute(*bc), 0);
+        EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+
+        //同一个VM再执行一次，栈桢和缓存都重新开始
+        testing::internal::CaptureStdout();
+        EXPECT_EQ(vm.execute(*bc), 0);
+        EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+    }
+
+    //运行时错误与普通的主循环一样返回-2：整数减字符串，两个操作数都在缓存里
+    std::string error = "let s : string = \"x\";";
+    CharStream errorStream(error);
+    Scanner errorScanner(errorStream);
+    auto errorParser = Parser(errorScanner);
+    auto errorAst = errorParser.parseProg();
+    semanticAnalyer.execute(*errorAst);
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(BCGenerator().visit(*errorAst, ""));
+    ASSERT_EQ(bc->_main->byteCode[0], OpCode::sldc);
+    uint8_t stringIndex = bc->_main->byteCode[1];
+    bc->_main->byteCode = {OpCode::iconst_1, OpCode::sldc, stringIndex, OpCode::isub, OpCode::vreturn};
+    VM vm;
+    vm.useStackCache = true;
+    EXPECT_EQ(vm.execute(*bc), -2);
+}
+
+TEST(VM, vm_wide_operands)
+{
+    //超过256个本地变量
+    std::string program;
+    program += "let v0 : number = 1;\n";
+    for (uint32_t i = 1; i < 300; i++) {
+        program += "let v" + std::to_string(i) + " : number = v" + std::to_string(i - 1) + " + 1;\n";
+    }
+
+    //超过256个常量
+    program += "function consts():string{\n    let s : string = \"\";\n    let n : number = 0;\n";
+    for (uint32_t i = 0; i < 150; i++) {
+        program += "    s = \"k" + std::to_string(i) + "\";\n";
+        program += "    n = n + " + std::to_string(40000 + i) + ";\n";
+    }
+    program += "    return s + n;\n}\n";
+
+    //循环体的代码超过64KB
+    program += "function long(n : number):number{\n    let x : number = 0;\n";
+    program += "    for (let i : number = 0; i < n; i++) {\n";
+    for (uint32_t i = 0; i < 6000; i++) {
+        program += "        x = x + i * 2 - (x / 3 + 1) * 2;\n";
+    }
+    program += "    }\n    return x;\n}\n";
+
+    program += "function fib(n : number):number{\n    if (n < 2) return n;\n    return fib(n - 1) + fib(n - 2);\n}\n";
+    program += "println(v299 + v0);\nprintln(consts());\nprintln(long(3));\nprintln(fib(10));\n";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto interpretor = Interpretor();
+    testing::internal::CaptureStdout();
+    interpretor.visit(*ast, "");
+    auto expect = testing::internal::GetCapturedStdout();
+    for (auto line: {"301\n", "k1496011175\n", "55\n"}) {
+        EXPECT_NE(expect.find(line), std::string::npos);
+    }
+
+    auto run = [](const BCModule& m, bool useRegisterTier, bool useStackCache) {
+        VM vm;
+        vm.useRegisterTier = useRegisterTier;
+        vm.useStackCache = useStackCache;
+        testing::internal::CaptureStdout();
+        EXPECT_EQ(vm.execute(m), 0);
+        return testing::internal::GetCapturedStdout();
+    };
+
+    auto prog = std::dynamic_pointer_cast<Prog>(ast);
+    auto functionCode = [&](size_t index) -> std::vector<uint8_t>& {
+        return std::dynamic_pointer_cast<FunctionDecl>(prog->stmts[index])->sym->byteCode;
+    };
+    for (bool useSuperInstructions: {false, true}) {
+        auto generator = BCGenerator();
+        generator.useSuperInstructions = useSuperInstructions;
+        auto bc = std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+        EXPECT_TRUE(BCVerifier().verify(*bc));
+
+        //下标超过1个字节的iload、istore、sldc、ldc加上了wide前缀
+        auto main = Disassemble(bc->_main->byteCode);
+        EXPECT_NE(main.find("wide iload 298"), std::string::npos);
+        EXPECT_NE(main.find("wide istore 299"), std::string::npos);
+        auto consts = Disassemble(functionCode(300));
+        EXPECT_NE(consts.find("wide sldc"), std::string::npos);
+        EXPECT_NE(consts.find("wide ldc"), std::string::npos);
+
+        //超过64KB的函数，跳转指令都是wide形式，跳转目标是4个字节
+        auto& longCode = functionCode(301);
+        EXPECT_GT(longCode.size(), 0xffffu);
+        auto longText = Disassemble(longCode);
+        EXPECT_NE(longText.find("wide igoto"), std::string::npos);
+        EXPECT_NE(longText.find("wide if_icmplt"), std::string::npos);
+
+        //小函数的跳转指令仍然是紧凑的形式
+        auto fib = Disassemble(functionCode(302));
+        EXPECT_EQ(fib.find("wide"), std::string::npos);
+        EXPECT_NE(fib.find("if_icmpge"), std::string::npos);
+
+        //栈式虚拟机、栈顶缓存、寄存器虚拟机（回退到栈式虚拟机），以及写到文件再读回来，结果都与解释器相同
+        EXPECT_EQ(run(*bc, false, false), expect);
+        EXPECT_EQ(run(*bc, false, true), expect);
+        EXPECT_EQ(run(*bc, true, false), expect);
+        auto hex = BCModuleWriter().write(*bc);
+        auto loaded = BCModuleReader().read(hex);
+        ASSERT_NE(loaded, nullptr);
+        EXPECT_EQ(loaded->_main->byteCode, bc->_main->byteCode);
+        EXPECT_EQ(run(*loaded, false, false), expect);
+        EXPECT_EQ(run(*loaded, false, true), expect);
+    }
+
+    //wide后面是不能加宽的指令，或者加宽的下标越界，通不过校验
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(BCGenerator().visit(*ast, ""));
+    auto original = bc->_main->byteCode;
+    bc->_main->byteCode = {OpCode::iconst_1, OpCode::iconst_1, OpCode::wide, OpCode::iadd, OpCode::pop, OpCode::vreturn};
+    EXPECT_FALSE(BCVerifier().verify(*bc));
+    bc->_main->byteCode = {OpCode::wide, OpCode::iload, 0x10, 0, OpCode::pop, OpCode::vreturn};
+    EXPECT_FALSE(BCVerifier().verify(*bc));
+    bc->_main->byteCode = {OpCode::wide, OpCode::igoto, 0, 0, 0, 7, OpCode::vreturn};
+    EXPECT_FALSE(BCVerifier().verify(*bc));
+    bc->_main->byteCode = {OpCode::wide, OpCode::igoto, 0, 0, 0, 6, OpCode::vreturn};
+    EXPECT_TRUE(BCVerifier().verify(*bc));
+    bc->_main->byteCode = original;
+}
+
+TEST(VM, vm_runtime_strings)
+{
+    //循环里拼接出来的字符串不在字符串池里，比较时按内容比较
+    std::string program =
+R"(
+let s : string = "";
+let same : number = 0;
+for (let i : number = 0; i < 200; i++) {
+    s = "k" + i;
+    if (s == "k" + i) same++;
+    if (s != "k7") same++;
+}
+println(s);
+println(same);
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto interpretor = Interpretor();
+    testing::internal::CaptureStdout();
+    interpretor.visit(*ast, "");
+    auto expect = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(expect, PrintedLines({"k199", "399"}));
+
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(BCGenerator().visit(*ast, ""));
+    for (bool useStackCache: {false, true}) {
+        VM vm;
+        vm.useStackCache = useStackCache;
+        testing::internal::CaptureStdout();
+        EXPECT_EQ(vm.execute(*bc), 0);
+        EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+    }
+}
+
+TEST(VM, vm_shadowing_and_arguments)
+{
+    //for语句里的i与外面的i同名，占用不同的槽位；赋值表达式作为实参时，它的值就是实参
+    std::string program =
+R"(
+function f(x : number, y : number):number{
+    return x * 10 + y;
+}
+
+let i : number = 100;
+for (let i : number = 0; i < 3; i++) {
+}
+println(i);
+let a : number = 1;
+println(a = 7);
+println(a);
+println(f(a = 2, a + 1));
+let s : string = "x";
+println(s += "y");
+)";
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto expect = PrintedLines({"100", "7", "7", "23", "xy"});
+    auto interpretor = Interpretor();
+    testing::internal::CaptureStdout();
+    interpretor.visit(*ast, "");
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+
+    ClosureEngine engine;
+    testing::internal::CaptureStdout();
+    engine.run(*std::dynamic_pointer_cast<Prog>(ast));
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), expect);
+
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(BCGenerator().visit(*ast, ""));
+    EXPECT_TRUE(BCVerifier().verify(*bc));
+    auto run = [](const BCModule& m, bool useRegisterTier, bool useStackCache) {
+        VM vm;
+        vm.useRegisterTier = useRegisterTier;
+        vm.useStackCache = useStackCache;
+        testing::internal::CaptureStdout();
+        EXPECT_EQ(vm.execute(m), 0);
+        return testing::internal::GetCapturedStdout();
+    };
+    EXPECT_EQ(run(*bc, false, false), expect);
+    EXPECT_EQ(run(*bc, true, false), expect);
+    EXPECT_EQ(run(*bc, false, true), expect);
+    auto loaded = BCModuleReader().read(BCModuleWriter().write(*bc));
+    ASSERT_NE(loaded, nullptr);
+    EXPECT_EQ(run(*loaded, false, false), expect);
+}
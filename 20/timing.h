@@ -0,0 +1,41 @@
+#ifndef __TIMING_H_
+#define __TIMING_H_
+
+//
+// 计时工具
+// 内置函数tick()、cycles()，以及bench语句都基于这里的两个函数。
+// 各个执行引擎和汇编代码所链接的运行时（runtime.cpp）共用同一份实现，这样测出来的数据可以互相比较。
+//
+
+#include <chrono>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * 单调时钟，返回从第一次调用开始经过的纳秒数。
+ * 用decimal返回，因为number是32位整数，1秒就会溢出。
+ */
+inline double TickNanos() {
+    static const auto origin = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::now() - origin;
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+/**
+ * CPU的时间戳计数器（rdtsc），返回从第一次调用开始经过的周期数。
+ * 减去起点，是为了让数值保持在double能精确表示的范围内。
+ * 非x86平台没有rdtsc，退化为纳秒数。
+ */
+inline double CycleCount() {
+#if defined(__x86_64__) || defined(__i386__)
+    static const uint64_t origin = __rdtsc();
+    return static_cast<double>(__rdtsc() - origin);
+#else
+    return TickNanos();
+#endif
+}
+
+#endif
@@ -0,0 +1,271 @@
+//
+// 根据剖析数据生成超级指令
+// 用法：gen_superinstructions OUTPUT REPORT CORPUS...
+// 依次执行语料中的每个程序（生成字节码时不使用超级指令），用OpCodeProfile统计连续执行的指令对和三元组，
+// 以及每条指令的执行次数。然后贪心地挑选超级指令：每一轮把每个候选序列加进来试一下，
+// 用与窥孔优化相同的匹配规则重新划分语料的字节码，算出需要分派的次数，选能省掉最多分派的那个。
+// 候选序列互相重叠（比如 a b c 和 b c d），所以不能简单地把每个序列的执行次数加起来。
+// 最多挑选MaxSuperInstructions条，结果写到OUTPUT（也就是superinstructions.h）。
+// 挑选的依据写到REPORT（也就是superinstructions.txt）：剖析出的指令对和三元组，以及每一轮的候选和选择结果。
+// 超级指令的组成部分只能是IsFusibleOpCode()的指令。
+//
+#include "vm.h"
+#include "semantic.h"
+#include "parser.h"
+#include "common.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+static const size_t MaxSuperInstructions = 8;
+static const size_t MaxCandidates = 64;
+static const uint32_t FirstOpCode = 0xd0;
+
+//一个候选的指令序列
+struct Candidate{
+    std::vector<uint8_t> ops;
+
+    //连续执行的次数
+    uint64_t count {0};
+
+    //合并之后省掉的分派次数
+    uint64_t saved() const {
+        return this->count * (this->ops.size() - 1);
+    }
+
+    std::string name() const {
+        std::string ret;
+        for (auto op: this->ops) {
+            ret += (ret.empty() ? "" : " ") + toString(static_cast<OpCode>(op));
+        }
+        return ret;
+    }
+
+    //用于试算分派次数，操作码和名称用不到
+    SuperInstruction toSuperInstruction() const {
+        SuperInstruction superInst {OpCode::iconst_0, "", {}};
+        for (auto op: this->ops) {
+            superInst.components.push_back(static_cast<OpCode>(op));
+        }
+        return superInst;
+    }
+};
+
+//剖析过的一个函数：字节码，以及每个位置上的指令的执行次数
+struct ProfiledCode{
+    std::vector<uint8_t> code;
+    std::vector<uint64_t> counts;
+};
+
+//执行一个程序，把指令序列记录到profile里，每个函数的执行次数记录到codes里
+static bool Profile(const std::string& filename, OpCodeProfile& profile, std::vector<ProfiledCode>& codes) {
+    std::string program = ReadFile(filename);
+    if (program.empty()) {
+        return false;
+    }
+
+    CharStream charStream(program);
+    Scanner scanner(charStream);
+    auto parser = Parser(scanner);
+    auto ast = parser.parseProg();
+
+    SemanticAnalyer semanticAnalyer;
+    semanticAnalyer.execute(*ast);
+
+    auto generator = BCGenerator();
+    generator.useSuperInstructions = false;
+    auto bc = std::any_cast<std::shared_ptr<BCModule>>(generator.visit(*ast, ""));
+
+    VM vm;
+    vm.opCodeProfile = &profile;
+    if (vm.execute(*bc) != 0) {
+        return false;
+    }
+
+    //字节码的地址在这个模块释放之后会被重用，所以现在就取出来
+    for (auto& c: bc->consts) {
+        if (!isType<std::shared_ptr<FunctionSymbol>>(c)) {
+            continue;
+        }
+        auto& code = std::any_cast<const std::shared_ptr<FunctionSymbol>&>(c)->byteCode;
+        auto iter = profile.positions.find(code.data());
+        if (!code.empty() && iter != profile.positions.end()) {
+            codes.push_back(ProfiledCode{code, iter->second});
+        }
+    }
+    profile.positions.clear();
+    return true;
+}
+
+//使用一组超级指令之后，执行语料需要分派的次数
+static uint64_t Dispatches(const std::vector<ProfiledCode>& codes, const std::vector<SuperInstruction>& superInsts) {
+    uint64_t total = 0;
+    for (auto& c: codes) {
+        auto targets = JumpTargets(c.code);
+        uint32_t i = 0;
+        while (i < c.code.size() && InstructionLength(c.code, i) != 0) {
+            total += i < c.counts.size() ? c.counts[i] : 0;
+            uint32_t end = 0;
+            if (MatchSuperInstruction(c.code, i, targets, superInsts, end) != nullptr) {
+                i = end;
+            }
+            else {
+                i += InstructionLength(c.code, i);
+            }
+        }
+    }
+    return total;
+}
+
+static std::vector<Candidate> Collect(const std::unordered_map<uint32_t, uint64_t>& counts, uint32_t length) {
+    std::vector<Candidate> candidates;
+    for (auto& x: counts) {
+        Candidate candidate;
+        for (int32_t k = length - 1; k >= 0; k--) {
+            candidate.ops.push_back((x.first >> (k * 8)) & 0xff);
+        }
+        if (std::all_of(candidate.ops.begin(), candidate.ops.end(), IsFusibleOpCode)) {
+            candidate.count = x.second;
+            candidates.push_back(candidate);
+        }
+    }
+    return candidates;
+}
+
+//贪心地挑选超级指令，dispatches是使用挑选出的超级指令之后的分派次数，log记下每一轮的试算结果
+static std::vector<Candidate> Select(std::vector<Candidate> candidates, const std::vector<ProfiledCode>& codes, uint64_t& dispatches,
+                                     std::stringstream& log) {
+    //只在执行次数最多的一些序列里挑选
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        if (a.saved() != b.saved()) {
+            return a.saved() > b.saved();
+        }
+        return a.ops < b.ops;  //次数相同的时候，结果也要稳定
+    });
+    if (candidates.size() > MaxCandidates) {
+        candidates.resize(MaxCandidates);
+    }
+
+    char tmp[128] = {0};
+    log << "candidates (top " << candidates.size() << " by count * (length - 1)):\n";
+    for (auto& candidate: candidates) {
+        snprintf(tmp, sizeof(tmp), "%10llu %10llu  ", static_cast<unsigned long long>(candidate.count),
+                 static_cast<unsigned long long>(candidate.saved()));
+        log << tmp << candidate.name() << "\n";
+    }
+
+    std::vector<Candidate> selected;
+    std::vector<SuperInstruction> superInsts;
+    dispatches = Dispatches(codes, superInsts);
+    log << "\ndispatches without superinstructions: " << dispatches << "\n";
+    while (selected.size() < MaxSuperInstructions) {
+        //每个候选加进来之后的分派次数，按省掉的次数排序，报告里列出前几名
+        std::vector<std::pair<uint64_t, size_t>> trials;
+        for (size_t i = 0; i < candidates.size(); i++) {
+            superInsts.push_back(candidates[i].toSuperInstruction());
+            trials.push_back({Dispatches(codes, superInsts), i});
+            superInsts.pop_back();
+        }
+        std::sort(trials.begin(), trials.end());
+        if (trials.empty() || trials[0].first >= dispatches) {
+            log << "\nround " << selected.size() + 1 << ": no candidate saves any dispatch, stop\n";
+            break;
+        }
+
+        log << "\nround " << selected.size() + 1 << " (dispatches " << dispatches << "):\n";
+        for (size_t i = 0; i < trials.size() && i < 5; i++) {
+            snprintf(tmp, sizeof(tmp), "  %s %10llu %10llu  ", i == 0 ? "*" : " ",
+                     static_cast<unsigned long long>(trials[i].first), static_cast<unsigned long long>(dispatches - trials[i].first));
+            log << tmp << candidates[trials[i].second].name() << "\n";
+        }
+        size_t best = trials[0].second;
+        uint64_t bestDispatches = trials[0].first;
+
+        auto& chosen = candidates[best];
+        superInsts.push_back(chosen.toSuperInstruction());
+        selected.push_back(chosen);
+        candidates.erase(candidates.begin() + best);
+        dispatches = bestDispatches;
+    }
+    return selected;
+}
+
+static std::string Generate(const std::vector<Candidate>& selected, const std::vector<std::string>& corpus,
+                            const OpCodeProfile& profile, uint64_t dispatches, const std::string& report) {
+    std::stringstream ss;
+    ss << "#ifndef __SUPERINSTRUCTIONS_H_\n";
+    ss << "#define __SUPERINSTRUCTIONS_H_\n\n";
+    ss << "//\n";
+    ss << "// 超级指令列表，由tools/gen_superinstructions.cpp生成，不要手工修改。\n";
+    ss << "// 重新生成（在20/目录下）：\n";
+    ss << "//   cmake -S . -B build -DENABLE_TOOLS=ON && cmake --build build --target gen_superinstructions\n";
+    ss << "//   ./build/gen_superinstructions superinstructions.h superinstructions.txt corpus/*.ts\n";
+    ss << "//\n";
+    ss << "// 剖析语料：";
+    for (size_t i = 0; i < corpus.size(); i++) {
+        ss << (i == 0 ? "" : " ") << corpus[i];
+    }
+    ss << "\n";
+    ss << "// 语料执行的指令数：" << profile.numInsts << "，使用这些超级指令之后的分派次数：" << dispatches << "\n";
+    ss << "//\n";
+    ss << "// 每一项是 X(操作码, 名称, 组成指令...)，注释是这个指令序列在语料中连续执行的次数\n";
+    ss << "// 每一轮挑选时的试算结果见" << report << "\n";
+    ss << "//\n";
+    ss << "#define VM_SUPERINSTRUCTIONS(X)";
+
+    char tmp[16] = {0};
+    for (size_t i = 0; i < selected.size(); i++) {
+        std::string name;
+        std::string components;
+        for (auto op: selected[i].ops) {
+            auto opName = toString(static_cast<OpCode>(op));
+            name += name.empty() ? opName : "_" + opName;
+            components += ", " + opName;
+        }
+        snprintf(tmp, sizeof(tmp), "0x%02x", static_cast<uint32_t>(FirstOpCode + i));
+        ss << " \\\n    X(" << tmp << ", " << name << components << ")  /* " << selected[i].count << " */";
+    }
+    ss << "\n\n#endif\n";
+    return ss.str();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        printf("Usage: %s OUTPUT REPORT CORPUS...\n", argv[0]);
+        return 1;
+    }
+
+    OpCodeProfile profile;
+    std::vector<ProfiledCode> codes;
+    std::vector<std::string> corpus;
+    for (int i = 3; i < argc; i++) {
+        if (!Profile(argv[i], profile, codes)) {
+            fprintf(stderr, "failed to run %s\n", argv[i]);
+            return 1;
+        }
+        corpus.push_back(argv[i]);
+    }
+    std::stringstream log;
+    log << "corpus:";
+    for (auto& filename: corpus) {
+        log << " " << filename;
+    }
+    log << "\n\n" << profile.report(20) << "\n";
+
+    auto candidates = Collect(profile.pairs, 2);
+    auto triples = Collect(profile.triples, 3);
+    candidates.insert(candidates.end(), triples.begin(), triples.end());
+    uint64_t dispatches = 0;
+    auto selected = Select(candidates, codes, dispatches, log);
+
+    std::ofstream out(argv[1]);
+    std::ofstream report(argv[2]);
+    if (!out.is_open() || !report.is_open()) {
+        fprintf(stderr, "failed to open %s or %s\n", argv[1], argv[2]);
+        return 1;
+    }
+    out << Generate(selected, corpus, profile, dispatches, argv[2]);
+    report << log.str();
+    return 0;
+}
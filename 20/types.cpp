@@ -22,8 +22,8 @@ std::shared_ptr<Type> Type::getUpperBound(std::shared_ptr<Type>& type1, std::sha
             return type1;
         }
         else{
-            //return new UnionType([type1,type2]);
-            return SysTypes::Any();
+            std::vector<std::shared_ptr<Type>> types{type1, type2};
+            return std::make_shared<UnionType>(types);
         }
     }
     return nullptr;
@@ -70,24 +70,72 @@ bool SimpleType::LE(std::shared_ptr<Type>& type2) {
             return false;
         }
     }
-    // else if (Type.isUnionType(type2)){
-        // let t = type2 as UnionType;
-        // if (t.types.indexOf(this)!=-1){
-            // return true;
-        // }
-        // else{ //是联合类型中其中一个类型的子类型就行
-            // for (let t2 of t.types){
-                // if (this.LE(t2)){
-                    // return true;
-                // }
-            // }
-            // return false;
-        // }
-    // }
+    else if (type2->isUnionType()){
+        auto t = std::dynamic_pointer_cast<UnionType>(type2);
+        //是联合类型中其中一个类型的子类型就行
+        for (auto& t2: t->types){
+            if (this->LE(t2)){
+                return true;
+            }
+        }
+        return false;
+    }
+    else{
+        return false;
+    }
+}
+
+bool FunctionType::LE(std::shared_ptr<Type>& type2) {
+    if (*type2 == *SysTypes::Any()){
+         return true;
+    }
+    else if (*this == *type2){
+        return true;
+    }
+    else if (type2->isUnionType()){
+        auto t = std::dynamic_pointer_cast<UnionType>(type2);
+        auto equal = [&](const std::shared_ptr<Type>& type) {
+            return *this == *type;
+        };
+        return std::find_if(t->types.begin(), t->types.end(), equal) != t->types.end();
+    }
     else{
         return false;
     }
 }
 
+/**
+ * 联合类型的每个成员，都是type2（或type2的某个成员）的子类型。
+ */
+bool UnionType::LE(std::shared_ptr<Type>& type2) {
+    if (*type2 == *SysTypes::Any()){
+        return true;
+    }
+    else if (type2->isUnionType()){
+        auto t = std::dynamic_pointer_cast<UnionType>(type2);
+        for (auto& t1: this->types){
+            bool found = false;
+            for (auto& t2: t->types){
+                if (t1->LE(t2)){
+                    found = true;
+                    break;
+                }
+            }
+            if (!found){
+                return false;
+            }
+        }
+        return true;
+    }
+    else{
+        //所有成员都是type2的子类型
+        for (auto& t1: this->types){
+            if (!t1->LE(type2)){
+                return false;
+            }
+        }
+        return !this->types.empty();
+    }
+}
 
 int32_t FunctionType::index = {0};
@@ -23,6 +23,7 @@
 #define __TYPES_H_
 
 #include <stdint.h>
+#include <algorithm>
 #include <string>
 #include <any>
 #include <vector>
@@ -46,6 +47,7 @@ public:
 
     virtual bool isSimpleType() = 0;
     virtual bool isFunctionType() = 0;
+    virtual bool isUnionType() = 0;
 
     virtual  bool LE(std::shared_ptr<Type>& type2) = 0;
 
@@ -79,6 +81,9 @@ public:
     bool isFunctionType() override {
         return false;
     }
+    bool isUnionType() override {
+        return false;
+    }
 
     bool LE(std::shared_ptr<Type>& type2) override;
 };
@@ -146,7 +151,7 @@ public:
         return type;
     }
 
-    static isSysType(const std::shared_ptr<Type>& t){
+    static bool isSysType(const std::shared_ptr<Type>& t){
         return *t == *SysTypes::Any()     || *t == *SysTypes::String()  || *t == *SysTypes::Number() ||
                *t == *SysTypes::Boolean() || *t == *SysTypes::Null()    || *t == *SysTypes::Undefined() ||
                *t == *SysTypes::Void()    || *t == *SysTypes::Integer() || *t == *SysTypes::Decimal();
@@ -181,6 +186,9 @@ public:
     bool isFunctionType() override {
         return true;
     }
+    bool isUnionType() override {
+        return false;
+    }
 
     std::string toString() override {
         std::string paramTypeNames = "[";
@@ -191,28 +199,70 @@ public:
         return "FunctionType {name: " + this->name + ", returnType: " + this->returnType->name + ", paramTypes: " + paramTypeNames+ "}";
     }
 
-    bool LE(std::shared_ptr<Type>& type2) override {
-        if (*type2 == *SysTypes::Any()){
-             return true;
-        }
-        else if (*this == *type2){
-            return true;
+    bool LE(std::shared_ptr<Type>& type2) override;
+};
+
+/**
+ * 联合类型，比如 number|string
+ * 成员类型按名称排序、去重，名称由成员类型的名称用'|'连接而成，
+ * 这样两个成员相同的联合类型就是相等的，与成员的书写顺序无关。
+ */
+class UnionType: public Type{
+public:
+    std::vector<std::shared_ptr<Type>> types;
+
+    UnionType(const std::vector<std::shared_ptr<Type>>& types): Type(""){
+        this->setTypes(types);
+    }
+
+    /**
+     * 设置成员类型：按名称排序并去掉重复的成员，名称总是由成员生成。
+     * 所以成员的书写顺序不同、有重复成员的联合类型，成员和名称都相同。
+     */
+    void setTypes(const std::vector<std::shared_ptr<Type>>& types) {
+        this->types = types;
+        std::sort(this->types.begin(), this->types.end(), [](const std::shared_ptr<Type>& a, const std::shared_ptr<Type>& b) {
+            return a->name < b->name;
+        });
+        this->types.erase(std::unique(this->types.begin(), this->types.end(), [](const std::shared_ptr<Type>& a, const std::shared_ptr<Type>& b) {
+            return a->name == b->name;
+        }), this->types.end());
+
+        this->name = "";
+        for (auto& t: this->types){
+            this->name += (this->name.empty() ? "" : "|") + t->name;
         }
-        // else if (Type.isUnionType(type2)){
-            // let t = type2 as UnionType;
-            // if (t.types.indexOf(this)!=-1){
-                // return true;
-            // }
-            // else{
-                // return false;
-            // }
-        // }
-        else{
-            return false;
+    }
+
+    bool hasVoid() override {
+        for (auto& t: this->types){
+            if (t->hasVoid()){
+                return true;
+            }
         }
+        return false;
+    }
 
+    bool isSimpleType() override {
+        return false;
+    }
+    bool isFunctionType() override {
         return false;
     }
+    bool isUnionType() override {
+        return true;
+    }
+
+    std::string toString() override {
+        std::string typeNames = "[";
+        for (auto ut: this->types){
+            typeNames += ut->name +", ";
+        }
+        typeNames += "]";
+        return "UnionType {name: " + this->name + ", types: " + typeNames + "}";
+    }
+
+    bool LE(std::shared_ptr<Type>& type2) override;
 };
 
 #endif
@@ -0,0 +1,31 @@
+#include "value.h"
+#include "symbol.h"
+
+#include <unordered_map>
+
+const StringObject* StringPool::intern(const std::string& str) {
+    //池持有新建对象的那个引用，永远不会减少，所以这些字符串不会被释放
+    static std::unordered_map<std::string, const StringObject*> pool;
+    auto& obj = pool[str];
+    if (obj == nullptr) {
+        obj = new StringObject(str);
+    }
+    return obj;
+}
+
+std::string Value::toString() const {
+    switch (this->tag) {
+        case ValueTag::Integer:
+            return ValueToString(this->i);
+        case ValueTag::Decimal:
+            return ValueToString(this->d);
+        case ValueTag::Boolean:
+            return ValueToString(this->b);
+        case ValueTag::String:
+            return *this->s;
+        case ValueTag::Function:
+            return "function " + this->f->name;
+        default:
+            return "undefined";
+    }
+}
@@ -0,0 +1,158 @@
+#ifndef __VALUE_H_
+#define __VALUE_H_
+
+#include "common.h"
+
+#include <string>
+#include <stdint.h>
+
+class FunctionSymbol;
+
+//
+// 字符串对象
+// 运行时值里只存放一个指针，字符串本身在堆上，带一个引用计数，由Value的拷贝、赋值和析构维护，
+// 计数减到0时释放。运行时拼接、转换出来的字符串都是这样，循环里反复生成字符串，内存也不会一直增长。
+//
+struct StringObject: public std::string {
+    //新建的对象的计数是1，归创建者所有
+    mutable uint32_t refCount {1};
+
+    explicit StringObject(std::string str): std::string(std::move(str)) {}
+};
+
+//
+// 字符串池
+// 字符串字面量和常量池里的字符串，相同内容只保存一份，加载常量时不需要分配内存。
+// 池本身持有每个字符串的一个引用，所以池中的字符串在程序运行期间不会被释放。
+// 运行时生成的字符串不进入字符串池，所以比较字符串要比较内容，不能只比较指针。
+//
+class StringPool{
+public:
+    static const StringObject* intern(const std::string& str);
+};
+
+//
+// 树遍历解释器的运行时值
+// 一个字节的类型标签，加上8个字节的联合体，一共16个字节，可以直接按值传递。
+// 比较类型只需要比较标签，计算表达式的过程中也不需要在堆上分配内存（生成新的字符串除外）。
+// 字符串是引用计数的，拷贝、赋值和析构时只有标签是String的值才需要修改计数。
+//
+struct Value{
+    ValueTag tag {ValueTag::Undefined};
+    union {
+        int32_t i;
+        double d;
+        bool b;
+        const StringObject* s;   //字符串，引用计数的
+        FunctionSymbol* f;       //函数的引用
+        uint64_t bits;           //拷贝时整体复制
+    };
+
+    Value(): bits(0) {}
+    Value(int32_t v): tag(ValueTag::Integer), i(v) {}
+    Value(double v): tag(ValueTag::Decimal), d(v) {}
+    Value(bool v): tag(ValueTag::Boolean), b(v) {}
+    //运行时生成的字符串
+    Value(std::string v): tag(ValueTag::String), s(new StringObject(std::move(v))) {}
+    Value(const char* v): tag(ValueTag::String), s(new StringObject(v)) {}
+    //字符串池里的字符串，见StringPool::intern()
+    Value(const StringObject* v): tag(ValueTag::String), s(v) {
+        this->retain();
+    }
+    Value(FunctionSymbol* v): tag(ValueTag::Function), f(v) {}
+
+    Value(const Value& other): tag(other.tag), bits(other.bits) {
+        this->retain();
+    }
+
+    Value(Value&& other) noexcept: tag(other.tag), bits(other.bits) {
+        other.tag = ValueTag::Undefined;
+    }
+
+    Value& operator=(const Value& other) {
+        //先增加计数再释放，自己给自己赋值时也不会提前释放
+        other.retain();
+        this->release();
+        this->tag = other.tag;
+        this->bits = other.bits;
+        return *this;
+    }
+
+    Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            this->release();
+            this->tag = other.tag;
+            this->bits = other.bits;
+            other.tag = ValueTag::Undefined;
+        }
+        return *this;
+    }
+
+    ~Value() {
+        this->release();
+    }
+
+    bool isUndefined() const {
+        return this->tag == ValueTag::Undefined;
+    }
+
+    //作为if、for的条件时是否成立：false、0、0.0、空字符串和undefined不成立，其他的值成立
+    bool isTruthy() const {
+        switch (this->tag) {
+            case ValueTag::Boolean:
+                return this->b;
+            case ValueTag::Integer:
+                return this->i != 0;
+            case ValueTag::Decimal:
+                return this->d != 0.0;
+            case ValueTag::String:
+                return !this->s->empty();
+            case ValueTag::Function:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    std::string toString() const;
+
+private:
+    void retain() const {
+        if (this->tag == ValueTag::String) {
+            this->s->refCount++;
+        }
+    }
+
+    void release() {
+        if (this->tag == ValueTag::String && --this->s->refCount == 0) {
+            delete this->s;
+        }
+    }
+};
+
+static_assert(sizeof(Value) == 16, "Value should be 16 bytes");
+
+//按C++类型取出Value中的值，调用者需要先检查标签
+template<typename T>
+T ValueAs(const Value& v) {
+    if constexpr (std::is_same_v<T, int32_t>) {
+        return v.i;
+    } else if constexpr (std::is_same_v<T, double>) {
+        return v.d;
+    } else if constexpr (std::is_same_v<T, bool>) {
+        return v.b;
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        return *v.s;
+    } else {
+        static_assert(std::is_same_v<T, FunctionSymbol*>, "unsupported Value type");
+        return v.f;
+    }
+}
+
+//让common.h中的二元运算模板（PlusIntInt等）也能用于Value
+template<typename T>
+T Unbox(const Value& v) {
+    return ValueAs<T>(v);
+}
+
+#endif
@@ -1,125 +1,670 @@
 #include "vm.h"
 
-std::map<OpCode, std::string> opCodeToString = {
-    {OpCode::iconst_0    ,           "iconst_0"    },
-    {OpCode::iconst_1    ,           "iconst_1"    },
-    {OpCode::iconst_2    ,           "iconst_2"    },
-    {OpCode::iconst_3    ,           "iconst_3"    },
-    {OpCode::iconst_4    ,           "iconst_4"    },
-    {OpCode::iconst_5    ,           "iconst_5"    },
-    {OpCode::bipush      ,           "bipush"      },
-    {OpCode::sipush      ,           "sipush"      },
-    {OpCode::ldc         ,           "ldc"         },
-    {OpCode::iload       ,           "iload"       },
-    {OpCode::iload_0     ,           "iload_0"     },
-    {OpCode::iload_1     ,           "iload_1"     },
-    {OpCode::iload_2     ,           "iload_2"     },
-    {OpCode::iload_3     ,           "iload_3"     },
-    {OpCode::istore      ,           "istore"      },
-    {OpCode::istore_0    ,           "istore_0"    },
-    {OpCode::istore_1    ,           "istore_1"    },
-    {OpCode::istore_2    ,           "istore_2"    },
-    {OpCode::istore_3    ,           "istore_3"    },
-    {OpCode::iadd        ,           "iadd"        },
-    {OpCode::isub        ,           "isub"        },
-    {OpCode::imul        ,           "imul"        },
-    {OpCode::idiv        ,           "idiv"        },
-    {OpCode::iinc        ,           "iinc"        },
-    {OpCode::lcmp        ,           "lcmp"        },
-    {OpCode::ifeq        ,           "ifeq"        },
-    {OpCode::ifne        ,           "ifne"        },
-    {OpCode::iflt        ,           "iflt"        },
-    {OpCode::ifge        ,           "ifge"        },
-    {OpCode::ifgt        ,           "ifgt"        },
-    {OpCode::ifle        ,           "ifle"        },
-    {OpCode::if_icmpeq   ,           "if_icmpeq"   },
-    {OpCode::if_icmpne   ,           "if_icmpne"   },
-    {OpCode::if_icmplt   ,           "if_icmplt"   },
-    {OpCode::if_icmpge   ,           "if_icmpge"   },
-    {OpCode::if_icmpgt   ,           "if_icmpgt"   },
-    {OpCode::if_icmple   ,           "if_icmple"   },
-    {OpCode::igoto       ,           "igoto"       },
-    {OpCode::ireturn     ,           "ireturn"     },
-    {OpCode::vreturn     ,           "vreturn"     },
-    {OpCode::invokestatic,           "invokestatic"},
-
-    {OpCode::sadd        ,           "sadd"        },
-    {OpCode::sldc        ,           "sldc"        },
-};
+#include <algorithm>
+#include <set>
+#include <sstream>
 
 std::string toString(OpCode op) {
-    auto iter = opCodeToString.find(op);
-    if (iter == opCodeToString.end()) {
+    auto name = OpCodeInfos[static_cast<uint8_t>(op)].name;
+    if (name == nullptr) {
         char tmp[8] = {0};
         snprintf(tmp, sizeof(tmp), "%02x", static_cast<uint8_t>(op));
         return std::string(tmp);
     }
 
-    return iter->second;
+    return name;
 }
 
-std::map<OpCode,
-        std::map<std::type_index,
-            std::map<std::type_index,
-                VM::BinaryFunction>>> VM::binaryOp = {
+const std::vector<SuperInstruction>& SuperInstructions() {
+    static const std::vector<SuperInstruction> superInsts = {
+#define VM_SUPERINSTRUCTION_INFO(value, name, ...) {OpCode::name, #name, {__VA_ARGS__}},
+        VM_SUPERINSTRUCTIONS(VM_SUPERINSTRUCTION_INFO)
+#undef VM_SUPERINSTRUCTION_INFO
+    };
+    return superInsts;
+}
+
+const SuperInstruction* FindSuperInstruction(uint8_t op) {
+    for (auto& superInst: SuperInstructions()) {
+        if (superInst.op == op) {
+            return &superInst;
+        }
+    }
+    return nullptr;
+}
+
+bool IsFusibleOpCode(uint8_t op) {
+    return (op >= OpCode::iconst_0 && op <= OpCode::iconst_5) ||
+           op == OpCode::dconst_0 || op == OpCode::dconst_1 ||
+           op == OpCode::bconst_0 || op == OpCode::bconst_1 ||
+           op == OpCode::bipush || op == OpCode::sipush ||
+           op == OpCode::ldc || op == OpCode::ldc2_w || op == OpCode::sldc ||
+           op == OpCode::iload || (op >= OpCode::iload_0 && op <= OpCode::iload_3) ||
+           op == OpCode::istore || (op >= OpCode::istore_0 && op <= OpCode::istore_3) || op == OpCode::iinc ||
+           op == OpCode::iadd || op == OpCode::sadd || op == OpCode::isub || op == OpCode::imul || op == OpCode::idiv ||
+           op == OpCode::dadd || op == OpCode::dsub || op == OpCode::dmul || op == OpCode::ddiv;
+}
+
+//改写一个函数的字节码：rewrite把每条（或几条）指令写到新的代码里，返回消耗的字节数。
+//最后按照新旧位置的对应关系修正跳转指令的目标
+template<typename F>
+static std::vector<uint8_t> RewriteCode(const std::vector<uint8_t>& code, F&& rewrite) {
+    std::vector<uint8_t> ret;
+    std::vector<uint32_t> newIndex(code.size() + 1, 0);
+    uint32_t i = 0;
+    while (i < code.size()) {
+        newIndex[i] = ret.size();
+        uint32_t length = rewrite(i, ret);
+        if (length == 0) {
+            dbg("Error: unrecognized op code " + toString(static_cast<OpCode>(code[i])) + " at: " + std::to_string(i));
+            return code;
+        }
+        i += length;
+    }
+    newIndex[code.size()] = ret.size();
+
+    //跳转指令不会被合并，所以在新代码里都有对应的位置
+    for (uint32_t j = 0; j < code.size(); j += InstructionLength(code, j)) {
+        if (IsJump(code, j)) {
+            SetJumpTarget(ret, newIndex[j], newIndex[std::min<uint32_t>(JumpTarget(code, j), code.size())]);
+        }
+    }
+    return ret;
+}
+
+std::set<uint32_t> JumpTargets(const std::vector<uint8_t>& code) {
+    std::set<uint32_t> targets;
+    for (uint32_t i = 0; i < code.size() && InstructionLength(code, i) != 0; i += InstructionLength(code, i)) {
+        if (IsJump(code, i) && i + InstructionLength(code, i) <= code.size()) {
+            targets.insert(JumpTarget(code, i));
+        }
+    }
+    return targets;
+}
+
+const SuperInstruction* MatchSuperInstruction(const std::vector<uint8_t>& code, uint32_t index, const std::set<uint32_t>& targets,
+                                              const std::vector<SuperInstruction>& superInsts, uint32_t& end) {
+    const SuperInstruction* best = nullptr;
+    for (auto& superInst: superInsts) {
+        if (best != nullptr && superInst.components.size() <= best->components.size()) {
+            continue;
+        }
+        uint32_t j = index;
+        bool matched = true;
+        for (size_t k = 0; k < superInst.components.size(); k++) {
+            if (j >= code.size() || code[j] != superInst.components[k] || (k > 0 && targets.count(j) != 0)) {
+                matched = false;
+                break;
+            }
+            j += OpCodeLength(code[j]);
+        }
+        if (matched && j <= code.size()) {
+            best = &superInst;
+            end = j;
+        }
+    }
+    return best;
+}
+
+std::vector<uint8_t> FuseSuperInstructions(const std::vector<uint8_t>& code) {
+    if (SuperInstructions().empty()) {
+        return code;
+    }
+
+    auto targets = JumpTargets(code);
+    return RewriteCode(code, [&](uint32_t i, std::vector<uint8_t>& ret) {
+        uint32_t end = 0;
+        auto superInst = MatchSuperInstruction(code, i, targets, SuperInstructions(), end);
+        if (superInst == nullptr) {
+            uint32_t length = InstructionLength(code, i);
+            if (length != 0 && i + length <= code.size()) {
+                ret.insert(ret.end(), code.begin() + i, code.begin() + i + length);
+            }
+            return length;
+        }
+
+        //超级指令的操作码，后面是各条组成指令的操作数
+        ret.push_back(superInst->op);
+        for (uint32_t j = i; j < end; j += OpCodeLength(code[j])) {
+            ret.insert(ret.end(), code.begin() + j + 1, code.begin() + j + OpCodeLength(code[j]));
+        }
+        return end - i;
+    });
+}
+
+std::vector<uint8_t> ExpandSuperInstructions(const std::vector<uint8_t>& code) {
+    return RewriteCode(code, [&](uint32_t i, std::vector<uint8_t>& ret) {
+        uint32_t length = InstructionLength(code, i);
+        if (length == 0 || i + length > code.size()) {
+            return 0u;
+        }
+
+        auto superInst = FindSuperInstruction(code[i]);
+        if (superInst == nullptr) {
+            ret.insert(ret.end(), code.begin() + i, code.begin() + i + length);
+            return length;
+        }
+
+        //把操作数分给各条组成指令
+        uint32_t operand = i + 1;
+        for (auto component: superInst->components) {
+            uint32_t numOperands = OpCodeLength(component) - 1;
+            ret.push_back(component);
+            ret.insert(ret.end(), code.begin() + operand, code.begin() + operand + numOperands);
+            operand += numOperands;
+        }
+        return length;
+    });
+}
+
+std::vector<uint8_t> NarrowJumps(const std::vector<uint8_t>& code) {
+    //所有跳转指令都改成紧凑形式之后的长度，每条少3个字节
+    size_t size = code.size();
+    for (uint32_t i = 0; i < code.size() && InstructionLength(code, i) != 0; i += InstructionLength(code, i)) {
+        if (code[i] == OpCode::wide && IsJump(code, i)) {
+            size -= 3;
+        }
+    }
+    if (size == code.size() || size > 0xffff) {
+        return code;
+    }
+
+    return RewriteCode(code, [&](uint32_t i, std::vector<uint8_t>& ret) {
+        uint32_t length = InstructionLength(code, i);
+        if (length == 0 || i + length > code.size()) {
+            return 0u;
+        }
+        if (code[i] == OpCode::wide && IsJump(code, i)) {
+            //跳转目标由RewriteCode修正
+            ret.insert(ret.end(), {code[i + 1], 0, 0});
+        }
+        else {
+            ret.insert(ret.end(), code.begin() + i, code.begin() + i + length);
+        }
+        return length;
+    });
+}
+
+//一条基本指令的操作数，按OpCodeInfo::operand解码
+static std::string OperandToString(uint8_t op, const uint8_t* operand) {
+    switch (OpCodeInfos[op].operand) {
+        case OperandKind::None:
+            return "";
+        case OperandKind::Int8:
+            return std::to_string(static_cast<int8_t>(operand[0]));
+        case OperandKind::Int16:
+            return std::to_string(static_cast<int16_t>(operand[0] << 8 | operand[1]));
+        case OperandKind::Local:
+        case OperandKind::IntConst:
+        case OperandKind::StringConst:
+            return std::to_string(operand[0]);
+        case OperandKind::LocalDelta:
+            return std::to_string(operand[0]) + " " + std::to_string(static_cast<int8_t>(operand[1]));
+        case OperandKind::LocalDeltaWide:
+            return std::to_string(operand[0] << 8 | operand[1]) + " " + std::to_string(static_cast<int16_t>(operand[2] << 8 | operand[3]));
+        case OperandKind::Native:
+            return operand[0] < built_ins_by_id.size() && operand[0] != 0 ?
+                std::to_string(operand[0]) + " (" + built_ins_by_id[operand[0]]->name + ")" : std::to_string(operand[0]);
+        default:
+            return std::to_string(operand[0] << 8 | operand[1]);
+    }
+}
+
+std::string Disassemble(const std::vector<uint8_t>& code) {
+    std::stringstream ss;
+    char tmp[16] = {0};
+    uint32_t i = 0;
+    while (i < code.size()) {
+        uint8_t op = code[i];
+        uint32_t length = InstructionLength(code, i);
+        snprintf(tmp, sizeof(tmp), "%6u: ", i);
+        ss << tmp << toString(static_cast<OpCode>(op));
+        if (length == 0 || i + length > code.size()) {
+            ss << " <bad op code>\n";
+            break;
+        }
+
+        auto superInst = FindSuperInstruction(op);
+        if (op == OpCode::wide) {
+            ss << " " << toString(static_cast<OpCode>(code[i + 1])) << " " << ReadOperand(&code[i + 2], WideOperandBytes(code[i + 1]));
+        }
+        else if (superInst == nullptr) {
+            auto operand = OperandToString(op, &code[i + 1]);
+            ss << (operand.empty() ? "" : " " + operand);
+        }
+        else {
+            //超级指令：按组成指令显示操作数
+            uint32_t operand = i + 1;
+            ss << " {";
+            for (size_t k = 0; k < superInst->components.size(); k++) {
+                auto component = superInst->components[k];
+                auto str = OperandToString(component, &code[operand]);
+                ss << (k == 0 ? "" : "; ") << toString(component) << (str.empty() ? "" : " " + str);
+                operand += OpCodeLength(component) - 1;
+            }
+            ss << "}";
+        }
+        ss << "\n";
+        i += length;
+    }
+    return ss.str();
+}
+
+bool ReturnsValue(FunctionSymbol& sym) {
+    auto& code = sym.byteCode;
+    if (code.empty()) {
+        return !sym.theType->hasVoid();
+    }
+
+    uint32_t i = 0;
+    while (i < code.size()) {
+        if (code[i] == OpCode::ireturn || code[i] == OpCode::invoketail) {
+            return true;
+        }
+        auto length = InstructionLength(code, i);
+        if (length == 0) {
+            return false;
+        }
+        i += length;
+    }
+    return false;
+}
+
+bool BCVerifier::fail(FunctionSymbol& sym, uint32_t index, const std::string& msg) {
+    this->error = "Verify error: " + msg + " in " + sym.name + " at: " + std::to_string(index);
+    dbg(this->error);
+    return false;
+}
+
+bool BCVerifier::verifyFunction(FunctionSymbol& sym, const std::vector<std::any>& consts, uint32_t& maxStackDepth) {
+    auto& code = sym.byteCode;
+    uint32_t numVars = static_cast<uint32_t>(sym.vars.size());
+    if (code.empty()) {
+        return this->fail(sym, 0, "empty code");
+    }
+
+    //1.找出每条指令的开头
+    std::vector<bool> starts(code.size(), false);
+    uint32_t i = 0;
+    while (i < code.size()) {
+        uint32_t length = InstructionLength(code, i);
+        if (length == 0 && code[i] == OpCode::wide) {
+            return this->fail(sym, i, "bad wide prefix");
+        }
+        if (length == 0) {
+            return this->fail(sym, i, "unknown op code " + toString(static_cast<OpCode>(code[i])));
+        }
+        if (i + length > code.size()) {
+            return this->fail(sym, i, "operand out of code");
+        }
+        //快速指令只由虚拟机在自己的代码副本里改写出来
+        uint8_t op = code[i] == OpCode::wide ? code[i + 1] : code[i];
+        if (OpCodeInfos[op].isQuick) {
+            return this->fail(sym, i, "quickened op code in module: " + toString(static_cast<OpCode>(op)));
+        }
+        starts[i] = true;
+        i += length;
+    }
+
+    //2.检查一条基本指令的操作数，计算执行之后操作数栈的深度。wide表示指令带wide前缀，操作数是加宽的
+    int32_t maxDepth = 0;
+    auto execute = [&](uint8_t op, const uint8_t* operand, bool wide, uint32_t index, int32_t& depth) {
+        auto& info = OpCodeInfos[op];
+        int32_t pops = info.pops;
+        int32_t pushes = info.pushes;
+        //没有操作数的指令可能是代码的最后一个字节，不能去读operand；iinc_w只取前2个字节的下标
+        uint32_t value = wide ? ReadOperand(operand, WideOperandBytes(op)) : ReadOperand(operand, std::min<uint32_t>(OperandBytes(info.operand), 2));
+        switch (info.operand) {
+            case OperandKind::Local:
+                if (value >= numVars) {
+                    return this->fail(sym, index, "local index out of range: " + std::to_string(value));
+                }
+                break;
+            case OperandKind::LocalDelta:
+                if (operand[0] >= numVars) {
+                    return this->fail(sym, index, "local index out of range: " + std::to_string(operand[0]));
+                }
+                break;
+            case OperandKind::LocalDeltaWide:
+                if (value >= numVars) {
+                    return this->fail(sym, index, "local index out of range: " + std::to_string(value));
+                }
+                break;
+            case OperandKind::IntConst:
+            case OperandKind::StringConst:
+            case OperandKind::DecimalConst:
+            {
+                ValueTag expected = info.operand == OperandKind::IntConst ? ValueTag::Integer :
+                    (info.operand == OperandKind::StringConst ? ValueTag::String : ValueTag::Decimal);
+                if (value >= consts.size() || VM::ToValue(consts[value]).tag != expected) {
+                    return this->fail(sym, index, toString(static_cast<OpCode>(op)) + " value type mismatch, const index: " + std::to_string(value));
+                }
+                break;
+            }
+            case OperandKind::Function:
+            {
+                auto callee = value < consts.size() ? std::any_cast<std::shared_ptr<FunctionSymbol>>(&consts[value]) : nullptr;
+                if (callee == nullptr) {
+                    return this->fail(sym, index, "call target is not a function, const index: " + std::to_string(value));
+                }
+                //内置函数要用invokenative调用
+                if ((*callee)->byteCode.empty()) {
+                    return this->fail(sym, index, "can not find code for " + (*callee)->name);
+                }
+                pops = (*callee)->getNumParams();
+                pushes = op == OpCode::invokestatic && ReturnsValue(**callee) ? 1 : 0;
+                break;
+            }
+            case OperandKind::Native:
+            {
+                if (value == 0 || value >= built_ins_by_id.size() || value >= NativeFunctions().size()) {
+                    return this->fail(sym, index, "unknown built-in function: " + std::to_string(value));
+                }
+                auto& callee = built_ins_by_id[value];
+                pops = callee->getNumParams();
+                pushes = ReturnsValue(*callee) ? 1 : 0;
+                break;
+            }
+            case OperandKind::Jump:
+                if (value >= code.size() || !starts[value]) {
+                    return this->fail(sym, index, "bad jump target: " + std::to_string(value));
+                }
+                break;
+            default:
+                break;
+        }
+        if ((op >= OpCode::iload_0 && op <= OpCode::iload_3 && static_cast<uint32_t>(op - OpCode::iload_0) >= numVars) ||
+            (op >= OpCode::istore_0 && op <= OpCode::istore_3 && static_cast<uint32_t>(op - OpCode::istore_0) >= numVars)) {
+            return this->fail(sym, index, "local index out of range: " + toString(static_cast<OpCode>(op)));
+        }
+
+        if (depth < pops) {
+            return this->fail(sym, index, "operand stack underflow");
+        }
+        depth += pushes - pops;
+        maxDepth = std::max(maxDepth, depth);
+        return true;
+    };
+
+    //3.沿着所有执行路径模拟操作数栈的深度，depths是每条指令开始执行时的深度，-1表示还没有访问过
+    std::vector<int32_t> depths(code.size(), -1);
+    std::vector<uint32_t> worklist {0};
+    depths[0] = 0;
+    auto flowTo = [&](uint32_t target, int32_t depth, uint32_t from) {
+        if (target >= code.size()) {
+            return this->fail(sym, from, "falls off the end of code");
+        }
+        if (depths[target] < 0) {
+            depths[target] = depth;
+            worklist.push_back(target);
+        }
+        else if (depths[target] != depth) {
+            return this->fail(sym, target, "inconsistent operand stack depth: " + std::to_string(depths[target]) + " and " + std::to_string(depth));
+        }
+        return true;
+    };
+
+    while (!worklist.empty()) {
+        uint32_t index = worklist.back();
+        worklist.pop_back();
+        int32_t depth = depths[index];
+        bool wide = code[index] == OpCode::wide;
+        uint8_t op = InstructionOpCode(code, index);
+        auto& info = OpCodeInfos[op];
 
-    //{OpCode::Plus, { std::type_index(typeid(int32_t)), {std::type_index(typeid(int32_t)), PlusIntInt} } };
+        if (info.isSuper) {
+            uint32_t operand = index + 1;
+            for (auto component: FindSuperInstruction(op)->components) {
+                if (!execute(component, code.data() + operand, false, index, depth)) {
+                    return false;
+                }
+                operand += OpCodeLength(component) - 1;
+            }
+        }
+        else if (!execute(op, code.data() + index + (wide ? 2 : 1), wide, index, depth)) {
+            return false;
+        }
 
-};
+        uint32_t next = index + InstructionLength(code, index);
+        uint32_t target = info.operand == OperandKind::Jump ? JumpTarget(code, index) : 0;
+        bool ok = true;
+        switch (info.flow) {
+            case FlowKind::Next:
+                ok = flowTo(next, depth, index);
+                break;
+            case FlowKind::Branch:
+                ok = flowTo(target, depth, index) && flowTo(next, depth, index);
+                break;
+            case FlowKind::Goto:
+                ok = flowTo(target, depth, index);
+                break;
+            case FlowKind::Return:
+                break;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+
+    maxStackDepth = static_cast<uint32_t>(maxDepth);
+    return true;
+}
+
+bool BCVerifier::verify(const BCModule& bcModule) {
+    for (auto& c: bcModule.consts) {
+        auto sym = std::any_cast<std::shared_ptr<FunctionSymbol>>(&c);
+        if (sym == nullptr || (*sym)->byteCode.empty()) {
+            continue;
+        }
+        uint32_t maxStackDepth = 0;
+        if (!this->verifyFunction(**sym, bcModule.consts, maxStackDepth)) {
+            return false;
+        }
+        (*sym)->opStackSize = maxStackDepth;
+    }
+    return true;
+}
+
+std::string OpCodeProfile::report(size_t top) const {
+    std::stringstream ss;
+    ss << "instructions: " << this->numInsts << "\n";
+
+    auto list = [&](const std::string& title, const std::unordered_map<uint32_t, uint64_t>& counts, uint32_t length) {
+        std::vector<std::pair<uint32_t, uint64_t>> sorted(counts.begin(), counts.end());
+        std::sort(sorted.begin(), sorted.end(), [](const std::pair<uint32_t, uint64_t>& a, const std::pair<uint32_t, uint64_t>& b) {
+            return a.second > b.second || (a.second == b.second && a.first < b.first);
+        });
+
+        ss << title << ":\n";
+        char tmp[64] = {0};
+        for (size_t i = 0; i < sorted.size() && i < top; i++) {
+            std::string name;
+            for (int32_t k = length - 1; k >= 0; k--) {
+                name += toString(static_cast<OpCode>((sorted[i].first >> (k * 8)) & 0xff));
+                name += k > 0 ? " " : "";
+            }
+            snprintf(tmp, sizeof(tmp), "%10llu %6.2f%%  ", static_cast<unsigned long long>(sorted[i].second),
+                this->numInsts == 0 ? 0.0 : 100.0 * sorted[i].second / this->numInsts);
+            ss << tmp << name << "\n";
+        }
+    };
+    list("pairs", this->pairs, 2);
+    list("triples", this->triples, 3);
+    return ss.str();
+}
 
-std::once_flag VM::flag;
+template<typename T1, typename T2>
+constexpr void SetBinaryOpFunc(VM::BinaryOpTable& table, OpCode op, VM::BinaryFunction func) {
+    table[VM::BinaryOpIndex(op)][static_cast<size_t>(TagOf<T1>())][static_cast<size_t>(TagOf<T2>())] = func;
+}
 
+//把浮点数的运算注册到一个操作码下，整数与浮点数混合运算时，整数会提升为double
 template<typename T1, typename T2>
-inline void InsertBinaryOpFunc(OpCode op, const VM::BinaryFunction& func) {
-    //VM::binaryOp.insert(op, {});
-    auto& inner = VM::binaryOp[op];
-    auto& innerLeft = inner[std::type_index(typeid(T1))];
-    innerLeft[std::type_index(typeid(T2))] = func;
+constexpr void SetDecimalOpFuncs(VM::BinaryOpTable& table, OpCode add, OpCode sub, OpCode mul, OpCode div) {
+    SetBinaryOpFunc<T1, T2>(table, add, PlusIntInt<T1, T2, Value>); //'+'
+    SetBinaryOpFunc<T1, T2>(table, sub, MinusIntInt<T1, T2, Value>); //'-'
+    SetBinaryOpFunc<T1, T2>(table, mul, MultiplyIntInt<T1, T2, Value>); //'*'
+    SetBinaryOpFunc<T1, T2>(table, div, DivideIntInt<T1, T2, Value>); //'/'
+}
+
+//dadd等指令遇到两个整数时（比如decimal类型的参数传入的是整数），先都转换成double再运算
+template<Value (*Func)(const Value&, const Value&)>
+Value IntIntAsDecimal(const Value& l, const Value& r) {
+    return Func(static_cast<double>(l.i), static_cast<double>(r.i));
 }
 
-void VM::InitBinaryFunction() {
-    InsertBinaryOpFunc<int32_t, int32_t>(OpCode::iadd, PlusIntInt<int32_t, int32_t>); //'+'
-    InsertBinaryOpFunc<int8_t, int32_t>(OpCode::iadd, PlusIntInt<int8_t, int32_t>); //'+'
-    InsertBinaryOpFunc<int32_t, int8_t>(OpCode::iadd, PlusIntInt<int32_t, int8_t>); //'+'
-    InsertBinaryOpFunc<int8_t, int8_t>(OpCode::iadd, PlusIntInt<int8_t, int8_t>); //'+'
+constexpr VM::BinaryOpTable MakeBinaryOpTable() {
+    VM::BinaryOpTable table {};
 
-    InsertBinaryOpFunc<int32_t, int32_t>(OpCode::isub, MinusIntInt<int32_t, int32_t>); //'-'
-    InsertBinaryOpFunc<int8_t, int32_t>(OpCode::isub, MinusIntInt<int8_t, int32_t>); //'-'
-    InsertBinaryOpFunc<int32_t, int8_t>(OpCode::isub, MinusIntInt<int32_t, int8_t>); //'-'
-    InsertBinaryOpFunc<int8_t, int8_t>(OpCode::isub, MinusIntInt<int8_t, int8_t>); //'-'
+    SetBinaryOpFunc<int32_t, int32_t>(table, OpCode::iadd, PlusIntInt<int32_t, int32_t, Value>); //'+'
+    SetBinaryOpFunc<int32_t, int32_t>(table, OpCode::isub, MinusIntInt<int32_t, int32_t, Value>); //'-'
+    SetBinaryOpFunc<int32_t, int32_t>(table, OpCode::imul, MultiplyIntInt<int32_t, int32_t, Value>); //'*'
+    SetBinaryOpFunc<int32_t, int32_t>(table, OpCode::idiv, DivideIntInt<int32_t, int32_t, Value>); //'/'
 
-    InsertBinaryOpFunc<int32_t, int32_t>(OpCode::imul, MultiplyIntInt<int32_t, int32_t>); //'*'
-    InsertBinaryOpFunc<int8_t, int32_t>(OpCode::imul, MultiplyIntInt<int8_t, int32_t>); //'*'
-    InsertBinaryOpFunc<int32_t, int8_t>(OpCode::imul, MultiplyIntInt<int32_t, int8_t>); //'*'
-    InsertBinaryOpFunc<int8_t, int8_t>(OpCode::imul, MultiplyIntInt<int8_t, int8_t>); //'*'
+    //dadd等指令。number类型的变量在编译时不知道是整数还是浮点数，所以iadd等指令也要能处理浮点数
+    const OpCode opGroups[2][4] = {{OpCode::dadd, OpCode::dsub, OpCode::dmul, OpCode::ddiv},
+                                   {OpCode::iadd, OpCode::isub, OpCode::imul, OpCode::idiv}};
+    for (auto& ops: opGroups) {
+        SetDecimalOpFuncs<double, double>(table, ops[0], ops[1], ops[2], ops[3]);
+        SetDecimalOpFuncs<double, int32_t>(table, ops[0], ops[1], ops[2], ops[3]);
+        SetDecimalOpFuncs<int32_t, double>(table, ops[0], ops[1], ops[2], ops[3]);
+    }
+    SetBinaryOpFunc<int32_t, int32_t>(table, OpCode::dadd, IntIntAsDecimal<PlusIntInt<double, double, Value>>); //'+'
+    SetBinaryOpFunc<int32_t, int32_t>(table, OpCode::dsub, IntIntAsDecimal<MinusIntInt<double, double, Value>>); //'-'
+    SetBinaryOpFunc<int32_t, int32_t>(table, OpCode::dmul, IntIntAsDecimal<MultiplyIntInt<double, double, Value>>); //'*'
+    SetBinaryOpFunc<int32_t, int32_t>(table, OpCode::ddiv, IntIntAsDecimal<DivideIntInt<double, double, Value>>); //'/'
 
-    InsertBinaryOpFunc<int32_t, int32_t>(OpCode::idiv, DivideIntInt<int32_t, int32_t>); //'/'
-    InsertBinaryOpFunc<int8_t, int32_t>(OpCode::idiv, DivideIntInt<int8_t, int32_t>); //'/'
-    InsertBinaryOpFunc<int32_t, int8_t>(OpCode::idiv, DivideIntInt<int32_t, int8_t>); //'/'
-    InsertBinaryOpFunc<int8_t, int8_t>(OpCode::idiv, DivideIntInt<int8_t, int8_t>); //'/'
+    //没有静态类型信息的时候，iadd也可能遇到字符串（比如 number|string 类型的变量）
+    for (auto op: {OpCode::iadd, OpCode::sadd}) {
+        SetBinaryOpFunc<std::string, std::string>(table, op, ConcatStrStr<std::string, std::string, Value>); //'+'
+        SetBinaryOpFunc<std::string, int32_t>(table, op, ConcatStrStr<std::string, int32_t, Value>); //'+'
+        SetBinaryOpFunc<int32_t, std::string>(table, op, ConcatStrStr<int32_t, std::string, Value>); //'+'
+        SetBinaryOpFunc<std::string, double>(table, op, ConcatStrStr<std::string, double, Value>); //'+'
+        SetBinaryOpFunc<double, std::string>(table, op, ConcatStrStr<double, std::string, Value>); //'+'
+    }
+
+    return table;
 }
 
-std::optional<VM::BinaryFunction> VM::GetBinaryFunction(OpCode op, const std::any& l, const std::any& r) {
-    auto type1 = std::type_index(l.type());
-    auto type2 = std::type_index(r.type());
+//跳转表在编译期生成，运行时不需要初始化
+static constexpr VM::BinaryOpTable binaryOpTable = MakeBinaryOpTable();
+const VM::BinaryOpTable VM::binaryOp = binaryOpTable;
 
-    auto it = VM::binaryOp.find(op);
-    if (it == VM::binaryOp.end()) {
+std::optional<VM::BinaryFunction> VM::GetBinaryFunction(OpCode op, const Value& l, const Value& r) {
+    if (op < OpCode::iadd || op > OpCode::ddiv) {
         dbg("Unsupported binary, OpCode: " + toString(op));
         return std::nullopt;
     }
 
-    auto itLeft = it->second.find(type1);
-    if (itLeft == it->second.end()) {
-        dbg("Unsupported binary, leftType: " + std::string(l.type().name()));
+    auto func = VM::binaryOp[BinaryOpIndex(op)][static_cast<size_t>(l.tag)][static_cast<size_t>(r.tag)];
+    if (func == nullptr) {
+        dbg("Unsupported binary, leftTag: " + std::to_string(static_cast<int>(l.tag)) + ", rightTag: " + std::to_string(static_cast<int>(r.tag)));
         return std::nullopt;
     }
 
-    auto itRight = itLeft->second.find(type2);
-    if (itRight == itLeft->second.end()) {
-        dbg("Unsupported binary, rightType: " + std::string(r.type().name()));
-        return std::nullopt;
+    return func;
+}
+
+bool VM::CompareValues(OpCode op, const Value& l, const Value& r, bool& taken) {
+    bool lNumber = l.tag == ValueTag::Integer || l.tag == ValueTag::Decimal;
+    bool rNumber = r.tag == ValueTag::Integer || r.tag == ValueTag::Decimal;
+    if (lNumber && rNumber) {
+        double dl = l.tag == ValueTag::Integer ? l.i : l.d;
+        double dr = r.tag == ValueTag::Integer ? r.i : r.d;
+        switch (op) {
+            case OpCode::if_icmpeq:
+                taken = dl == dr;
+                return true;
+            case OpCode::if_icmpne:
+                taken = dl != dr;
+                return true;
+            case OpCode::if_icmplt:
+                taken = dl < dr;
+                return true;
+            case OpCode::if_icmpge:
+                taken = dl >= dr;
+                return true;
+            case OpCode::if_icmpgt:
+                taken = dl > dr;
+                return true;
+            default:
+                taken = dl <= dr;
+                return true;
+        }
     }
 
-    return itRight->second;
-}
\ No newline at end of file
+    //运行时生成的字符串不在字符串池里，内容相同的字符串不一定是同一个指针，所以要比较内容
+    if (l.tag == r.tag && (l.tag == ValueTag::String || l.tag == ValueTag::Boolean)
+        && (op == OpCode::if_icmpeq || op == OpCode::if_icmpne)) {
+        bool equal = l.tag == ValueTag::String ? (l.s == r.s || *l.s == *r.s) : l.b == r.b;
+        taken = (op == OpCode::if_icmpeq) == equal;
+        return true;
+    }
+
+    dbg("Unsupported comparison: " + toString(op) + ", leftTag: " + std::to_string(static_cast<int>(l.tag)) + ", rightTag: " + std::to_string(static_cast<int>(r.tag)));
+    return false;
+}
+
+bool VM::executeWide(Value* locals, Value*& sp, const uint8_t* code, uint32_t& codeIndex) {
+    uint8_t op = code[codeIndex + 1];
+    const uint8_t* operand = &code[codeIndex + 2];
+    bool taken = false;
+    switch (op) {
+        case OpCode::iload:
+            *sp++ = locals[ReadOperand(operand, 2)];
+            codeIndex += 4;
+            return true;
+        case OpCode::istore:
+            locals[ReadOperand(operand, 2)] = *--sp;
+            codeIndex += 4;
+            return true;
+        case OpCode::ldc:
+        case OpCode::sldc:
+            *sp++ = this->constants[ReadOperand(operand, 2)];
+            codeIndex += 4;
+            return true;
+        case OpCode::igoto:
+            codeIndex = ReadOperand(operand, 4);
+            return true;
+
+#define VM_WIDE_BRANCH(name) \
+        case OpCode::name: \
+            if (!VM::BranchCondition<OpCode::name>(sp, taken)) { \
+                return false; \
+            } \
+            codeIndex = taken ? ReadOperand(operand, 4) : codeIndex + 6; \
+            return true;
+        VM_WIDE_BRANCH(ifeq)
+        VM_WIDE_BRANCH(ifne)
+        VM_WIDE_BRANCH(iflt)
+        VM_WIDE_BRANCH(ifge)
+        VM_WIDE_BRANCH(ifgt)
+        VM_WIDE_BRANCH(ifle)
+        VM_WIDE_BRANCH(if_icmpeq)
+        VM_WIDE_BRANCH(if_icmpne)
+        VM_WIDE_BRANCH(if_icmplt)
+        VM_WIDE_BRANCH(if_icmpge)
+        VM_WIDE_BRANCH(if_icmpgt)
+        VM_WIDE_BRANCH(if_icmple)
+#undef VM_WIDE_BRANCH
+
+        default:
+            dbg("Unsupported wide op code: " + toString(static_cast<OpCode>(op)));
+            return false;
+    }
+}
+
+Value VM::ToValue(const std::any& c) {
+    if (isType<int32_t>(c)) {
+        return Value(std::any_cast<int32_t>(c));
+    } else if (isType<double>(c)) {
+        return Value(std::any_cast<double>(c));
+    } else if (isType<std::string>(c)) {
+        return Value(StringPool::intern(std::any_cast<const std::string&>(c)));
+    } else if (isType<bool>(c)) {
+        return Value(std::any_cast<bool>(c));
+    } else if (isType<std::shared_ptr<FunctionSymbol>>(c)) {
+        return Value(std::any_cast<const std::shared_ptr<FunctionSymbol>&>(c).get());
+    }
+    return Value();
+}
@@ -7,7 +7,11 @@
 #include "types.h"
 #include "symbol.h"
 #include "common.h"
+#include "timing.h"
 #include "ast.h"
+#include "value.h"
+#include "native.h"
+#include "superinstructions.h"
 
 #include "dbg.h"
 
@@ -24,6 +28,10 @@
 #include <type_traits>
 #include <mutex>
 #include <optional>
+#include <cstring>
+#include <array>
+#include <unordered_map>
+#include <initializer_list>
 
 enum OpCode{
     //参考JVM的操作码
@@ -33,9 +41,12 @@ enum OpCode{
     iconst_3 = 0x06,
     iconst_4 = 0x07,
     iconst_5 = 0x08,
+    dconst_0 = 0x0e,  //浮点数0.0入栈
+    dconst_1 = 0x0f,  //浮点数1.0入栈
     bipush   = 0x10,  //8位整数入栈
     sipush   = 0x11,  //16位整数入栈
     ldc      = 0x12,  //从常量池加载，load const
+    ldc2_w   = 0x14,  //从常量池加载浮点数，用两个字节记录下标
     iload    = 0x15,  //本地变量入栈
     iload_0  = 0x1a,
     iload_1  = 0x1b,
@@ -46,10 +57,15 @@ enum OpCode{
     istore_1 = 0x3c,
     istore_2 = 0x3d,
     istore_3 = 0x3e,
+    pop      = 0x57,  //弹出栈顶的值，表达式语句的值不再使用时生成
     iadd     = 0x60,
+    dadd     = 0x63,
     isub     = 0x64,
+    dsub     = 0x67,
     imul     = 0x68,
+    dmul     = 0x6b,
     idiv     = 0x6c,
+    ddiv     = 0x6f,
     iinc     = 0x84,
     lcmp     = 0x94,
     ifeq     = 0x99,
@@ -68,14 +84,462 @@ enum OpCode{
     ireturn  = 0xac,
     vreturn   = 0xb1,
     invokestatic= 0xb8, //调用函数
+    wide     = 0xc4,    //前缀，加宽下一条指令的操作数，见WideOperandBytes()
 
     //自行扩展的操作码
     sadd     = 0x61,    //字符串连接
     sldc     = 0x13,    //把字符串常量入栈。字符串放在常量区，用两个操作数记录下标。
+    invoketail= 0xb9,   //尾调用：复用当前栈桢调用函数，被调用函数返回时直接返回到当前函数的调用者
+    invokenative= 0xba, //调用内置函数，操作数是1个字节的内置函数编号（BuiltinId），不经过常量池
+    iinc_w   = 0xbb,    //iinc的宽版本，本地变量下标或者增量超出1个字节时使用
+    bconst_0 = 0xbc,    //布尔值false入栈
+    bconst_1 = 0xbd,    //布尔值true入栈
+
+    //快速指令，只出现在虚拟机自己的代码副本里，见VM::quicken()
+    ldc_int  = 0xbe,    //ldc第一次执行之后改写成的指令，常量是整数
+    sldc_ref = 0xbf,    //sldc第一次执行之后改写成的指令，常量是字符串池里的字符串
+    invoke_direct= 0xc0,//invokestatic第一次执行之后改写成的指令
+
+    //超级指令，从0xd0开始编号，见superinstructions.h
+#define VM_SUPERINSTRUCTION_OPCODE(value, name, ...) name = value,
+    VM_SUPERINSTRUCTIONS(VM_SUPERINSTRUCTION_OPCODE)
+#undef VM_SUPERINSTRUCTION_OPCODE
 };
 
 std::string toString(OpCode op);
 
+//
+// 操作码的元数据
+// 每个操作码的名称、操作数、对操作数栈的影响和控制流，在编译期生成一张表。
+// 生成器（修正跳转目标）、反汇编、读取字节码文件、校验器和虚拟机都查这张表，不再各自手写每条指令的长度。
+//
+
+//操作数的种类，决定了操作数的字节数，以及校验器怎么检查它
+enum class OperandKind: uint8_t{
+    None,
+    Int8,           //bipush：1个字节的有符号整数
+    Int16,          //sipush：2个字节的有符号整数
+    Local,          //iload、istore：1个字节的本地变量下标
+    IntConst,       //ldc：1个字节的常量下标，常量是整数
+    StringConst,    //sldc：1个字节的常量下标，常量是字符串
+    DecimalConst,   //ldc2_w：2个字节的常量下标，常量是浮点数
+    Function,       //invokestatic、invoketail：2个字节的常量下标，常量是有字节码的函数
+    Native,         //invokenative：1个字节的内置函数编号
+    Jump,           //跳转指令：2个字节的跳转目标，从代码的开头算起
+    LocalDelta,     //iinc：1个字节的本地变量下标，加上1个字节的有符号增量
+    LocalDeltaWide, //iinc_w：2个字节的本地变量下标，加上2个字节的有符号增量
+};
+
+constexpr uint32_t OperandBytes(OperandKind kind) {
+    switch (kind) {
+        case OperandKind::None:
+            return 0;
+        case OperandKind::Int8:
+        case OperandKind::Local:
+        case OperandKind::IntConst:
+        case OperandKind::StringConst:
+        case OperandKind::Native:
+            return 1;
+        case OperandKind::LocalDeltaWide:
+            return 4;
+        default:
+            return 2;
+    }
+}
+
+//执行完一条指令之后，接着执行哪里
+enum class FlowKind: uint8_t{
+    Next,           //下一条指令
+    Branch,         //条件跳转：跳转目标或者下一条指令
+    Goto,           //无条件跳转
+    Return,         //返回，包括尾调用
+};
+
+struct OpCodeInfo{
+    //没有定义的操作码，name为nullptr，length为0
+    const char* name {nullptr};
+    OperandKind operand {OperandKind::None};
+
+    //从操作数栈弹出和压入的值的个数。
+    //调用指令弹出的实参个数和是否压入返回值，取决于被调用的函数，这里都是0
+    uint8_t pops {0};
+    uint8_t pushes {0};
+
+    FlowKind flow {FlowKind::Next};
+
+    //指令的长度，包括操作码和操作数
+    uint8_t length {0};
+
+    //超级指令的操作数是各条组成指令的操作数拼起来的，要按组成指令逐条解码，见SuperInstructions()
+    bool isSuper {false};
+
+    //快速指令是虚拟机执行时改写出来的，字节码文件里不能出现，校验器不接受
+    bool isQuick {false};
+};
+
+constexpr OpCodeInfo MakeOpCodeInfo(const char* name, OperandKind operand, uint8_t pops, uint8_t pushes, FlowKind flow = FlowKind::Next) {
+    return OpCodeInfo{name, operand, pops, pushes, flow, static_cast<uint8_t>(1 + OperandBytes(operand)), false};
+}
+
+//快速指令的操作数、对操作数栈的影响和控制流都与改写之前的指令相同
+constexpr OpCodeInfo MakeQuickOpCodeInfo(const char* name, const OpCodeInfo& original) {
+    OpCodeInfo info = original;
+    info.name = name;
+    info.isQuick = true;
+    return info;
+}
+
+//超级指令的元数据由组成指令的元数据合成：长度是操作数的总和加1，pops是执行前栈里至少要有的值的个数
+constexpr OpCodeInfo MakeSuperInstructionInfo(const char* name, const std::array<OpCodeInfo, 256>& infos, std::initializer_list<OpCode> components) {
+    OpCodeInfo info {name, OperandKind::None, 0, 0, FlowKind::Next, 1, true};
+    int32_t depth = 0;
+    int32_t minDepth = 0;
+    for (auto component: components) {
+        auto& c = infos[component];
+        depth -= c.pops;
+        minDepth = depth < minDepth ? depth : minDepth;
+        depth += c.pushes;
+        info.length += c.length - 1;
+    }
+    info.pops = static_cast<uint8_t>(-minDepth);
+    info.pushes = static_cast<uint8_t>(depth - minDepth);
+    return info;
+}
+
+constexpr std::array<OpCodeInfo, 256> MakeOpCodeInfos() {
+    std::array<OpCodeInfo, 256> infos {};
+    infos[OpCode::iconst_0]     = MakeOpCodeInfo("iconst_0",     OperandKind::None,         0, 1);
+    infos[OpCode::iconst_1]     = MakeOpCodeInfo("iconst_1",     OperandKind::None,         0, 1);
+    infos[OpCode::iconst_2]     = MakeOpCodeInfo("iconst_2",     OperandKind::None,         0, 1);
+    infos[OpCode::iconst_3]     = MakeOpCodeInfo("iconst_3",     OperandKind::None,         0, 1);
+    infos[OpCode::iconst_4]     = MakeOpCodeInfo("iconst_4",     OperandKind::None,         0, 1);
+    infos[OpCode::iconst_5]     = MakeOpCodeInfo("iconst_5",     OperandKind::None,         0, 1);
+    infos[OpCode::dconst_0]     = MakeOpCodeInfo("dconst_0",     OperandKind::None,         0, 1);
+    infos[OpCode::dconst_1]     = MakeOpCodeInfo("dconst_1",     OperandKind::None,         0, 1);
+    infos[OpCode::bconst_0]     = MakeOpCodeInfo("bconst_0",     OperandKind::None,         0, 1);
+    infos[OpCode::bconst_1]     = MakeOpCodeInfo("bconst_1",     OperandKind::None,         0, 1);
+    infos[OpCode::bipush]       = MakeOpCodeInfo("bipush",       OperandKind::Int8,         0, 1);
+    infos[OpCode::sipush]       = MakeOpCodeInfo("sipush",       OperandKind::Int16,        0, 1);
+    infos[OpCode::ldc]          = MakeOpCodeInfo("ldc",          OperandKind::IntConst,     0, 1);
+    infos[OpCode::ldc2_w]       = MakeOpCodeInfo("ldc2_w",       OperandKind::DecimalConst, 0, 1);
+    infos[OpCode::sldc]         = MakeOpCodeInfo("sldc",         OperandKind::StringConst,  0, 1);
+    infos[OpCode::iload]        = MakeOpCodeInfo("iload",        OperandKind::Local,        0, 1);
+    infos[OpCode::iload_0]      = MakeOpCodeInfo("iload_0",      OperandKind::None,         0, 1);
+    infos[OpCode::iload_1]      = MakeOpCodeInfo("iload_1",      OperandKind::None,         0, 1);
+    infos[OpCode::iload_2]      = MakeOpCodeInfo("iload_2",      OperandKind::None,         0, 1);
+    infos[OpCode::iload_3]      = MakeOpCodeInfo("iload_3",      OperandKind::None,         0, 1);
+    infos[OpCode::istore]       = MakeOpCodeInfo("istore",       OperandKind::Local,        1, 0);
+    infos[OpCode::istore_0]     = MakeOpCodeInfo("istore_0",     OperandKind::None,         1, 0);
+    infos[OpCode::istore_1]     = MakeOpCodeInfo("istore_1",     OperandKind::None,         1, 0);
+    infos[OpCode::istore_2]     = MakeOpCodeInfo("istore_2",     OperandKind::None,         1, 0);
+    infos[OpCode::istore_3]     = MakeOpCodeInfo("istore_3",     OperandKind::None,         1, 0);
+    infos[OpCode::pop]          = MakeOpCodeInfo("pop",          OperandKind::None,         1, 0);
+    infos[OpCode::iadd]         = MakeOpCodeInfo("iadd",         OperandKind::None,         2, 1);
+    infos[OpCode::sadd]         = MakeOpCodeInfo("sadd",         OperandKind::None,         2, 1);
+    infos[OpCode::isub]         = MakeOpCodeInfo("isub",         OperandKind::None,         2, 1);
+    infos[OpCode::imul]         = MakeOpCodeInfo("imul",         OperandKind::None,         2, 1);
+    infos[OpCode::idiv]         = MakeOpCodeInfo("idiv",         OperandKind::None,         2, 1);
+    infos[OpCode::dadd]         = MakeOpCodeInfo("dadd",         OperandKind::None,         2, 1);
+    infos[OpCode::dsub]         = MakeOpCodeInfo("dsub",         OperandKind::None,         2, 1);
+    infos[OpCode::dmul]         = MakeOpCodeInfo("dmul",         OperandKind::None,         2, 1);
+    infos[OpCode::ddiv]         = MakeOpCodeInfo("ddiv",         OperandKind::None,         2, 1);
+    infos[OpCode::iinc]         = MakeOpCodeInfo("iinc",         OperandKind::LocalDelta,   0, 0);
+    infos[OpCode::iinc_w]       = MakeOpCodeInfo("iinc_w",       OperandKind::LocalDeltaWide, 0, 0);
+    infos[OpCode::lcmp]         = MakeOpCodeInfo("lcmp",         OperandKind::None,         2, 1);
+    infos[OpCode::ifeq]         = MakeOpCodeInfo("ifeq",         OperandKind::Jump,         1, 0, FlowKind::Branch);
+    infos[OpCode::ifne]         = MakeOpCodeInfo("ifne",         OperandKind::Jump,         1, 0, FlowKind::Branch);
+    infos[OpCode::iflt]         = MakeOpCodeInfo("iflt",         OperandKind::Jump,         1, 0, FlowKind::Branch);
+    infos[OpCode::ifge]         = MakeOpCodeInfo("ifge",         OperandKind::Jump,         1, 0, FlowKind::Branch);
+    infos[OpCode::ifgt]         = MakeOpCodeInfo("ifgt",         OperandKind::Jump,         1, 0, FlowKind::Branch);
+    infos[OpCode::ifle]         = MakeOpCodeInfo("ifle",         OperandKind::Jump,         1, 0, FlowKind::Branch);
+    infos[OpCode::if_icmpeq]    = MakeOpCodeInfo("if_icmpeq",    OperandKind::Jump,         2, 0, FlowKind::Branch);
+    infos[OpCode::if_icmpne]    = MakeOpCodeInfo("if_icmpne",    OperandKind::Jump,         2, 0, FlowKind::Branch);
+    infos[OpCode::if_icmplt]    = MakeOpCodeInfo("if_icmplt",    OperandKind::Jump,         2, 0, FlowKind::Branch);
+    infos[OpCode::if_icmpge]    = MakeOpCodeInfo("if_icmpge",    OperandKind::Jump,         2, 0, FlowKind::Branch);
+    infos[OpCode::if_icmpgt]    = MakeOpCodeInfo("if_icmpgt",    OperandKind::Jump,         2, 0, FlowKind::Branch);
+    infos[OpCode::if_icmple]    = MakeOpCodeInfo("if_icmple",    OperandKind::Jump,         2, 0, FlowKind::Branch);
+    infos[OpCode::igoto]        = MakeOpCodeInfo("igoto",        OperandKind::Jump,         0, 0, FlowKind::Goto);
+    infos[OpCode::ireturn]      = MakeOpCodeInfo("ireturn",      OperandKind::None,         1, 0, FlowKind::Return);
+    infos[OpCode::vreturn]      = MakeOpCodeInfo("vreturn",      OperandKind::None,         0, 0, FlowKind::Return);
+    infos[OpCode::invokestatic] = MakeOpCodeInfo("invokestatic", OperandKind::Function,     0, 0);
+    infos[OpCode::invoketail]   = MakeOpCodeInfo("invoketail",   OperandKind::Function,     0, 0, FlowKind::Return);
+    infos[OpCode::invokenative] = MakeOpCodeInfo("invokenative", OperandKind::Native,       0, 0);
+    //wide前缀本身只有1个字节，带前缀的指令的长度见InstructionLength()
+    infos[OpCode::wide]         = MakeOpCodeInfo("wide",         OperandKind::None,         0, 0);
+
+    infos[OpCode::ldc_int]      = MakeQuickOpCodeInfo("ldc_int",       infos[OpCode::ldc]);
+    infos[OpCode::sldc_ref]     = MakeQuickOpCodeInfo("sldc_ref",      infos[OpCode::sldc]);
+    infos[OpCode::invoke_direct]= MakeQuickOpCodeInfo("invoke_direct", infos[OpCode::invokestatic]);
+
+#define VM_SUPERINSTRUCTION_INFO(value, name, ...) infos[OpCode::name] = MakeSuperInstructionInfo(#name, infos, {__VA_ARGS__});
+    VM_SUPERINSTRUCTIONS(VM_SUPERINSTRUCTION_INFO)
+#undef VM_SUPERINSTRUCTION_INFO
+    return infos;
+}
+
+inline constexpr std::array<OpCodeInfo, 256> OpCodeInfos = MakeOpCodeInfos();
+
+//一条指令的长度，包括操作码和操作数。不认识的操作码返回0
+constexpr uint32_t OpCodeLength(uint8_t op) {
+    return OpCodeInfos[op].length;
+}
+
+//跳转指令，操作数是两个字节的跳转目标
+constexpr bool IsJumpOpCode(uint8_t op) {
+    return OpCodeInfos[op].operand == OperandKind::Jump;
+}
+
+//ldc、sldc、invokestatic第一次执行之后改写成的快速指令。其他操作码不改写，返回它自己
+constexpr OpCode QuickOpCode(OpCode op) {
+    switch (op) {
+        case OpCode::ldc:
+            return OpCode::ldc_int;
+        case OpCode::sldc:
+            return OpCode::sldc_ref;
+        case OpCode::invokestatic:
+            return OpCode::invoke_direct;
+        default:
+            return op;
+    }
+}
+
+//
+// wide前缀（参考JVM）
+// 常见的情况用紧凑的形式：本地变量下标和ldc、sldc的常量下标是1个字节，跳转目标是2个字节。
+// 本地变量或常量超过256个，或者函数的代码超过64KB时，在指令前面加上wide前缀，操作数加宽：
+//   wide iload/istore index16      wide ldc/sldc index16      wide ifeq/.../igoto target32
+// iinc有单独的宽版本iinc_w；ldc2_w、invokestatic的常量下标本来就是2个字节。
+// 遍历代码的时候要用InstructionLength()，不能只看操作码的长度。
+//
+
+//wide前缀之后，op的操作数的字节数。不能加宽的指令返回0
+constexpr uint32_t WideOperandBytes(uint8_t op) {
+    switch (OpCodeInfos[op].operand) {
+        case OperandKind::Local:
+        case OperandKind::IntConst:
+        case OperandKind::StringConst:
+            return 2;
+        case OperandKind::Jump:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+//code[index]开始的一条指令的长度，包括wide前缀。不认识的操作码，或者wide后面是不能加宽的指令时返回0
+inline uint32_t InstructionLength(const std::vector<uint8_t>& code, uint32_t index) {
+    if (code[index] != OpCode::wide) {
+        return OpCodeLength(code[index]);
+    }
+    if (index + 1 >= code.size() || WideOperandBytes(code[index + 1]) == 0) {
+        return 0;
+    }
+    return 2 + WideOperandBytes(code[index + 1]);
+}
+
+//code[index]开始的一条指令的操作码，跳过wide前缀
+inline uint8_t InstructionOpCode(const std::vector<uint8_t>& code, uint32_t index) {
+    return code[index] == OpCode::wide && index + 1 < code.size() ? code[index + 1] : code[index];
+}
+
+//按大端顺序读写bytes个字节的操作数
+inline uint32_t ReadOperand(const uint8_t* operand, uint32_t bytes) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < bytes; i++) {
+        value = value << 8 | operand[i];
+    }
+    return value;
+}
+
+inline void WriteOperand(uint8_t* operand, uint32_t bytes, uint32_t value) {
+    for (uint32_t i = bytes; i > 0; i--) {
+        operand[i - 1] = static_cast<uint8_t>(value);
+        value >>= 8;
+    }
+}
+
+//code[index]开始的指令是不是跳转指令，包括带wide前缀的
+inline bool IsJump(const std::vector<uint8_t>& code, uint32_t index) {
+    return IsJumpOpCode(InstructionOpCode(code, index));
+}
+
+//跳转指令的目标
+inline uint32_t JumpTarget(const std::vector<uint8_t>& code, uint32_t index) {
+    return code[index] == OpCode::wide ? ReadOperand(&code[index + 2], 4) : ReadOperand(&code[index + 1], 2);
+}
+
+//修改跳转指令的目标。紧凑形式的跳转指令，调用者要保证目标不超过0xffff
+inline void SetJumpTarget(std::vector<uint8_t>& code, uint32_t index, uint32_t target) {
+    if (code[index] == OpCode::wide) {
+        WriteOperand(&code[index + 2], 4, target);
+    }
+    else {
+        WriteOperand(&code[index + 1], 2, target);
+    }
+}
+
+//
+// 超级指令（superinstruction）
+// 把几条经常连续执行的指令合并成一条，执行时只需要分派一次。
+// 超级指令的操作数是各条组成指令的操作数按顺序拼起来。
+// 选用哪些超级指令，是由tools/gen_superinstructions.cpp剖析corpus/下的程序之后生成的，见superinstructions.h。
+//
+struct SuperInstruction{
+    OpCode op;
+    std::string name;
+    std::vector<OpCode> components;
+};
+
+const std::vector<SuperInstruction>& SuperInstructions();
+
+//找到一个超级指令，不是超级指令时返回nullptr
+const SuperInstruction* FindSuperInstruction(uint8_t op);
+
+//可以作为超级指令的组成部分的指令：常量入栈、本地变量的加载、保存和iinc、二元运算。
+//调用、返回和跳转指令会改变控制流，不能被合并
+bool IsFusibleOpCode(uint8_t op);
+
+//一个函数的字节码中所有跳转指令的目标
+std::set<uint32_t> JumpTargets(const std::vector<uint8_t>& code);
+
+/**
+ * 在code的index位置，从superInsts中找出能匹配的最长的超级指令，end是匹配的指令序列的结束位置。
+ * 序列中间不能有跳转目标。没有能匹配的时候返回nullptr
+ */
+const SuperInstruction* MatchSuperInstruction(const std::vector<uint8_t>& code, uint32_t index, const std::set<uint32_t>& targets,
+                                              const std::vector<SuperInstruction>& superInsts, uint32_t& end);
+
+/**
+ * 窥孔优化：把一个函数的字节码中能匹配的指令序列替换成超级指令，优先匹配长的序列。
+ * 超级指令不会跨过跳转目标，跳转指令的目标会被修正。
+ */
+std::vector<uint8_t> FuseSuperInstructions(const std::vector<uint8_t>& code);
+
+//把超级指令还原成组成它的指令，是FuseSuperInstructions的逆过程
+std::vector<uint8_t> ExpandSuperInstructions(const std::vector<uint8_t>& code);
+
+/**
+ * 把带wide前缀的跳转指令改回2个字节的紧凑形式，跳转目标会被修正。
+ * 改完之后代码仍然超过64KB时，跳转目标放不进2个字节，所有跳转指令都保持wide形式。
+ */
+std::vector<uint8_t> NarrowJumps(const std::vector<uint8_t>& code);
+
+//反汇编一个函数的字节码，每行一条指令。超级指令的操作数按组成指令分开显示
+std::string Disassemble(const std::vector<uint8_t>& code);
+
+//一个函数返回时是否在调用者的操作数栈上留下返回值。
+//内置函数看返回类型；其他函数看有没有ireturn，或者有没有尾调用（只有return语句才会生成尾调用）
+bool ReturnsValue(FunctionSymbol& sym);
+
+class BCModule;
+
+//
+// 字节码校验器
+// 模块加载时校验每个函数的字节码，通过校验的代码，虚拟机执行时不再逐条检查：
+// 1.每个操作码都有定义，操作数没有越过代码的末尾；
+// 2.常量下标指向类型正确的常量：ldc是整数，ldc2_w是浮点数，sldc是字符串；调用指令指向有字节码的函数或者内置函数；
+// 3.本地变量的下标小于本地变量的个数；
+// 4.跳转目标是某条指令的开头；
+// 5.沿着所有执行路径模拟操作数栈的深度：不会弹空，几条路径汇合的地方深度相同，也不会执行到代码的末尾之外。
+//   同时算出操作数栈的最大深度，虚拟机按它分配栈桢（见VMStackFrame）。
+// 所有检查都查OpCodeInfos，超级指令按组成指令逐条检查。
+//
+class BCVerifier{
+public:
+    //校验失败的原因
+    std::string error;
+
+    /**
+     * 校验一个函数。
+     * @param maxStackDepth 操作数栈的最大深度
+     */
+    bool verifyFunction(FunctionSymbol& sym, const std::vector<std::any>& consts, uint32_t& maxStackDepth);
+
+    /**
+     * 校验模块里所有有字节码的函数，把操作数栈的最大深度写到FunctionSymbol::opStackSize。
+     */
+    bool verify(const BCModule& bcModule);
+
+private:
+    bool fail(FunctionSymbol& sym, uint32_t index, const std::string& msg);
+};
+
+//
+// 操作码剖析：统计执行过的指令，以及连续执行的指令对和指令三元组。
+// 只统计同一个函数中紧挨着的指令，调用、返回和跳转都会打断序列。
+// 剖析结果用来挑选超级指令，见tools/gen_superinstructions.cpp
+//
+class OpCodeProfile{
+public:
+    //执行的指令总数，也就是分派的次数
+    uint64_t numInsts {0};
+
+    //每个操作码的执行次数
+    std::array<uint64_t, 256> singles {};
+
+    //key是按顺序拼起来的操作码：指令对是(op1<<8)|op2，三元组是(op1<<16)|(op2<<8)|op3
+    std::unordered_map<uint32_t, uint64_t> pairs;
+    std::unordered_map<uint32_t, uint64_t> triples;
+
+    //每个函数的字节码中，每个位置上的指令的执行次数，key是虚拟机执行的字节码的地址（VMFunction::code）。
+    //用来准确地计算一组超级指令能省掉多少次分派
+    std::unordered_map<const uint8_t*, std::vector<uint64_t>> positions;
+
+    //记录一条将要执行的指令
+    void record(const uint8_t* code, uint32_t codeIndex) {
+        uint8_t op = code[codeIndex];
+        this->numInsts++;
+        this->singles[op]++;
+
+        auto& counts = this->positions[code];
+        if (counts.size() <= codeIndex) {
+            counts.resize(codeIndex + 1);
+        }
+        counts[codeIndex]++;
+
+        //紧接着上一条指令
+        if (code == this->lastCode && codeIndex == this->nextIndex) {
+            this->pairs[static_cast<uint32_t>(this->history[1]) << 8 | op]++;
+            if (this->runLength >= 2) {
+                this->triples[static_cast<uint32_t>(this->history[0]) << 16 | static_cast<uint32_t>(this->history[1]) << 8 | op]++;
+            }
+            this->runLength++;
+        }
+        else {
+            this->runLength = 1;
+        }
+
+        this->history[0] = this->history[1];
+        this->history[1] = op;
+        this->lastCode = code;
+        this->nextIndex = codeIndex + (op == OpCode::wide ? 2 + WideOperandBytes(code[codeIndex + 1]) : OpCodeLength(op));
+    }
+
+    //按执行次数从多到少，列出前top个指令对和三元组
+    std::string report(size_t top = 10) const;
+
+    void clear() {
+        this->numInsts = 0;
+        this->singles.fill(0);
+        this->pairs.clear();
+        this->triples.clear();
+        this->positions.clear();
+        this->lastCode = nullptr;
+        this->runLength = 0;
+    }
+
+private:
+    //上一条指令所在的代码，以及紧接着它的下一条指令的位置
+    const uint8_t* lastCode {nullptr};
+    uint32_t nextIndex {0};
+
+    //最近执行的两条指令
+    uint8_t history[2] {0, 0};
+
+    //当前连续序列的长度
+    uint32_t runLength {0};
+};
+
 class BCModule{
 public:
     //常量
@@ -84,12 +548,7 @@ public:
     //入口函数
     std::shared_ptr<FunctionSymbol> _main;
 
-    BCModule(){
-        //系统函数
-        for (auto& fun: built_ins){
-            this->consts.push_back(fun.second);
-        }
-    }
+    //内置函数不放在常量池里，invokenative直接用内置函数的编号（见BuiltinId）
 };
 
 class BCModuleDumper{
@@ -101,13 +560,20 @@ public:
                 auto val = std::any_cast<int32_t>(x);
                 Print(std::string("Number: ") + std::to_string(val));
             }
+            else if (isType<double>(x)){
+                auto val = std::any_cast<double>(x);
+                Print(std::string("Decimal: ") + ValueToString(val));
+            }
             else if (isType<std::string>(x)){
                 auto val = std::any_cast<std::string>(x);
                 Print(std::string("string: ") + val);
             }
             else if (isType<std::shared_ptr<FunctionSymbol>>(x)){
-                std::shared_ptr<Symbol> sym = std::any_cast<std::shared_ptr<FunctionSymbol>>(x);
-                symbolDumper.visit(*sym,"");
+                auto functionSym = std::any_cast<std::shared_ptr<FunctionSymbol>>(x);
+                symbolDumper.visit(*functionSym,"");
+                if (!functionSym->byteCode.empty()){
+                    Print(Disassemble(functionSym->byteCode));
+                }
             }
             else{
                 Print(std::string("unknown const: ") + x.type().name());
@@ -117,6 +583,21 @@ public:
     }
 };
 
+//函数体中是否有带返回值的return语句，不包括嵌套的函数声明
+class ReturnValueFinder: public AstVisitor{
+public:
+    bool found {false};
+
+    std::any visitReturnStatement(ReturnStatement& stmt, std::string prefix) override {
+        this->found = this->found || stmt.exp != nullptr;
+        return std::any();
+    }
+
+    std::any visitFunctionDecl(FunctionDecl& functionDecl, std::string prefix) override {
+        return std::any();
+    }
+};
+
 class BCGenerator: public AstVisitor{
 public:
     //编译后生成的模型
@@ -129,6 +610,10 @@ public:
     //TODO 以后这部分可以挪到数据流分析里。
     bool inExpression{ false };
 
+    //生成一个函数的字节码之后，用窥孔优化合并出超级指令。
+    //剖析指令序列的时候（tools/gen_superinstructions.cpp）要关掉
+    bool useSuperInstructions{ true };
+
     BCGenerator(){
         this->m = std::make_shared<BCModule>();
     }
@@ -140,21 +625,36 @@ public:
         return {};
     }
 
+    //把一段代码接到code的后面。
+    //每段代码中跳转指令的目标都是相对于这段代码的开头的，接上之后要加上code原来的长度
    void concatCodeWithAny(std::vector<uint8_t>& code, const std::any& val) {
         if (val.has_value() && isType<std::vector<uint8_t>>(val)) {
             auto vec = std::any_cast<std::vector<uint8_t>>(val);
+            this->addOffsetToJumpOp(vec, code.size());
             code.insert(code.end(), vec.begin(), vec.end());
         }
         return;
     }
 
+    //函数的字节码全部生成之后做的窥孔优化：跳转指令尽量改回紧凑形式，再合并超级指令
+    std::vector<uint8_t> peephole(const std::vector<uint8_t>& code) {
+        auto ret = NarrowJumps(code);
+        if (this->useSuperInstructions) {
+            return FuseSuperInstructions(ret);
+        }
+        return ret;
+    }
+
     std::any visitProg(Prog& prog, std::string prefix) override {
         this->functionSym = prog.sym;
         if ( this->functionSym != nullptr){
             this->m->consts.push_back(this->functionSym);
             this->m->_main = this->functionSym;
             auto byteCode = this->anyToCode(this->visitBlock(prog, prefix));
-            this->functionSym->byteCode = byteCode;
+            this->functionSym->byteCode = this->peephole(byteCode);
+
+            //所有函数都生成之后再校验，顺便算出每个函数的操作数栈的最大深度
+            BCVerifier().verify(*this->m);
         }
 
         return this->m;
@@ -166,12 +666,8 @@ public:
         for(auto& x: block.stmts){
             this->inExpression = false; //每个语句开始的时候，重置
             auto code = this->visit(*x);
-            if (code.has_value()){  //在visitFunctionDecl的时候，会返回std::any为空，则跳过
-                auto vec = this->anyToCode(code);
-                this->addOffsetToJumpOp(vec, vec.size());
-                ret.insert(ret.end(), vec.begin(), vec.end());
-                //dbg("=====================ret size:" + std::to_string(ret.size()));
-            }
+            //在visitFunctionDecl的时候，会返回std::any为空，则跳过
+            this->concatCodeWithAny(ret, code);
         }
         return ret;
     }
@@ -189,12 +685,11 @@ public:
         auto code2 = this->visit(*functionDecl.body);
 
         auto vec1 = this->anyToCode(code1);
-        auto vec2 = this->anyToCode(code2);
-        this->addOffsetToJumpOp(vec2, vec1.size());
 
         if(this->functionSym != nullptr){
-            this->concatCodeWithAny(vec1, vec2);
-            this->functionSym->byteCode = vec1;
+            this->concatCodeWithAny(vec1, code2);
+            this->addImplicitReturn(vec1);
+            this->functionSym->byteCode = this->peephole(vec1);
         }
 
         //3.恢复当前函数
@@ -203,10 +698,79 @@ public:
         return std::any();
     }
 
+    /**
+     * 没有返回值的函数可以不写return语句，在末尾补一条vreturn：
+     * 最后一条指令不是返回，或者有跳转指令跳到代码的末尾（比如函数体以if语句结束）。
+     * 有返回值的函数不补，执行到末尾的路径由校验器报错。
+     */
+    void addImplicitReturn(std::vector<uint8_t>& code) {
+        uint32_t last = 0;
+        for (uint32_t i = 0; i < code.size() && InstructionLength(code, i) != 0; i += InstructionLength(code, i)) {
+            if (code[i] == OpCode::ireturn || code[i] == OpCode::invoketail) {
+                return;
+            }
+            last = i;
+        }
+        if (code.empty() || OpCodeInfos[InstructionOpCode(code, last)].flow != FlowKind::Return || JumpTargets(code).count(code.size()) != 0) {
+            code.push_back(OpCode::vreturn);
+        }
+    }
+
+    std::any visitExpressionStatement(ExpressionStatement& stmt, std::string prefix) override {
+        return this->statementCode(*stmt.exp);
+    }
+
+    /**
+     * 把一个表达式当作语句生成代码：表达式的值不再使用，要从操作数栈弹出，
+     * 否则在循环里每执行一次，操作数栈就多一个值。for语句的init和increment部分也是这样。
+     */
+    std::vector<uint8_t> statementCode(AstNode& exp) {
+        this->inExpression = false;
+        auto code = this->anyToCode(this->visit(exp));
+        if (this->leavesValue(exp)) {
+            code.push_back(OpCode::pop);
+        }
+        return code;
+    }
+
+    /**
+     * 作为语句的表达式，执行之后是否在操作数栈上留下一个值。
+     * 赋值语句和++、--不留下值；函数调用要看被调用的函数有没有返回值。
+     * 被调用的函数可能还没有生成字节码，所以在函数体里找带返回值的return语句，这与ReturnsValue()的结果是一致的。
+     */
+    bool leavesValue(AstNode& exp) {
+        if (dynamic_cast<Expression*>(&exp) == nullptr){  //for语句init部分的变量声明
+            return false;
+        }
+        if (auto bi = dynamic_cast<Binary*>(&exp)){
+            return !IsAssignOp(bi->op);
+        }
+        if (auto unary = dynamic_cast<Unary*>(&exp)){
+            return unary->op != Op::Inc && unary->op != Op::Dec;
+        }
+        if (auto call = dynamic_cast<FunctionCall*>(&exp)){
+            if (call->sym == nullptr){
+                return false;
+            }
+            auto builtin = GetBuiltinId(*call->sym);
+            if (builtin != BuiltinId::None){
+                return NativeFunctions()[static_cast<size_t>(builtin)].returnsValue;
+            }
+            if (call->sym->decl == nullptr){
+                return false;
+            }
+            ReturnValueFinder finder;
+            finder.visit(*call->sym->decl->body);
+            return finder.found;
+        }
+        return true;
+    }
+
     std::any visitVariableDecl(VariableDecl& variableDecl, std::string prefix) override {
         std::vector<uint8_t> code;
         if (variableDecl.init != nullptr){
-            //获取初始化部分的Code
+            //获取初始化部分的Code，初始化表达式的值要留在栈上
+            this->inExpression = true;
             auto ret = this->visit(*variableDecl.init);
             this->concatCodeWithAny(code, ret);
             //生成变量赋值的指令
@@ -221,6 +785,15 @@ public:
         std::vector<uint8_t> code;
         //1.为return后面的表达式生成代码
         if(returnStatement.exp != nullptr){
+            //尾调用：生成invoketail，被调用函数的返回值就是当前函数的返回值，不需要再生成ireturn
+            auto functionCall = std::dynamic_pointer_cast<FunctionCall>(returnStatement.exp);
+            if (functionCall != nullptr && functionCall->isTailCall){
+                auto code1 = this->invoke(*functionCall, OpCode::invoketail);
+                this->concatCodeWithAny(code, code1);
+                return code;
+            }
+
+            this->inExpression = true;
             auto code1 = this->visit(*returnStatement.exp);
             // console.log(code1);
             this->concatCodeWithAny(code, code1);
@@ -235,19 +808,192 @@ public:
         }
     }
 
+    std::any visitBenchStatement(BenchStatement& stmt, std::string prefix) override {
+        //bench语句要对每次迭代计时并输出报告，字节码里还没有对应的指令，只能在Interpretor和ClosureEngine中执行
+        dbg("Error: bench statement is not supported by the VM");
+        return std::vector<uint8_t>();
+    }
+
+    std::any visitIfStatement(IfStatement& stmt, std::string prefix) override {
+        //条件不成立时，跳过if后面的语句
+        auto code = this->conditionalJump(*stmt.condition, false);
+        uint32_t jumpToElse = code.size() - BCGenerator::JumpLength;
+        this->inExpression = false;
+        this->concatCodeWithAny(code, this->visit(*stmt.stmt));
+        if (stmt.elseStmt == nullptr){
+            this->patchJump(code, jumpToElse, code.size());
+            return code;
+        }
+
+        //if后面的语句执行完之后，跳过else部分
+        uint32_t jumpToEnd = this->emitJump(code, OpCode::igoto);
+        this->patchJump(code, jumpToElse, code.size());
+        this->inExpression = false;
+        this->concatCodeWithAny(code, this->visit(*stmt.elseStmt));
+        this->patchJump(code, jumpToEnd, code.size());
+        return code;
+    }
+
+    /**
+     * for循环。条件放在循环体的后面，每次迭代只需要执行一条条件跳转指令：
+     *         init
+     *         igoto cond
+     *   body: stmt
+     *         increment
+     *   cond: 条件成立时跳转到body
+     * 省略了条件的循环，在increment后面直接跳转到body。
+     */
+    std::any visitForStatement(ForStatement& stmt, std::string prefix) override {
+        std::vector<uint8_t> code;
+        if (stmt.init != nullptr){
+            this->concatCodeWithAny(code, this->statementCode(*stmt.init));
+        }
+        uint32_t jumpToCondition = code.size();
+        if (stmt.condition != nullptr){
+            this->emitJump(code, OpCode::igoto);
+        }
+
+        uint32_t body = code.size();
+        this->inExpression = false;
+        this->concatCodeWithAny(code, this->visit(*stmt.stmt));
+        if (stmt.increment != nullptr){
+            this->concatCodeWithAny(code, this->statementCode(*stmt.increment));
+        }
+
+        if (stmt.condition == nullptr){
+            this->emitJump(code, OpCode::igoto);
+        }
+        else{
+            this->patchJump(code, jumpToCondition, code.size());
+            this->concatCodeWithAny(code, this->conditionalJump(*stmt.condition, true));
+        }
+        this->patchJump(code, code.size() - BCGenerator::JumpLength, body);
+        return code;
+    }
+
+    /**
+     * 为条件生成代码：条件成立（jumpIfTrue为true）或者不成立时跳转，否则接着执行下一条指令。
+     * 比较运算直接生成比较并跳转的指令（if_icmp*，与整数0比较时是if*），不需要先算出0或1，再判断一次；
+     * 其他表达式先算出值，再用ifne、ifeq判断。
+     * 跳转指令在返回的代码的末尾，跳转目标由调用者用patchJump()填写。
+     */
+    std::vector<uint8_t> conditionalJump(AstNode& condition, bool jumpIfTrue) {
+        std::vector<uint8_t> code;
+        this->inExpression = true;
+        auto bi = dynamic_cast<Binary*>(&condition);
+        if (bi != nullptr && IsCompareOp(bi->op)){
+            auto op = jumpIfTrue ? bi->op : NegateCompareOp(bi->op);
+            this->concatCodeWithAny(code, this->visit(*bi->exp1));
+            auto zero = dynamic_cast<IntegerLiteral*>(bi->exp2.get());
+            if (zero != nullptr && zero->value == 0){
+                this->emitJump(code, CompareZeroOpCode(op));
+            }
+            else{
+                this->concatCodeWithAny(code, this->visit(*bi->exp2));
+                this->emitJump(code, CompareOpCode(op));
+            }
+        }
+        else{
+            this->concatCodeWithAny(code, this->visit(condition));
+            this->emitJump(code, jumpIfTrue ? OpCode::ifne : OpCode::ifeq);
+        }
+        return code;
+    }
+
+    //生成的过程中，跳转指令都用wide形式（4个字节的目标），片段再长、接到多长的代码后面都放得下。
+    //函数的代码全部生成之后，再由NarrowJumps()尽量改回紧凑的形式，见peephole()
+    static constexpr uint32_t JumpLength = 6;
+
+    //在code的末尾加上一条跳转指令，返回它的位置。跳转目标由patchJump()填写
+    uint32_t emitJump(std::vector<uint8_t>& code, OpCode op) {
+        uint32_t index = code.size();
+        code.insert(code.end(), {OpCode::wide, static_cast<uint8_t>(op), 0, 0, 0, 0});
+        return index;
+    }
+
+    //填写code中index位置的跳转指令的目标
+    void patchJump(std::vector<uint8_t>& code, uint32_t index, uint32_t target) {
+        SetJumpTarget(code, index, target);
+    }
+
+    static bool IsCompareOp(Op op) {
+        return op == Op::G || op == Op::GE || op == Op::L || op == Op::LE || op == Op::EQ || op == Op::NE;
+    }
+
+    //相反的比较条件
+    static Op NegateCompareOp(Op op) {
+        switch (op) {
+            case Op::G:
+                return Op::LE;
+            case Op::GE:
+                return Op::L;
+            case Op::L:
+                return Op::GE;
+            case Op::LE:
+                return Op::G;
+            case Op::EQ:
+                return Op::NE;
+            default:
+                return Op::EQ;
+        }
+    }
+
+    //比较两个操作数，条件成立时跳转的指令
+    static OpCode CompareOpCode(Op op) {
+        switch (op) {
+            case Op::G:
+                return OpCode::if_icmpgt;
+            case Op::GE:
+                return OpCode::if_icmpge;
+            case Op::L:
+                return OpCode::if_icmplt;
+            case Op::LE:
+                return OpCode::if_icmple;
+            case Op::EQ:
+                return OpCode::if_icmpeq;
+            default:
+                return OpCode::if_icmpne;
+        }
+    }
+
+    //与0比较，条件成立时跳转的指令。if*与if_icmp*两组指令的顺序相同
+    static OpCode CompareZeroOpCode(Op op) {
+        return static_cast<OpCode>(CompareOpCode(op) - OpCode::if_icmpeq + OpCode::ifeq);
+    }
+
     std::any visitFunctionCall(FunctionCall& functionCall, std::string prefix) override {
+        return this->invoke(functionCall, OpCode::invokestatic);
+    }
+
+    /**
+     * 生成函数调用的代码
+     * @param op invokestatic或invoketail
+     */
+    std::any invoke(FunctionCall& functionCall, OpCode op) {
         // console.log("in AstVisitor.visitFunctionCall "+ functionCall.name);
         std::vector<uint8_t> code;
-        //1.依次生成与参数计算有关的指令，也就是把参数压到计算栈里
+        //1.依次生成与参数计算有关的指令，也就是把参数压到计算栈里。
+        //实参都在表达式里面，赋值、++、--的值要留在操作数栈上
+        bool inExpression = this->inExpression;
         for(auto& param: functionCall.arguments){
+            this->inExpression = true;
             auto code1 = this->visit(*param);
             this->concatCodeWithAny(code, code1);
         }
+        this->inExpression = inExpression;
 
         //2.生成invoke指令
         // console.log(functionCall.sym);
 
-        //本地变量的下标
+        //内置函数用invokenative，操作数是内置函数的编号
+        auto builtin = GetBuiltinId(*functionCall.sym);
+        if (builtin != BuiltinId::None) {
+            code.push_back(OpCode::invokenative);
+            code.push_back(static_cast<uint8_t>(builtin));
+            return code;
+        }
+
+        //函数在常量池中的下标
         auto compare = [&functionCall](const std::any& e) {
             return isType<std::shared_ptr<FunctionSymbol>>(e) &&
                 std::any_cast<std::shared_ptr<FunctionSymbol>>(e)->name == functionCall.sym->name;
@@ -259,10 +1005,13 @@ public:
             return std::any();
         }
 
+        if (iter - this->m->consts.begin() > 0xffff) {
+            dbg("Error: const index out of range for " + functionCall.sym->name);
+        }
         uint16_t index = static_cast<uint16_t>(iter - this->m->consts.begin());
 
         // console.log(this->module);
-        code.push_back(OpCode::invokestatic);
+        code.push_back(op);
         code.push_back(index>>8);
         code.push_back(index);
 
@@ -284,8 +1033,12 @@ public:
 
     std::any visitIntegerLiteral(IntegerLiteral& integerLiteral, std::string prefix) override {
         // console.log("visitIntegerLiteral in BC");
+        return this->integerConstant(integerLiteral.value);
+    }
+
+    //把一个整数常量入栈
+    std::vector<uint8_t> integerConstant(int32_t value) {
         std::vector<uint8_t> code;
-        int32_t value = integerLiteral.value;
         //0-5之间的数字，直接用快捷指令
         if (value >= 0 && value <= 5) {
             switch (value) {
@@ -326,37 +1079,106 @@ public:
 
         //大于16位的，采用ldc指令，从常量池中去取
         else{
-            code.push_back(OpCode::ldc);
             //把value值放入常量池。
             this->m->consts.push_back(value);
-            code.push_back(this->m->consts.size() - 1);
+            code = this->indexedOp(OpCode::ldc, this->m->consts.size() - 1);
         }
         // console.log(ret);
         return code;
     }
 
+    std::any visitDecimalLiteral(DecimalLiteral& decimalLiteral, std::string prefix) override {
+        return this->decimalConstant(decimalLiteral.value);
+    }
+
+    //把一个浮点数常量入栈
+    std::vector<uint8_t> decimalConstant(double value) {
+        std::vector<uint8_t> code;
+        //0.0和1.0，直接用快捷指令
+        if (value == 0.0) {
+            code.push_back(OpCode::dconst_0);
+        }
+        else if (value == 1.0) {
+            code.push_back(OpCode::dconst_1);
+        }
+        //其他的浮点数放入常量池，用ldc2_w指令加载
+        else{
+            this->m->consts.push_back(value);
+            if (this->m->consts.size() > 0x10000) {
+                dbg("Error: const index out of range for ldc2_w");
+            }
+            uint16_t index = static_cast<uint16_t>(this->m->consts.size() - 1);
+            code.push_back(OpCode::ldc2_w);
+            code.push_back(index>>8);
+            code.push_back(index);
+        }
+        return code;
+    }
+
+    /**
+     * 判断表达式的值是不是浮点数，用来选择dadd等指令。
+     * 目前还没有做类型推导，只根据字面量、变量和函数的声明类型，以及算术运算的操作数来判断。
+     * 判断不出来的，仍然生成iadd等指令，由VM根据操作数的标签在运行时处理。
+     */
+    bool isDecimal(AstNode& node) {
+        auto exp = dynamic_cast<Expression*>(&node);
+        if (exp != nullptr && exp->theType != nullptr && *exp->theType == *SysTypes::Decimal()){
+            return true;
+        }
+
+        if (auto bi = dynamic_cast<Binary*>(&node)){
+            if (bi->op == Op::Plus || bi->op == Op::Minus || bi->op == Op::Multiply || bi->op == Op::Divide){
+                return this->isDecimal(*bi->exp1) || this->isDecimal(*bi->exp2);
+            }
+        }
+        else if (auto u = dynamic_cast<Unary*>(&node)){
+            return (u->op == Op::Plus || u->op == Op::Minus) && this->isDecimal(*u->exp);
+        }
+        else if (auto v = dynamic_cast<Variable*>(&node)){
+            return v->sym != nullptr && *v->sym->theType == *SysTypes::Decimal();
+        }
+        else if (auto call = dynamic_cast<FunctionCall*>(&node)){
+            if (call->sym != nullptr){
+                auto functionType = std::dynamic_pointer_cast<FunctionType>(call->sym->theType);
+                return functionType != nullptr && *functionType->returnType == *SysTypes::Decimal();
+            }
+        }
+        return false;
+    }
+
+    std::any visitStringLiteral(StringLiteral& stringLiteral, std::string prefix) override {
+        std::vector<uint8_t> code;
+        //把字符串放入常量池，用sldc指令加载
+        this->m->consts.push_back(stringLiteral.value);
+        return this->indexedOp(OpCode::sldc, this->m->consts.size() - 1);
+    }
+
     std::any visitBinary(Binary& bi, std::string prefix) override {
         std::vector<uint8_t> code;
 
+        //赋值表达式作为语句时，不需要把值留在操作数栈上
+        bool isStatement = !this->inExpression;
         this->inExpression = true;
+
+        ////1.处理赋值，包括+=等复合赋值
+        if (IsAssignOp(bi.op)){
+            return this->assign(bi, isStatement);
+        }
+
         auto ret1 = this->visit(*bi.exp1);
         auto ret2 = this->visit(*bi.exp2);
 
         auto code1 = this->anyToCode(ret1);
         auto code2 = this->anyToCode(ret2);
 
-        uint16_t address1 = 0;
-        uint16_t address2 = 0;
-        uint8_t tempCode = 0;
+        uint32_t jumpToFalse = 0;
+        uint32_t jumpToEnd = 0;
+
+        //有浮点数参与的算术运算，用d开头的指令
+        bool decimal = this->isDecimal(bi);
 
-        ////1.处理赋值
-        if (bi.op == Op::Assign){
-            // 左值的情况，返回符号
-            dbg("Error: current not support Op::Assign!");
-            return code;
-        }
         ////2.处理其他二元运算
-        else{
+        {
             //加入左子树的代码
             code = code1;
             //加入右子树的代码
@@ -368,17 +1190,13 @@ public:
                         code.push_back(OpCode::sadd);
                     }
                     else{
-                        code.push_back(OpCode::iadd);
+                        code.push_back(ArithOpCode(bi.op, decimal).value());
                     }
                     break;
                 case Op::Minus: //'-'
-                    code.push_back(OpCode::isub);
-                    break;
                 case Op::Multiply: //'*'
-                    code.push_back(OpCode::imul);
-                    break;
                 case Op::Divide: //'/'
-                    code.push_back(OpCode::idiv);
+                    code.push_back(ArithOpCode(bi.op, decimal).value());
                     break;
                 case Op::G:  //'>'
                 case Op::GE: //'>='
@@ -386,35 +1204,13 @@ public:
                 case Op::LE: //'<='
                 case Op::EQ: //'=='
                 case Op::NE: //'!='
-                    if (bi.op ==Op::G){
-                        tempCode = OpCode::if_icmple;
-                    }
-                    else if (bi.op ==Op::GE){
-                        tempCode = OpCode::if_icmplt;
-                    }
-                    else if (bi.op ==Op::L){
-                        tempCode = OpCode::if_icmpge;
-                    }
-                    else if (bi.op ==Op::LE){
-                        tempCode = OpCode::if_icmpgt;
-                    }
-                    else if (bi.op ==Op::EQ){
-                        tempCode = OpCode::if_icmpne;
-                    }
-                    else if (bi.op ==Op::NE){
-                        tempCode = OpCode::if_icmpeq;
-                    }
-
-                    address1 = code.size() + 7;
-                    address2 = address1 + 1;
-                    code.push_back(tempCode);
-                    code.push_back(address1>>8);
-                    code.push_back(address1);
-                    code.push_back(OpCode::iconst_1);
-                    code.push_back(OpCode::igoto);
-                    code.push_back(address2>>8);
-                    code.push_back(address2);
-                    code.push_back(OpCode::iconst_0);
+                    //比较的结果作为值使用时，算出布尔值true或false，与解释器一致。作为if、for的条件时不走这里，见conditionalJump()
+                    jumpToFalse = this->emitJump(code, CompareOpCode(NegateCompareOp(bi.op)));
+                    code.push_back(OpCode::bconst_1);
+                    jumpToEnd = this->emitJump(code, OpCode::igoto);
+                    this->patchJump(code, jumpToFalse, code.size());
+                    code.push_back(OpCode::bconst_0);
+                    this->patchJump(code, jumpToEnd, code.size());
                     break;
                 default:
                     dbg("Unsupported binary operation: " + toString(bi.op));
@@ -425,19 +1221,191 @@ public:
         return code;
     }
 
-    std::vector<uint8_t> getVariableValue(std::shared_ptr<VarSymbol>& sym) {
+    /**
+     * 一元运算：正负号，以及++、--。
+     * ++、--的操作数必须是变量，用iinc原地加减，作为语句时不需要操作数栈。
+     * 在表达式里面时，前缀表达式的值是加减之后的值，后缀表达式的值是原来的值。
+     */
+    std::any visitUnary(Unary& exp, std::string prefix) override {
         std::vector<uint8_t> code;
-        if (sym != nullptr){
-            //本地变量的下标
-            auto compare = [&sym](const std::shared_ptr<Symbol> & var) {
-                return sym->name == var->name;
-            };
-            auto iter = std::find_if(this->functionSym->vars.begin(), this->functionSym->vars.end(), compare);
-            if (iter == this->functionSym->vars.end()) {
-                dbg("Error: Can find variable, get val failed!");
+        bool isStatement = !this->inExpression;
+        this->inExpression = true;
+
+        if (exp.op == Op::Inc || exp.op == Op::Dec){
+            auto variable = std::dynamic_pointer_cast<Variable>(exp.exp);
+            auto sym = variable != nullptr ? std::dynamic_pointer_cast<VarSymbol>(variable->sym) : nullptr;
+            if (sym == nullptr){
+                dbg("Error: the operand of ++ or -- must be a variable");
+                return code;
+            }
+
+            int32_t delta = exp.op == Op::Inc ? 1 : -1;
+            std::vector<uint8_t> update;
+            if (this->canIncrement(sym, delta)){
+                update = this->increment(sym, delta);
+            }
+            else{
+                update = this->getVariableValue(sym);
+                update.push_back(OpCode::iconst_1);
+                update.push_back(exp.op == Op::Inc ? OpCode::iadd : OpCode::isub);
+                this->concatCodeWithAny(update, this->setVariableValue(sym));
+            }
+
+            if (isStatement){
+                return update;
+            }
+            if (exp.isPrefix){
+                code = update;
+                this->concatCodeWithAny(code, this->getVariableValue(sym));
+            }
+            else{
+                code = this->getVariableValue(sym);
+                this->concatCodeWithAny(code, update);
             }
+            return code;
+        }
+
+        switch (exp.op){
+            case Op::Plus:
+                return this->visit(*exp.exp);
+            case Op::Minus:
+                //负的字面量直接生成常量
+                if (auto literal = dynamic_cast<IntegerLiteral*>(exp.exp.get())){
+                    return this->integerConstant(-literal->value);
+                }
+                if (auto literal = dynamic_cast<DecimalLiteral*>(exp.exp.get())){
+                    return this->decimalConstant(-literal->value);
+                }
+                //-a 相当于 0 - a
+                if (this->isDecimal(*exp.exp)){
+                    code.push_back(OpCode::dconst_0);
+                    this->concatCodeWithAny(code, this->visit(*exp.exp));
+                    code.push_back(OpCode::dsub);
+                }
+                else{
+                    code.push_back(OpCode::iconst_0);
+                    this->concatCodeWithAny(code, this->visit(*exp.exp));
+                    code.push_back(OpCode::isub);
+                }
+                return code;
+            default:
+                dbg("Unsupported unary operation: " + toString(exp.op));
+                return code;
+        }
+    }
+
+    //算术运算符对应的指令，不是算术运算符时返回空
+    static std::optional<OpCode> ArithOpCode(Op op, bool decimal) {
+        switch (op) {
+            case Op::Plus:
+                return decimal ? OpCode::dadd : OpCode::iadd;
+            case Op::Minus:
+                return decimal ? OpCode::dsub : OpCode::isub;
+            case Op::Multiply:
+                return decimal ? OpCode::dmul : OpCode::imul;
+            case Op::Divide:
+                return decimal ? OpCode::ddiv : OpCode::idiv;
+            default:
+                return std::nullopt;
+        }
+    }
+
+    /**
+     * 赋值：计算右边的值，保存到左边的本地变量。
+     * 赋值表达式在其他表达式里面时（比如a = b = 1），保存之后再把变量的值入栈，作为赋值表达式的值。
+     */
+    std::vector<uint8_t> assign(Binary& bi, bool isStatement) {
+        std::vector<uint8_t> code;
+        auto variable = std::dynamic_pointer_cast<Variable>(bi.exp1);
+        auto sym = variable != nullptr ? std::dynamic_pointer_cast<VarSymbol>(variable->sym) : nullptr;
+        if (sym == nullptr){
+            dbg("Error: the left side of an assignment must be a variable");
+            return code;
+        }
+
+        //a += 1、a -= 1：给本地变量加减一个整数常量，用iinc
+        auto literal = dynamic_cast<IntegerLiteral*>(bi.exp2.get());
+        if (literal != nullptr && (bi.op == Op::PlusAssign || bi.op == Op::MinusAssign)){
+            int64_t delta = bi.op == Op::PlusAssign ? literal->value : -static_cast<int64_t>(literal->value);
+            if (this->canIncrement(sym, delta)){
+                code = this->increment(sym, static_cast<int32_t>(delta));
+                if (!isStatement){
+                    this->concatCodeWithAny(code, this->getVariableValue(sym));
+                }
+                return code;
+            }
+        }
+
+        //复合赋值：a += b 相当于 a = a + b
+        if (bi.op != Op::Assign){
+            auto opCode = ArithOpCode(CompoundAssignOp(bi.op), this->isDecimal(*bi.exp1) || this->isDecimal(*bi.exp2));
+            if (!opCode){
+                dbg("Unsupported assignment: " + toString(bi.op));
+                return {};
+            }
+            code = this->getVariableValue(sym);
+            this->concatCodeWithAny(code, this->visit(*bi.exp2));
+            code.push_back(opCode.value());
+        }
+        else{
+            this->concatCodeWithAny(code, this->visit(*bi.exp2));
+        }
+        this->concatCodeWithAny(code, this->setVariableValue(sym));
+        if (!isStatement){
+            this->concatCodeWithAny(code, this->getVariableValue(sym));
+        }
+        return code;
+    }
+
+    //本地变量的下标，语义分析时已经确定（见VarSymbol::index）。
+    //不能按名称查找：for语句里声明的变量可以与外面的变量同名，它们占用不同的槽位
+    uint32_t localIndex(std::shared_ptr<VarSymbol>& sym) {
+        if (sym->index < 0) {
+            dbg("Error: Can find variable: " + sym->name);
+            return 0;
+        }
+        return static_cast<uint32_t>(sym->index);
+    }
+
+    /**
+     * 本地变量加上一个整数常量：iinc直接修改本地变量，不经过操作数栈。
+     * 下标或者增量超出1个字节时，用iinc_w。
+     */
+    std::vector<uint8_t> increment(std::shared_ptr<VarSymbol>& sym, int32_t delta) {
+        auto index = this->localIndex(sym);
+        if (index <= 0xff && delta >= -128 && delta < 128){
+            return {OpCode::iinc, static_cast<uint8_t>(index), static_cast<uint8_t>(delta)};
+        }
+        return {OpCode::iinc_w, static_cast<uint8_t>(index >> 8), static_cast<uint8_t>(index),
+                static_cast<uint8_t>(delta >> 8), static_cast<uint8_t>(delta)};
+    }
+
+    /**
+     * 能不能用iinc给变量加上delta：字符串变量不行（+是字符串连接），增量要在16位以内
+     */
+    bool canIncrement(std::shared_ptr<VarSymbol>& sym, int64_t delta) {
+        return sym->theType != nullptr && !(*sym->theType == *SysTypes::String())
+            && delta >= -32768 && delta < 32768;
+    }
+
+    /**
+     * 操作数是1个字节的下标的指令：iload、istore的本地变量下标，ldc、sldc的常量下标。
+     * 下标超过1个字节时加上wide前缀，用2个字节的下标
+     */
+    std::vector<uint8_t> indexedOp(OpCode op, uint32_t index) {
+        if (index <= 0xff) {
+            return {static_cast<uint8_t>(op), static_cast<uint8_t>(index)};
+        }
+        if (index > 0xffff) {
+            dbg("Error: index out of range for " + toString(op) + ": " + std::to_string(index));
+        }
+        return {OpCode::wide, static_cast<uint8_t>(op), static_cast<uint8_t>(index >> 8), static_cast<uint8_t>(index)};
+    }
 
-            auto index = iter - this->functionSym->vars.begin();
+    std::vector<uint8_t> getVariableValue(std::shared_ptr<VarSymbol>& sym) {
+        std::vector<uint8_t> code;
+        if (sym != nullptr){
+            auto index = this->localIndex(sym);
             //根据不同的下标生成指令，尽量生成压缩指令
             switch (index){
                 case 0:
@@ -453,8 +1421,7 @@ public:
                     code.push_back(OpCode::iload_3);
                     break;
                 default:
-                    code.push_back(OpCode::iload);
-                    code.push_back(static_cast<uint8_t>(index));
+                    code = this->indexedOp(OpCode::iload, index);
                     break;
             }
         }
@@ -464,16 +1431,7 @@ public:
     std::vector<uint8_t> setVariableValue(std::shared_ptr<VarSymbol>& sym) {
         std::vector<uint8_t> code;
         if (sym != nullptr){
-            //本地变量的下标
-            auto compare = [&sym](const std::shared_ptr<Symbol> & var) {
-                return sym->name == var->name;
-            };
-            auto iter = std::find_if(this->functionSym->vars.begin(), this->functionSym->vars.end(), compare);
-            if (iter == this->functionSym->vars.end()) {
-                dbg("Error: Can find variable, set val failed!");
-            }
-
-            auto index = iter - this->functionSym->vars.begin();
+            auto index = this->localIndex(sym);
             //根据不同的下标生成指令，尽量生成压缩指令
             switch (index){
                 case 0:
@@ -489,8 +1447,7 @@ public:
                     code.push_back(OpCode::istore_3);
                     break;
                 default:
-                    code.push_back(OpCode::istore);
-                    code.push_back(static_cast<uint8_t>(index));
+                    code = this->indexedOp(OpCode::istore, index);
                     break;
             }
         }
@@ -502,563 +1459,957 @@ public:
 
         uint32_t codeIndex = 0;
         while(codeIndex < code.size()){
-            switch(code[codeIndex]){
-                //纯指令，后面不带操作数
-                case OpCode::iadd:
-                case OpCode::sadd:
-                case OpCode::isub:
-                case OpCode::imul:
-                case OpCode::idiv:
-                case OpCode::iconst_0:
-                case OpCode::iconst_1:
-                case OpCode::iconst_2:
-                case OpCode::iconst_3:
-                case OpCode::iconst_4:
-                case OpCode::iconst_5:
-                case OpCode::istore_0:
-                case OpCode::istore_1:
-                case OpCode::istore_2:
-                case OpCode::istore_3:
-                case OpCode::iload_0:
-                case OpCode::iload_1:
-                case OpCode::iload_2:
-                case OpCode::iload_3:
-                case OpCode::ireturn:
-                case OpCode::vreturn:
-                case OpCode::lcmp:
-                    codeIndex++;
-                    break;
+            auto length = InstructionLength(code, codeIndex);
+            if (length == 0){
+                dbg("unrecognized Op Code in addOffsetToJumpOp: "+ std::to_string(code[codeIndex]));
+                return;
+            }
 
-                //指令后面带1个字节的操作数
-                case OpCode::iload:
-                case OpCode::istore:
-                case OpCode::bipush:
-                case OpCode::ldc:
-                case OpCode::sldc:
-                    codeIndex +=2;
-                    break;
+            //跳转语句，需要给跳转指令加上offset。生成的过程中跳转指令都是wide形式，目标是32位的，见emitJump()
+            if (IsJump(code, codeIndex)){
+                SetJumpTarget(code, codeIndex, JumpTarget(code, codeIndex) + offset);
+            }
+            codeIndex += length;
+        }
 
-                //指令后面带2个字节的操作数
-                case OpCode::iinc:
-                case OpCode::invokestatic:
-                case OpCode::sipush:
-                    codeIndex +=3;
-                    break;
+        return;
+    }
 
-                //跳转语句，需要给跳转指令加上offset
-                case OpCode::if_icmpeq:
-                case OpCode::if_icmpne:
-                case OpCode::if_icmpge:
-                case OpCode::if_icmpgt:
-                case OpCode::if_icmple:
-                case OpCode::if_icmplt:
-                case OpCode::ifeq:
-                case OpCode::ifne:
-                case OpCode::ifge:
-                case OpCode::ifgt:
-                case OpCode::ifle:
-                case OpCode::iflt:
-                case OpCode::igoto:
-                {
-                    int8_t byte1 = code[codeIndex+1];
-                    int8_t byte2 = code[codeIndex+2];
-                    int16_t address = (byte1<<8|byte2) + offset;
-                    code[codeIndex+1] = static_cast<int8_t>(address>>8);
-                    code[codeIndex+2] = static_cast<int8_t>(address);
-                    codeIndex += 3;
-                    break;
-                }
+};
 
+//
+// 函数的栈桢布局。模块加载时为常量池里的每个函数生成一个，调用时不需要再查符号表和类型
+//
+struct VMFunction{
+    FunctionSymbol* sym {nullptr};
 
-                default:
-                    dbg("unrecognized Op Code in addOffsetToJumpOp: "+ std::to_string(code[codeIndex]));
-                    return;
+    //函数的字节码。默认直接指向FunctionSymbol::byteCode，调用和返回时不需要拷贝。
+    //虚拟机加载模块时使用自己的副本（ownCode），快速指令只改写副本，模块里的字节码不变，见VM::quicken()
+    uint8_t* code {nullptr};
+    uint32_t codeLength {0};
+    std::unique_ptr<uint8_t[]> ownCode;
+
+    uint32_t numParams {0};
+
+    //本地变量的个数，参数也算本地变量
+    uint32_t numVars {0};
+
+    //栈桢在VM::stack里占用的槽位数：本地变量加上操作数栈的最大深度
+    uint32_t frameSize {0};
+
+    VMFunction() = default;
+
+    VMFunction(FunctionSymbol& sym, bool copyCode = false): sym(&sym),
+        code(sym.byteCode.data()), codeLength(static_cast<uint32_t>(sym.byteCode.size())),
+        numParams(sym.getNumParams()), numVars(static_cast<uint32_t>(sym.vars.size())),
+        frameSize(static_cast<uint32_t>(sym.vars.size()) + sym.opStackSize) {
+        if (copyCode) {
+            this->ownCode = std::make_unique<uint8_t[]>(this->codeLength);
+            std::copy(sym.byteCode.begin(), sym.byteCode.end(), this->ownCode.get());
+            this->code = this->ownCode.get();
+        }
+    }
+};
+
+//
+// 栈式虚拟机的栈桢
+// 所有栈桢的本地变量和操作数栈都在VM::stack这一块连续的内存里，一个栈桢紧挨着上一个栈桢：
+//   | 调用者的本地变量 | 调用者的操作数栈 ... 实参 | 被调用者的其他本地变量 | 被调用者的操作数栈 ...
+//                                          ^ 被调用者的localVars
+// 调用者压到操作数栈顶的实参，就是被调用者的前几个本地变量，传参不需要拷贝；
+// 返回时把栈顶退回到被调用者的localVars，实参也就一起弹出了。
+// 栈桢头（也就是这个结构体）放在另一个数组VM::callStack里，不然实参与其他本地变量之间隔着栈桢头，又需要拷贝。
+// 两个数组都是预先分配好的，调用和返回只是移动指针，不在堆上分配内存。
+//
+struct VMStackFrame{
+    //对应的函数，用来找到代码
+    const VMFunction* function;
+
+    //指令指针。调用其他函数时，保存返回地址，也就是调用指令的下一条指令
+    uint32_t returnIndex = 0;
+
+    //本地变量，指向VM::stack中的槽位，操作数栈紧接在本地变量后面
+    Value* localVars;
+
+    VMStackFrame(const VMFunction* function, Value* localVars): function(function), localVars(localVars){
+    }
+};
+
+//
+// 虚拟机主循环的分派方式
+// GCC和Clang支持labels-as-values扩展：把每条指令的处理代码的地址放在一张表里，
+// 处理完一条指令之后，直接跳到下一条指令的处理代码（direct threading），
+// 不需要回到循环的开头，也省掉了switch的范围检查。每个处理代码的末尾都有一个自己的间接跳转，CPU也更容易预测。
+// 其他编译器，或者定义了VM_SWITCH_DISPATCH的时候，使用可移植的switch分派。
+//
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(VM_SWITCH_DISPATCH)
+#define VM_COMPUTED_GOTO 1
+#else
+#define VM_COMPUTED_GOTO 0
+#endif
+
+#if VM_COMPUTED_GOTO
+#define VM_CASE(op) case OpCode::op: L_##op:
+#define VM_DEFAULT L_default:
+#define VM_DISPATCH() goto *dispatchTable[opCode]
+
+//
+// 分派表，下标是操作码（栈顶缓存的主循环里是缓存状态和操作码合在一起），值是处理代码的地址。
+// 主循环把分派表放在函数内的静态常量里，第一次执行时生成，之后的每次执行（包括从原生函数重入）都直接使用。
+//
+template<size_t N>
+struct DispatchTable{
+    void* labels[N];
+};
+
+//labels[i]放在positions[i]的位置上，其他位置都是defaultLabel
+template<size_t N>
+DispatchTable<N> MakeDispatchTable(void* defaultLabel, void* const* labels, const uint16_t* positions, size_t count) {
+    DispatchTable<N> table;
+    for (auto& label: table.labels) {
+        label = defaultLabel;
+    }
+    for (size_t i = 0; i < count; i++) {
+        table.labels[positions[i]] = labels[i];
+    }
+    return table;
+}
+#else
+#define VM_CASE(op) case OpCode::op:
+#define VM_DEFAULT
+#define VM_DISPATCH() break
+#endif
+
+//主循环里有处理代码的指令（不包括超级指令）
+#define VM_HANDLED_OPCODES(X) \
+    X(iconst_0) X(iconst_1) X(iconst_2) X(iconst_3) X(iconst_4) X(iconst_5) X(dconst_0) X(dconst_1) X(bconst_0) \
+    X(bconst_1) X(bipush) X(sipush) X(ldc) X(ldc_int) X(ldc2_w) X(sldc) X(sldc_ref) X(iload) X(iload_0) X(iload_1) \
+    X(iload_2) X(iload_3) X(istore) X(istore_0) X(istore_1) X(istore_2) X(istore_3) X(pop) X(iadd) X(sadd) \
+    X(isub) X(imul) X(idiv) X(dadd) X(dsub) X(dmul) X(ddiv) X(iinc) X(iinc_w) X(ifeq) X(ifne) X(iflt) X(ifge) \
+    X(ifgt) X(ifle) X(if_icmpeq) X(if_icmpne) X(if_icmplt) X(if_icmpge) X(if_icmpgt) X(if_icmple) X(igoto) X(ireturn) X(vreturn) \
+    X(invokestatic) X(invoke_direct) X(invoketail) X(invokenative) X(wide)
+
+class RegisterVM;
+
+class VM{
+public:
+    //调用栈的最大深度，以及VM::stack的槽位数（每个槽位16字节，一共1MB）
+    static constexpr uint32_t MaxCallDepth = 4096;
+    static constexpr uint32_t StackSize = 64 * 1024;
+
+    //栈桢头。预先分配MaxCallDepth个，压栈时不会重新分配，所以栈桢的指针一直有效
+    std::vector<VMStackFrame> callStack;
+
+    //所有栈桢的本地变量和操作数栈，见VMStackFrame
+    std::vector<Value> stack;
+
+    //使用寄存器虚拟机执行（见regvm.h）。
+    //模块加载时把每个函数的栈式字节码翻译成寄存器指令，字节码文件的格式不变。
+    //模块里有寄存器虚拟机还不支持的指令时，仍然用栈式虚拟机执行
+    bool useRegisterTier {false};
+
+    //寄存器虚拟机，保存着翻译过的模块，同一个模块只翻译一次
+    std::shared_ptr<RegisterVM> registerVM;
+
+    //使用栈顶缓存的主循环执行（见vmcache.cpp）：操作数栈顶部的一两个值放在局部变量里，减少读写内存。
+    //字节码不变，剖析的时候仍然使用普通的主循环
+    bool useStackCache {false};
+
+    //不为空时，栈式虚拟机把执行的每一条指令记录到这里
+    OpCodeProfile* opCodeProfile {nullptr};
+
+    //是否改写快速指令，加载模块时决定，见quicken()
+    bool quickening {false};
+
+    VM(){
+    }
+
+    using BinaryFunction = Value (*)(const Value&, const Value&);
+
+    //二元运算的跳转表，下标是[操作码][左操作数标签][右操作数标签]。
+    //iadd(0x60)到ddiv(0x6f)这一段操作码是连续的。
+    static constexpr size_t NumBinaryOpCodes = static_cast<size_t>(OpCode::ddiv) - static_cast<size_t>(OpCode::iadd) + 1;
+    using BinaryOpTable = std::array<TagTable<BinaryFunction>, NumBinaryOpCodes>;
+    static const BinaryOpTable binaryOp;   //在编译期生成，见vm.cpp
+
+    static constexpr size_t BinaryOpIndex(OpCode op) {
+        return static_cast<size_t>(op) - static_cast<size_t>(OpCode::iadd);
+    }
+
+    static std::optional<BinaryFunction> GetBinaryFunction(OpCode op, const Value& l, const Value& r);
+
+    //把常量池中的一个常量转换成Value
+    static Value ToValue(const std::any& c);
+
+    //常量池转换成Value之后的结果，ldc等指令直接从这里取值，不需要any_cast。
+    //functions与常量池一一对应，是常量池里的函数的栈桢布局，不是函数的位置上sym为nullptr。
+    //同一个模块只加载一次
+    const BCModule* loadedModule {nullptr};
+    std::vector<Value> constants;
+    std::vector<VMFunction> functions;
+    VMFunction mainFunction;
+
+    /**
+     * 加载模块：校验字节码，转换常量池，算出每个函数的栈桢布局。
+     * 通过校验之后，执行时不再检查常量的类型、本地变量和调用目标。
+     * 不剖析的时候，每个函数的字节码拷贝一份给这个虚拟机，执行时改写成快速指令。
+     * 剖析的时候直接执行模块里的字节码，剖析数据按FunctionSymbol::byteCode的地址记录（见tools/gen_superinstructions.cpp）。
+     * @return 校验失败时返回false
+     */
+    bool loadModule(const BCModule& bcModule) {
+        bool quickening = this->opCodeProfile == nullptr;
+        if (this->loadedModule == &bcModule && this->constants.size() == bcModule.consts.size() && this->quickening == quickening) {
+            return true;
+        }
+        this->loadedModule = nullptr;
+        BCVerifier verifier;
+        if (!verifier.verify(bcModule)) {
+            return false;
+        }
+
+        this->constants.clear();
+        this->functions.clear();
+        for (auto& c: bcModule.consts) {
+            this->constants.push_back(VM::ToValue(c));
+            auto sym = std::any_cast<std::shared_ptr<FunctionSymbol>>(&c);
+            this->functions.push_back(sym != nullptr ? VMFunction(**sym, quickening) : VMFunction());
+        }
+        this->mainFunction = VMFunction(*bcModule._main, quickening);
+        this->quickening = quickening;
+        this->loadedModule = &bcModule;
+        return true;
+    }
+
+    /**
+     * 快速指令（quickening）：ldc、sldc、invokestatic第一次执行时，把自己的操作码改写成
+     * ldc_int、sldc_ref、invoke_direct，操作数不变，然后接着执行快速指令的处理代码。
+     * 之后再执行到这里，直接分派到快速指令：
+     * ldc_int和sldc_ref按已知的类型直接构造整数值和字符串池的引用，不用拷贝常量池里的Value；
+     * invoke_direct直接使用加载模块时算好的栈桢布局。
+     * 只改写虚拟机自己的代码副本，codeIndex是指令的开头。超级指令的组成部分不改写。
+     */
+    template<OpCode op>
+    void quicken(uint8_t* code, uint32_t codeIndex) const {
+        if constexpr (QuickOpCode(op) != op) {
+            if (this->quickening) {
+                code[codeIndex] = QuickOpCode(op);
             }
         }
-
-        return;
     }
 
-};
-
-struct VMStackFrame{
-    //对应的函数，用来找到代码
-    std::shared_ptr<FunctionSymbol> funtionSym;
-
-    //返回地址
-    uint32_t returnIndex = 0;
-
-    //本地变量
-    std::vector<int32_t> localVars;
-
-    //操作数栈
-    std::vector<std::any> oprandStack;
-
-    VMStackFrame(std::shared_ptr<FunctionSymbol>& funtionSym): funtionSym(funtionSym){
-        this->localVars.resize(funtionSym->vars.size());
+    /**
+     * 压入一个栈桢。本地变量从localVars开始，前面的实参已经放好了，其他本地变量清空。
+     * @return 调用栈太深，或者VM::stack放不下这个栈桢时返回false
+     */
+    bool pushFrame(const VMFunction& function, Value* localVars) {
+        if (this->callStack.size() == VM::MaxCallDepth ||
+            localVars + function.frameSize > this->stack.data() + this->stack.size()) {
+            dbg("Error: stack overflow when calling " + function.sym->name);
+            return false;
+        }
+        this->callStack.emplace_back(&function, localVars);
+        std::fill(localVars + function.numParams, localVars + function.numVars, Value());
+        return true;
+    }
+
+    template<OpCode op, typename T>
+    static T Arithmetic(T l, T r) {
+        if constexpr (op == OpCode::iadd || op == OpCode::dadd) {
+            return l + r;
+        } else if constexpr (op == OpCode::isub || op == OpCode::dsub) {
+            return l - r;
+        } else if constexpr (op == OpCode::imul || op == OpCode::dmul) {
+            return l * r;
+        } else {
+            return l / r;
+        }
+    }
+
+    /**
+     * 计算一条二元运算指令，每个操作码生成一个特化的版本。结果写到dst，dst可以是l或r本身。
+     * 两个操作数都是整数（iadd等）或者都是浮点数（dadd等）时，直接计算；
+     * 其他情况（整数与浮点数混合、字符串连接等）查跳转表。
+     * 栈式虚拟机和寄存器虚拟机（见regvm.h）共用这一份实现，保证两者的语义相同。
+     */
+    template<OpCode op>
+    static bool BinaryOp(Value& dst, const Value& l, const Value& r) {
+        if constexpr (op == OpCode::iadd || op == OpCode::isub || op == OpCode::imul || op == OpCode::idiv) {
+            if (l.tag == ValueTag::Integer && r.tag == ValueTag::Integer) {
+                dst = Value(Arithmetic<op>(l.i, r.i));
+                return true;
+            }
+        }
+        else if constexpr (op == OpCode::dadd || op == OpCode::dsub || op == OpCode::dmul || op == OpCode::ddiv) {
+            if (l.tag == ValueTag::Decimal && r.tag == ValueTag::Decimal) {
+                dst = Value(Arithmetic<op>(l.d, r.d));
+                return true;
+            }
+        }
+
+        auto func = VM::binaryOp[BinaryOpIndex(op)][static_cast<size_t>(l.tag)][static_cast<size_t>(r.tag)];
+        if (func == nullptr) {
+            dbg("Unsupported binary operation: " + toString(op));
+            return false;
+        }
+        dst = func(l, r);
+        return true;
+    }
+
+    /**
+     * 执行一条二元运算指令：在操作数栈上原地计算，结果留在栈顶。
+     * @param sp 栈顶指针，指向栈顶元素的下一个槽位
+     */
+    template<OpCode op>
+    static bool ExecuteBinary(Value*& sp) {
+        Value& l = sp[-2];
+        if (!VM::BinaryOp<op>(l, l, sp[-1])) {
+            return false;
+        }
+        sp--;
+        return true;
+    }
+
+    /**
+     * iinc、iinc_w：本地变量原地加上一个常量，不经过操作数栈。
+     * 整数直接修改；其他类型（比如浮点数）与iadd、isub的语义相同，也就是与 a = a + 1、a = a - 1 的结果一样。
+     */
+    static bool Increment(Value& local, int32_t delta) {
+        if (local.tag == ValueTag::Integer) {
+            local.i += delta;
+            return true;
+        }
+        if (delta >= 0) {
+            return VM::BinaryOp<OpCode::iadd>(local, local, Value(delta));
+        }
+        return VM::BinaryOp<OpCode::isub>(local, local, Value(-delta));
+    }
+
+    //条件跳转指令的比较条件。if*与if_icmp*两组指令共用，if*的右操作数是0
+    template<OpCode op, typename T>
+    static bool Condition(T l, T r) {
+        if constexpr (op == OpCode::ifeq || op == OpCode::if_icmpeq) {
+            return l == r;
+        } else if constexpr (op == OpCode::ifne || op == OpCode::if_icmpne) {
+            return l != r;
+        } else if constexpr (op == OpCode::iflt || op == OpCode::if_icmplt) {
+            return l < r;
+        } else if constexpr (op == OpCode::ifge || op == OpCode::if_icmpge) {
+            return l >= r;
+        } else if constexpr (op == OpCode::ifgt || op == OpCode::if_icmpgt) {
+            return l > r;
+        } else {
+            return l <= r;
+        }
+    }
+
+    /**
+     * 比较两个不都是整数的操作数，实现在vm.cpp中。语义与解释器相同：
+     * 整数与浮点数混合时转换成double比较；字符串和布尔值只能比较是否相等。
+     * @param op 比较的条件，用if_icmp*表示
+     * @return 两个操作数不能比较时返回false
+     */
+    static bool CompareValues(OpCode op, const Value& l, const Value& r, bool& taken);
+
+    /**
+     * 计算if_icmp*的条件。每个操作码生成一个特化的版本，操作数都是整数时直接比较，不需要查表。
+     */
+    template<OpCode op>
+    static bool CompareCondition(const Value& l, const Value& r, bool& taken) {
+        if (l.tag == ValueTag::Integer && r.tag == ValueTag::Integer) {
+            taken = Condition<op>(l.i, r.i);
+            return true;
+        }
+        return VM::CompareValues(op, l, r, taken);
+    }
+
+    /**
+     * 计算if*的条件，也就是与0比较。
+     * ifeq、ifne判断值是否成立（见Value::isTruthy），所以也可以用于布尔值等其他类型的值。
+     */
+    template<OpCode op>
+    static bool TestCondition(const Value& v, bool& taken) {
+        if (v.tag == ValueTag::Integer) {
+            taken = Condition<op>(v.i, 0);
+            return true;
+        }
+        if constexpr (op == OpCode::ifeq) {
+            taken = !v.isTruthy();
+            return true;
+        }
+        else if constexpr (op == OpCode::ifne) {
+            taken = v.isTruthy();
+            return true;
+        }
+        else {
+            return VM::CompareValues(static_cast<OpCode>(op - OpCode::ifeq + OpCode::if_icmpeq), v, Value(0), taken);
+        }
+    }
+
+    //计算一条条件跳转指令的条件，并弹出操作数
+    template<OpCode op>
+    static bool BranchCondition(Value*& sp, bool& taken) {
+        if constexpr (op >= OpCode::if_icmpeq && op <= OpCode::if_icmple) {
+            sp -= 2;
+            return VM::CompareCondition<op>(sp[0], sp[1], taken);
+        }
+        else {
+            return VM::TestCondition<op>(*--sp, taken);
+        }
+    }
+
+    /**
+     * 压栈类指令（常量、ldc、iload等）要压入的值。
+     * codeIndex指向已经读过的最后一个字节，操作数从它后面读取。
+     */
+    template<OpCode op>
+    Value loadValue(const Value* locals, const uint8_t* code, uint32_t& codeIndex) const {
+        if constexpr (op >= OpCode::iconst_0 && op <= OpCode::iconst_5) {
+            return Value(static_cast<int32_t>(op - OpCode::iconst_0));
+        }
+        else if constexpr (op == OpCode::dconst_0 || op == OpCode::dconst_1) {
+            return Value(op == OpCode::dconst_0 ? 0.0 : 1.0);
+        }
+        else if constexpr (op == OpCode::bconst_0 || op == OpCode::bconst_1) {
+            return Value(op == OpCode::bconst_1);
+        }
+        else if constexpr (op == OpCode::bipush) {
+            return Value(static_cast<int32_t>(static_cast<int8_t>(code[++codeIndex])));
+        }
+        else if constexpr (op == OpCode::sipush) {
+            int8_t byte1 = code[++codeIndex];
+            uint8_t byte2 = code[++codeIndex];
+            return Value(static_cast<int32_t>((byte1<<8)|byte2));
+        }
+        else if constexpr (op == OpCode::ldc_int) {
+            return Value(this->constants[code[++codeIndex]].i);
+        }
+        else if constexpr (op == OpCode::sldc_ref) {
+            return Value(this->constants[code[++codeIndex]].s);
+        }
+        else if constexpr (op == OpCode::ldc || op == OpCode::sldc || op == OpCode::ldc2_w) {
+            uint32_t constIndex = code[++codeIndex];
+            if constexpr (op == OpCode::ldc2_w) {
+                constIndex = constIndex<<8 | code[++codeIndex];
+            }
+            return this->constants[constIndex];
+        }
+        else if constexpr (op == OpCode::iload) {
+            return locals[code[++codeIndex]];
+        }
+        else {
+            static_assert(op >= OpCode::iload_0 && op <= OpCode::iload_3, "not a load op code");
+            return locals[op - OpCode::iload_0];
+        }
+    }
+
+    /**
+     * 执行超级指令中的一条组成指令，语义与单独执行这条指令相同。
+     * codeIndex指向已经读过的最后一个字节，操作数从它后面读取。
+     */
+    template<OpCode op>
+    bool executeStep(Value* locals, Value*& sp, const uint8_t* code, uint32_t& codeIndex) {
+        if constexpr (OpCodeInfos[op].pops == 0 && OpCodeInfos[op].pushes == 1) {
+            *sp++ = this->loadValue<op>(locals, code, codeIndex);
+        }
+        else if constexpr (op == OpCode::istore) {
+            locals[code[++codeIndex]] = *--sp;
+        }
+        else if constexpr (op >= OpCode::istore_0 && op <= OpCode::istore_3) {
+            locals[op - OpCode::istore_0] = *--sp;
+        }
+        else if constexpr (op == OpCode::iinc) {
+            uint8_t index = code[++codeIndex];
+            int8_t delta = code[++codeIndex];
+            return VM::Increment(locals[index], delta);
+        }
+        else {
+            static_assert((op >= OpCode::iadd && op <= OpCode::ddiv), "not a fusible op code");
+            return VM::ExecuteBinary<op>(sp);
+        }
+        return true;
     }
-};
 
-class VM{
-public:
-    std::vector<std::shared_ptr<VMStackFrame>> callStack;
-
-    VM(){
-        std::call_once(flag, [](){
-            dbg("VM::InitBinaryFunction: called once");
-            InitBinaryFunction();
-        });
+    //依次执行超级指令的各条组成指令
+    template<OpCode... ops>
+    bool executeSteps(Value* locals, Value*& sp, const uint8_t* code, uint32_t& codeIndex) {
+        return (this->executeStep<ops>(locals, sp, code, codeIndex) && ...);
     }
 
-    using BinaryFunction = std::function<std::any(const std::any&, const std::any&)>;
-    static std::map<OpCode,
-                    std::map<std::type_index,
-                        std::map<std::type_index,
-                            BinaryFunction>>> binaryOp;
-    static void InitBinaryFunction();
-    static std::optional<BinaryFunction> GetBinaryFunction(OpCode op, const std::any& l, const std::any& r);
-    static std::once_flag flag;
-
     /**
      * 运行一个模块。
      * @param bcModule
      */
     int32_t execute(const BCModule& bcModule){
 
+        int32_t ret = 0;
+        if (this->useRegisterTier && this->executeRegister(bcModule, ret)) {
+            return ret;
+        }
+
         //找到入口函数
-        std::shared_ptr<FunctionSymbol> functionSym;
         if (bcModule._main == nullptr){
             dbg("Can not find main function.");
             return -1;
         }
-        else{
-            functionSym = bcModule._main;
+
+        if (!this->loadModule(bcModule)) {
+            return -1;
+        }
+        if (this->mainFunction.codeLength == 0){
+            dbg("Can not find code for "+ bcModule._main->name);
+            return -1;
         }
 
-        //创建栈桢
-        auto frame = std::make_shared<VMStackFrame>(functionSym);
-        this->callStack.push_back(frame);
+        //分配调用栈。上一次执行出错时可能留下了栈桢，也一起清掉
+        if (this->stack.size() != VM::StackSize) {
+            this->stack.resize(VM::StackSize);
+            this->callStack.reserve(VM::MaxCallDepth);
+        }
+        this->callStack.clear();
 
-        //当前运行的代码
-        std::vector<uint8_t> code;
-        if (!functionSym->byteCode.empty()){
-            code = functionSym->byteCode;
+        //创建栈桢
+        Value* locals = this->stack.data();
+        if (!this->pushFrame(this->mainFunction, locals)) {
+            return -2;
         }
-        else{
-            dbg("Can not find code for "+ frame->funtionSym->name);
-            return -1;
+        VMStackFrame* frame = &this->callStack.back();
+
+        if (this->useStackCache && this->opCodeProfile == nullptr) {
+            return this->executeCached(locals);
         }
 
+        //操作数栈的栈顶，指向栈顶元素的下一个槽位
+        Value* sp = locals + this->mainFunction.numVars;
+
+        //当前运行的代码，指向当前栈桢的函数的字节码。快速指令会改写它，见quicken()
+        uint8_t* code = frame->function->code;
+
         //当前代码的位置
         uint32_t codeIndex = 0;
 
         //一直执行代码，直到遇到return语句
         uint8_t opCode = code[codeIndex];
 
+        //原生函数表。执行期间不会注册新的函数，所以这个指针一直有效
+        const NativeFunction* natives = NativeFunctions().data();
+
         //临时变量
         int8_t byte1 = 0;
         int8_t byte2 = 0;
-        std::any vleft;
-        std::any vright;
-
-        int32_t tmpLocal = 0;
-
-        std::any anyTmp;
         uint32_t constIndex = 0;
-        int32_t numValue = 0;
-        std::string strValue;
+        bool taken = false;
+
+#if VM_COMPUTED_GOTO
+        //指令的处理代码的地址，下标是操作码。没有处理代码的操作码跳到default
+#define VM_HANDLER_LABEL(op) &&L_##op,
+#define VM_HANDLER_POSITION(op) OpCode::op,
+#define VM_SUPERINSTRUCTION_LABEL(value, name, ...) &&L_##name,
+#define VM_SUPERINSTRUCTION_POSITION(value, name, ...) OpCode::name,
+        static void* const labels[] = {VM_HANDLED_OPCODES(VM_HANDLER_LABEL) VM_SUPERINSTRUCTIONS(VM_SUPERINSTRUCTION_LABEL)};
+        static const uint16_t positions[] = {VM_HANDLED_OPCODES(VM_HANDLER_POSITION) VM_SUPERINSTRUCTIONS(VM_SUPERINSTRUCTION_POSITION)};
+#undef VM_SUPERINSTRUCTION_POSITION
+#undef VM_SUPERINSTRUCTION_LABEL
+#undef VM_HANDLER_POSITION
+#undef VM_HANDLER_LABEL
+        static const DispatchTable<256> handlers =
+            MakeDispatchTable<256>(&&L_default, labels, positions, sizeof(labels) / sizeof(labels[0]));
+
+        //剖析的时候，每条指令都先跳到L_profile，记录之后再跳到真正的处理代码。
+        //不剖析的时候直接使用handlers，没有额外的开销。两张表都是静态的，每次执行只选择一次
+        static const DispatchTable<256> profiling = MakeDispatchTable<256>(&&L_profile, nullptr, nullptr, 0);
+        void* const* dispatchTable = this->opCodeProfile != nullptr ? profiling.labels : handlers.labels;
+
+        //第一条指令是通过switch分派的，在这里记录
+        if (this->opCodeProfile != nullptr) {
+            this->opCodeProfile->record(code, codeIndex);
+        }
+#endif
 
         while(true){
+#if !VM_COMPUTED_GOTO
+            if (this->opCodeProfile != nullptr) {
+                this->opCodeProfile->record(code, codeIndex);
+            }
+#endif
             switch (opCode){
-                case OpCode::iconst_0:
-                    frame->oprandStack.push_back(static_cast<int8_t>(0));
+                VM_CASE(iconst_0)
+                    *sp++ = Value(static_cast<int32_t>(0));
                     opCode = code[++codeIndex];
-                    break;
-                case OpCode::iconst_1:
-                    frame->oprandStack.push_back(static_cast<int8_t>(1));
+                    VM_DISPATCH();
+                VM_CASE(iconst_1)
+                    *sp++ = Value(static_cast<int32_t>(1));
                     opCode = code[++codeIndex];
-                    break;
-                case OpCode::iconst_2:
-                    frame->oprandStack.push_back(static_cast<int8_t>(2));
+                    VM_DISPATCH();
+                VM_CASE(iconst_2)
+                    *sp++ = Value(static_cast<int32_t>(2));
                     opCode = code[++codeIndex];
-                    break;
-                case OpCode::iconst_3:
-                    frame->oprandStack.push_back(static_cast<int8_t>(3));
+                    VM_DISPATCH();
+                VM_CASE(iconst_3)
+                    *sp++ = Value(static_cast<int32_t>(3));
                     opCode = code[++codeIndex];
-                    break;
-                case OpCode::iconst_4:
-                    frame->oprandStack.push_back(static_cast<int8_t>(4));
+                    VM_DISPATCH();
+                VM_CASE(iconst_4)
+                    *sp++ = Value(static_cast<int32_t>(4));
                     opCode = code[++codeIndex];
-                    break;
-                case OpCode::iconst_5:
-                    frame->oprandStack.push_back(static_cast<int8_t>(5));
+                    VM_DISPATCH();
+                VM_CASE(iconst_5)
+                    *sp++ = Value(static_cast<int32_t>(5));
                     opCode = code[++codeIndex];
-                    break;
-                case OpCode::bipush:  //取出1个字节
-                    frame->oprandStack.push_back(static_cast<int8_t>(code[++codeIndex]));
+                    VM_DISPATCH();
+                VM_CASE(dconst_0)
+                    *sp++ = Value(0.0);
                     opCode = code[++codeIndex];
-                    break;
-                case OpCode::sipush:  //取出2个字节
+                    VM_DISPATCH();
+                VM_CASE(dconst_1)
+                    *sp++ = Value(1.0);
+                    opCode = code[++codeIndex];
+                    VM_DISPATCH();
+                VM_CASE(bconst_0)
+                    *sp++ = Value(false);
+                    opCode = code[++codeIndex];
+                    VM_DISPATCH();
+                VM_CASE(bconst_1)
+                    *sp++ = Value(true);
+                    opCode = code[++codeIndex];
+                    VM_DISPATCH();
+                VM_CASE(bipush)  //取出1个字节
+                    *sp++ = Value(static_cast<int32_t>(static_cast<int8_t>(code[++codeIndex])));
+                    opCode = code[++codeIndex];
+                    VM_DISPATCH();
+                VM_CASE(sipush)  //取出2个字节
                     byte1 = code[++codeIndex];
                     byte2 = code[++codeIndex];
-                    frame->oprandStack.push_back((byte1<<8)|byte2);
+                    //高字节带符号，低字节不带符号
+                    *sp++ = Value(static_cast<int32_t>((byte1<<8)|static_cast<uint8_t>(byte2)));
                     opCode = code[++codeIndex];
-                    break;
+                    VM_DISPATCH();
 
-                case OpCode::ldc:   //从常量池加载
+                //常量的类型在加载模块时已经校验过了（见BCVerifier）
+                VM_CASE(ldc)   //从常量池加载，第一次执行时改写成ldc_int
+                    this->quicken<OpCode::ldc>(code, codeIndex);
+                    [[fallthrough]];
+                VM_CASE(ldc_int)   //校验器保证了常量是整数
                     constIndex = code[++codeIndex];
-                    anyTmp = bcModule.consts[constIndex];
-
-                    if (!isType<int32_t>(anyTmp)) {
-                        dbg("Error: ldc value type not int32 at: " + std::to_string(codeIndex - 1));
-                        return -2;
-                    }
-                    numValue = std::any_cast<int32_t>(anyTmp);
-                    frame->oprandStack.push_back(numValue);
+                    *sp++ = Value(this->constants[constIndex].i);
                     opCode = code[++codeIndex];
-                    break;
+                    VM_DISPATCH();
 
 
-                case OpCode::sldc:   //从常量池加载字符串
+                VM_CASE(ldc2_w)   //从常量池加载浮点数
+                    byte1 = code[++codeIndex];
+                    byte2 = code[++codeIndex];
+                    constIndex = static_cast<uint8_t>(byte1)<<8 | static_cast<uint8_t>(byte2);
+                    *sp++ = this->constants[constIndex];
+                    opCode = code[++codeIndex];
+                    VM_DISPATCH();
+
+                VM_CASE(sldc)   //从常量池加载字符串，第一次执行时改写成sldc_ref
+                    this->quicken<OpCode::sldc>(code, codeIndex);
+                    [[fallthrough]];
+                VM_CASE(sldc_ref)   //常量池里的字符串都在字符串池里，直接引用
                     constIndex = code[++codeIndex];
-                    anyTmp = bcModule.consts[constIndex];
-                    if (!isType<std::string>(anyTmp)) {
-                        dbg("Error: sldc value type not string at: " + std::to_string(codeIndex - 1));
-                        return -2;
-                    }
-                    strValue = std::any_cast<std::string>(anyTmp);
-                    frame->oprandStack.push_back(strValue);
+                    *sp++ = Value(this->constants[constIndex].s);
                     opCode = code[++codeIndex];
-                    break;
-                case OpCode::iload:
-                    frame->oprandStack.push_back(frame->localVars[code[++codeIndex]]);
+                    VM_DISPATCH();
+                VM_CASE(iload)
+                    *sp++ = locals[code[++codeIndex]];
                     opCode = code[++codeIndex];
-                    break;
-                case OpCode::iload_0:
-                    frame->oprandStack.push_back(frame->localVars[0]);
+                    VM_DISPATCH();
+                VM_CASE(iload_0)
+                    *sp++ = locals[0];
                     opCode = code[++codeIndex];
-                    break;
-                case OpCode::iload_1:
-                    frame->oprandStack.push_back(frame->localVars[1]);
+                    VM_DISPATCH();
+                VM_CASE(iload_1)
+                    *sp++ = locals[1];
                     opCode = code[++codeIndex];
-                    break;
-                case OpCode::iload_2:
-                    frame->oprandStack.push_back(frame->localVars[2]);
+                    VM_DISPATCH();
+                VM_CASE(iload_2)
+                    *sp++ = locals[2];
                     opCode = code[++codeIndex];
-                    break;
-                case OpCode::iload_3:
-                    frame->oprandStack.push_back(frame->localVars[3]);
+                    VM_DISPATCH();
+                VM_CASE(iload_3)
+                    *sp++ = locals[3];
                     opCode = code[++codeIndex];
-                    break;
+                    VM_DISPATCH();
+
+                VM_CASE(istore)
+                    locals[code[++codeIndex]] = *--sp;
+                    opCode = code[++codeIndex];
+                    VM_DISPATCH();
+                VM_CASE(istore_0)
+                    locals[0] = *--sp;
+                    opCode = code[++codeIndex];
+                    VM_DISPATCH();
+                VM_CASE(istore_1)
+                    locals[1] = *--sp;
+                    opCode = code[++codeIndex];
+                    VM_DISPATCH();
+                VM_CASE(istore_2)
+                    locals[2] = *--sp;
+                    opCode = code[++codeIndex];
+                    VM_DISPATCH();
+                VM_CASE(istore_3)
+                    locals[3] = *--sp;
+                    opCode = code[++codeIndex];
+                    VM_DISPATCH();
 
-                case OpCode::istore:
-                    anyTmp = frame->oprandStack.back();
-                    frame->oprandStack.pop_back();
-                    if (!isType<int32_t>(anyTmp)) {
-                        dbg("Error: istore value type not int32_t at: " + std::to_string(codeIndex - 1));
+                VM_CASE(pop)
+                    --sp;
+                    opCode = code[++codeIndex];
+                    VM_DISPATCH();
+
+                VM_CASE(iadd)
+                    if (!VM::ExecuteBinary<OpCode::iadd>(sp)) {
                         return -2;
                     }
-                    tmpLocal = std::any_cast<int32_t>(anyTmp);
-                    frame->localVars[code[++codeIndex]] = tmpLocal;
                     opCode = code[++codeIndex];
-                    break;
-
-                case OpCode::istore_0:
-                {
-                    anyTmp = frame->oprandStack.back();
-                    frame->oprandStack.pop_back();
-                    if (isType<int32_t>(anyTmp)) {
-                        tmpLocal = std::any_cast<int32_t>(anyTmp);
-                    } else if (isType<int8_t>(anyTmp)) {
-                        tmpLocal = std::any_cast<int8_t>(anyTmp);
-                    } else {
-                        dbg("Error: istore value type not int32_t/int8_t at: " + std::string(anyTmp.type().name()));
+                    VM_DISPATCH();
+                VM_CASE(sadd)
+                    if (!VM::ExecuteBinary<OpCode::sadd>(sp)) {
                         return -2;
                     }
-
-                    frame->localVars[0] = tmpLocal;
                     opCode = code[++codeIndex];
-                    break;
-                }
-                case OpCode::istore_1:
-                    anyTmp = frame->oprandStack.back();
-                    frame->oprandStack.pop_back();
-                    if (!isType<int32_t>(anyTmp)) {
-                        dbg("Error: istore value type not int32_t at: " + std::to_string(codeIndex - 1));
+                    VM_DISPATCH();
+                VM_CASE(isub)
+                    if (!VM::ExecuteBinary<OpCode::isub>(sp)) {
                         return -2;
                     }
-                    tmpLocal = std::any_cast<int32_t>(anyTmp);
-
-                    frame->localVars[1] = tmpLocal;
                     opCode = code[++codeIndex];
-                    break;
-                case OpCode::istore_2:
-                    anyTmp = frame->oprandStack.back();
-                    frame->oprandStack.pop_back();
-                    if (!isType<int32_t>(anyTmp)) {
-                        dbg("Error: istore value type not int32_t at: " + std::to_string(codeIndex - 1));
+                    VM_DISPATCH();
+                VM_CASE(imul)
+                    if (!VM::ExecuteBinary<OpCode::imul>(sp)) {
                         return -2;
                     }
-                    tmpLocal = std::any_cast<int32_t>(anyTmp);
-
-                    frame->localVars[2] = tmpLocal;
                     opCode = code[++codeIndex];
-                    break;
-                case OpCode::istore_3:
-                    anyTmp = frame->oprandStack.back();
-                    frame->oprandStack.pop_back();
-                    if (!isType<int32_t>(anyTmp)) {
-                        dbg("Error: istore value type not int32_t at: " + std::to_string(codeIndex - 1));
+                    VM_DISPATCH();
+                VM_CASE(idiv)
+                    if (!VM::ExecuteBinary<OpCode::idiv>(sp)) {
                         return -2;
                     }
-                    tmpLocal = std::any_cast<int32_t>(anyTmp);
-
-                    frame->localVars[3] = tmpLocal;
                     opCode = code[++codeIndex];
-                    break;
-
-                case OpCode::iadd:
-                case OpCode::isub:
-                case OpCode::imul:
-                case OpCode::idiv:
-                {
-                    vright = frame->oprandStack.back();
-                    frame->oprandStack.pop_back();
-                    vleft = frame->oprandStack.back();
-                    frame->oprandStack.pop_back();
-
-                    auto func = VM::GetBinaryFunction(static_cast<OpCode>(opCode), vleft, vright);
-                    if (!func) {
-                        dbg("Unsupported binary operation: " + toString(static_cast<OpCode>(opCode)));
+                    VM_DISPATCH();
+                VM_CASE(dadd)
+                    if (!VM::ExecuteBinary<OpCode::dadd>(sp)) {
                         return -2;
                     }
-
-                    auto ret = func.value()(vleft, vright);
-                    frame->oprandStack.push_back(ret);
                     opCode = code[++codeIndex];
-                    break;
-                }
-
-/*
-                case OpCode::sadd:
-                case OpCode::iinc:
-                    auto varIndex = code[++codeIndex];
-                    auto offset = code[++codeIndex];
-                    frame->localVars[varIndex] = frame->localVars[varIndex]+offset;
+                    VM_DISPATCH();
+                VM_CASE(dsub)
+                    if (!VM::ExecuteBinary<OpCode::dsub>(sp)) {
+                        return -2;
+                    }
                     opCode = code[++codeIndex];
-                    break;
-*/
+                    VM_DISPATCH();
+                VM_CASE(dmul)
+                    if (!VM::ExecuteBinary<OpCode::dmul>(sp)) {
+                        return -2;
+                    }
+                    opCode = code[++codeIndex];
+                    VM_DISPATCH();
+                VM_CASE(ddiv)
+                    if (!VM::ExecuteBinary<OpCode::ddiv>(sp)) {
+                        return -2;
+                    }
+                    opCode = code[++codeIndex];
+                    VM_DISPATCH();
+
+                VM_CASE(iinc)
+                    if (!VM::Increment(locals[code[codeIndex + 1]], static_cast<int8_t>(code[codeIndex + 2]))) {
+                        return -2;
+                    }
+                    codeIndex += 3;
+                    opCode = code[codeIndex];
+                    VM_DISPATCH();
+                VM_CASE(iinc_w)
+                    if (!VM::Increment(locals[code[codeIndex + 1] << 8 | code[codeIndex + 2]],
+                                       static_cast<int16_t>(code[codeIndex + 3] << 8 | code[codeIndex + 4]))) {
+                        return -2;
+                    }
+                    codeIndex += 5;
+                    opCode = code[codeIndex];
+                    VM_DISPATCH();
 
-                case OpCode::ireturn:
-                case OpCode::vreturn:
+                VM_CASE(ireturn)
+                VM_CASE(vreturn)
                 {
                     //确定返回值
-                    std::any retValue;
+                    Value retValue;
                     if(opCode == OpCode::ireturn){
-                        retValue = frame->oprandStack.back();
-                        frame->oprandStack.pop_back();
+                        retValue = *--sp;
                     }
 
-                    //弹出栈桢，返回到上一级函数，继续执行
+                    //弹出栈桢，返回到上一级函数，继续执行。
+                    //被调用者的本地变量是从调用者的实参开始的，退回到这里，也就弹出了实参
+                    sp = frame->localVars;
                     this->callStack.pop_back();
                     if (this->callStack.empty()){ //主程序返回，结束运行
                         return 0;
                     }
                     else { //返回到上一级调用者
-                        frame = this->callStack.back();
+                        frame = &this->callStack.back();
+                        locals = frame->localVars;
                         //设置返回值到上一级栈桢
-                        // frame.retValue = retValue;
                         if(opCode == OpCode::ireturn){
-                            frame->oprandStack.push_back(retValue);
-                        }
-                        //设置新的code、codeIndex和oPCode
-                        if (!frame->funtionSym->byteCode.empty()){
-                            //切换到调用者的代码
-                            code = frame->funtionSym->byteCode;
-                            //设置指令指针为返回地址，也就是调用该函数的下一条指令
-                            codeIndex = frame->returnIndex;
-                            opCode = code[codeIndex];
-                            break;
-                        }
-                        else{
-                            dbg("Can not find code for " + frame->funtionSym->name);
-                            return -1;
+                            *sp++ = retValue;
                         }
+                        //切换到调用者的代码
+                        code = frame->function->code;
+                        //设置指令指针为返回地址，也就是调用该函数的下一条指令
+                        codeIndex = frame->returnIndex;
+                        opCode = code[codeIndex];
+                        VM_DISPATCH();
                     }
-                    break;
                 }
 
-                case OpCode::invokestatic:
+                VM_CASE(invokestatic)   //第一次执行时改写成invoke_direct
+                    this->quicken<OpCode::invokestatic>(code, codeIndex);
+                    [[fallthrough]];
+                VM_CASE(invoke_direct)
                 {
-                    //从常量池找到被调用的函数
-                    byte1 = code[++codeIndex];
-                    byte2 = code[++codeIndex];
-                    auto sym = bcModule.consts[byte1<<8|byte2];
-                    if (!isType<std::shared_ptr<FunctionSymbol>>(sym)) {
-                        dbg("Error: invokestatic expect is std::shared_ptr<FunctionSymbol>, index: " + std::to_string(byte1<<8|byte2));
-                        return -2;
-                    }
+                    //找到被调用的函数。校验器保证了这个常量是有字节码的函数，栈桢布局在加载模块时已经算好了
+                    constIndex = code[codeIndex + 1] << 8 | code[codeIndex + 2];
+                    codeIndex += 2;
+                    const VMFunction& callee = this->functions[constIndex];
 
-                    functionSym = std::any_cast<std::shared_ptr<FunctionSymbol>>(sym);
+                    //设置返回值地址，为函数调用的下一条指令
+                    frame->returnIndex = codeIndex + 1;
 
-                    //对于内置函数特殊处理
-                    if(functionSym->name == "println"){
-                        dbg("VM call println");
-                        //取出一个参数
-                        auto param = frame->oprandStack.back();
-                        frame->oprandStack.pop_back();
-                        opCode = code[++codeIndex];
-                        PrintAny(param);   //打印显示
-                    }
-                    else if(functionSym->name == "tick"){
-                        opCode = code[++codeIndex];
-                        // TODO add some time
-                        int32_t value = 1024;
-                        frame->oprandStack.push_back(value);
+                    //新的栈桢从实参开始，实参就是被调用者的前几个本地变量，不需要拷贝
+                    locals = sp - callee.numParams;
+                    if (!this->pushFrame(callee, locals)) {
+                        return -2;
                     }
-                    else if(functionSym->name == "integer_to_string"){
-                        opCode = code[++codeIndex];
-                        anyTmp =frame->oprandStack.back();
-                        frame->oprandStack.pop_back();
-
-                        if (!isType<int32_t>(anyTmp)) {
-                            dbg("Error: invokestatic integer_to_string expect int32_t, but: " + std::string(anyTmp.type().name()));
-                        }
+                    frame = &this->callStack.back();
+                    sp = locals + callee.numVars;
 
-                        numValue = std::any_cast<int32_t>(anyTmp);
+                    //切换到被调用函数的代码，代码指针归零
+                    code = callee.code;
+                    codeIndex = 0;
+                    opCode = code[codeIndex];
+                    VM_DISPATCH();
+                }
 
-                        frame->oprandStack.push_back(std::to_string(numValue));
+                //内置函数和注册的原生函数：按编号查表调用。校验器保证了编号有效。
+                //实参在操作数栈顶，原地调用，返回值写到第一个实参的位置
+                VM_CASE(invokenative)
+                {
+                    const NativeFunction& native = natives[code[++codeIndex]];
+                    Value* args = sp - native.numParams;
+                    if (!native.call(args, *args)) {
+                        dbg("Error: invokenative " + native.name + " argument type mismatch");
+                        return -2;
                     }
-                    else{
-                        //设置返回值地址，为函数调用的下一条指令
-                        frame->returnIndex = codeIndex + 1;
-
-                        //创建新的栈桢
-                        auto lastFrame = frame;
-                        frame = std::make_shared<VMStackFrame>(functionSym);
-                        this->callStack.push_back(frame);
-
-                        //传递参数
-                        auto paramCount = functionSym->getNumParams();
-                        for(int32_t i = paramCount -1; i>= 0; i--){
-                            auto tmp = lastFrame->oprandStack.back();
-                            lastFrame->oprandStack.pop_back();
-
-                            if (!isType<int8_t>(tmp)) {
-                                dbg("Error: invokestatic param expect int8_t, but: " + std::string(tmp.type().name()));
-                            }
-
-                            frame->localVars[i] = std::any_cast<int8_t>(tmp);
-                        }
+                    sp = native.returnsValue ? args + 1 : args;
+                    opCode = code[++codeIndex];
+                    VM_DISPATCH();
+                }
 
-                        //设置新的code、codeIndex和oPCode
-                        if (!frame->funtionSym->byteCode.empty()){
-                            //切换到被调用函数的代码
-                            code = frame->funtionSym->byteCode;
-                            //代码指针归零
-                            codeIndex = 0;
-                            opCode = code[codeIndex];
-                            break;
-                        }
-                        else{
-                            dbg("Can not find code for "+ frame->funtionSym->name);
-                            return -1;
-                        }
+                VM_CASE(invoketail)
+                {
+                    //找到被调用的函数。校验器保证了被尾调用的函数有字节码
+                    constIndex = code[codeIndex + 1] << 8 | code[codeIndex + 2];
+                    codeIndex += 2;
+                    const VMFunction& callee = this->functions[constIndex];
+
+                    //复用当前栈桢：参数在操作数栈的顶部，移到本地变量里。
+                    //returnIndex保存在调用者的栈桢里，不需要改变，被调用函数会直接返回到当前函数的调用者
+                    std::copy(sp - callee.numParams, sp, locals);
+                    this->callStack.pop_back();
+                    if (!this->pushFrame(callee, locals)) {
+                        return -2;
                     }
-                    break;
+                    frame = &this->callStack.back();
+                    sp = locals + callee.numVars;
+
+                    //切换到被调用函数的代码
+                    code = callee.code;
+                    codeIndex = 0;
+                    opCode = code[codeIndex];
+                    VM_DISPATCH();
                 }
 
-/*
-                case OpCode::ifeq:
-                    byte1 = code[++codeIndex];
-                    byte2 = code[++codeIndex];
-                    if(frame->oprandStack.pop() == 0){
-                        codeIndex = byte1<<8|byte2;
-                        opCode = code[codeIndex];
-                    }
-                    else{
-                        opCode = code[++codeIndex];
-                    }
-                    break;
-                case OpCode::ifne:
-                    byte1 = code[++codeIndex];
-                    byte2 = code[++codeIndex];
-                    if(frame->oprandStack.pop() != 0){
-                        codeIndex = byte1<<8|byte2;
-                        opCode = code[codeIndex];
-                    }
-                    else{
-                        opCode = code[++codeIndex];
-                    }
-                    break;
-                case OpCode::if_icmplt:
-                    byte1 = code[++codeIndex];
-                    byte2 = code[++codeIndex];
-                    vright = frame->oprandStack.pop();
-                    vleft = frame->oprandStack.pop();
-                    if(vleft < vright){
-                        codeIndex = byte1<<8|byte2;
-                        opCode = code[codeIndex];
-                    }
-                    else{
-                        opCode = code[++codeIndex];
-                    }
-                    break;
-                case OpCode::if_icmpge:
-                    byte1 = code[++codeIndex];
-                    byte2 = code[++codeIndex];
-                    vright = frame->oprandStack.pop();
-                    vleft = frame->oprandStack.pop();
-                    if(vleft >= vright){
-                        codeIndex = byte1<<8|byte2;
-                        opCode = code[codeIndex];
-                    }
-                    else{
-                        opCode = code[++codeIndex];
-                    }
-                    break;
-                case OpCode::if_icmpgt:
-                    byte1 = code[++codeIndex];
-                    byte2 = code[++codeIndex];
-                    vright = frame->oprandStack.pop();
-                    vleft = frame->oprandStack.pop();
-                    if(vleft > vright){
-                        codeIndex = byte1<<8|byte2;
-                        opCode = code[codeIndex];
-                    }
-                    else{
-                        opCode = code[++codeIndex];
-                    }
-                    break;
-                case OpCode::if_icmple:
-                    byte1 = code[++codeIndex];
-                    byte2 = code[++codeIndex];
-                    vright = frame->oprandStack.pop();
-                    vleft = frame->oprandStack.pop();
-                    if(vleft <= vright){
-                        codeIndex = byte1<<8|byte2;
-                        opCode = code[codeIndex];
-                    }
-                    else{
-                        opCode = code[++codeIndex];
+                //条件跳转：条件成立时跳到操作数给出的位置，否则执行下一条指令
+#define VM_BRANCH_HANDLER(name) \
+                VM_CASE(name) \
+                    if (!VM::BranchCondition<OpCode::name>(sp, taken)) { \
+                        return -2; \
+                    } \
+                    codeIndex = taken ? (code[codeIndex + 1] << 8 | code[codeIndex + 2]) : codeIndex + 3; \
+                    opCode = code[codeIndex]; \
+                    VM_DISPATCH();
+                VM_BRANCH_HANDLER(ifeq)
+                VM_BRANCH_HANDLER(ifne)
+                VM_BRANCH_HANDLER(iflt)
+                VM_BRANCH_HANDLER(ifge)
+                VM_BRANCH_HANDLER(ifgt)
+                VM_BRANCH_HANDLER(ifle)
+                VM_BRANCH_HANDLER(if_icmpeq)
+                VM_BRANCH_HANDLER(if_icmpne)
+                VM_BRANCH_HANDLER(if_icmplt)
+                VM_BRANCH_HANDLER(if_icmpge)
+                VM_BRANCH_HANDLER(if_icmpgt)
+                VM_BRANCH_HANDLER(if_icmple)
+#undef VM_BRANCH_HANDLER
+
+                VM_CASE(igoto)
+                    codeIndex = code[codeIndex + 1] << 8 | code[codeIndex + 2];
+                    opCode = code[codeIndex];
+                    VM_DISPATCH();
+
+                //带wide前缀的指令很少见，不单独分派
+                VM_CASE(wide)
+                    if (!this->executeWide(locals, sp, code, codeIndex)) {
+                        return -2;
                     }
-                    break;
-                case OpCode::goto:
-                    byte1 = code[++codeIndex];
-                    byte2 = code[++codeIndex];
-                    codeIndex = byte1<<8|byte2;
                     opCode = code[codeIndex];
-                    break;
-*/
+                    VM_DISPATCH();
+
+                //超级指令，依次执行各条组成指令
+#define VM_SUPERINSTRUCTION_HANDLER(value, name, ...) \
+                VM_CASE(name) \
+                    if (!this->executeSteps<__VA_ARGS__>(locals, sp, code, codeIndex)) { \
+                        return -2; \
+                    } \
+                    opCode = code[++codeIndex]; \
+                    VM_DISPATCH();
+                VM_SUPERINSTRUCTIONS(VM_SUPERINSTRUCTION_HANDLER)
+#undef VM_SUPERINSTRUCTION_HANDLER
+
                 default:
+                VM_DEFAULT
                     dbg("Unknown or Unsupported op code: "+ toString(static_cast<OpCode>(opCode)));
                     return -2;
             }
+
+#if VM_COMPUTED_GOTO
+        L_profile:
+            this->opCodeProfile->record(code, codeIndex);
+            goto *handlers.labels[opCode];
+#endif
         }
 
         return 0;
     }
 
+    /**
+     * 执行一条带wide前缀的指令，实现在vm.cpp。
+     * codeIndex指向wide前缀，执行完指向下一条要执行的指令
+     */
+    bool executeWide(Value* locals, Value*& sp, const uint8_t* code, uint32_t& codeIndex);
+
+    /**
+     * 用寄存器虚拟机运行一个模块，实现在regvm.cpp。
+     * @return 模块不能翻译成寄存器指令时返回false，ret是运行结果
+     */
+    bool executeRegister(const BCModule& bcModule, int32_t& ret);
+
+    /**
+     * 用栈顶缓存的主循环执行，实现在vmcache.cpp。入口函数的栈桢已经压入了。
+     * @param locals 入口函数的本地变量
+     * @return 与execute()相同
+     */
+    int32_t executeCached(Value* locals);
+
 };
 
 class BCModuleWriter {
@@ -1072,7 +2423,9 @@ public:
             return false;
         }
 
-        auto it = find(this->types.begin(), this->types.end(), t);
+        //联合类型每次解析都会新建对象，所以按名称去重
+        auto it = std::find_if(this->types.begin(), this->types.end(),
+            [&t](const std::shared_ptr<Type>& x){ return x->name == t->name; });
         if (it != this->types.end()){
             return false;
         }
@@ -1089,11 +2442,16 @@ public:
 
         // dbg(std::string("bcModule.consts size: ") + std::to_string(bcModule.consts.size()));
         //写入常量
-        uint8_t numConsts = 0;
+        uint32_t numConsts = 0;
         for(auto& c: bcModule.consts){
             if (isType<int32_t>(c)){
                 bc2.push_back(1); //代表接下来是一个number；
-                bc2.push_back(std::any_cast<int32_t>(c));
+                this->writeVarInt(bc2, std::any_cast<int32_t>(c));
+                numConsts++;
+            }
+            else if (isType<double>(c)){
+                bc2.push_back(4); //代表接下来是一个double；
+                this->writeDouble(bc2, std::any_cast<double>(c));
                 numConsts++;
             }
             else if (isType<std::string>(c)){
@@ -1118,23 +2476,30 @@ public:
         //写入类型
         std::vector<uint8_t> bc1;
         this->writeString(bc1,"types");
-        bc1.push_back(this->types.size());
-        for (auto t: this->types){
+        //写入函数类型的时候可能会加入新的参数类型，所以不能用迭代器遍历
+        std::vector<uint8_t> bcTypes;
+        for (size_t i = 0; i < this->types.size(); i++){
+            auto t = this->types[i];
             std::vector<uint8_t> tmp;
             if (t->isFunctionType()){
                 tmp = this->writeFunctionType(t);
             }
+            else if (t->isUnionType()){
+                tmp = this->writeUnionType(t);
+            }
             else if (t->isSimpleType()){
                 tmp = this->writeSimpleType(t);
             }
             else{
                 dbg("Unsupported type in BCModuleWriter: " + t->name);
             }
-            bc1.insert(bc1.end(), tmp.begin(), tmp.end());
+            bcTypes.insert(bcTypes.end(), tmp.begin(), tmp.end());
         }
+        this->writeVarUint(bc1, this->types.size());
+        bc1.insert(bc1.end(), bcTypes.begin(), bcTypes.end());
 
         this->writeString(bc1, "consts");
-        bc1.push_back(numConsts);
+        this->writeVarUint(bc1, numConsts);
 
         bc1.insert(bc1.end(), bc2.begin(), bc2.end());
 
@@ -1173,10 +2538,10 @@ public:
         }
 
         //写入操作数栈最大的大小
-        bc.push_back(sym->opStackSize);
+        this->writeVarUint(bc, sym->opStackSize);
 
         //写入本地变量个数
-        bc.push_back(sym->vars.size());
+        this->writeVarUint(bc, sym->vars.size());
 
         //逐一写入变量
         //TODO：其实具体变量的信息不是必需的。
@@ -1190,7 +2555,7 @@ public:
             bc.push_back(0);
         }
         else{  //自定义函数
-            bc.push_back(sym->byteCode.size());
+            this->writeVarUint(bc, sym->byteCode.size());
             PrintHex(sym->byteCode);
             bc.insert(bc.end(), sym->byteCode.begin(), sym->byteCode.end());
         }
@@ -1222,13 +2587,12 @@ public:
         this->writeString(bc, t->returnType->name);
 
         //写入参数数量
-        bc.push_back(static_cast<uint8_t>(t->paramTypes.size()));
+        this->writeVarUint(bc, t->paramTypes.size());
 
         //写入参数的类型名称
         for (auto pt: t->paramTypes){
             this->writeString(bc, pt->name);
-            auto it = find(this->types.begin(), this->types.end(), pt);
-            if (it == this->types.end()){
+            if (this->CanAddTypes(pt)){
                 this->types.push_back(pt);
             }
         }
@@ -1238,6 +2602,56 @@ public:
 
 
 
+    std::vector<uint8_t> writeUnionType(std::shared_ptr<Type>& type) {
+        std::vector<uint8_t> bc;
+
+        auto t = std::dynamic_pointer_cast<UnionType>(type);
+        bc.push_back(static_cast<uint8_t>(3)); //代表UnionType
+
+        //写入类型名称
+        this->writeString(bc, t->name);
+
+        //写入成员类型的数量
+        this->writeVarUint(bc, t->types.size());
+
+        //写入成员类型的名称
+        for (auto ut: t->types){
+            this->writeString(bc, ut->name);
+        }
+
+        return bc;
+    }
+
+    /**
+     * 以LEB128的变长格式写入无符号整数：每个字节保存7位，从低位开始，最高位为1表示后面还有字节。
+     * 数量、长度等不超过127时只占1个字节
+     */
+    void writeVarUint(std::vector<uint8_t>& bc, uint32_t value){
+        while (value >= 0x80){
+            bc.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        bc.push_back(static_cast<uint8_t>(value));
+    }
+
+    /**
+     * 有符号整数先做zigzag编码（0,-1,1,-2...依次对应0,1,2,3...），绝对值小的负数也只占很少的字节
+     */
+    void writeVarInt(std::vector<uint8_t>& bc, int32_t value){
+        this->writeVarUint(bc, (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31));
+    }
+
+    /**
+     * 按IEEE 754的位模式，以小端顺序写入8个字节
+     */
+    void writeDouble(std::vector<uint8_t>& bc, double value){
+        uint64_t bits = 0;
+        std::memcpy(&bits, &value, sizeof(bits));
+        for (uint32_t i = 0; i < 8; i++){
+            bc.push_back(static_cast<uint8_t>(bits >> (i * 8)));
+        }
+    }
+
     /**
      * 把字符串添加的字节码数组中
      * @param bc
@@ -1245,7 +2659,7 @@ public:
      */
     void writeString(std::vector<uint8_t>& bc, const std::string& str){
         //写入字符串的长度
-        bc.push_back(static_cast<uint8_t>(str.size()));
+        this->writeVarUint(bc, str.size());
         for (auto c : str){
             bc.push_back(static_cast<uint8_t>(c));
         }
@@ -1284,8 +2698,8 @@ public:
             return nullptr;
         }
 
-        auto numTypes = bc[this->index++];
-        for (uint8_t i = 0; i < numTypes; i++){
+        auto numTypes = this->readVarUint(bc);
+        for (uint32_t i = 0; i < numTypes; i++){
             auto typeKind = bc[this->index++];
             switch(typeKind){
                 case 1:
@@ -1310,16 +2724,19 @@ public:
             return nullptr;
         }
 
-        auto numConsts = bc[this->index++];
-        for (uint8_t i = 0; i< numConsts; i++){
+        auto numConsts = this->readVarUint(bc);
+        for (uint32_t i = 0; i< numConsts; i++){
             auto constType = bc[this->index++];
             if (constType == 1){
-                bcModule->consts.push_back(bc[this->index++]);
+                bcModule->consts.push_back(this->readVarInt(bc));
             }
             else if (constType == 2){
                 auto str = this->readString(bc);
                 bcModule->consts.push_back(str);
             }
+            else if (constType == 4){
+                bcModule->consts.push_back(this->readDouble(bc));
+            }
             else if (constType == 3){
                 auto functionSym = this->readFunctionSymbol(bc);
                 bcModule->consts.push_back(functionSym);
@@ -1332,6 +2749,12 @@ public:
             }
         }
 
+        //3.校验字节码。文件里的操作数栈大小不可信，用校验时算出来的值
+        BCVerifier verifier;
+        if (!verifier.verify(*bcModule)) {
+            return nullptr;
+        }
+
         return bcModule;
     }
 
@@ -1352,7 +2775,17 @@ public:
             auto typeName = item.first;
             auto t = this->types[typeName];
 
-            if (t->isSimpleType()){
+            if (t->isUnionType()){
+                auto unionType = std::dynamic_pointer_cast<UnionType>(t);
+                auto utNames = std::any_cast<std::vector<std::string>>(item.second);
+                std::vector<std::shared_ptr<Type>> members;
+                for (const auto& utName: utNames){
+                    members.push_back(this->types[utName]);
+                }
+                //名称由成员生成，与编译器生成的同一个联合类型一致
+                unionType->setTypes(members);
+            }
+            else if (t->isSimpleType()){
                 dbg("Error: BCModuleReader SimpleType not support!");
                 // todo
             }
@@ -1369,10 +2802,6 @@ public:
                     funtionType->paramTypes.push_back(ut);
                 }
             }
-            // not support
-            // else if (t->isUnionType()){
-                // dbg("Error: BCModuleReader UnionType not support!");
-            // }
             else{
                 dbg("Unsupported type in BCModuleReader: " + t->name);
             }
@@ -1381,10 +2810,38 @@ public:
         this->typeInfos.clear();
     }
 
+    //读取writeVarUint()写入的整数
+    uint32_t readVarUint(const std::vector<uint8_t>& bc) {
+        uint32_t value = 0;
+        for (uint32_t shift = 0; shift < 32 && this->index < bc.size(); shift += 7){
+            uint8_t byte = bc[this->index++];
+            value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0){
+                break;
+            }
+        }
+        return value;
+    }
+
+    int32_t readVarInt(const std::vector<uint8_t>& bc) {
+        uint32_t value = this->readVarUint(bc);
+        return static_cast<int32_t>((value >> 1) ^ (0u - (value & 1)));
+    }
+
+    double readDouble(const std::vector<uint8_t>& bc) {
+        uint64_t bits = 0;
+        for (uint32_t i = 0; i < 8; i++){
+            bits |= static_cast<uint64_t>(bc[this->index++]) << (i * 8);
+        }
+        double value = 0;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
     std::string readString(const std::vector<uint8_t>& bc) {
-        uint8_t len = bc[this->index++];
+        uint32_t len = this->readVarUint(bc);
         std::string str = "";
-        for (uint8_t i = 0; i< len; i++){
+        for (uint32_t i = 0; i< len; i++){
             str += static_cast<char>(bc[this->index++]);
         }
         return str;
@@ -1392,9 +2849,9 @@ public:
 
     void readSimpleType(const std::vector<uint8_t>& bc) {
         auto typeName = this->readString(bc);
-        auto numUpperTypes = bc[this->index++];
+        auto numUpperTypes = this->readVarUint(bc);
         std::vector<std::string> upperTypes;
-        for (uint8_t i = 0; i < numUpperTypes; i++){
+        for (uint32_t i = 0; i < numUpperTypes; i++){
             upperTypes.push_back(this->readString(bc));
         }
 
@@ -1406,9 +2863,9 @@ public:
     void readFunctionType(const std::vector<uint8_t>& bc) {
         auto typeName = this->readString(bc);
         auto returnType = this->readString(bc);
-        auto numParams = bc[this->index++];
+        auto numParams = this->readVarUint(bc);
         std::vector<std::string> paramTypes;
-        for (uint8_t i = 0; i< numParams; i++){
+        for (uint32_t i = 0; i< numParams; i++){
             paramTypes.push_back(this->readString(bc));
         }
 
@@ -1419,7 +2876,17 @@ public:
     }
 
     void readUnionType(const std::vector<uint8_t>& bc) {
-        dbg("Error: BCModuleReader::readUnionType not support!");
+        auto typeName = this->readString(bc);
+        auto numTypes = this->readVarUint(bc);
+        std::vector<std::string> unionTypes;
+        for (uint32_t i = 0; i < numTypes; i++){
+            unionTypes.push_back(this->readString(bc));
+        }
+
+        //成员类型在buildTypes的时候再填进去，名称也在那时生成。这里先用文件里的名称来查找
+        std::shared_ptr<Type> t = std::make_shared<UnionType>(std::vector<std::shared_ptr<Type>>{});
+        this->types.insert({typeName, t});
+        this->typeInfos.insert({typeName, unionTypes});
     }
 
     std::shared_ptr<FunctionSymbol> readFunctionSymbol(const std::vector<uint8_t>& bc) {
@@ -1431,19 +2898,19 @@ public:
         auto functionType = this->types[typeName];
 
         //操作数栈的大小
-        auto opStackSize = bc[this->index++];
+        auto opStackSize = this->readVarUint(bc);
 
         //变量个数
-        auto numVars = bc[this->index++];
+        auto numVars = this->readVarUint(bc);
 
         //读取变量
         std::vector<std::shared_ptr<Symbol>> vars;
-        for (uint8_t i = 0; i < numVars; i++){
+        for (uint32_t i = 0; i < numVars; i++){
             vars.push_back(this->readVarSymbol(bc));
         }
 
         //读取函数体的字节码
-        auto numByteCodes = bc[this->index++];
+        auto numByteCodes = this->readVarUint(bc);
         std::vector<uint8_t> byteCodes;
         if (numByteCodes != 0){  //系统函数0
             byteCodes.insert(byteCodes.end(), bc.begin() + this->index, bc.begin() + this->index + numByteCodes);
@@ -0,0 +1,430 @@
+#include "vm.h"
+
+#include <algorithm>
+
+//
+// 栈顶缓存（stack caching）
+// 普通的主循环里，每条指令都通过sp读写内存中的操作数栈，比如iadd要读两个值、再写回一个值。
+// 这里把操作数栈顶部最多两个值放在主循环的局部变量t0、t1里，编译器可以把它们分配到寄存器中：
+//   缓存状态0：操作数栈全部在内存里
+//   缓存状态1：栈顶在t0，其余在内存里
+//   缓存状态2：栈顶在t0，次栈顶在t1，其余在内存里
+// 每条指令在每个缓存状态下都有一份处理代码，都由同一个模板（CachedStep等）生成。
+// 处理代码在编译期就知道执行前后的状态，比如状态2下的iadd就是 t0 = t1 + t0，不读写内存，执行之后是状态1；
+// 分派时直接跳到下一条指令在新状态下的处理代码。
+// 同一条指令可能在不同的状态下到达（比如跳转目标），状态随着分派传递，所以跳转之前不需要统一状态。
+// 函数调用、返回需要实参在内存中连续存放，先把缓存写回内存，再按状态0执行。
+//
+
+namespace {
+
+//最多缓存几个值，也就是状态的个数减1
+constexpr uint32_t MaxCached = 2;
+constexpr uint32_t NumCacheStates = MaxCached + 1;
+
+//在状态state下，执行一条弹出pops个值、压入pushes个值的指令之后的状态
+constexpr uint32_t NextCacheState(uint32_t state, uint32_t pops, uint32_t pushes) {
+    return std::min(state - std::min(state, pops) + pushes, MaxCached);
+}
+
+//在状态state下，依次执行ops之后的状态
+template<OpCode... ops>
+constexpr uint32_t CacheStateAfter(uint32_t state) {
+    ((state = NextCacheState(state, OpCodeInfos[ops].pops, OpCodeInfos[ops].pushes)), ...);
+    return state;
+}
+
+//在状态S下弹出栈顶的值，之后是状态NextCacheState(S, 1, 0)
+template<uint32_t S>
+inline Value CachePop(Value& t0, Value& t1, Value*& sp) {
+    if constexpr (S == 0) {
+        return *--sp;
+    }
+    else if constexpr (S == 1) {
+        return t0;
+    }
+    else {
+        Value v = t0;
+        t0 = t1;
+        return v;
+    }
+}
+
+//在状态S下压入一个值。状态2下缓存已满，先把次栈顶写回内存
+template<uint32_t S>
+inline void CachePush(Value& t0, Value& t1, Value*& sp, const Value& v) {
+    if constexpr (S == 2) {
+        *sp++ = t1;
+    }
+    if constexpr (S >= 1) {
+        t1 = t0;
+    }
+    t0 = v;
+}
+
+//把缓存的值写回内存，之后是状态0
+template<uint32_t S>
+inline void CacheFlush(Value& t0, Value& t1, Value*& sp) {
+    if constexpr (S == 2) {
+        *sp++ = t1;
+    }
+    if constexpr (S >= 1) {
+        *sp++ = t0;
+    }
+}
+
+/**
+ * 在状态S下执行一条只读写操作数栈和本地变量的指令，语义与VM::executeStep()相同。
+ * codeIndex指向已经读过的最后一个字节，操作数从它后面读取。
+ */
+template<OpCode op, uint32_t S>
+inline bool CachedStep(const VM& vm, Value* locals, const uint8_t* code, uint32_t& codeIndex, Value& t0, Value& t1, Value*& sp) {
+    constexpr uint32_t popped = NextCacheState(S, 1, 0);
+    if constexpr (OpCodeInfos[op].pops == 0 && OpCodeInfos[op].pushes == 1) {
+        CachePush<S>(t0, t1, sp, vm.loadValue<op>(locals, code, codeIndex));
+    }
+    else if constexpr (op == OpCode::istore) {
+        uint8_t index = code[++codeIndex];
+        locals[index] = CachePop<S>(t0, t1, sp);
+    }
+    else if constexpr (op >= OpCode::istore_0 && op <= OpCode::istore_3) {
+        locals[op - OpCode::istore_0] = CachePop<S>(t0, t1, sp);
+    }
+    else if constexpr (op == OpCode::pop) {
+        CachePop<S>(t0, t1, sp);
+    }
+    else if constexpr (op == OpCode::iinc) {
+        uint8_t index = code[++codeIndex];
+        int8_t delta = code[++codeIndex];
+        return VM::Increment(locals[index], delta);
+    }
+    else if constexpr (op == OpCode::iinc_w) {
+        uint32_t index = code[codeIndex + 1] << 8 | code[codeIndex + 2];
+        int16_t delta = code[codeIndex + 3] << 8 | code[codeIndex + 4];
+        codeIndex += 4;
+        return VM::Increment(locals[index], delta);
+    }
+    else {
+        static_assert(op >= OpCode::iadd && op <= OpCode::ddiv, "not a cacheable op code");
+        //状态2下两个操作数都在缓存里，结果也留在缓存里，不读写内存
+        Value r = CachePop<S>(t0, t1, sp);
+        Value l = CachePop<popped>(t0, t1, sp);
+        constexpr uint32_t pushed = NextCacheState(popped, 1, 0);
+
+        //快速路径直接写在处理代码里。调用VM::BinaryOp要传操作数的地址，t0、t1就不能放在寄存器里了
+        if constexpr (op == OpCode::iadd || op == OpCode::isub || op == OpCode::imul || op == OpCode::idiv) {
+            if (l.tag == ValueTag::Integer && r.tag == ValueTag::Integer) {
+                CachePush<pushed>(t0, t1, sp, Value(VM::Arithmetic<op>(l.i, r.i)));
+                return true;
+            }
+        }
+        else if constexpr (op == OpCode::dadd || op == OpCode::dsub || op == OpCode::dmul || op == OpCode::ddiv) {
+            if (l.tag == ValueTag::Decimal && r.tag == ValueTag::Decimal) {
+                CachePush<pushed>(t0, t1, sp, Value(VM::Arithmetic<op>(l.d, r.d)));
+                return true;
+            }
+        }
+        Value result;
+        if (!VM::BinaryOp<op>(result, l, r)) {
+            return false;
+        }
+        CachePush<pushed>(t0, t1, sp, result);
+    }
+    return true;
+}
+
+//依次执行超级指令的各条组成指令，每条组成指令执行之后的状态在编译期算出
+template<uint32_t S, OpCode op, OpCode... rest>
+inline bool CachedSteps(const VM& vm, Value* locals, const uint8_t* code, uint32_t& codeIndex, Value& t0, Value& t1, Value*& sp) {
+    if (!CachedStep<op, S>(vm, locals, code, codeIndex, t0, t1, sp)) {
+        return false;
+    }
+    if constexpr (sizeof...(rest) == 0) {
+        return true;
+    }
+    else {
+        return CachedSteps<CacheStateAfter<op>(S), rest...>(vm, locals, code, codeIndex, t0, t1, sp);
+    }
+}
+
+//在状态S下计算条件跳转指令的条件，并弹出操作数
+template<OpCode op, uint32_t S>
+inline bool CachedBranch(Value& t0, Value& t1, Value*& sp, bool& taken) {
+    if constexpr (op >= OpCode::if_icmpeq && op <= OpCode::if_icmple) {
+        Value r = CachePop<S>(t0, t1, sp);
+        Value l = CachePop<NextCacheState(S, 1, 0)>(t0, t1, sp);
+        return VM::CompareCondition<op>(l, r, taken);
+    }
+    else {
+        return VM::TestCondition<op>(CachePop<S>(t0, t1, sp), taken);
+    }
+}
+
+}
+
+//处理代码的标签和分派。每个处理代码的末尾跳到下一条指令在新状态下的处理代码；
+//switch分派时，把状态和操作码合在一起作为switch的值
+#if VM_COMPUTED_GOTO
+#define VM_CACHED_CASE(S, op) L_##op##_##S:
+#define VM_CACHED_DISPATCH(S) goto *dispatchTable[(S) << 8 | opCode]
+#else
+#define VM_CACHED_CASE(S, op) case (S) << 8 | OpCode::op:
+#define VM_CACHED_DISPATCH(S) state = (S); break
+#endif
+
+//对每个缓存状态各生成一份
+#define VM_CACHED_STATES(X, ...) X(0, __VA_ARGS__) X(1, __VA_ARGS__) X(2, __VA_ARGS__)
+
+//只读写操作数栈和本地变量的指令，处理代码由CachedStep生成
+#define VM_CACHED_STEP_OPS(X) \
+    X(iconst_0) X(iconst_1) X(iconst_2) X(iconst_3) X(iconst_4) X(iconst_5) X(dconst_0) X(dconst_1) X(bconst_0) X(bconst_1) \
+    X(bipush) X(sipush) X(ldc) X(ldc_int) X(ldc2_w) X(sldc) X(sldc_ref) \
+    X(iload) X(iload_0) X(iload_1) X(iload_2) X(iload_3) \
+    X(istore) X(istore_0) X(istore_1) X(istore_2) X(istore_3) X(pop) \
+    X(iadd) X(sadd) X(isub) X(imul) X(idiv) X(dadd) X(dsub) X(dmul) X(ddiv) \
+    X(iinc) X(iinc_w)
+
+//条件跳转指令，处理代码由CachedBranch生成
+#define VM_CACHED_BRANCH_OPS(X) \
+    X(ifeq) X(ifne) X(iflt) X(ifge) X(ifgt) X(ifle) \
+    X(if_icmpeq) X(if_icmpne) X(if_icmplt) X(if_icmpge) X(if_icmpgt) X(if_icmple)
+
+//调用、返回和带wide前缀的指令。只有状态0的处理代码，其他状态先写回缓存
+#define VM_CACHED_CALL_OPS(X) \
+    X(ireturn) X(vreturn) X(invokestatic) X(invoke_direct) X(invoketail) X(invokenative) X(wide)
+
+int32_t VM::executeCached(Value* locals) {
+    VMStackFrame* frame = &this->callStack.back();
+
+    //内存中的操作数栈的栈顶，缓存的值不在这里
+    Value* sp = locals + frame->function->numVars;
+
+    //缓存的栈顶和次栈顶，见缓存状态
+    Value t0;
+    Value t1;
+
+    uint8_t* code = frame->function->code;
+    uint32_t codeIndex = 0;
+    uint8_t opCode = code[codeIndex];
+
+    //原生函数表。执行期间不会注册新的函数，所以这个指针一直有效
+    const NativeFunction* natives = NativeFunctions().data();
+
+    //临时变量
+    uint32_t constIndex = 0;
+    bool taken = false;
+
+#if VM_COMPUTED_GOTO
+    //下标是缓存状态<<8 | 操作码。没有处理代码的操作码跳到default。
+    //分派表是静态常量，只在第一次执行时生成一次
+#define VM_CACHED_LABEL(S, op) &&L_##op##_##S,
+#define VM_CACHED_POSITION(S, op) (S) << 8 | OpCode::op,
+#define VM_CACHED_LABELS(op) VM_CACHED_STATES(VM_CACHED_LABEL, op)
+#define VM_CACHED_POSITIONS(op) VM_CACHED_STATES(VM_CACHED_POSITION, op)
+#define VM_CACHED_SUPERINSTRUCTION_LABELS(value, name, ...) VM_CACHED_LABELS(name)
+#define VM_CACHED_SUPERINSTRUCTION_POSITIONS(value, name, ...) VM_CACHED_POSITIONS(name)
+    static void* const labels[] = {
+        VM_CACHED_STEP_OPS(VM_CACHED_LABELS)
+        VM_CACHED_BRANCH_OPS(VM_CACHED_LABELS)
+        VM_CACHED_CALL_OPS(VM_CACHED_LABELS)
+        VM_CACHED_LABELS(igoto)
+        VM_SUPERINSTRUCTIONS(VM_CACHED_SUPERINSTRUCTION_LABELS)
+    };
+    static const uint16_t positions[] = {
+        VM_CACHED_STEP_OPS(VM_CACHED_POSITIONS)
+        VM_CACHED_BRANCH_OPS(VM_CACHED_POSITIONS)
+        VM_CACHED_CALL_OPS(VM_CACHED_POSITIONS)
+        VM_CACHED_POSITIONS(igoto)
+        VM_SUPERINSTRUCTIONS(VM_CACHED_SUPERINSTRUCTION_POSITIONS)
+    };
+#undef VM_CACHED_SUPERINSTRUCTION_POSITIONS
+#undef VM_CACHED_SUPERINSTRUCTION_LABELS
+#undef VM_CACHED_POSITIONS
+#undef VM_CACHED_LABELS
+#undef VM_CACHED_POSITION
+#undef VM_CACHED_LABEL
+    static const DispatchTable<NumCacheStates * 256> table =
+        MakeDispatchTable<NumCacheStates * 256>(&&L_default, labels, positions, sizeof(labels) / sizeof(labels[0]));
+    void* const* dispatchTable = table.labels;
+#else
+    uint32_t state = 0;
+#endif
+
+    while(true){
+#if VM_COMPUTED_GOTO
+        goto *dispatchTable[opCode];
+#else
+        switch (state << 8 | opCode){
+#endif
+
+#define VM_CACHED_STEP_HANDLER(S, op) \
+            VM_CACHED_CASE(S, op) \
+                this->quicken<OpCode::op>(code, codeIndex); \
+                if (!CachedStep<OpCode::op, S>(*this, locals, code, codeIndex, t0, t1, sp)) { \
+                    return -2; \
+                } \
+                opCode = code[++codeIndex]; \
+                VM_CACHED_DISPATCH(CacheStateAfter<OpCode::op>(S));
+#define VM_CACHED_STEP_HANDLERS(op) VM_CACHED_STATES(VM_CACHED_STEP_HANDLER, op)
+            VM_CACHED_STEP_OPS(VM_CACHED_STEP_HANDLERS)
+#undef VM_CACHED_STEP_HANDLERS
+#undef VM_CACHED_STEP_HANDLER
+
+            //条件跳转：条件成立时跳到操作数给出的位置，否则执行下一条指令
+#define VM_CACHED_BRANCH_HANDLER(S, op) \
+            VM_CACHED_CASE(S, op) \
+                if (!CachedBranch<OpCode::op, S>(t0, t1, sp, taken)) { \
+                    return -2; \
+                } \
+                codeIndex = taken ? (code[codeIndex + 1] << 8 | code[codeIndex + 2]) : codeIndex + 3; \
+                opCode = code[codeIndex]; \
+                VM_CACHED_DISPATCH(CacheStateAfter<OpCode::op>(S));
+#define VM_CACHED_BRANCH_HANDLERS(op) VM_CACHED_STATES(VM_CACHED_BRANCH_HANDLER, op)
+            VM_CACHED_BRANCH_OPS(VM_CACHED_BRANCH_HANDLERS)
+#undef VM_CACHED_BRANCH_HANDLERS
+#undef VM_CACHED_BRANCH_HANDLER
+
+            //无条件跳转不改变操作数栈，缓存状态也不变
+#define VM_CACHED_GOTO_HANDLER(S, op) \
+            VM_CACHED_CASE(S, op) \
+                codeIndex = code[codeIndex + 1] << 8 | code[codeIndex + 2]; \
+                opCode = code[codeIndex]; \
+                VM_CACHED_DISPATCH(S);
+            VM_CACHED_STATES(VM_CACHED_GOTO_HANDLER, igoto)
+#undef VM_CACHED_GOTO_HANDLER
+
+            //超级指令，依次执行各条组成指令，中间的状态变化在编译期就确定了
+#define VM_CACHED_SUPERINSTRUCTION_HANDLER(S, name, ...) \
+            VM_CACHED_CASE(S, name) \
+                if (!CachedSteps<S, __VA_ARGS__>(*this, locals, code, codeIndex, t0, t1, sp)) { \
+                    return -2; \
+                } \
+                opCode = code[++codeIndex]; \
+                VM_CACHED_DISPATCH((CacheStateAfter<__VA_ARGS__>(S)));
+#define VM_CACHED_SUPERINSTRUCTION_HANDLERS(value, name, ...) VM_CACHED_STATES(VM_CACHED_SUPERINSTRUCTION_HANDLER, name, __VA_ARGS__)
+            VM_SUPERINSTRUCTIONS(VM_CACHED_SUPERINSTRUCTION_HANDLERS)
+#undef VM_CACHED_SUPERINSTRUCTION_HANDLERS
+#undef VM_CACHED_SUPERINSTRUCTION_HANDLER
+
+            //调用和返回：把缓存写回内存，再重新分派到同一条指令在状态0下的处理代码
+#define VM_CACHED_FLUSH_HANDLER(S, op) \
+            VM_CACHED_CASE(S, op) \
+                CacheFlush<S>(t0, t1, sp); \
+                VM_CACHED_DISPATCH(0);
+#define VM_CACHED_FLUSH_HANDLERS(op) VM_CACHED_FLUSH_HANDLER(1, op) VM_CACHED_FLUSH_HANDLER(2, op)
+            VM_CACHED_CALL_OPS(VM_CACHED_FLUSH_HANDLERS)
+#undef VM_CACHED_FLUSH_HANDLERS
+#undef VM_CACHED_FLUSH_HANDLER
+
+            //以下与VM::execute()中的处理代码相同，操作数栈全部在内存里
+            VM_CACHED_CASE(0, ireturn)
+            VM_CACHED_CASE(0, vreturn)
+            {
+                bool returnsValue = opCode == OpCode::ireturn;
+                Value retValue;
+                if (returnsValue) {
+                    retValue = *--sp;
+                }
+
+                sp = frame->localVars;
+                this->callStack.pop_back();
+                if (this->callStack.empty()) {
+                    return 0;
+                }
+                frame = &this->callStack.back();
+                locals = frame->localVars;
+                code = frame->function->code;
+                codeIndex = frame->returnIndex;
+                opCode = code[codeIndex];
+
+                //调用之前缓存已经写回了内存，返回值直接放到缓存里
+                if (returnsValue) {
+                    t0 = retValue;
+                    VM_CACHED_DISPATCH(1);
+                }
+                VM_CACHED_DISPATCH(0);
+            }
+
+            VM_CACHED_CASE(0, invokestatic)
+                //改写成invoke_direct之后，接着执行下面的处理代码
+                this->quicken<OpCode::invokestatic>(code, codeIndex);
+            VM_CACHED_CASE(0, invoke_direct)
+            {
+                constIndex = code[codeIndex + 1] << 8 | code[codeIndex + 2];
+                const VMFunction& callee = this->functions[constIndex];
+                frame->returnIndex = codeIndex + 3;
+
+                locals = sp - callee.numParams;
+                if (!this->pushFrame(callee, locals)) {
+                    return -2;
+                }
+                frame = &this->callStack.back();
+                sp = locals + callee.numVars;
+
+                code = callee.code;
+                codeIndex = 0;
+                opCode = code[codeIndex];
+                VM_CACHED_DISPATCH(0);
+            }
+
+            VM_CACHED_CASE(0, invokenative)
+            {
+                const NativeFunction& native = natives[code[++codeIndex]];
+                Value* args = sp - native.numParams;
+                if (!native.call(args, *args)) {
+                    dbg("Error: invokenative " + native.name + " argument type mismatch");
+                    return -2;
+                }
+                sp = native.returnsValue ? args + 1 : args;
+                opCode = code[++codeIndex];
+                VM_CACHED_DISPATCH(0);
+            }
+
+            VM_CACHED_CASE(0, invoketail)
+            {
+                constIndex = code[codeIndex + 1] << 8 | code[codeIndex + 2];
+                const VMFunction& callee = this->functions[constIndex];
+
+                std::copy(sp - callee.numParams, sp, locals);
+                this->callStack.pop_back();
+                if (!this->pushFrame(callee, locals)) {
+                    return -2;
+                }
+                frame = &this->callStack.back();
+                sp = locals + callee.numVars;
+
+                code = callee.code;
+                codeIndex = 0;
+                opCode = code[codeIndex];
+                VM_CACHED_DISPATCH(0);
+            }
+
+            //带wide前缀的指令很少见，直接用VM::executeWide()在内存中的操作数栈上执行
+            VM_CACHED_CASE(0, wide)
+                if (!this->executeWide(locals, sp, code, codeIndex)) {
+                    return -2;
+                }
+                opCode = code[codeIndex];
+                VM_CACHED_DISPATCH(0);
+
+#if VM_COMPUTED_GOTO
+        L_default:
+#else
+            default:
+#endif
+            dbg("Unknown or Unsupported op code: "+ toString(static_cast<OpCode>(opCode)));
+            return -2;
+#if !VM_COMPUTED_GOTO
+        }
+#endif
+    }
+
+    return 0;
+}
+
+#undef VM_CACHED_CALL_OPS
+#undef VM_CACHED_BRANCH_OPS
+#undef VM_CACHED_STEP_OPS
+#undef VM_CACHED_STATES
+#undef VM_CACHED_DISPATCH
+#undef VM_CACHED_CASE